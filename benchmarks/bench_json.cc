@@ -0,0 +1,238 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief Throughput benchmark for Json::Load and Json::Dump.
+ *
+ * Usage: bench-json [min seconds per measurement] [corpus name filter]
+ *
+ * For each generated corpus, the document is dumped in text and UBJSON mode, then
+ * loaded back, validated and projected.  Text is also loaded into a tape.  Reported
+ * numbers are MB/s of the serialized size and heap allocations per document.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "nih/Json.h"
+#include "nih/JsonIO.h"
+#include "nih/JsonPointer.h"
+#include "nih/JsonTape.h"
+
+namespace {
+std::atomic<uint64_t> n_allocs{0};
+}  // anonymous namespace
+
+// Count every allocation, including the ones made inside libnih.
+void* operator new(std::size_t size) {
+  n_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace nih {
+namespace {
+std::string RandomString(std::mt19937* rng, size_t min_len, size_t max_len,
+                         std::string const& alphabet) {
+  std::uniform_int_distribution<size_t> len_dist{min_len, max_len};
+  std::uniform_int_distribution<size_t> char_dist{0, alphabet.size() - 1};
+  std::string str(len_dist(*rng), '\0');
+  for (auto& c : str) {
+    c = alphabet[char_dist(*rng)];
+  }
+  return str;
+}
+
+Json MakeDeep(std::mt19937* rng) {
+  size_t constexpr kDocs = 256, kDepth = 256;
+  std::vector<Json> docs;
+  for (size_t i = 0; i < kDocs; ++i) {
+    Json node{Integer{static_cast<Integer::Int>((*rng)())}};
+    for (size_t d = 0; d < kDepth; ++d) {
+      if (d % 2 == 0) {
+        Json obj{Object{}};
+        obj["depth"] = Integer{static_cast<Integer::Int>(d)};
+        obj["child"] = std::move(node);
+        node = std::move(obj);
+      } else {
+        node = Array{std::vector<Json>{std::move(node), Json{Boolean{true}}}};
+      }
+    }
+    docs.emplace_back(std::move(node));
+  }
+  return Json{Array{std::move(docs)}};
+}
+
+Json MakeWide(std::mt19937* rng) {
+  size_t constexpr kKeys = 100000;
+  Json obj{Object{}};
+  for (size_t i = 0; i < kKeys; ++i) {
+    auto key = "feature_" + std::to_string(i);
+    if (i % 3 == 0) {
+      obj[key] = String{RandomString(rng, 4, 12, "abcdefghijklmnopqrstuvwxyz")};
+    } else if (i % 3 == 1) {
+      obj[key] = Integer{static_cast<Integer::Int>((*rng)() % 100000)};
+    } else {
+      obj[key] = Null{};
+    }
+  }
+  return obj;
+}
+
+Json MakeNumeric(std::mt19937* rng) {
+  size_t constexpr kValues = 500000;
+  std::normal_distribution<float> dist{0.0f, 100.0f};
+  std::vector<Json> values;
+  values.reserve(kValues);
+  for (size_t i = 0; i < kValues; ++i) {
+    if (i % 4 == 0) {
+      values.emplace_back(Integer{static_cast<Integer::Int>((*rng)())});
+    } else {
+      values.emplace_back(Number{dist(*rng)});
+    }
+  }
+  return Json{Array{std::move(values)}};
+}
+
+Json MakeStrings(std::mt19937* rng) {
+  size_t constexpr kStrings = 100000;
+  std::vector<Json> values;
+  for (size_t i = 0; i < kStrings; ++i) {
+    values.emplace_back(String{RandomString(
+        rng, 8, 64, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 _-.")});
+  }
+  return Json{Array{std::move(values)}};
+}
+
+Json MakeEscapes(std::mt19937* rng) {
+  size_t constexpr kStrings = 100000;
+  std::vector<Json> values;
+  for (size_t i = 0; i < kStrings; ++i) {
+    values.emplace_back(String{RandomString(rng, 8, 64, "ab\"\\\n\t\r/")});
+  }
+  return Json{Array{std::move(values)}};
+}
+
+Json MakeTyped(std::mt19937* rng) {
+  size_t constexpr kValues = 1 << 20;
+  std::normal_distribution<float> dist{0.0f, 1.0f};
+  F32Array f32{kValues};
+  for (auto& v : f32.GetArray()) {
+    v = dist(*rng);
+  }
+  I32Array i32{kValues};
+  for (auto& v : i32.GetArray()) {
+    v = static_cast<int32_t>((*rng)());
+  }
+  I64Array i64{kValues};
+  for (auto& v : i64.GetArray()) {
+    v = static_cast<int64_t>((*rng)()) << 16;
+  }
+  U8Array u8{kValues};
+  for (auto& v : u8.GetArray()) {
+    v = static_cast<uint8_t>((*rng)());
+  }
+  Json obj{Object{}};
+  obj["f32"] = std::move(f32);
+  obj["i32"] = std::move(i32);
+  obj["i64"] = std::move(i64);
+  obj["u8"] = std::move(u8);
+  return obj;
+}
+
+struct Measurement {
+  double seconds;
+  uint64_t n_allocs;
+  size_t n_iters;
+};
+
+// Run `fn` repeatedly for at least `min_seconds`.
+Measurement Measure(double min_seconds, std::function<void()> const& fn) {
+  using Clock = std::chrono::steady_clock;
+  fn();  // warm up
+  Measurement m{0.0, 0, 0};
+  auto beg = Clock::now();
+  auto allocs = n_allocs.load();
+  do {
+    fn();
+    ++m.n_iters;
+    m.seconds = std::chrono::duration<double>(Clock::now() - beg).count();
+  } while (m.seconds < min_seconds);
+  m.n_allocs = n_allocs.load() - allocs;
+  return m;
+}
+
+void Report(std::string const& corpus, char const* mode, char const* op, size_t n_bytes,
+            Measurement const& m) {
+  double mb = static_cast<double>(n_bytes) * m.n_iters / (1024.0 * 1024.0);
+  std::printf("%-10s %-6s %-8s %12zu %12.1f %14.1f\n", corpus.c_str(), mode, op, n_bytes,
+              mb / m.seconds, static_cast<double>(m.n_allocs) / m.n_iters);
+}
+}  // anonymous namespace
+}  // namespace nih
+
+int main(int argc, char** argv) {
+  using namespace nih;  // NOLINT
+  double min_seconds = argc > 1 ? std::atof(argv[1]) : 1.0;
+  std::string filter = argc > 2 ? argv[2] : "";
+
+  std::mt19937 rng{2023};
+  std::vector<std::pair<std::string, std::function<Json(std::mt19937*)>>> generators{
+      {"deep", MakeDeep},       {"wide", MakeWide},       {"numeric", MakeNumeric},
+      {"strings", MakeStrings}, {"escapes", MakeEscapes}, {"typed", MakeTyped}};
+
+  std::printf("%-10s %-6s %-8s %12s %12s %14s\n", "corpus", "mode", "op", "bytes", "MB/s",
+              "allocs/doc");
+  for (auto const& gen : generators) {
+    if (gen.first.find(filter) == std::string::npos) {
+      continue;
+    }
+    auto doc = gen.second(&rng);
+    for (auto mode : {std::ios::in, std::ios::binary}) {
+      char const* mode_name = mode == std::ios::binary ? "ubjson" : "text";
+      std::vector<char> buffer;
+      auto dump = Measure(min_seconds, [&] { Json::Dump(doc, &buffer, mode); });
+      Report(gen.first, mode_name, "dump", buffer.size(), dump);
+
+      ConstStringRef str{buffer.data(), buffer.size()};
+      auto load = Measure(min_seconds, [&] { Json::Load(str, mode); });
+      Report(gen.first, mode_name, "load", buffer.size(), load);
+      auto validate = Measure(min_seconds, [&] {
+        if (!Json::Validate(str, mode)) {
+          std::abort();
+        }
+      });
+      Report(gen.first, mode_name, "validate", buffer.size(), validate);
+      // Extract a single value, the rest of the document is skipped.
+      JsonProjection projection{std::vector<std::string>{"/1"}};
+      auto project = Measure(min_seconds, [&] { projection.Extract(str, mode); });
+      Report(gen.first, mode_name, "project", buffer.size(), project);
+      // Convert to the other format without a Json tree.
+      auto to = mode == std::ios::binary ? std::ios::out : std::ios::binary;
+      std::vector<char> converted;
+      auto transcode = Measure(min_seconds, [&] {
+        converted.clear();
+        Transcode(str, mode, &converted, to);
+      });
+      Report(gen.first, mode_name, "transcod", buffer.size(), transcode);
+      if (mode != std::ios::binary) {
+        auto tape = Measure(min_seconds, [&] { JsonTape::Load(str); });
+        Report(gen.first, mode_name, "tape", buffer.size(), tape);
+      }
+    }
+  }
+  return 0;
+}
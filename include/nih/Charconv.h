@@ -9,8 +9,12 @@
 #define NIH_CHARCONV_H_
 
 #include <nih/Intrinsics.h>
+#include <nih/Span.h>
 
+#include <algorithm>
+#include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <iterator>
 #include <limits>
 #include <system_error>
@@ -27,10 +31,410 @@ struct from_chars_result {  // NOLINT
   std::errc ec;
 };
 
+struct from_chars_batch_result {  // NOLINT
+  /*! \brief Past the last parsed value, or the input if there's none. */
+  const char *ptr;
+  /*! \brief Number of parsed values. */
+  std::size_t n;
+};
+
 namespace detail {
 int32_t ToCharsFloatImpl(float f, char *const result);
 to_chars_result ToCharsUnsignedImpl(char *first, char *last, uint64_t const value);
 from_chars_result FromCharFloatImpl(const char *buffer, const int len, float *result);
+int32_t ToCharsDoubleImpl(double f, char *const result);
+from_chars_result FromCharDoubleImpl(const char *buffer, const int len, double *result);
+
+struct UnsignedFloatBase2;
+
+struct IEEE754 {
+  static constexpr uint32_t kFloatMantissaBits = 23;
+  static constexpr uint32_t kFloatBias = 127;
+  static constexpr uint32_t kFloatExponentBits = 8;
+
+  static void Decode(float f, UnsignedFloatBase2 *uf, bool *signbit);
+  static float Encode(UnsignedFloatBase2 const &uf, bool signbit);
+  static float Infinity(bool sign);
+
+  static constexpr uint32_t EncodeBits(uint32_t mantissa, uint32_t exponent,
+                                       bool signbit) {
+    return (((static_cast<uint32_t>(signbit) << kFloatExponentBits) | exponent)
+            << kFloatMantissaBits) |
+           mantissa;
+  }
+  static constexpr uint32_t InfinityBits(bool sign) {
+    return (static_cast<uint32_t>(sign) << (kFloatExponentBits + kFloatMantissaBits)) |
+           (0xffu << kFloatMantissaBits);
+  }
+};
+
+struct RyuPowLogUtils {
+  // This table is generated by PrintFloatLookupTable from ryu.  We adopted only the float
+  // 32 table instead of double full table.
+  // f2s_full_table.h
+  uint32_t constexpr static kFloatPow5InvBitcount = 59;
+  static constexpr uint64_t kFloatPow5InvSplit[55] = {
+      576460752303423489u, 461168601842738791u, 368934881474191033u,
+      295147905179352826u, 472236648286964522u, 377789318629571618u,
+      302231454903657294u, 483570327845851670u, 386856262276681336u,
+      309485009821345069u, 495176015714152110u, 396140812571321688u,
+      316912650057057351u, 507060240091291761u, 405648192073033409u,
+      324518553658426727u, 519229685853482763u, 415383748682786211u,
+      332306998946228969u, 531691198313966350u, 425352958651173080u,
+      340282366920938464u, 544451787073501542u, 435561429658801234u,
+      348449143727040987u, 557518629963265579u, 446014903970612463u,
+      356811923176489971u, 570899077082383953u, 456719261665907162u,
+      365375409332725730u, 292300327466180584u, 467680523945888934u,
+      374144419156711148u, 299315535325368918u, 478904856520590269u,
+      383123885216472215u, 306499108173177772u, 490398573077084435u,
+      392318858461667548u, 313855086769334039u, 502168138830934462u,
+      401734511064747569u, 321387608851798056u, 514220174162876889u,
+      411376139330301511u, 329100911464241209u, 526561458342785934u,
+      421249166674228747u, 336999333339382998u, 539198933343012796u,
+      431359146674410237u, 345087317339528190u, 552139707743245103u,
+      441711766194596083u};
+
+  uint32_t constexpr static kFloatPow5Bitcount = 61;
+  static constexpr uint64_t kFloatPow5Split[47] = {
+      1152921504606846976u, 1441151880758558720u, 1801439850948198400u,
+      2251799813685248000u, 1407374883553280000u, 1759218604441600000u,
+      2199023255552000000u, 1374389534720000000u, 1717986918400000000u,
+      2147483648000000000u, 1342177280000000000u, 1677721600000000000u,
+      2097152000000000000u, 1310720000000000000u, 1638400000000000000u,
+      2048000000000000000u, 1280000000000000000u, 1600000000000000000u,
+      2000000000000000000u, 1250000000000000000u, 1562500000000000000u,
+      1953125000000000000u, 1220703125000000000u, 1525878906250000000u,
+      1907348632812500000u, 1192092895507812500u, 1490116119384765625u,
+      1862645149230957031u, 1164153218269348144u, 1455191522836685180u,
+      1818989403545856475u, 2273736754432320594u, 1421085471520200371u,
+      1776356839400250464u, 2220446049250313080u, 1387778780781445675u,
+      1734723475976807094u, 2168404344971008868u, 1355252715606880542u,
+      1694065894508600678u, 2117582368135750847u, 1323488980084844279u,
+      1654361225106055349u, 2067951531382569187u, 1292469707114105741u,
+      1615587133892632177u, 2019483917365790221u};
+
+  static constexpr uint32_t Pow5Factor(uint32_t value) noexcept(true) {
+    uint32_t count = 0;
+    for (;;) {
+      const uint32_t q = value / 5;
+      const uint32_t r = value % 5;
+      if (r != 0) {
+        break;
+      }
+      value = q;
+      ++count;
+    }
+    return count;
+  }
+
+  // Returns true if value is divisible by 5^p.
+  static constexpr bool MultipleOfPowerOf5(const uint32_t value,
+                                           const uint32_t p) noexcept(true) {
+    return Pow5Factor(value) >= p;
+  }
+
+  // Returns true if value is divisible by 2^p.
+  static constexpr bool MultipleOfPowerOf2(const uint32_t value,
+                                           const uint32_t p) noexcept(true) {
+#if defined(__GNUC__)
+    return static_cast<uint32_t>(__builtin_ctz(value)) >= p;
+#else
+    return (value & ((1u << p) - 1)) == 0;
+#endif  // defined(__GNUC__)
+  }
+
+  // Returns e == 0 ? 1 : ceil(log_2(5^e)).
+  static constexpr uint32_t Pow5Bits(const int32_t e) noexcept(true) {
+    return static_cast<uint32_t>(((e * 163391164108059ull) >> 46) + 1);
+  }
+
+  static constexpr int32_t Log2Pow5(const int32_t e) {
+    // This approximation works up to the point that the multiplication
+    // overflows at e = 3529. If the multiplication were done in 64 bits, it
+    // would fail at 5^4004 which is just greater than 2^9297.
+    assert(e >= 0);
+    assert(e <= 3528);
+    return static_cast<int32_t>(((static_cast<uint32_t>(e)) * 1217359) >> 19);
+  }
+
+  static constexpr int32_t CeilLog2Pow5(const int32_t e) {
+    return RyuPowLogUtils::Log2Pow5(e) + 1;
+  }
+
+  /*
+   * \brief Multiply 32-bit and 64-bit -> 128 bit, then access the higher bits.
+   */
+  static constexpr uint32_t MulShift(const uint32_t x, const uint64_t y,
+                           const int32_t shift) noexcept(true) {
+    // For 32-bit * 64-bit: x * y, it can be decomposed into:
+    //
+    //   x * (y_high + y_low) = (x * y_high) + (x * y_low)
+    //
+    // For more general case 64-bit * 64-bit, see https://stackoverflow.com/a/1541458
+    const uint32_t y_low = static_cast<uint32_t>(y);
+    const uint32_t y_high = static_cast<uint32_t>(y >> 32);
+
+    const uint64_t low = static_cast<uint64_t>(x) * y_low;
+    const uint64_t high = static_cast<uint64_t>(x) * y_high;
+
+    const uint64_t sum = (low >> 32) + high;
+    const uint64_t shifted_sum = sum >> (shift - 32);
+
+    return static_cast<uint32_t>(shifted_sum);
+  }
+
+  /*
+   * \brief floor(5^q/2*k) and shift by j
+   */
+  static constexpr uint32_t MulPow5InvDivPow2(const uint32_t m, const uint32_t q,
+                                    const int32_t j) noexcept(true) {
+    return MulShift(m, kFloatPow5InvSplit[q], j);
+  }
+
+  /*
+   * \brief floor(2^k/5^q) + 1 and shift by j
+   */
+  static constexpr uint32_t MulPow5divPow2(const uint32_t m, const uint32_t i,
+                                 const int32_t j) noexcept(true) {
+    // clang-tidy makes false assumption that can lead to i >= 47, which is impossible.
+    // Can be verified by enumerating all float32 values.
+    return MulShift(m, kFloatPow5Split[i], j);  // NOLINT
+  }
+
+  static constexpr uint32_t FloorLog2(const uint32_t value) {
+#if defined(__GNUC__)
+    return 31 - __builtin_clz(value);
+#else
+    uint32_t index = 0;
+    for (uint32_t v = value; v > 1; v >>= 1) {
+      ++index;
+    }
+    return index;
+#endif
+  }
+
+  /*
+   * \brief floor(e * log_10(2)).
+   */
+  static constexpr uint32_t Log10Pow2(const int32_t e) noexcept(true) {
+    // The first value this approximation fails for is 2^1651 which is just
+    // greater than 10^297.
+    assert(e >= 0);
+    assert(e <= 1 << 15);
+    return static_cast<uint32_t>((static_cast<uint64_t>(e) * 169464822037455ull) >> 49);
+  }
+
+  // Returns floor(e * log_10(5)).
+  static constexpr uint32_t Log10Pow5(const int32_t expoent) noexcept(true) {
+    // The first value this approximation fails for is 5^2621 which is just
+    // greater than 10^1832.
+    assert(expoent >= 0);
+    assert(expoent <= 1 << 15);
+    return static_cast<uint32_t>(
+        ((static_cast<uint64_t>(expoent)) * 196742565691928ull) >> 48);
+  }
+};
+
+/**
+ * \brief Parse a float from decimal digits, the result is the IEEE754 bits.  Unlike
+ *        FromCharFloatImpl, this can be used in constant expressions.
+ */
+constexpr from_chars_result FromCharFloatBits(const char *buffer, const int len,
+                                              uint32_t *result) {
+  if (len == 0) {
+    return {buffer, std::errc::invalid_argument};
+  }
+  int32_t m10digits = 0;
+  int32_t e10digits = 0;
+  int32_t dot_ind = len;
+  int32_t e_ind = len;
+  uint32_t mantissa_b10 = 0;
+  int32_t exp_b10 = 0;
+  bool signed_mantissa = false;
+  bool signed_exp = false;
+  int32_t i = 0;
+  if (buffer[i] == '-') {
+    signed_mantissa = true;
+    i++;
+  }
+  for (; i < len; i++) {
+    char c = buffer[i];
+    if (c == '.') {
+      if (dot_ind != len) {
+        return {buffer + i, std::errc::invalid_argument};
+      }
+      dot_ind = i;
+      continue;
+    }
+    if ((c < '0') || (c > '9')) {
+      break;
+    }
+    if (m10digits >= 9) {
+      return {buffer + i, std::errc::result_out_of_range};
+    }
+    mantissa_b10 = 10 * mantissa_b10 + (c - '0');
+    if (mantissa_b10 != 0) {
+      m10digits++;
+    }
+  }
+
+  if (i < len && ((buffer[i] == 'e') || (buffer[i] == 'E'))) {
+    e_ind = i;
+    i++;
+    if (i < len && ((buffer[i] == '-') || (buffer[i] == '+'))) {
+      signed_exp = buffer[i] == '-';
+      i++;
+    }
+    for (; i < len; i++) {
+      char c = buffer[i];
+      if ((c < '0') || (c > '9')) {
+        return {buffer + i, std::errc::invalid_argument};
+      }
+      if (e10digits > 3) {
+        return {buffer + i, std::errc::result_out_of_range};
+      }
+      exp_b10 = 10 * exp_b10 + (c - '0');
+      if (exp_b10 != 0) {
+        e10digits++;
+      }
+    }
+  }
+  if (i < len) {
+    return {buffer + i, std::errc::invalid_argument};
+  }
+  if (signed_exp) {
+    exp_b10 = -exp_b10;
+  }
+  exp_b10 -= dot_ind < e_ind ? e_ind - dot_ind - 1 : 0;
+  if (mantissa_b10 == 0) {
+    *result = static_cast<uint32_t>(signed_mantissa) << 31;
+    return {};
+  }
+
+  if ((m10digits + exp_b10 <= -46) || (mantissa_b10 == 0)) {
+    // Number is less than 1e-46, which should be rounded down to 0; return
+    // +/-0.0.
+    uint32_t ieee =
+        (static_cast<uint32_t>(signed_mantissa))
+        << (IEEE754::kFloatExponentBits + IEEE754::kFloatMantissaBits);
+    *result = ieee;
+    return {};
+  }
+  if (m10digits + exp_b10 >= 40) {
+    // Number is larger than 1e+39, which should be rounded to +/-Infinity.
+    *result = IEEE754::InfinityBits(signed_mantissa);
+    return {};
+  }
+
+  // Convert to binary float m2 * 2^e2, while retaining information about
+  // whether the conversion was exact (trailingZeros).
+  int32_t exp_b2 = 0;
+  uint32_t mantissa_b2 = 0;
+  bool trailing_zeros = false;
+  if (exp_b10 >= 0) {
+    // The length of m * 10^e in bits is:
+    //   log2(m10 * 10^e10) = log2(m10) + e10 log2(10) = log2(m10) + e10 + e10 *
+    //   log2(5)
+    //
+    // We want to compute the IEEE754::kFloatMantissaBits + 1 top-most bits (+1 for the
+    // implicit leading one in IEEE format). We therefore choose a binary output
+    // exponent of
+    //   log2(m10 * 10^e10) - (IEEE754::kFloatMantissaBits + 1).
+    //
+    // We use floor(log2(5^e10)) so that we get at least this many bits; better
+    // to have an additional bit than to not have enough bits.
+    exp_b2 = RyuPowLogUtils::FloorLog2(mantissa_b10) + exp_b10 +
+             RyuPowLogUtils::Log2Pow5(exp_b10) -
+             (IEEE754::kFloatMantissaBits + 1);
+
+    // We now compute [m10 * 10^e10 / 2^e2] = [m10 * 5^e10 / 2^(e2-e10)].
+    // To that end, we use the RyuPowLogUtils::kFloatPow5Bitcount table.
+    int j = exp_b2 - exp_b10 - RyuPowLogUtils::CeilLog2Pow5(exp_b10) +
+            RyuPowLogUtils::kFloatPow5Bitcount;
+    assert(j >= 0);
+    mantissa_b2 = RyuPowLogUtils::MulPow5divPow2(mantissa_b10, exp_b10, j);
+
+    // We also compute if the result is exact, i.e.,
+    //   [m10 * 10^e10 / 2^e2] == m10 * 10^e10 / 2^e2.
+    // This can only be the case if 2^e2 divides m10 * 10^e10, which in turn
+    // requires that the largest power of 2 that divides m10 + e10 is greater
+    // than e2. If e2 is less than e10, then the result must be exact. Otherwise
+    // we use the existing multipleOfPowerOf2 function.
+    trailing_zeros =
+        exp_b2 < exp_b10 ||
+        (exp_b2 - exp_b10 < 32 &&
+         RyuPowLogUtils::MultipleOfPowerOf2(mantissa_b10, exp_b2 - exp_b10));
+  } else {
+    exp_b2 = RyuPowLogUtils::FloorLog2(mantissa_b10) + exp_b10 -
+             RyuPowLogUtils::CeilLog2Pow5(-exp_b10) -
+             (IEEE754::kFloatMantissaBits + 1);
+
+    // We now compute [m10 * 10^e10 / 2^e2] = [m10 / (5^(-e10) 2^(e2-e10))].
+    int j = exp_b2 - exp_b10 + RyuPowLogUtils::CeilLog2Pow5(-exp_b10) - 1 +
+            RyuPowLogUtils::kFloatPow5InvBitcount;
+    mantissa_b2 = RyuPowLogUtils::MulPow5InvDivPow2(mantissa_b10, -exp_b10, j);
+
+    // We also compute if the result is exact, i.e.,
+    //   [m10 / (5^(-e10) 2^(e2-e10))] == m10 / (5^(-e10) 2^(e2-e10))
+    //
+    // If e2-e10 >= 0, we need to check whether (5^(-e10) 2^(e2-e10)) divides
+    // m10, which is the case iff pow5(m10) >= -e10 AND pow2(m10) >= e2-e10.
+    //
+    // If e2-e10 < 0, we have actually computed [m10 * 2^(e10 e2) / 5^(-e10)]
+    // above, and we need to check whether 5^(-e10) divides (m10 * 2^(e10-e2)),
+    // which is the case iff pow5(m10 * 2^(e10-e2)) = pow5(m10) >= -e10.
+    trailing_zeros =
+        (exp_b2 < exp_b10 ||
+         (exp_b2 - exp_b10 < 32 && RyuPowLogUtils::MultipleOfPowerOf2(
+                                       mantissa_b10, exp_b2 - exp_b10))) &&
+        RyuPowLogUtils::MultipleOfPowerOf5(mantissa_b10, -exp_b10);
+  }
+
+  // Compute the final IEEE exponent.
+  uint32_t f_e2 =
+      std::max(static_cast<int32_t>(0),
+               static_cast<int32_t>(exp_b2 + IEEE754::kFloatBias +
+                                    RyuPowLogUtils::FloorLog2(mantissa_b2)));
+
+  if (f_e2 > 0xfe) {
+    // Final IEEE exponent is larger than the maximum representable; return
+    // +/-Infinity.
+    *result = IEEE754::InfinityBits(signed_mantissa);
+    return {};
+  }
+
+  // We need to figure out how much we need to shift m2. The tricky part is that
+  // we need to take the final IEEE exponent into account, so we need to reverse
+  // the bias and also special-case the value 0.
+  int32_t shift = (f_e2 == 0 ? 1 : f_e2) - exp_b2 - IEEE754::kFloatBias -
+                  IEEE754::kFloatMantissaBits;
+  assert(shift >= 0);
+
+  // We need to round up if the exact value is more than 0.5 above the value we
+  // computed. That's equivalent to checking if the last removed bit was 1 and
+  // either the value was not just trailing zeros or the result would otherwise
+  // be odd.
+  //
+  // We need to update trailingZeros given that we have the exact output
+  // exponent ieee_e2 now.
+  trailing_zeros &= (mantissa_b2 & ((1u << (shift - 1)) - 1)) == 0;
+  uint32_t lastRemovedBit = (mantissa_b2 >> (shift - 1)) & 1;
+  bool roundup = (lastRemovedBit != 0) &&
+                 (!trailing_zeros || (((mantissa_b2 >> shift) & 1) != 0));
+
+  uint32_t f_m2 = (mantissa_b2 >> shift) + roundup;
+  assert(f_m2 <= (1u << (IEEE754::kFloatMantissaBits + 1)));
+  f_m2 &= (1u << IEEE754::kFloatMantissaBits) - 1;
+  if (f_m2 == 0 && roundup) {
+    // Rounding up may overflow the mantissa.
+    // In this case we move a trailing zero of the mantissa into the exponent.
+    // Due to how the IEEE represents +/-Infinity, we don't need to check for
+    // overflow here.
+    f_e2++;
+  }
+  *result = IEEE754::EncodeBits(f_m2, f_e2, signed_mantissa);
+  return {};
+}
 }  // namespace detail
 
 template <typename T>
@@ -46,6 +450,12 @@ struct NumericLimits<float> {
   static constexpr size_t kToCharsSize = 16;
 };
 
+template <>
+struct NumericLimits<double> {
+  // sign + 17 digits + decimal point + `E` + sign + len(str(324)) + '\0'
+  static constexpr size_t kToCharsSize = 25;
+};
+
 template <>
 struct NumericLimits<int64_t> {
   // From llvm libcxx: numeric_limits::digits10 returns value less on 1 than desired for
@@ -56,6 +466,17 @@ struct NumericLimits<int64_t> {
       3;  // +1 for minus, +1 for digits10, +1 for '\0' just to be safe.
 };
 
+template <>
+struct NumericLimits<int32_t> {
+  // minus + len(str(2^31)) + '\0'
+  static constexpr size_t kToCharsSize = 12;
+};
+
+template <>
+struct NumericLimits<uint8_t> {
+  static constexpr size_t kToCharsSize = 4;
+};
+
 inline to_chars_result to_chars(char *first, char *last, float value) {  // NOLINT
   if (NIH_UNLIKELY(
           !(static_cast<size_t>(last - first) >= NumericLimits<float>::kToCharsSize))) {
@@ -74,6 +495,15 @@ inline to_chars_result to_chars(char *first, char *last, float value) {  // NOLI
   return ret;
 }
 
+inline to_chars_result to_chars(char *first, char *last, double value) {  // NOLINT
+  if (NIH_UNLIKELY(
+          !(static_cast<size_t>(last - first) >= NumericLimits<double>::kToCharsSize))) {
+    return {first, std::errc::value_too_large};
+  }
+  auto index = detail::ToCharsDoubleImpl(value, first);
+  return {first + index, std::errc()};
+}
+
 inline to_chars_result to_chars(char *first, char *last, int64_t value) {  // NOLINT
   if (NIH_UNLIKELY(first == last)) {
     return {first, std::errc::value_too_large};
@@ -92,12 +522,68 @@ inline to_chars_result to_chars(char *first, char *last, int64_t value) {  // NO
   return detail::ToCharsUnsignedImpl(first, last, unsigned_value);
 }
 
+/**
+ * \brief Write a sequence of values separated by `delimiter`, there's no delimiter after
+ *        the last value.  A buffer of `values.size() * (kToCharsSize + 1)` bytes, with
+ *        kToCharsSize from NumericLimits of the element type, is always large enough.
+ *
+ * \return `ptr` is past the last written byte.  With `std::errc::value_too_large`, it's
+ *         past the last value that fits.
+ */
+to_chars_result to_chars(char *first, char *last, Span<float const> values,  // NOLINT
+                         char delimiter = ',');
+to_chars_result to_chars(char *first, char *last, Span<int64_t const> values,  // NOLINT
+                         char delimiter = ',');
+to_chars_result to_chars(char *first, char *last, Span<int32_t const> values,  // NOLINT
+                         char delimiter = ',');
+to_chars_result to_chars(char *first, char *last, Span<uint8_t const> values,  // NOLINT
+                         char delimiter = ',');
+
 inline from_chars_result from_chars(const char *buffer, const char *end,  // NOLINT
                                     float &value) {                       // NOLINT
   from_chars_result res =
       detail::FromCharFloatImpl(buffer, std::distance(buffer, end), &value);
   return res;
 }
+
+/**
+ * \brief Parse a double with at most 17 significant digits, trailing zeros are not
+ *        counted.  Longer mantissas return `std::errc::result_out_of_range`.
+ */
+inline from_chars_result from_chars(const char *buffer, const char *end,  // NOLINT
+                                    double &value) {                      // NOLINT
+  return detail::FromCharDoubleImpl(buffer, std::distance(buffer, end), &value);
+}
+
+/**
+ * \brief Parse a sequence of numbers separated by `delimiter` into `values`.  Whitespace
+ *        is allowed around the delimiter, a whitespace delimiter matches any run of
+ *        whitespace.  Parsing stops when `values` is full, or before the first delimiter
+ *        that isn't followed by a number of the element type.  Out of range integers and
+ *        numbers with a fraction or an exponent don't match integer types.  Floats accept
+ *        integers, NaN, Infinity and -Infinity as well.
+ *
+ * \code
+ *   std::vector<float> values(3);
+ *   auto ret = from_chars(str.data(), str.data() + str.size(), Span<float>{values});
+ * \endcode
+ */
+from_chars_batch_result from_chars(const char *first, const char *last,  // NOLINT
+                                   Span<float> values, char delimiter = ',');
+from_chars_batch_result from_chars(const char *first, const char *last,  // NOLINT
+                                   Span<int64_t> values, char delimiter = ',');
+from_chars_batch_result from_chars(const char *first, const char *last,  // NOLINT
+                                   Span<int32_t> values, char delimiter = ',');
+
+namespace detail {
+/**
+ * \brief The float version of batch from_chars.  With `fractions_only`, it stops at
+ *        integers too, for readers that keep integers and floats apart.
+ */
+from_chars_batch_result FromCharsFloatBatch(const char *first, const char *last,
+                                            Span<float> values, char delimiter,
+                                            bool fractions_only);
+}  // namespace detail
 }  // namespace nih
 
 #endif  // NIH_CHARCONV_H_
@@ -0,0 +1,69 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief A small LZ77 family block codec and a block-compressed container around
+ *        serialized Json documents.
+ *
+ * Container layout, all integers are big-endian:
+ *
+ *   "NIHZ" | version (u8) | format (u8) | reserved (u16) | block size (u32)
+ *   | number of blocks (u32) | raw size (u64) | compressed block sizes (u32 each)
+ *   | blocks
+ *
+ * The format byte is 'U' for UBJSON and 'J' for text.  Every block except the last
+ * one decodes to exactly `block size` bytes so that blocks can be decompressed
+ * independently into their final position.  Blocks that don't compress are stored
+ * as is, marked by the highest bit of their size.
+ */
+#ifndef NIH_COMPRESS_H_
+#define NIH_COMPRESS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <vector>
+
+#include "Json.h"
+#include "StringRef.h"
+
+namespace nih {
+/*!
+ * \brief Upper bound of compressed size for an input of `n` bytes.
+ */
+size_t LZCompressBound(size_t n);
+/*!
+ * \brief Compress `n` bytes from `src` into `dst`, which must hold at least
+ *        `LZCompressBound(n)` bytes.
+ *
+ * \return Number of bytes written to `dst`.
+ */
+size_t LZCompress(char const* src, size_t n, char* dst);
+/*!
+ * \brief Decompress `n` bytes from `src` into `dst`.  `n_out` is the exact size of the
+ *        decoded data, corrupted input is reported as an error.
+ */
+void LZDecompress(char const* src, size_t n, char* dst, size_t n_out);
+
+static size_t constexpr kCompressBlockSize = 1 << 20;
+
+/*!
+ * \brief Serialize `json` with `mode` and wrap it in the block-compressed container.
+ *
+ * \param n_threads Number of threads used for compression, 0 for all available cores.
+ */
+void DumpCompressed(Json json, std::vector<char>* out,
+                    std::ios::openmode mode = std::ios::binary,
+                    size_t block_size = kCompressBlockSize, int32_t n_threads = 0);
+/*!
+ * \brief Load a document produced by `DumpCompressed`.  Blocks are decompressed in
+ *        parallel before parsing.  `order` is used for UBJSON documents.
+ */
+Json LoadCompressed(ConstStringRef str, int32_t n_threads = 0,
+                    UBJByteOrder order = UBJByteOrder::kBigEndian);
+/*!
+ * \brief Whether `str` starts with the container magic.
+ */
+bool IsCompressed(ConstStringRef str);
+}  // namespace nih
+
+#endif  // NIH_COMPRESS_H_
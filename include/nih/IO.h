@@ -14,11 +14,20 @@
  */
 #pragma once
 
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // defined(__unix__)
+
 #include <cstring>
 #include <fstream>
 #include <string>
+#include <utility>
 
 #include "Logging.h"
+#include "StringRef.h"
 
 namespace nih {
 inline std::string loadSequentialFile(std::string uri) {
@@ -48,4 +57,81 @@ inline std::string loadSequentialFile(std::string uri) {
 
   return buffer;
 }
+
+/**
+ * \brief Read-only memory mapping of a file.  On platforms without mmap the file is
+ *        read into memory instead.
+ */
+class MappedFile {
+  char const* ptr_{nullptr};
+  size_t size_{0};
+  std::string buffer_;  // fallback storage
+
+ public:
+  enum class Advice { kNormal, kSequential, kRandom };
+
+  explicit MappedFile(std::string const& path, Advice advice = Advice::kNormal) {
+#if defined(__unix__)
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      LOG(FATAL) << "Opening " << path << " failed: " << strerror(errno);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      LOG(FATAL) << "Failed to stat " << path << ": " << strerror(errno);
+    }
+    size_ = st.st_size;
+    if (size_ != 0) {
+      auto ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr == MAP_FAILED) {
+        close(fd);
+        LOG(FATAL) << "Failed to map " << path << ": " << strerror(errno);
+      }
+      ptr_ = static_cast<char const*>(ptr);
+      // The hints are best effort, failures are ignored.
+      switch (advice) {
+        case Advice::kSequential:
+          madvise(ptr, size_, MADV_SEQUENTIAL);
+          madvise(ptr, size_, MADV_WILLNEED);
+          break;
+        case Advice::kRandom:
+          madvise(ptr, size_, MADV_RANDOM);
+          break;
+        case Advice::kNormal:
+          break;
+      }
+    }
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+#else
+    buffer_ = loadSequentialFile(path);
+    buffer_.pop_back();  // remove the null terminator
+    ptr_ = buffer_.data();
+    size_ = buffer_.size();
+#endif  // defined(__unix__)
+  }
+  MappedFile(MappedFile const& that) = delete;
+  MappedFile& operator=(MappedFile const& that) = delete;
+  MappedFile(MappedFile&& that) noexcept
+      : ptr_{std::exchange(that.ptr_, nullptr)},
+        size_{std::exchange(that.size_, 0)},
+        buffer_{std::move(that.buffer_)} {
+    if (!buffer_.empty()) {
+      ptr_ = buffer_.data();
+    }
+  }
+
+  ~MappedFile() {
+#if defined(__unix__)
+    if (ptr_) {
+      munmap(const_cast<char*>(ptr_), size_);
+    }
+#endif  // defined(__unix__)
+  }
+
+  char const* data() const { return ptr_; }  // NOLINT
+  size_t size() const { return size_; }      // NOLINT
+  ConstStringRef Ref() const { return ConstStringRef{ptr_ ? ptr_ : "", size_}; }
+};
 }  // namespace nih
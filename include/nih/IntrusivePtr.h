@@ -6,34 +6,153 @@
 #define NIH_INTRUSIVE_PTR_H_
 
 #include <atomic>
+#include <cassert>
 #include <cinttypes>
 #include <functional>
 #include <ostream>
 
 namespace nih {
 /*!
- * \brief Helper class for embedding reference counting into client objects.  See
+ * \brief Thread safe reference counting policy.  See
  *        https://www.boost.org/doc/libs/1_74_0/doc/html/atomic/usage_examples.html for
  *        discussions of memory order.
  */
-class IntrusivePtrCell {
- private:
-  std::atomic<int32_t> _count;
-  template <typename T> friend class IntrusivePtr;
+class AtomicRefCount {
+  std::atomic<int32_t> _count{0};
 
-  std::int32_t IncRef() noexcept {
-    return _count.fetch_add(1, std::memory_order_relaxed);
+ public:
+  void IncRef() noexcept { _count.fetch_add(1, std::memory_order_relaxed); }
+  /*! \brief Returns true when the last reference is dropped. */
+  bool DecRef() noexcept {
+    if (_count.fetch_sub(1, std::memory_order_release) == 1) {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return true;
+    }
+    return false;
   }
-  std::int32_t DecRef() noexcept {
-    return _count.fetch_sub(1, std::memory_order_release);
+  [[nodiscard]] int32_t Count() const noexcept {
+    return _count.load(std::memory_order_relaxed);
   }
+};
+
+/*!
+ * \brief Reference counting policy without any synchronization, for objects that are
+ *        never shared between threads.
+ */
+class PlainRefCount {
+  int32_t _count{0};
+
+ public:
+  void IncRef() noexcept { ++_count; }
+  bool DecRef() noexcept { return --_count == 0; }
+  [[nodiscard]] int32_t Count() const noexcept { return _count; }
+};
+
+/*!
+ * \brief Reference counting policy that is atomic by default, with an opt-in thread
+ *        local mode for objects built by a single thread.
+ *
+ *   Objects created while a `LocalScope` is alive on the creating thread are counted
+ *   with plain loads and stores, which avoids the locked read-modify-write instructions.
+ *   `Share` switches such an object to atomic counting and must be called before the
+ *   object is made visible to other threads, the usual synchronization used for
+ *   publishing the object then makes the flag visible as well.  Debug builds assert that
+ *   an object that is not shared is only counted by the thread that created it.
+ */
+class DeferredRefCount {
+  static inline thread_local int32_t _n_local_scopes{0};
+
+  std::atomic<int32_t> _count{0};
+  bool _shared{_n_local_scopes == 0};
+  // Creating thread of an object that is not shared, recorded in all builds so that the
+  // layout doesn't depend on NDEBUG.  It fits in the padding after `_shared`.
+  uint16_t _owner{_shared ? uint16_t{0} : ThreadTag()};
+
+  // Small non-zero id of the calling thread, ids are reused after 65535 threads.
+  static uint16_t ThreadTag() noexcept {
+    static std::atomic<uint32_t> n_threads{0};
+    static thread_local uint16_t tag{0};
+    if (tag == 0) {
+      tag = static_cast<uint16_t>(n_threads.fetch_add(1, std::memory_order_relaxed) %
+                                  UINT16_MAX) +
+            1;
+    }
+    return tag;
+  }
+  void CheckOwner() const noexcept {
+    assert(_owner == ThreadTag() &&
+           "Object counted by another thread before `Share` is called.");
+  }
+
+ public:
+  /*!
+   * \brief RAII guard, objects created on this thread during its lifetime start with
+   *        thread local counting.  Guards can be nested.
+   */
+  class LocalScope {
+   public:
+    LocalScope() noexcept { ++_n_local_scopes; }
+    ~LocalScope() { --_n_local_scopes; }
+    LocalScope(LocalScope const &that) = delete;
+    LocalScope &operator=(LocalScope const &that) = delete;
+  };
+
+  void IncRef() noexcept {
+    if (_shared) {
+      _count.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      CheckOwner();
+      _count.store(_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+  }
+  bool DecRef() noexcept {
+    if (_shared) {
+      if (_count.fetch_sub(1, std::memory_order_release) == 1) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+      }
+      return false;
+    }
+    CheckOwner();
+    auto n = _count.load(std::memory_order_relaxed) - 1;
+    _count.store(n, std::memory_order_relaxed);
+    return n == 0;
+  }
+  [[nodiscard]] int32_t Count() const noexcept {
+    return _count.load(std::memory_order_relaxed);
+  }
+
+  void Share() noexcept { _shared = true; }
+  [[nodiscard]] bool IsShared() const noexcept { return _shared; }
+};
+
+/*!
+ * \brief Helper class for embedding reference counting into client objects.
+ *
+ * \tparam Policy One of `AtomicRefCount`, `PlainRefCount` and `DeferredRefCount`.
+ */
+template <typename Policy>
+class IntrusivePtrCellImpl {
+ private:
+  Policy _count;
+  template <typename T> friend class IntrusivePtr;
+
+  void IncRef() noexcept { _count.IncRef(); }
+  bool DecRef() noexcept { return _count.DecRef(); }
   [[nodiscard]] bool IsZero() const { return Count() == 0; }
 
  public:
-  IntrusivePtrCell() noexcept : _count{0} {}
-  [[nodiscard]] int32_t Count() const { return _count.load(std::memory_order_relaxed); }
+  IntrusivePtrCellImpl() noexcept = default;
+  [[nodiscard]] int32_t Count() const { return _count.Count(); }
+
+  /*! \brief Switch to thread safe counting, only available for `DeferredRefCount`. */
+  void Share() noexcept { _count.Share(); }
+  [[nodiscard]] bool IsShared() const noexcept { return _count.IsShared(); }
 };
 
+/*! \brief Thread safe reference counter. */
+class IntrusivePtrCell : public IntrusivePtrCellImpl<AtomicRefCount> {};
+
 /*!
  * \brief User defined function for returing embedded reference count.
  */
@@ -43,7 +162,7 @@ template <typename T> IntrusivePtrCell &IntrusivePtrRefCount(T const *ptr) noexc
  * \brief Implementation of Intrusive Pointer.  A smart pointer that points to an object
  *        with an embedded reference counter. The underlying object must implement a
  *        friend function IntrusivePtrRefCount() that returns the ref counter (of type
- *        IntrusivePtrCell). The intrusive pointer is faster than std::shared_ptr<>:
+ *        IntrusivePtrCell, or IntrusivePtrCellImpl with another counting policy). The intrusive pointer is faster than std::shared_ptr<>:
  *        std::shared_ptr<> makes an extra memory allocation for the ref counter whereas
  *        the intrusive pointer does not.
  *
@@ -78,8 +197,7 @@ template <typename T> class IntrusivePtr {
   }
   void DecRef(T *ptr) {
     if (ptr) {
-      if (IntrusivePtrRefCount(ptr).DecRef() == 1) {
-        std::atomic_thread_fence(std::memory_order_acquire);
+      if (IntrusivePtrRefCount(ptr).DecRef()) {
         delete ptr;
       }
     }
@@ -4,14 +4,19 @@
 #ifndef XGBOOST_JSON_H_
 #define XGBOOST_JSON_H_
 
+#include <nih/Intrinsics.h>
 #include <nih/IntrusivePtr.h>
 #include <nih/Logging.h>
 #include <nih/StringRef.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -21,10 +26,33 @@ class Json;
 class JsonReader;
 class JsonWriter;
 
+namespace detail {
+/*! \brief Lazily computed structural hash of a container node. */
+class HashCache {
+  // 0 is reserved for not computed.
+  mutable std::atomic<uint64_t> hash_{0};
+
+ public:
+  template <typename Fn>
+  uint64_t Get(Fn&& fn) const {
+    auto h = hash_.load(std::memory_order_relaxed);
+    if (h == 0) {
+      h = fn();
+      h = h == 0 ? 1 : h;
+      hash_.store(h, std::memory_order_relaxed);
+    }
+    return h;
+  }
+  void Invalidate() { hash_.store(0, std::memory_order_relaxed); }
+};
+}  // namespace detail
+
 class Value {
  private:
-  mutable class IntrusivePtrCell ref_;
-  friend IntrusivePtrCell& IntrusivePtrRefCount(Value const* t) noexcept {
+  // Counted atomically unless created in a `Json::LocalScope`, see `Json::Share`.
+  mutable IntrusivePtrCellImpl<DeferredRefCount> ref_;
+  friend IntrusivePtrCellImpl<DeferredRefCount>& IntrusivePtrRefCount(
+      Value const* t) noexcept {
     return t->ref_;
   }
 
@@ -50,17 +78,29 @@ class Value {
   ValueKind Type() const { return kind_; }
   virtual ~Value() = default;
 
-  virtual void Save(JsonWriter* writer) const = 0;
+  /*! \brief Dispatch to the `Visit` overload of the writer for this value. */
+  void Save(JsonWriter* writer) const;
 
   virtual Json& operator[](std::string const& key);
   virtual Json& operator[](int ind);
 
-  virtual bool operator==(Value const& rhs) const = 0;
+  bool operator==(Value const& rhs) const;
+  /**
+   * \brief Structural hash of this value, consistent with `operator==`.
+   *
+   *   Hashes of arrays, objects and typed arrays are cached on the node.  The cache is
+   *   invalidated by the non-const accessors of the node itself, but not of its
+   *   ancestors, so the hash is only valid for a document that is no longer modified
+   *   once it's hashed.  This includes `std::hash<Json>`, keys of hash containers must
+   *   not be modified.
+   */
+  uint64_t Hash() const;
 #if !defined(__APPLE__)
   virtual Value& operator=(Value const& rhs) = delete;
 #endif  // !defined(__APPLE__)
 
-  std::string TypeStr() const;
+  std::string TypeStr() const { return TypeStr(kind_); }
+  static std::string TypeStr(ValueKind kind);
 
  private:
   ValueKind kind_;
@@ -71,14 +111,15 @@ bool IsA(Value const* value) {
   return T::IsClassOf(value);
 }
 
+/**
+ * \brief Checked downcast.  The kind is verified by `IsA`, so no RTTI is needed.
+ */
 template <typename T, typename U>
 T* Cast(U* value) {
-  if (IsA<T>(value)) {
-    return dynamic_cast<T*>(value);
-  } else {
+  if (NIH_UNLIKELY(!IsA<T>(value))) {
     LOG(FATAL) << "Invalid cast, from " + value->TypeStr() + " to " + T().TypeStr();
   }
-  return dynamic_cast<T*>(value);  // suppress compiler warning.
+  return static_cast<T*>(value);
 }
 
 class JsonString : public Value {
@@ -98,14 +139,19 @@ class JsonString : public Value {
     std::swap(str.str_, this->str_);
   }
 
-  void Save(JsonWriter* writer) const override;
-
   std::string const& GetString() && { return str_; }
   std::string const& GetString() const& { return str_; }
-  std::string& GetString() & { return str_; }
+  std::string& GetString() & {
+    return str_;
+  }
+
+  bool operator==(Value const& rhs) const;
 
-  bool operator==(Value const& rhs) const override;
+ protected:
+  friend class Value;
+  uint64_t ComputeHash() const;
 
+ public:
   static bool IsClassOf(Value const* value) {
     return value->Type() == ValueKind::kString;
   }
@@ -113,6 +159,7 @@ class JsonString : public Value {
 
 class JsonArray : public Value {
   std::vector<Json> vec_;
+  detail::HashCache hash_;
 
  public:
   JsonArray() : Value(ValueKind::kArray) {}
@@ -125,18 +172,27 @@ class JsonArray : public Value {
   JsonArray(JsonArray const& that) = delete;
   JsonArray(JsonArray&& that) noexcept;
 
-  void Save(JsonWriter* writer) const override;
-
-  Json& operator[](int ind) override { return vec_.at(ind); }
+  Json& operator[](int ind) override {
+    hash_.Invalidate();
+    return vec_.at(ind);
+  }
   // silent the partial oveeridden warning
   Json& operator[](std::string const& key) override { return Value::operator[](key); }
 
   std::vector<Json> const& GetArray() && { return vec_; }
   std::vector<Json> const& GetArray() const& { return vec_; }
-  std::vector<Json>& GetArray() & { return vec_; }
+  std::vector<Json>& GetArray() & {
+    hash_.Invalidate();
+    return vec_;
+  }
 
-  bool operator==(Value const& rhs) const override;
+  bool operator==(Value const& rhs) const;
 
+ protected:
+  friend class Value;
+  uint64_t ComputeHash() const;
+
+ public:
   static bool IsClassOf(Value const* value) {
     return value->Type() == ValueKind::kArray;
   }
@@ -151,6 +207,7 @@ class JsonArray : public Value {
 template <typename T, Value::ValueKind kind>
 class JsonTypedArray : public Value {
   std::vector<T> vec_;
+  detail::HashCache hash_;
 
  public:
   using Type = T;
@@ -158,18 +215,29 @@ class JsonTypedArray : public Value {
   JsonTypedArray() : Value(kind) {}
   explicit JsonTypedArray(size_t n) : Value(kind) { vec_.resize(n); }
   JsonTypedArray(JsonTypedArray&& that) noexcept
-      : Value{kind}, vec_{std::move(that.vec_)} {}
+      : Value{kind}, vec_{std::move(that.vec_)} {
+    that.hash_.Invalidate();
+  }
 
-  bool operator==(Value const& rhs) const override;
+  bool operator==(Value const& rhs) const;
 
-  void Set(size_t i, T v) { vec_[i] = v; }
-  size_t Size() const { return vec_.size(); }
+ protected:
+  friend class Value;
+  uint64_t ComputeHash() const;
 
-  void Save(JsonWriter* writer) const override;
+ public:
+  void Set(size_t i, T v) {
+    hash_.Invalidate();
+    vec_[i] = v;
+  }
+  size_t Size() const { return vec_.size(); }
 
   std::vector<T> const& GetArray() && { return vec_; }
   std::vector<T> const& GetArray() const& { return vec_; }
-  std::vector<T>& GetArray() & { return vec_; }
+  std::vector<T>& GetArray() & {
+    hash_.Invalidate();
+    return vec_;
+  }
 
   static bool IsClassOf(Value const* value) { return value->Type() == kind; }
 };
@@ -197,6 +265,7 @@ class JsonObject : public Value {
 
  private:
   Map object_;
+  detail::HashCache hash_;
 
  public:
   JsonObject() : Value(ValueKind::kObject) {}
@@ -204,30 +273,70 @@ class JsonObject : public Value {
   JsonObject(JsonObject const& that) = delete;
   JsonObject(JsonObject&& that) noexcept;
 
-  void Save(JsonWriter* writer) const override;
-
   // silent the partial oveeridden warning
   Json& operator[](int ind) override { return Value::operator[](ind); }
-  Json& operator[](std::string const& key) override { return object_[key]; }
+  Json& operator[](std::string const& key) override {
+    hash_.Invalidate();
+    return object_[key];
+  }
 
   Map const& GetObject() && { return object_; }
   Map const& GetObject() const& { return object_; }
-  Map& GetObject() & { return object_; }
+  Map& GetObject() & {
+    hash_.Invalidate();
+    return object_;
+  }
+
+  bool operator==(Value const& rhs) const;
 
-  bool operator==(Value const& rhs) const override;
+ protected:
+  friend class Value;
+  uint64_t ComputeHash() const;
 
+ public:
   static bool IsClassOf(Value const* value) {
     return value->Type() == ValueKind::kObject;
   }
   ~JsonObject() override = default;
 };
 
+/**
+ * \brief A JSON number, stored as float.
+ *
+ *   Every number node reserves kMaxRawSize bytes, shared between the text of a parsed
+ *   number and the value of a number set from a double.  This makes a number node 32
+ *   bytes larger than the float alone on 64-bit platforms, including for numbers that
+ *   use neither.  Prefer typed arrays for large numeric arrays, their elements don't
+ *   have a node each.
+ */
 class JsonNumber : public Value {
  public:
   using Float = float;
+  /*! \brief Longest number text kept by the parser for lazy conversion. */
+  static std::size_t constexpr kMaxRawSize = 24;
 
  private:
-  Float number_{0};
+  enum State : uint8_t { kReady = 0, kRaw = 1, kConverting = 2 };
+
+  mutable Float number_{0};
+  // Numbers from the text parser keep their raw text.  The text is converted on first
+  // access and written back verbatim until the number is modified.
+  mutable std::atomic<uint8_t> state_{kReady};
+  uint8_t raw_size_{0};
+  // Whether the number is set from a double, which is kept in `double_`.
+  bool is_double_{false};
+  union {
+    char raw_[kMaxRawSize];
+    double double_;
+  };
+
+  void Materialize() const;
+  Float const& Number() const {
+    if (state_.load(std::memory_order_acquire) != kReady) {
+      this->Materialize();
+    }
+    return number_;
+  }
 
  public:
   JsonNumber() : Value(ValueKind::kNumber) {}
@@ -236,23 +345,72 @@ class JsonNumber : public Value {
   JsonNumber(FloatT value) : Value(ValueKind::kNumber) {  // NOLINT
     number_ = value;
   }
+  /**
+   * \brief Keeps the full precision, GetNumber returns the value rounded to float.  The
+   *        number compares equal to other doubles in full precision, and to floats,
+   *        including numbers parsed from text, only when it's exactly a float.
+   */
   template <typename FloatT, typename std::enable_if<
                                  std::is_same<FloatT, double>::value>::type* = nullptr>
   JsonNumber(FloatT value)
       : Value{ValueKind::kNumber},  // NOLINT
-        number_{static_cast<Float>(value)} {}
+        number_{static_cast<Float>(value)},
+        is_double_{true},
+        double_{value} {}
+  /**
+   * \brief Construct from the text of a valid JSON number without converting it.  The
+   *        text must be shorter than kMaxRawSize.
+   */
+  explicit JsonNumber(ConstStringRef raw);
   JsonNumber(JsonNumber const& that) = delete;
   JsonNumber(JsonNumber&& that) noexcept
-      : Value{ValueKind::kNumber}, number_{that.number_} {}
+      : Value{ValueKind::kNumber},
+        number_{that.number_},
+        state_{that.state_.load(std::memory_order_acquire)},
+        raw_size_{that.raw_size_},
+        is_double_{that.is_double_} {
+    if (is_double_) {
+      double_ = that.double_;
+    } else {
+      std::copy_n(that.raw_, raw_size_, raw_);
+    }
+  }
 
-  void Save(JsonWriter* writer) const override;
+  Float const& GetNumber() && { return Number(); }
+  Float const& GetNumber() const& { return Number(); }
+  /**
+   * \brief Mutable access, which is lossy even when the number isn't modified: the raw
+   *        text and the double are dropped, the number is then written and compared as
+   *        the float.  Use the const accessors to read the number.
+   */
+  Float& GetNumber() & {
+    Number();
+    raw_size_ = 0;
+    is_double_ = false;
+    return number_;
+  }
+  /**
+   * \brief The number in double precision.  Numbers parsed from text are converted from
+   *        their raw text, numbers set from a float are widened.
+   */
+  double GetDouble() const;
+  /*! \brief Whether the number is set from a double, see the double constructor. */
+  bool IsDouble() const { return is_double_; }
+  /*! \brief Whether GetNumber is exact, false for doubles that need more precision. */
+  bool IsExactFloat() const {
+    return !is_double_ || static_cast<double>(number_) == double_ || double_ != double_;
+  }
+  /*! \brief Whether the number retains the text it was parsed from. */
+  bool HasRaw() const { return raw_size_ != 0; }
+  ConstStringRef GetRaw() const { return ConstStringRef{raw_, raw_size_}; }
 
-  Float const& GetNumber() && { return number_; }
-  Float const& GetNumber() const& { return number_; }
-  Float& GetNumber() & { return number_; }
+  bool operator==(Value const& rhs) const;
 
-  bool operator==(Value const& rhs) const override;
+ protected:
+  friend class Value;
+  uint64_t ComputeHash() const;
 
+ public:
   static bool IsClassOf(Value const* value) {
     return value->Type() == ValueKind::kNumber;
   }
@@ -290,13 +448,19 @@ class JsonInteger : public Value {
   JsonInteger(JsonInteger&& that) noexcept
       : Value{ValueKind::kInteger}, integer_{that.integer_} {}
 
-  bool operator==(Value const& rhs) const override;
+  bool operator==(Value const& rhs) const;
 
   Int const& GetInteger() && { return integer_; }
   Int const& GetInteger() const& { return integer_; }
-  Int& GetInteger() & { return integer_; }
-  void Save(JsonWriter* writer) const override;
+  Int& GetInteger() & {
+    return integer_;
+  }
+
+ protected:
+  friend class Value;
+  uint64_t ComputeHash() const;
 
+ public:
   static bool IsClassOf(Value const* value) {
     return value->Type() == ValueKind::kInteger;
   }
@@ -308,13 +472,15 @@ class JsonNull : public Value {
   JsonNull(std::nullptr_t) : Value(ValueKind::kNull) {}  // NOLINT
   JsonNull(JsonNull&&) noexcept : Value(ValueKind::kNull) {}
 
-  void Save(JsonWriter* writer) const override;
-
-  bool operator==(Value const& rhs) const override;
+  bool operator==(Value const& rhs) const;
 
   static bool IsClassOf(Value const* value) {
     return value->Type() == ValueKind::kNull;
   }
+
+ protected:
+  friend class Value;
+  uint64_t ComputeHash() const;
 };
 
 /*! \brief Describes both true and false. */
@@ -336,24 +502,39 @@ class JsonBoolean : public Value {
         Value(ValueKind::kBoolean),
         boolean_{value.boolean_} {}
 
-  void Save(JsonWriter* writer) const override;
-
   bool const& GetBoolean() && { return boolean_; }
   bool const& GetBoolean() const& { return boolean_; }
-  bool& GetBoolean() & { return boolean_; }
+  bool& GetBoolean() & {
+    return boolean_;
+  }
+
+  bool operator==(Value const& rhs) const;
 
-  bool operator==(Value const& rhs) const override;
+ protected:
+  friend class Value;
+  uint64_t ComputeHash() const;
 
+ public:
   static bool IsClassOf(Value const* value) {
     return value->Type() == ValueKind::kBoolean;
   }
 };
 
+/**
+ * \brief Byte order of numbers in UBJSON input.
+ *
+ *   UBJSON is big endian.  Files written by earlier versions of UBJWriter store numbers
+ *   in the byte order of the writing machine, they can be read with `kLegacyHost` on a
+ *   machine with the same byte order and converted by dumping them again.
+ */
+enum class UBJByteOrder : uint8_t { kBigEndian, kLegacyHost };
+
 /*!
  * \brief Data structure representing JSON format.
  *
- * Limitation:  UTF-8 is not properly supported.  Code points above ASCII are
- *              invalid.
+ * Strings are stored as UTF-8.  The text reader decodes `\uXXXX` escapes and rejects
+ * invalid UTF-8, the text writer rejects invalid UTF-8 and escapes non-ASCII characters
+ * by default.
  *
  * Examples:
  *
@@ -370,11 +551,30 @@ class Json {
  public:
   /**
    *  \brief Decode the JSON object.  Optional parameter mode for choosing between text
-   *         and binary (ubjson) input.
+   *         and binary (ubjson) input, `order` is only used for binary input.
    */
-  static Json Load(ConstStringRef str, std::ios::openmode mode = std::ios::in);
+  static Json Load(ConstStringRef str, std::ios::openmode mode = std::ios::in,
+                   UBJByteOrder order = UBJByteOrder::kBigEndian);
   /*! \brief Pass your own JsonReader. */
   static Json Load(JsonReader* reader);
+  /**
+   *  \brief Decode the JSON object stored in a file.  The file is memory mapped and
+   *         parsed in place without being copied into a buffer first.  Files written
+   *         by `DumpCompressed` are detected and decompressed, `mode` is ignored for them.
+   *         `order` is used for binary input, including compressed UBJSON.
+   */
+  static Json LoadFile(std::string const& path, std::ios::openmode mode = std::ios::in,
+                       UBJByteOrder order = UBJByteOrder::kBigEndian);
+  /**
+   *  \brief Check whether `str` is a well-formed document without building the tree.
+   *         Text is validated against RFC 8259, including UTF-8 and escape rules, with
+   *         `NaN` and `Infinity` accepted as extensions.  Binary input is validated
+   *         against the UBJSON subset supported by the reader.
+   *
+   *  \param error Optional, receives the reason and the byte offset of the failure.
+   */
+  static bool Validate(ConstStringRef str, std::ios::openmode mode = std::ios::in,
+                       std::string* error = nullptr);
   /**
    *  \brief Encode the JSON object.  Optional parameter mode for choosing between text
    *         and binary (ubjson) output.
@@ -465,7 +665,36 @@ class Json {
   Value const& GetValue() && { return *ptr_; }
   Value& GetValue() & { return *ptr_; }
 
-  bool operator==(Json const& rhs) const { return *ptr_ == *(rhs.ptr_); }
+  /**
+   * \brief Structural equality.  Shared nodes are resolved without visiting the tree.
+   *        Cached hashes are not used since they can be stale, see `Value::Hash`.
+   */
+  bool operator==(Json const& rhs) const {
+    if (ptr_ == rhs.ptr_) {
+      return true;
+    }
+    return *ptr_ == *(rhs.ptr_);
+  }
+  /*! \brief Structural hash, see `Value::Hash`. */
+  uint64_t Hash() const { return ptr_->Hash(); }
+
+  /**
+   * \brief Opt-in guard for documents owned by one thread.
+   *
+   *   Nodes created on this thread while the guard is alive are counted with plain loads
+   *   and stores, so that building, copying and destroying the document doesn't pay for
+   *   atomic instructions.  Such a document must be `Share`d before it's handed to other
+   *   threads.  Nodes created outside of any guard are always thread safe.
+   */
+  using LocalScope = DeferredRefCount::LocalScope;
+  /**
+   * \brief Make reference counting of the whole document thread safe.  Only needed for
+   *        documents with nodes created in a `LocalScope`.  Such nodes inserted afterward
+   *        are not covered until the next call.
+   */
+  void Share() const;
+  /*! \brief Whether the root node is counted atomically. */
+  bool IsShared() const { return IntrusivePtrRefCount(ptr_.get()).IsShared(); }
 
   friend std::ostream& operator<<(std::ostream& os, Json const& j) {
     std::string str;
@@ -495,6 +724,78 @@ bool IsA(Json const& j) {
   return IsA<T>(&v);
 }
 
+/**
+ * \brief Helper for building a visitor from lambdas.
+ *
+ * \code
+ *   auto n = visit(json, overloaded{[](Array const& arr) { return arr.GetArray().size(); },
+ *                                   [](auto const&) { return size_t{1}; }});
+ * \endcode
+ */
+template <typename... Fn>
+struct overloaded : Fn... {  // NOLINT
+  using Fn::operator()...;
+};
+template <typename... Fn>
+overloaded(Fn...) -> overloaded<Fn...>;
+
+namespace detail {
+template <typename V, typename T>
+using ConstLike = std::conditional_t<std::is_const<V>::value, T const, T>;
+
+template <typename V, typename Fn>
+decltype(auto) VisitImpl(V& value, Fn&& fn) {
+  using Kind = Value::ValueKind;
+  switch (value.Type()) {
+    case Kind::kString:
+      return fn(static_cast<ConstLike<V, JsonString>&>(value));
+    case Kind::kNumber:
+      return fn(static_cast<ConstLike<V, JsonNumber>&>(value));
+    case Kind::kInteger:
+      return fn(static_cast<ConstLike<V, JsonInteger>&>(value));
+    case Kind::kObject:
+      return fn(static_cast<ConstLike<V, JsonObject>&>(value));
+    case Kind::kArray:
+      return fn(static_cast<ConstLike<V, JsonArray>&>(value));
+    case Kind::kBoolean:
+      return fn(static_cast<ConstLike<V, JsonBoolean>&>(value));
+    case Kind::kNumberArray:
+      return fn(static_cast<ConstLike<V, F32Array>&>(value));
+    case Kind::kU8Array:
+      return fn(static_cast<ConstLike<V, U8Array>&>(value));
+    case Kind::kI32Array:
+      return fn(static_cast<ConstLike<V, I32Array>&>(value));
+    case Kind::kI64Array:
+      return fn(static_cast<ConstLike<V, I64Array>&>(value));
+    case Kind::kNull:
+      break;
+  }
+  return fn(static_cast<ConstLike<V, JsonNull>&>(value));
+}
+}  // namespace detail
+
+/**
+ * \brief Call `fn` with the value cast to its concrete type.  Dispatch is a switch on
+ *        the value kind, there's no virtual call or RTTI involved.  `fn` must accept all
+ *        value types and return the same type for each of them.
+ */
+template <typename Fn>
+decltype(auto) visit(Value const& value, Fn&& fn) {  // NOLINT
+  return detail::VisitImpl(value, std::forward<Fn>(fn));
+}
+template <typename Fn>
+decltype(auto) visit(Value& value, Fn&& fn) {  // NOLINT
+  return detail::VisitImpl(value, std::forward<Fn>(fn));
+}
+template <typename Fn>
+decltype(auto) visit(Json const& json, Fn&& fn) {  // NOLINT
+  return detail::VisitImpl(json.GetValue(), std::forward<Fn>(fn));
+}
+template <typename Fn>
+decltype(auto) visit(Json& json, Fn&& fn) {  // NOLINT
+  return detail::VisitImpl(json.GetValue(), std::forward<Fn>(fn));
+}
+
 namespace detail {
 // Number
 template <typename T,
@@ -601,4 +902,11 @@ using Boolean = JsonBoolean;
 using String = JsonString;
 using Null = JsonNull;
 }  // namespace nih
+
+namespace std {
+template <>
+struct hash<nih::Json> {
+  size_t operator()(nih::Json const& json) const { return json.Hash(); }
+};
+}  // namespace std
 #endif  // XGBOOST_JSON_H_
@@ -0,0 +1,133 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief Cache of parsed JSON files.
+ */
+#ifndef NIH_JSON_CACHE_H_
+#define NIH_JSON_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <ios>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "Json.h"
+
+namespace nih {
+/**
+ * \brief Identity of a file's content as seen by `stat`.  A file is reloaded when any of
+ *        these changes, including when it's replaced by a rename.
+ */
+struct FileIdentity {
+  uint64_t device{0};
+  uint64_t inode{0};
+  int64_t mtime_ns{0};
+  uint64_t size{0};
+
+  bool operator==(FileIdentity const& that) const {
+    return device == that.device && inode == that.inode && mtime_ns == that.mtime_ns &&
+           size == that.size;
+  }
+  bool operator!=(FileIdentity const& that) const { return !(*this == that); }
+
+  static FileIdentity Stat(std::string const& path);
+};
+
+/**
+ * \brief A thread-safe cache of parsed JSON files.
+ *
+ *   Documents are returned as shared immutable handles, which have been `Share`d so that
+ *   they can be copied on any thread.  A repeated load of an unchanged file costs a
+ *   `stat` and a lookup.  When several threads request the same file, it's parsed only
+ *   once and the others wait for the result.  Least recently used documents are evicted
+ *   once the memory used by the cached documents exceeds the budget, handles held by
+ *   callers stay valid.
+ *
+ * \code
+ *   JsonFileCache cache{256 << 20};
+ *   auto config = cache.Load("config.json");
+ *   auto model = cache.Load("model.ubj", std::ios::binary);
+ * \endcode
+ */
+class JsonFileCache {
+ public:
+  using Handle = std::shared_ptr<Json const>;
+
+  struct Stats {
+    /*! \brief Loads served from the cache, including those that waited for a parse. */
+    std::size_t hits{0};
+    /*! \brief Loads that parsed the file. */
+    std::size_t misses{0};
+    std::size_t evictions{0};
+    std::size_t n_entries{0};
+    /*! \brief Memory used by the cached documents, see GetMemoryUsage. */
+    std::size_t bytes{0};
+  };
+
+ private:
+  // Path, whether it's loaded as UBJSON and the byte order of UBJSON.
+  using Key = std::tuple<std::string, bool, UBJByteOrder>;
+  static Key MakeKey(std::string const& path, std::ios::openmode mode,
+                     UBJByteOrder order);
+  struct Entry {
+    FileIdentity identity;
+    std::shared_future<Handle> document;
+    // Zero until the document is loaded, pending entries are not evicted.
+    std::size_t bytes{0};
+    bool loaded{false};
+    // Tells apart a reloaded entry from the one a loader inserted.
+    uint64_t id{0};
+    std::list<Key>::iterator lru;
+  };
+
+  mutable std::mutex lock_;
+  std::map<Key, Entry> entries_;
+  // Most recently used first.
+  std::list<Key> lru_;
+  std::size_t budget_;
+  uint64_t next_id_{0};
+  Stats stats_;
+
+  void Erase(std::map<Key, Entry>::iterator it);
+  void Evict();
+
+ public:
+  /**
+   * \param memory_budget Bytes of memory the cached documents can use.
+   */
+  explicit JsonFileCache(
+      std::size_t memory_budget = std::numeric_limits<std::size_t>::max())
+      : budget_{memory_budget} {}
+
+  JsonFileCache(JsonFileCache const& that) = delete;
+  JsonFileCache& operator=(JsonFileCache const& that) = delete;
+
+  /**
+   * \brief Load a file with Json::LoadFile, or return the cached document if the file
+   *        hasn't changed since it was loaded.
+   *
+   * \param mode  std::ios::in for JSON text, std::ios::binary for UBJSON.  Compressed
+   *              containers are detected regardless of the mode.
+   * \param order Byte order of UBJSON input, see UBJByteOrder.
+   */
+  Handle Load(std::string const& path, std::ios::openmode mode = std::ios::in,
+              UBJByteOrder order = UBJByteOrder::kBigEndian);
+  /*! \brief Drop the cached document of a file, returns whether there was one. */
+  bool Erase(std::string const& path, std::ios::openmode mode = std::ios::in,
+             UBJByteOrder order = UBJByteOrder::kBigEndian);
+  void Clear();
+
+  Stats GetStats() const;
+  std::size_t MemoryBudget() const { return budget_; }
+};
+}  // namespace nih
+
+#endif  // NIH_JSON_CACHE_H_
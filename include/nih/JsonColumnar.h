@@ -0,0 +1,81 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief Conversion of arrays of records into columns of typed arrays.
+ */
+#ifndef NIH_JSON_COLUMNAR_H_
+#define NIH_JSON_COLUMNAR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Json.h"
+#include "StringRef.h"
+
+namespace nih {
+/**
+ * \brief Values of one key across all the records.
+ */
+struct JsonColumn {
+  enum class Type : std::uint8_t { kNumber, kInteger, kBoolean, kString };
+
+  std::string name;
+  /**
+   * \brief Integers mixed with numbers make a number column.  A column without any
+   *        non-null value is an integer column.
+   */
+  Type type{Type::kInteger};
+  /**
+   * \brief F32Array for numbers, I64Array for integers and U8Array of 0 and 1 for
+   *        booleans.  For strings, indices into `dictionary` as a U8Array when there are
+   *        at most 256 distinct strings, otherwise an I32Array.  Null and missing values
+   *        are 0.
+   */
+  Json values;
+  /*! \brief Distinct strings in the order of their first appearance. */
+  std::vector<std::string> dictionary;
+  /*! \brief Bit `i % 8` of byte `i / 8` is set if row i has a non-null value. */
+  std::vector<std::uint8_t> validity;
+  std::size_t null_count{0};
+
+  bool IsValid(std::size_t i) const { return (validity[i / 8] >> (i % 8)) & 1; }
+  static std::string TypeStr(Type type);
+};
+
+/**
+ * \brief Struct of arrays for an array of objects.
+ */
+struct JsonColumns {
+  std::size_t n_rows{0};
+  /*! \brief Columns in the order of the first appearance of their keys. */
+  std::vector<JsonColumn> columns;
+
+  /*! \brief Returns nullptr if there's no such column. */
+  JsonColumn const* Find(ConstStringRef name) const;
+};
+
+/**
+ * \brief Convert an array of objects into columns, one for each key found in any of the
+ *        objects.  Values must be scalars, and values of the same key must be of
+ *        compatible types, see JsonColumn::Type.
+ *
+ * \code
+ *   auto table = ToColumns(records);
+ *   auto const& price = get<F32Array const>(table.Find("price")->values);
+ * \endcode
+ */
+JsonColumns ToColumns(Json const& records);
+/**
+ * \brief Same as ToColumns, but parse the records from JSON text without building a
+ *        Json tree.
+ *
+ *   Unlike ToColumns, a key repeated in the same record is an error.  A Json tree keeps
+ *   only the last value of a repeated key, there's no such tree here to resolve the
+ *   duplicate, and the values already appended to the column aren't revisited.
+ */
+JsonColumns LoadColumns(ConstStringRef str);
+}  // namespace nih
+
+#endif  // NIH_JSON_COLUMNAR_H_
@@ -0,0 +1,319 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief Lexical rules of JSON text shared by the runtime readers and the compile-time
+ *        parser in StaticJson.h.  Everything here can be used in constant expressions.
+ */
+#ifndef NIH_JSON_GRAMMAR_H_
+#define NIH_JSON_GRAMMAR_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nih {
+namespace detail {
+struct NumberScan {
+  /*! \brief Past the end of the number, or the offending character if it's invalid. */
+  char const* ptr;
+  /*! \brief Value of an integer, wraps around on overflow. */
+  int64_t integer;
+  bool is_float;
+  /*! \brief Whether the text is in the RFC 8259 form, false for leading zeros. */
+  bool canonical;
+  bool valid;
+};
+
+/**
+ * \brief Find the extent of a number starting at `p`.  The number must be in the RFC
+ *        8259 form, except that leading zeros are accepted.  NaN and Infinity are not
+ *        handled here.  Adopted from sajson with some simplifications, the input is not
+ *        required to be null terminated.
+ */
+constexpr NumberScan ScanNumber(char const* p, char const* end) {
+  auto is_digit = [&p, end] { return p != end && *p >= '0' && *p <= '9'; };
+  NumberScan scan{p, 0, false, true, true};
+  auto invalid = [&scan, &p] {
+    scan.ptr = p;
+    scan.valid = false;
+    return scan;
+  };
+
+  bool negative = false;
+  if (p != end && *p == '-') {
+    negative = true;
+    ++p;
+  }
+
+  uint64_t i = 0;
+  if (p != end && *p == '0') {
+    p++;
+    scan.canonical = !is_digit();
+  } else if (!is_digit()) {
+    return invalid();
+  }
+
+  while (is_digit()) {
+    i = i * 10 + (*p - '0');
+    p++;
+  }
+
+  if (p != end && *p == '.') {
+    p++;
+    scan.is_float = true;
+    if (!is_digit()) {
+      return invalid();
+    }
+    while (is_digit()) {
+      p++;
+    }
+  }
+
+  if (p != end && (*p == 'E' || *p == 'e')) {
+    scan.is_float = true;
+    p++;
+    if (p != end && (*p == '-' || *p == '+')) {
+      p++;
+    }
+    if (!is_digit()) {
+      return invalid();
+    }
+    while (is_digit()) {
+      p++;
+    }
+  }
+
+  scan.ptr = p;
+  scan.integer = static_cast<int64_t>(negative ? 0 - i : i);
+  return scan;
+}
+
+/**
+ * \brief Length of the well-formed UTF-8 sequence starting at `p`, 0 if it's invalid.
+ *        Overlong encodings, surrogates and code points above U+10FFFF are rejected
+ *        following table 3-7 of the Unicode standard.
+ */
+constexpr std::size_t UTF8SequenceLength(char const* p, char const* end) {
+  auto b0 = static_cast<uint8_t>(p[0]);
+  if (b0 < 0x80) {
+    return 1;
+  }
+  std::size_t n = 0;
+  uint8_t lo = 0x80, hi = 0xBF;  // range of the second byte
+  if (b0 >= 0xC2 && b0 <= 0xDF) {
+    n = 2;
+  } else if (b0 >= 0xE0 && b0 <= 0xEF) {
+    n = 3;
+    if (b0 == 0xE0) {
+      lo = 0xA0;
+    } else if (b0 == 0xED) {
+      hi = 0x9F;
+    }
+  } else if (b0 >= 0xF0 && b0 <= 0xF4) {
+    n = 4;
+    if (b0 == 0xF0) {
+      lo = 0x90;
+    } else if (b0 == 0xF4) {
+      hi = 0x8F;
+    }
+  } else {
+    return 0;
+  }
+  if (static_cast<std::size_t>(end - p) < n) {
+    return 0;
+  }
+  auto b1 = static_cast<uint8_t>(p[1]);
+  if (b1 < lo || b1 > hi) {
+    return 0;
+  }
+  for (std::size_t i = 2; i < n; ++i) {
+    auto b = static_cast<uint8_t>(p[i]);
+    if (b < 0x80 || b > 0xBF) {
+      return 0;
+    }
+  }
+  return n;
+}
+
+constexpr bool IsStringSpecial(char c) {
+  auto b = static_cast<uint8_t>(c);
+  return b < 0x20 || b >= 0x80 || c == '"' || c == '\\';
+}
+
+/**
+ * \brief Find the first byte in a JSON string that can't be copied verbatim: a quote, a
+ *        backslash, a control character or the first byte of a non-ASCII sequence.
+ *        Returns `end` if there's none.
+ */
+constexpr char const* FindStringSpecialScalar(char const* p, char const* end) {
+  while (p != end && !IsStringSpecial(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+/*! \brief Decode a well-formed sequence of length `n` returned by UTF8SequenceLength. */
+constexpr uint32_t DecodeUTF8(char const* p, std::size_t n) {
+  auto b = [p](std::size_t i) {
+    return static_cast<uint32_t>(static_cast<uint8_t>(p[i]));
+  };
+  switch (n) {
+    case 1:
+      return b(0);
+    case 2:
+      return ((b(0) & 0x1F) << 6) | (b(1) & 0x3F);
+    case 3:
+      return ((b(0) & 0x0F) << 12) | ((b(1) & 0x3F) << 6) | (b(2) & 0x3F);
+    default:
+      return ((b(0) & 0x07) << 18) | ((b(1) & 0x3F) << 12) | ((b(2) & 0x3F) << 6) |
+             (b(3) & 0x3F);
+  }
+}
+
+/*! \brief Encode a code point as UTF-8, `out` must have room for 4 bytes. */
+constexpr std::size_t EncodeUTF8(uint32_t code, char* out) {
+  if (code < 0x80) {
+    out[0] = static_cast<char>(code);
+    return 1;
+  }
+  if (code < 0x800) {
+    out[0] = static_cast<char>(0xC0 | (code >> 6));
+    out[1] = static_cast<char>(0x80 | (code & 0x3F));
+    return 2;
+  }
+  if (code < 0x10000) {
+    out[0] = static_cast<char>(0xE0 | (code >> 12));
+    out[1] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+    out[2] = static_cast<char>(0x80 | (code & 0x3F));
+    return 3;
+  }
+  out[0] = static_cast<char>(0xF0 | (code >> 18));
+  out[1] = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+  out[2] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+  out[3] = static_cast<char>(0x80 | (code & 0x3F));
+  return 4;
+}
+
+/*! \brief Parse 4 hex digits, returns false if any of them is invalid. */
+constexpr bool ParseHex4(char const* p, uint32_t* code) {
+  uint32_t v = 0;
+  for (std::size_t i = 0; i < 4; ++i) {
+    char c = p[i];
+    uint32_t digit = 0;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return false;
+    }
+    v = (v << 4) | digit;
+  }
+  *code = v;
+  return true;
+}
+
+constexpr bool IsHighSurrogate(uint32_t code) { return code >= 0xD800 && code <= 0xDBFF; }
+constexpr bool IsLowSurrogate(uint32_t code) { return code >= 0xDC00 && code <= 0xDFFF; }
+
+// Characters of the single character escapes, indexed by the character after `\`.
+struct UnescapeTable {
+  char table[256]{};
+  constexpr UnescapeTable() {
+    table[static_cast<uint8_t>('"')] = '"';
+    table[static_cast<uint8_t>('\\')] = '\\';
+    table[static_cast<uint8_t>('/')] = '/';
+    table[static_cast<uint8_t>('b')] = '\b';
+    table[static_cast<uint8_t>('f')] = '\f';
+    table[static_cast<uint8_t>('n')] = '\n';
+    table[static_cast<uint8_t>('r')] = '\r';
+    table[static_cast<uint8_t>('t')] = '\t';
+  }
+  constexpr char operator[](uint8_t c) const { return table[c]; }
+};
+inline constexpr UnescapeTable kUnescape;
+
+/**
+ * \brief Decode the body of a JSON string.  `*pp` points past the opening quote.
+ *
+ * \param out  Sink with `push_back(char)` and `append(char const*, size_t)`.
+ * \param find Returns the first byte in `[p, end)` that IsStringSpecial, or `end`.
+ *
+ * \return nullptr on success with `*pp` moved past the closing quote.  Otherwise an error
+ *         message, with `*pp` pointing to the offending byte.
+ */
+template <typename Out, typename FindSpecial>
+constexpr char const* UnescapeString(char const** pp, char const* end, Out* out,
+                                     FindSpecial find) {
+  char const* p = *pp;
+  auto fail = [&](char const* msg) {
+    *pp = p;
+    return msg;
+  };
+  while (true) {
+    auto run = find(p, end);
+    if (run != p) {
+      out->append(p, static_cast<std::size_t>(run - p));
+      p = run;
+    }
+    if (p == end) {
+      return fail("Unterminated string");
+    }
+    auto c = static_cast<uint8_t>(*p);
+    if (c == '"') {
+      ++p;
+      break;
+    }
+    if (c == '\\') {
+      if (end - p < 2) {
+        return fail("Unterminated string");
+      }
+      ++p;
+      auto unescaped = kUnescape[static_cast<uint8_t>(*p)];
+      if (unescaped != 0) {
+        out->push_back(unescaped);
+        ++p;
+        continue;
+      }
+      if (*p != 'u') {
+        return fail("Unknown escape");
+      }
+      ++p;
+      uint32_t code = 0;
+      if (end - p < 4 || !ParseHex4(p, &code)) {
+        return fail("Invalid unicode escape");
+      }
+      p += 4;
+      if (IsLowSurrogate(code)) {
+        return fail("Unpaired low surrogate");
+      }
+      if (IsHighSurrogate(code)) {
+        uint32_t low = 0;
+        if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !ParseHex4(p + 2, &low) ||
+            !IsLowSurrogate(low)) {
+          return fail("Unpaired high surrogate");
+        }
+        p += 6;
+        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+      }
+      char buf[4]{};
+      out->append(buf, EncodeUTF8(code, buf));
+    } else if (c < 0x20) {
+      return fail("Control character in string");
+    } else {
+      auto n = UTF8SequenceLength(p, end);
+      if (n == 0) {
+        return fail("Invalid UTF-8 in string");
+      }
+      out->append(p, n);
+      p += n;
+    }
+  }
+  *pp = p;
+  return nullptr;
+}
+}  // namespace detail
+}  // namespace nih
+
+#endif  // NIH_JSON_GRAMMAR_H_
@@ -6,9 +6,12 @@
 #include <nih/Intrinsics.h>
 #include <nih/StringRef.h>
 #include <nih/Json.h>
+#include <nih/Span.h>
 
 #include <cinttypes>
+#include <cstdio>   // std::FILE
 #include <cstring>  // std::memcpy
+#include <ios>
 #include <limits>
 #include <map>
 #include <memory>
@@ -19,9 +22,11 @@
 #include <vector>
 
 namespace nih {
+class FileScheme;
+
 /*
- * \brief A json reader, currently error checking and utf-8 is not fully
- * supported.
+ * \brief A json reader.  Strings are validated as UTF-8, `\uXXXX` escapes including
+ *        surrogate pairs are decoded into UTF-8.
  */
 class JsonReader {
  protected:
@@ -36,7 +41,7 @@ class JsonReader {
     size_t Pos() const { return pos_; }
 
     void Forward() { pos_++; }
-    void Forward(uint32_t n) { pos_ += n; }
+    void Forward(size_t n) { pos_ += n; }
   } cursor_;
 
   ConstStringRef raw_str_;
@@ -79,6 +84,23 @@ class JsonReader {
 
   void Error(std::string msg) const;
 
+  size_t Remaining() const { return raw_str_.size() - cursor_.Pos(); }
+  /*! \brief Consume n bytes, throw if the input is shorter. */
+  char const* Consume(size_t n) {
+    if (NIH_UNLIKELY(Remaining() < n)) {
+      Error("Unexpected end of input");
+    }
+    auto ptr = raw_str_.c_str() + cursor_.Pos();
+    cursor_.Forward(n);
+    return ptr;
+  }
+  template <typename T>
+  T ReadStream() {
+    T v{0};
+    std::memcpy(&v, this->Consume(sizeof(v)), sizeof(v));
+    return v;
+  }
+
   // Report expected character
   void Expect(char c, char got) {
     std::string msg = "Expecting: \"";
@@ -123,7 +145,8 @@ class JsonWriter {
     size_t size = vec.size();
     for (size_t i = 0; i < size; ++i) {
       auto const &value = vec[i];
-      this->Save(fn(value));
+      auto const &json = fn(value);
+      Write(this, json.GetValue());
       if (i != size - 1) {
         stream_->emplace_back(',');
       }
@@ -133,9 +156,26 @@ class JsonWriter {
 
  protected:
   std::vector<char> *stream_;
+  bool ensure_ascii_{true};
+
+  /**
+   * \brief Write a nested value.  The value kind is dispatched with a switch, calls to
+   *        `Visit` are resolved statically when `Writer` is a final class.
+   */
+  template <typename Writer>
+  static void Write(Writer *writer, Value const &value) {
+    visit(value, [writer](auto const &v) { writer->Visit(&v); });
+  }
 
  public:
-  explicit JsonWriter(std::vector<char> *stream) : stream_{stream} {}
+  /**
+   * \param stream       Output buffer.
+   * \param ensure_ascii Escape non-ASCII characters as `\uXXXX`, otherwise they are
+   *                     written as UTF-8.  Strings with invalid UTF-8 are rejected in
+   *                     both cases.
+   */
+  explicit JsonWriter(std::vector<char> *stream, bool ensure_ascii = true)
+      : stream_{stream}, ensure_ascii_{ensure_ascii} {}
 
   virtual ~JsonWriter() = default;
 
@@ -175,8 +215,11 @@ inline uint64_t BuiltinBSwap(uint64_t v) {
 #else
 template <typename T>
 T BuiltinBSwap(T v) {
-  dmlc::ByteSwap(&v, sizeof(v), 1);
-  return v;
+  T r{0};
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    r = (r << 8) | ((v >> (i * 8)) & 0xff);
+  }
+  return r;
 }
 #endif  //  defined(__GLIBC__)
 
@@ -188,53 +231,293 @@ inline T ToBigEndian(T v) {
 template <typename T, std::enable_if_t<sizeof(T) != 1> * = nullptr>
 inline T ToBigEndian(T v) {
   static_assert(std::is_pod<T>::value, "Only pod is supported.");
-#if DMLC_LITTLE_ENDIAN
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
   auto constexpr kS = sizeof(T);
   std::conditional_t<kS == 2, uint16_t, std::conditional_t<kS == 4, uint32_t, uint64_t>>
       u;
   std::memcpy(&u, &v, sizeof(u));
   u = BuiltinBSwap(u);
   std::memcpy(&v, &u, sizeof(u));
-#endif  // DMLC_LITTLE_ENDIAN
+#endif  // __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
   return v;
 }
 
+namespace detail {
+template <typename Source>
+class UBJParser;
+}  // namespace detail
+
 /**
  * \brief Reader for UBJSON https://ubjson.org/
  */
 class UBJReader : public JsonReader {
-  Json Parse();
+  template <typename Source>
+  friend class detail::UBJParser;
+
+  UBJByteOrder order_;
 
   template <typename T>
-  T ReadStream() {
-    auto ptr = this->raw_str_.c_str() + cursor_.Pos();
-    T v{0};
-    std::memcpy(&v, ptr, sizeof(v));
-    cursor_.Forward(sizeof(v));
-    return v;
+  T FromUBJ(T v) const {
+    return order_ == UBJByteOrder::kBigEndian ? ToBigEndian(v) : v;
+  }
+  // Byte source for the parser.
+  bool AtEnd() const { return Remaining() == 0; }
+  template <typename T>
+  T ReadPrimitive() {
+    return FromUBJ(ReadStream<T>());
+  }
+  void ReadBytes(char* out, size_t n) {
+    if (n != 0) {
+      std::memcpy(out, this->Consume(n), n);
+    }
   }
+  bool Fits(int64_t n, size_t size) const {
+    return n >= 0 && static_cast<size_t>(n) <= Remaining() / size;
+  }
+  bool Sized() const { return true; }
+
+ public:
+  explicit UBJReader(ConstStringRef str, UBJByteOrder order = UBJByteOrder::kBigEndian)
+      : JsonReader{str}, order_{order} {}
+  Json Load() override;
+};
+
+/**
+ * \brief Reader for UBJSON that pulls the input from a file through a fixed-size buffer,
+ *        the document doesn't need to be staged in memory.  Lengths in the input are
+ *        validated against the remaining size of the file before any allocation, and
+ *        large typed arrays are read directly into their destination.  When the size is
+ *        not known, like for a pipe, strings and arrays grow as the data arrives.
+ *
+ * \code
+ *   UBJStreamReader reader{"model.ubj"};
+ *   Json model = Json::Load(&reader);
+ * \endcode
+ */
+class UBJStreamReader : public JsonReader {
+  template <typename Source>
+  friend class detail::UBJParser;
+
+  std::FILE* fd_{nullptr};
+  bool owned_{false};
+  UBJByteOrder order_;
+  // Whether the size of the input is known, false for pipes and character devices.
+  bool sized_{false};
+
+  std::vector<char> buffer_;
+  size_t beg_{0};
+  size_t end_{0};
+  // Bytes in the file that are not yet pulled into the buffer.
+  size_t remaining_{0};
+  // Total number of bytes consumed, used for error reporting.
+  size_t consumed_{0};
+
+  void Init(size_t buffer_size);
+  void Fill();
+  void Ensure(size_t n);
+
+  void Error(std::string msg) const;
 
+  template <typename T>
+  T FromUBJ(T v) const {
+    return order_ == UBJByteOrder::kBigEndian ? ToBigEndian(v) : v;
+  }
+  // Byte source for the parser, characters are only read when not at end.
+  bool AtEnd() {
+    if (NIH_UNLIKELY(beg_ == end_)) {
+      this->Fill();
+    }
+    return beg_ == end_;
+  }
+  char GetNextChar() {
+    consumed_++;
+    return buffer_[beg_++];
+  }
+  char PeekNextChar() { return buffer_[beg_]; }
   template <typename T>
   T ReadPrimitive() {
-    auto v = ReadStream<T>();
-    v = ToBigEndian(v);
-    return v;
+    T v{0};
+    this->Ensure(sizeof(v));
+    std::memcpy(&v, buffer_.data() + beg_, sizeof(v));
+    beg_ += sizeof(v);
+    consumed_ += sizeof(v);
+    return FromUBJ(v);
+  }
+  void ReadBytes(char* out, size_t n);
+  bool Fits(int64_t n, size_t size) const {
+    return n >= 0 &&
+           (!sized_ || static_cast<size_t>(n) <= (end_ - beg_ + remaining_) / size);
   }
+  bool Sized() const { return sized_; }
 
-  template <typename TypedArray>
-  auto ParseTypedArray(int64_t n) {
-    TypedArray results{static_cast<size_t>(n)};
-    for (int64_t i = 0; i < n; ++i) {
-      auto v = this->ReadPrimitive<typename TypedArray::Type>();
-      results.Set(i, v);
+ public:
+  static size_t constexpr kDefaultBufferSize = 1 << 16;
+
+  explicit UBJStreamReader(std::string const& path,
+                           size_t buffer_size = kDefaultBufferSize,
+                           UBJByteOrder order = UBJByteOrder::kBigEndian);
+  /*! \brief Read from an opened file, the reader starts at current file position. */
+  explicit UBJStreamReader(FileScheme* file, size_t buffer_size = kDefaultBufferSize,
+                           UBJByteOrder order = UBJByteOrder::kBigEndian);
+  UBJStreamReader(UBJStreamReader const& that) = delete;
+  ~UBJStreamReader() override;
+
+  Json Load() override;
+};
+
+/**
+ * \brief Writer for UBJSON https://ubjson.org/
+ */
+class UBJWriter final : public JsonWriter {
+  friend class JsonWriter;
+
+  bool typed_arrays_{false};
+
+  void Visit(JsonArray const *arr) override;
+  void Visit(F32Array const *arr) override;
+  void Visit(U8Array const *arr) override;
+  void Visit(I32Array const *arr) override;
+  void Visit(I64Array const *arr) override;
+  void Visit(JsonObject const *obj) override;
+  void Visit(JsonNumber const *num) override;
+  void Visit(JsonInteger const *num) override;
+  void Visit(JsonNull const *null) override;
+  void Visit(JsonString const *str) override;
+  void Visit(JsonBoolean const *boolean) override;
+
+ public:
+  /**
+   * \param stream       Output buffer.
+   * \param typed_arrays Write arrays whose elements are all integers or all numbers as
+   *                     typed arrays, integers use the narrowest of u8, i32 and i64 that
+   *                     holds every element.  The output is smaller and faster to load,
+   *                     but such arrays are loaded back as typed arrays instead of Array.
+   */
+  explicit UBJWriter(std::vector<char> *stream, bool typed_arrays = false)
+      : JsonWriter{stream}, typed_arrays_{typed_arrays} {}
+  void Save(Json json) override;
+};
+
+/**
+ * \brief Write a document incrementally without building a Json tree.  Output is text
+ *        by default, or UBJSON when `mode` has std::ios::binary.
+ *
+ *   Misuse like a value without a key inside an object, or a second top-level value, is
+ *   reported as an error.  UBJSON containers are written without a count since the size
+ *   is not known in advance.
+ *
+ * \code
+ *   std::vector<char> out;
+ *   JsonStreamWriter writer{&out};
+ *   writer.BeginObject().Key("step").Value(3).Key("loss").Value(0.25f).End();
+ * \endcode
+ */
+class JsonStreamWriter {
+  struct Frame {
+    bool is_object;
+    bool has_key;
+    bool empty;
+  };
+  std::vector<char> *stream_;
+  bool binary_;
+  bool ensure_ascii_;
+  bool done_{false};
+  std::vector<Frame> stack_;
+
+  void BeforeValue();
+  void AfterValue() { done_ = stack_.empty(); }
+  void Begin(bool is_object);
+  void IntegerOverflow(uint64_t v) const;
+
+ public:
+  explicit JsonStreamWriter(std::vector<char> *stream,
+                            std::ios::openmode mode = std::ios::out,
+                            bool ensure_ascii = true)
+      : stream_{stream}, binary_{(mode & std::ios::binary) != 0},
+        ensure_ascii_{ensure_ascii} {}
+
+  JsonStreamWriter &BeginObject() {
+    this->Begin(true);
+    return *this;
+  }
+  JsonStreamWriter &BeginArray() {
+    this->Begin(false);
+    return *this;
+  }
+  /*! \brief Close the innermost object or array. */
+  JsonStreamWriter &End();
+  JsonStreamWriter &Key(ConstStringRef key);
+
+  JsonStreamWriter &Value(int64_t v);
+  JsonStreamWriter &Value(float v);
+  JsonStreamWriter &Value(bool v);
+  JsonStreamWriter &Value(ConstStringRef v);
+  JsonStreamWriter &Value(char const *v) { return this->Value(ConstStringRef{v}); }
+  JsonStreamWriter &Value(std::string const &v) { return this->Value(ConstStringRef{v}); }
+  /*! \brief Integers are written as int64_t, larger unsigned values are rejected. */
+  template <typename T, std::enable_if_t<std::is_integral<T>::value &&
+                                         !std::is_same<T, bool>::value> * = nullptr>
+  JsonStreamWriter &Value(T v) {
+    if constexpr (std::is_unsigned<T>::value && sizeof(T) >= sizeof(int64_t)) {
+      if (NIH_UNLIKELY(v > static_cast<T>(std::numeric_limits<int64_t>::max()))) {
+        this->IntegerOverflow(v);
+      }
     }
-    return Json{std::move(results)};
+    return this->Value(static_cast<int64_t>(v));
   }
+  /*! \brief Written as a UBJSON float64 if the value doesn't fit in a float. */
+  JsonStreamWriter &Value(double v);
+  /*! \brief Write an existing Json value in place. */
+  JsonStreamWriter &Value(Json const &v);
+  JsonStreamWriter &Null();
+  /**
+   * \brief Write a numeric array.  It's a typed array in UBJSON, supported element types
+   *        are float, uint8_t, int32_t and int64_t.
+   */
+  template <typename T>
+  JsonStreamWriter &Array(Span<T const> values);
 
-  std::string DecodeStr();
+  /*! \brief Whether a complete top-level value has been written. */
+  bool Done() const { return done_; }
+};
 
-  Json ParseArray() override;
-  Json ParseObject() override;
+/**
+ * \brief Convert a document between JSON text and UBJSON without building a Json tree.
+ *        Object members are written in the order of the input, objects with duplicated
+ *        keys are rejected.
+ *
+ * \param input        The serialized document.
+ * \param from         std::ios::binary for UBJSON input, otherwise text.
+ * \param out          Output buffer, the document is appended to it.
+ * \param to           std::ios::binary for UBJSON output, otherwise text.
+ * \param typed_arrays For UBJSON output, write arrays whose elements are all integers or
+ *                     all floats as typed arrays.  Integers use the narrowest type that
+ *                     holds every element.  Such arrays are loaded back as typed arrays
+ *                     instead of Array.
+ */
+void Transcode(ConstStringRef input, std::ios::openmode from, std::vector<char> *out,
+               std::ios::openmode to, bool typed_arrays = true);
+
+/**
+ * \brief Reader for MessagePack https://msgpack.org/
+ *
+ *   Binary strings are decoded into U8Array, extension types defined in MsgPackExt
+ *   are decoded into the corresponding typed arrays.
+ */
+class MsgPackReader : public JsonReader {
+  Json Parse();
+
+  template <typename T>
+  T ReadPrimitive() {
+    return ToBigEndian(ReadStream<T>());
+  }
+  template <typename TypedArray>
+  Json ParseTypedArray(size_t n_bytes);
+
+  std::string DecodeStr(size_t n);
+  Json ParseArray(size_t n);
+  Json ParseObject(size_t n);
+  Json ParseExt(size_t n_bytes);
 
  public:
   using JsonReader::JsonReader;
@@ -242,9 +525,70 @@ class UBJReader : public JsonReader {
 };
 
 /**
- * \brief Writer for UBJSON https://ubjson.org/
+ * \brief Writer for MessagePack https://msgpack.org/
+ */
+class MsgPackWriter final : public JsonWriter {
+  friend class JsonWriter;
+
+  void Visit(JsonArray const *arr) override;
+  void Visit(F32Array const *arr) override;
+  void Visit(U8Array const *arr) override;
+  void Visit(I32Array const *arr) override;
+  void Visit(I64Array const *arr) override;
+  void Visit(JsonObject const *obj) override;
+  void Visit(JsonNumber const *num) override;
+  void Visit(JsonInteger const *num) override;
+  void Visit(JsonNull const *null) override;
+  void Visit(JsonString const *str) override;
+  void Visit(JsonBoolean const *boolean) override;
+
+ public:
+  /*! \brief Application defined extension types used for typed arrays. */
+  enum MsgPackExt : int8_t { kF32Array = 1, kI32Array = 2, kI64Array = 3 };
+
+  using JsonWriter::JsonWriter;
+  void Save(Json json) override;
+};
+
+/**
+ * \brief Reader for CBOR https://www.rfc-editor.org/rfc/rfc8949
+ *
+ *   Typed arrays are decoded from the tags defined in RFC 8746, in both big and little
+ *   endian.  Untagged byte strings are decoded into U8Array and other tags are ignored.
  */
-class UBJWriter : public JsonWriter {
+class CBORReader : public JsonReader {
+  Json Parse();
+
+  template <typename T>
+  T ReadPrimitive() {
+    return ToBigEndian(ReadStream<T>());
+  }
+  /*! \brief Read the argument of a data item, returns false for indefinite length. */
+  bool ReadArgument(uint8_t info, uint64_t *arg);
+  /*! \brief Consume the break of an indefinite length item, throw on end of input. */
+  bool AtBreak();
+  template <typename TypedArray>
+  Json ParseTypedArray(bool little_endian);
+
+  std::string DecodeStr(uint8_t info, uint8_t major);
+  Json ParseArray(uint8_t info);
+  Json ParseObject(uint8_t info);
+  Json ParseTag(uint64_t tag);
+  Json ParseSimple(uint8_t info);
+
+ public:
+  using JsonReader::JsonReader;
+  Json Load() override;
+};
+
+/**
+ * \brief Writer for CBOR https://www.rfc-editor.org/rfc/rfc8949
+ *
+ *   Typed arrays are encoded as big endian RFC 8746 typed arrays.
+ */
+class CBORWriter final : public JsonWriter {
+  friend class JsonWriter;
+
   void Visit(JsonArray const *arr) override;
   void Visit(F32Array const *arr) override;
   void Visit(U8Array const *arr) override;
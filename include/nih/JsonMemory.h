@@ -0,0 +1,74 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief Memory footprint accounting for Json documents.
+ */
+#ifndef NIH_JSON_MEMORY_H_
+#define NIH_JSON_MEMORY_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "Json.h"
+
+namespace nih {
+/**
+ * \brief Bytes occupied by a Json tree.
+ *
+ *   Sizes are the bytes requested from the allocator, allocator headers and rounding
+ *   are not included.  `n_allocs` can be used to estimate them.  The size of a std::map
+ *   node is estimated from the red-black tree header used by common implementations.
+ */
+struct MemoryUsage {
+  /*! \brief Size of the Value objects themselves. */
+  std::size_t nodes{0};
+  /*! \brief Heap buffers of strings, including object keys.  Short strings stored
+   *         inline are not counted. */
+  std::size_t strings{0};
+  /*! \brief Used part of array and typed array buffers. */
+  std::size_t arrays{0};
+  /*! \brief Unused capacity of arrays and strings. */
+  std::size_t slack{0};
+  /*! \brief Object entries, including the tree node overhead. */
+  std::size_t map_nodes{0};
+
+  std::size_t n_values{0};
+  std::size_t n_allocs{0};
+
+  std::size_t Total() const { return nodes + strings + arrays + slack + map_nodes; }
+
+  MemoryUsage& operator+=(MemoryUsage const& that);
+};
+
+struct MemoryUsageEntry {
+  /*! \brief JSON pointer (RFC 6901) of the subtree, empty for the root. */
+  std::string path;
+  MemoryUsage usage;
+};
+
+/**
+ * \brief Memory used by `json`.  Nodes shared by several parents are counted once.
+ */
+MemoryUsage GetMemoryUsage(Json const& json);
+
+/**
+ * \brief Memory used by each subtree of `json` up to `max_depth` levels below the root,
+ *        sorted by total size in descending order.
+ *
+ * \param json      The document.
+ * \param max_depth Subtrees deeper than this are accounted to their ancestors only.
+ * \param min_bytes Subtrees smaller than this are not reported.
+ *
+ * \code
+ *   for (auto const& entry : GetMemoryBreakdown(model, 2, 1 << 20)) {
+ *     std::cout << entry.path << ": " << entry.usage.Total() << std::endl;
+ *   }
+ * \endcode
+ */
+std::vector<MemoryUsageEntry> GetMemoryBreakdown(Json const& json,
+                                                 std::size_t max_depth = 1,
+                                                 std::size_t min_bytes = 0);
+}  // namespace nih
+
+#endif  // NIH_JSON_MEMORY_H_
@@ -0,0 +1,43 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief Structural diff and patch for Json documents, following RFC 6902 (JSON Patch)
+ *        with RFC 6901 pointers.
+ */
+#ifndef NIH_JSON_PATCH_H_
+#define NIH_JSON_PATCH_H_
+
+#include <string>
+
+#include "Json.h"
+#include "JsonPointer.h"
+
+namespace nih {
+/**
+ * \brief Compute a patch that turns `from` into `to`.
+ *
+ *   The result is an array of operations.  Only "add", "remove" and "replace" are
+ *   generated, along with an extension for typed arrays:
+ *
+ * \code
+ *   {"op": "splice", "path": "/weights", "offset": 8, "length": 2, "value": [...]}
+ * \endcode
+ *
+ *   which replaces `length` elements starting at `offset` with the elements of `value`.
+ *   Subtrees shared by both documents are skipped without being visited, so diffing a
+ *   copy that was modified in a few places is cheap.  Values in the patch share
+ *   storage with `to`.
+ */
+Json Diff(Json const& from, Json const& to);
+/**
+ * \brief Apply a patch produced by `Diff` or any RFC 6902 patch to `doc` in place.  All
+ *        six standard operations are supported along with "splice".
+ *
+ *   Containers shared with other Json objects are copied before being modified, so the
+ *   patch doesn't leak into other documents.  An invalid operation is reported as an
+ *   error, the preceding operations are not rolled back.
+ */
+void Patch(Json* doc, Json const& patch);
+}  // namespace nih
+
+#endif  // NIH_JSON_PATCH_H_
@@ -0,0 +1,101 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief JSON pointer (RFC 6901) and multi-path projection.
+ */
+#ifndef NIH_JSON_POINTER_H_
+#define NIH_JSON_POINTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Json.h"
+#include "StringRef.h"
+
+namespace nih {
+/**
+ * \brief A parsed JSON pointer.  Reference tokens are unescaped and array indices are
+ *        parsed once, so the pointer can be resolved repeatedly without string
+ *        processing.
+ */
+class JsonPointer {
+  std::vector<std::string> tokens_;
+  // Array index of each token, -1 if the token is not a valid index.
+  std::vector<int64_t> indices_;
+
+ public:
+  /*! \brief The empty pointer, which refers to the whole document. */
+  JsonPointer() = default;
+  /*! \brief Parse a pointer like "/a/0/b~1c", an invalid pointer is an error. */
+  explicit JsonPointer(std::string const& pointer);
+  /*! \brief Construct from unescaped reference tokens. */
+  static JsonPointer FromTokens(std::vector<std::string> tokens);
+
+  std::vector<std::string> const& Tokens() const { return tokens_; }
+  std::size_t Size() const { return tokens_.size(); }
+  bool IsRoot() const { return tokens_.empty(); }
+  /*! \brief Array index of the i^th token, -1 if it's not a valid index. */
+  int64_t Index(std::size_t i) const { return indices_[i]; }
+
+  /*! \brief The escaped string form. */
+  std::string ToString() const;
+
+  /**
+   * \brief Resolve the pointer in a parsed document, returns nullptr if the path doesn't
+   *        exist.  Elements of typed arrays are not Json values and can't be resolved,
+   *        use JsonProjection for them.
+   */
+  Json const* Find(Json const& doc) const;
+  Json* Find(Json* doc) const;
+};
+
+/*! \brief Escape a key as a JSON pointer reference token. */
+std::string EscapePointerToken(std::string const& key);
+
+/**
+ * \brief Extract a set of paths from a document.
+ *
+ *   For serialized input, only the values at the requested paths are parsed.  The rest
+ *   of the document is skipped by matching brackets in text and by following length
+ *   prefixes in UBJSON, skipped values are not validated.  Scanning of a container stops
+ *   once all requested children are found.
+ *
+ * \code
+ *   JsonProjection proj{{"/learner/objective/name", "/version"}};
+ *   Json fields = proj.Extract(ConstStringRef{str});
+ *   auto const& name = get<String const>(fields["/learner/objective/name"]);
+ * \endcode
+ */
+class JsonProjection {
+ public:
+  struct Node;
+
+ private:
+  std::vector<JsonPointer> paths_;
+  std::vector<std::string> keys_;
+  std::shared_ptr<Node const> root_;
+
+ public:
+  explicit JsonProjection(std::vector<JsonPointer> paths);
+  explicit JsonProjection(std::vector<std::string> const& paths);
+
+  std::vector<JsonPointer> const& Paths() const { return paths_; }
+
+  /**
+   * \brief Returns an object keyed by the string form of each path.  Missing paths are
+   *        absent from the result.  Values share storage with `doc`.
+   */
+  Json Extract(Json const& doc) const;
+  /**
+   * \brief Same as above, but works on serialized text or UBJSON input without parsing
+   *        it as a whole.
+   */
+  Json Extract(ConstStringRef str, std::ios::openmode mode = std::ios::in) const;
+};
+}  // namespace nih
+
+#endif  // NIH_JSON_POINTER_H_
@@ -0,0 +1,482 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief Compact read-only document stored as a flat tape.
+ */
+#ifndef NIH_JSON_TAPE_H_
+#define NIH_JSON_TAPE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Intrinsics.h"
+#include "Json.h"
+#include "StringRef.h"
+
+namespace nih {
+class JsonTape;
+
+namespace detail {
+/**
+ * \brief Tag in the top 8 bits of a tape word, the rest 56 bits is the payload.
+ *
+ *   - Null, False, True: no payload.
+ *   - Integer: the value if it fits into 56 bits.  Otherwise it's Integer64 and the
+ *     value is stored in the next word.
+ *   - Number: bits of the float.
+ *   - String: offset into the string buffer, where a 32-bit length precedes the bytes.
+ *   - Object, Array: the index of the word after the last member in the lower 32 bits,
+ *     followed by the number of members in the upper 24 bits.  The members follow the
+ *     header directly, object members are a key string followed by the value.
+ */
+enum class TapeTag : uint8_t {
+  kNull,
+  kFalse,
+  kTrue,
+  kInteger,
+  kInteger64,
+  kNumber,
+  kString,
+  kObject,
+  kArray
+};
+}  // namespace detail
+
+class TapeArray;
+class TapeObject;
+
+/**
+ * \brief Reference to a value in a JsonTape, mirrors the read-only part of Json.  It's
+ *        a pair of pointer and index, cheap to copy and valid as long as the tape.
+ */
+class TapeRef {
+  JsonTape const* tape_;
+  std::size_t idx_;
+
+  [[noreturn]] void TypeError(Value::ValueKind expected) const;
+  std::size_t CountMembers() const;
+
+ public:
+  TapeRef(JsonTape const* tape, std::size_t idx) : tape_{tape}, idx_{idx} {}
+
+  detail::TapeTag Tag() const;
+  Value::ValueKind Type() const;
+  std::string TypeStr() const { return Value::TypeStr(this->Type()); }
+
+  float GetNumber() const;
+  int64_t GetInteger() const;
+  bool GetBoolean() const;
+  ConstStringRef GetString() const;
+  TapeArray GetArray() const;
+  TapeObject GetObject() const;
+
+  /*! \brief Number of elements of an array or members of an object. */
+  std::size_t Size() const;
+  /**
+   * \brief Lookup a member of an object, it's an error if the key doesn't exist.
+   *        Members are searched linearly in the order of the input, the first one wins
+   *        for duplicated keys.
+   */
+  TapeRef operator[](ConstStringRef key) const;
+  /*! \brief The i^th element of an array, O(i) as containers are skipped in O(1). */
+  TapeRef operator[](std::size_t i) const;
+
+  /*! \brief Convert into a Json tree. */
+  Json ToJson() const;
+
+  JsonTape const* Tape() const { return tape_; }
+  std::size_t Index() const { return idx_; }
+};
+
+/**
+ * \brief A parsed document stored as one contiguous array of 64-bit words for the
+ *        structure and scalars, plus a buffer for strings.
+ *
+ *   Containers store the index of their end, so skipping a subtree is O(1) and a lookup
+ *   touches only the headers of the preceding siblings.  Most values take a single word,
+ *   which keeps the footprint close to the size of the input compared to a Json tree.
+ *   The document is read-only.
+ *
+ *   The tape holds no pointers, so it can be saved as an image and mapped read-only by
+ *   any number of processes, see `Save` and `Map`.  The pages of a mapped tape are shared
+ *   between the processes through the page cache.
+ *
+ * \code
+ *   auto tape = JsonTape::Load(ConstStringRef{str});
+ *   auto root = tape.Root();
+ *   auto depth = get<Integer const>(root["gbm"]["trees"][0]["nodes"][0]["depth"]);
+ *
+ *   tape.Save("model.tape");
+ *   // In the worker processes.
+ *   auto mapped = JsonTape::Map("model.tape");
+ * \endcode
+ */
+class JsonTape {
+  // Storage of a tape built in memory.
+  std::vector<uint64_t> words_;
+  std::string strings_;
+  // Storage of a mapped image, null for a tape built in memory.
+  std::shared_ptr<void const> image_;
+  // The tape being read, points into either of the above.
+  uint64_t const* word_ptr_{nullptr};
+  std::size_t n_words_{0};
+  char const* string_ptr_{nullptr};
+  std::size_t n_string_bytes_{0};
+
+  friend class TapeRef;
+  friend class TapeArray;
+  friend class TapeObject;
+  friend class TapeBuilder;
+
+  static std::size_t constexpr kTagShift = 56;
+  static uint64_t constexpr kPayloadMask = (uint64_t{1} << kTagShift) - 1;
+  static std::size_t constexpr kCountShift = 32;
+  // The count is saturated, larger containers are counted by iteration.
+  static uint64_t constexpr kMaxCount = (uint64_t{1} << (kTagShift - kCountShift)) - 1;
+
+  static uint64_t MakeWord(detail::TapeTag tag, uint64_t payload) {
+    return (static_cast<uint64_t>(tag) << kTagShift) | payload;
+  }
+  detail::TapeTag Tag(std::size_t i) const {
+    return static_cast<detail::TapeTag>(word_ptr_[i] >> kTagShift);
+  }
+  uint64_t Payload(std::size_t i) const { return word_ptr_[i] & kPayloadMask; }
+  /*! \brief Index of the word after the value at i. */
+  std::size_t Next(std::size_t i) const {
+    switch (Tag(i)) {
+      case detail::TapeTag::kInteger64:
+        return i + 2;
+      case detail::TapeTag::kObject:
+      case detail::TapeTag::kArray:
+        return static_cast<std::size_t>(Payload(i) & 0xFFFFFFFF);
+      default:
+        return i + 1;
+    }
+  }
+  ConstStringRef String(std::size_t i) const {
+    auto offset = Payload(i);
+    uint32_t n;
+    std::memcpy(&n, string_ptr_ + offset, sizeof(n));
+    return ConstStringRef{string_ptr_ + offset + sizeof(n), n};
+  }
+  /*! \brief Point the views to the storage, after the tape is built or copied. */
+  void Bind(JsonTape const& that) {
+    if (image_) {
+      word_ptr_ = that.word_ptr_;
+      n_words_ = that.n_words_;
+      string_ptr_ = that.string_ptr_;
+      n_string_bytes_ = that.n_string_bytes_;
+    } else {
+      word_ptr_ = words_.data();
+      n_words_ = words_.size();
+      string_ptr_ = strings_.data();
+      n_string_bytes_ = strings_.size();
+    }
+  }
+  /*! \brief Check the image is a well-formed tape so that reads stay in bounds. */
+  void Validate() const;
+  static JsonTape FromImage(std::shared_ptr<void const> image, ConstStringRef bytes);
+
+ public:
+  /*! \brief A document with a single null value. */
+  JsonTape() : words_{MakeWord(detail::TapeTag::kNull, 0)} { this->Bind(*this); }
+  JsonTape(JsonTape const& that)
+      : words_{that.words_}, strings_{that.strings_}, image_{that.image_} {
+    this->Bind(that);
+  }
+  JsonTape(JsonTape&& that) noexcept
+      : words_{std::move(that.words_)},
+        strings_{std::move(that.strings_)},
+        image_{std::move(that.image_)} {
+    this->Bind(that);
+  }
+  JsonTape& operator=(JsonTape const& that) {
+    if (this != &that) {
+      words_ = that.words_;
+      strings_ = that.strings_;
+      image_ = that.image_;
+      this->Bind(that);
+    }
+    return *this;
+  }
+  JsonTape& operator=(JsonTape&& that) noexcept {
+    if (this != &that) {
+      words_ = std::move(that.words_);
+      strings_ = std::move(that.strings_);
+      image_ = std::move(that.image_);
+      this->Bind(that);
+    }
+    return *this;
+  }
+
+  /*! \brief Parse a JSON text document, errors are the same as Json::Load. */
+  static JsonTape Load(ConstStringRef str);
+  /**
+   * \brief Store an existing Json tree, typed arrays are stored as normal arrays.  Throws
+   *        on doubles that can't be represented exactly as float.
+   */
+  static JsonTape FromJson(Json const& json);
+
+  /**
+   * \brief Write the tape as an image that can be mapped by `Map` or `View`.  The image
+   *        uses the byte order of this machine.
+   */
+  void Save(std::vector<char>* out) const;
+  void Save(std::string const& path) const;
+  /**
+   * \brief Map an image written by `Save` read-only.  The path can also refer to a
+   *        shared memory object, like `/dev/shm/...` or `/proc/self/fd/<memfd>`.  The
+   *        image is validated, which reads it once.
+   */
+  static JsonTape Map(std::string const& path);
+  /**
+   * \brief Read an image in memory owned by the caller, like a shared memory segment.
+   *        The buffer must be 8-byte aligned and outlive the tape and its copies.
+   */
+  static JsonTape View(ConstStringRef image);
+
+  TapeRef Root() const { return TapeRef{this, 0}; }
+  /*! \brief Whether the tape reads from an image instead of its own storage. */
+  bool IsMapped() const { return static_cast<bool>(image_); }
+  /*! \brief Number of bytes used by the tape and the string buffer. */
+  std::size_t MemoryUsage() const {
+    return n_words_ * sizeof(uint64_t) + n_string_bytes_;
+  }
+};
+
+/**
+ * \brief View of an array in a tape.
+ */
+class TapeArray {
+  JsonTape const* tape_;
+  std::size_t beg_;
+  std::size_t end_;
+  std::size_t size_;
+
+ public:
+  class const_iterator {  // NOLINT
+    JsonTape const* tape_;
+    std::size_t idx_;
+
+   public:
+    using iterator_category = std::forward_iterator_tag;  // NOLINT
+    using value_type = TapeRef;                           // NOLINT
+    using difference_type = std::ptrdiff_t;              // NOLINT
+    using pointer = TapeRef const*;                       // NOLINT
+    using reference = TapeRef;                            // NOLINT
+
+    const_iterator(JsonTape const* tape, std::size_t idx) : tape_{tape}, idx_{idx} {}
+    TapeRef operator*() const { return TapeRef{tape_, idx_}; }
+    const_iterator& operator++() {
+      idx_ = tape_->Next(idx_);
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto ret = *this;
+      ++(*this);
+      return ret;
+    }
+    bool operator==(const_iterator const& that) const { return idx_ == that.idx_; }
+    bool operator!=(const_iterator const& that) const { return !(*this == that); }
+  };
+
+  TapeArray(JsonTape const* tape, std::size_t beg, std::size_t end, std::size_t size)
+      : tape_{tape}, beg_{beg}, end_{end}, size_{size} {}
+
+  const_iterator begin() const { return const_iterator{tape_, beg_}; }  // NOLINT
+  const_iterator end() const { return const_iterator{tape_, end_}; }    // NOLINT
+  std::size_t size() const { return size_; }                            // NOLINT
+  bool empty() const { return beg_ == end_; }                           // NOLINT
+  TapeRef operator[](std::size_t i) const;
+};
+
+/**
+ * \brief View of an object in a tape.  Members are in the order of the input.
+ */
+class TapeObject {
+  JsonTape const* tape_;
+  std::size_t beg_;
+  std::size_t end_;
+  std::size_t size_;
+
+ public:
+  class const_iterator {  // NOLINT
+    JsonTape const* tape_;
+    std::size_t idx_;
+
+   public:
+    using iterator_category = std::forward_iterator_tag;        // NOLINT
+    using value_type = std::pair<ConstStringRef, TapeRef>;      // NOLINT
+    using difference_type = std::ptrdiff_t;                     // NOLINT
+    using pointer = value_type const*;                          // NOLINT
+    using reference = value_type;                               // NOLINT
+
+    const_iterator(JsonTape const* tape, std::size_t idx) : tape_{tape}, idx_{idx} {}
+    value_type operator*() const {
+      return {tape_->String(idx_), TapeRef{tape_, idx_ + 1}};
+    }
+    const_iterator& operator++() {
+      idx_ = tape_->Next(idx_ + 1);
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto ret = *this;
+      ++(*this);
+      return ret;
+    }
+    bool operator==(const_iterator const& that) const { return idx_ == that.idx_; }
+    bool operator!=(const_iterator const& that) const { return !(*this == that); }
+  };
+
+  TapeObject(JsonTape const* tape, std::size_t beg, std::size_t end, std::size_t size)
+      : tape_{tape}, beg_{beg}, end_{end}, size_{size} {}
+
+  const_iterator begin() const { return const_iterator{tape_, beg_}; }  // NOLINT
+  const_iterator end() const { return const_iterator{tape_, end_}; }    // NOLINT
+  std::size_t size() const { return size_; }                            // NOLINT
+  bool empty() const { return beg_ == end_; }                           // NOLINT
+  /*! \brief Returns end() if the key doesn't exist. */
+  const_iterator find(ConstStringRef key) const {  // NOLINT
+    for (auto i = beg_; i != end_; i = tape_->Next(i + 1)) {
+      auto k = tape_->String(i);
+      if (k.size() == key.size() && std::memcmp(k.data(), key.data(), k.size()) == 0) {
+        return const_iterator{tape_, i};
+      }
+    }
+    return this->end();
+  }
+};
+
+inline detail::TapeTag TapeRef::Tag() const { return tape_->Tag(idx_); }
+
+inline float TapeRef::GetNumber() const {
+  if (NIH_UNLIKELY(this->Tag() != detail::TapeTag::kNumber)) {
+    TypeError(Value::ValueKind::kNumber);
+  }
+  auto bits = static_cast<uint32_t>(tape_->Payload(idx_));
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+inline int64_t TapeRef::GetInteger() const {
+  auto tag = this->Tag();
+  if (NIH_LIKELY(tag == detail::TapeTag::kInteger)) {
+    // Sign extend the 56-bit payload.
+    return static_cast<int64_t>(tape_->Payload(idx_) << 8) >> 8;
+  }
+  if (NIH_UNLIKELY(tag != detail::TapeTag::kInteger64)) {
+    TypeError(Value::ValueKind::kInteger);
+  }
+  return static_cast<int64_t>(tape_->word_ptr_[idx_ + 1]);
+}
+
+inline bool TapeRef::GetBoolean() const {
+  auto tag = this->Tag();
+  if (NIH_UNLIKELY(tag != detail::TapeTag::kTrue && tag != detail::TapeTag::kFalse)) {
+    TypeError(Value::ValueKind::kBoolean);
+  }
+  return tag == detail::TapeTag::kTrue;
+}
+
+inline ConstStringRef TapeRef::GetString() const {
+  if (NIH_UNLIKELY(this->Tag() != detail::TapeTag::kString)) {
+    TypeError(Value::ValueKind::kString);
+  }
+  return tape_->String(idx_);
+}
+
+inline TapeArray TapeRef::GetArray() const {
+  if (NIH_UNLIKELY(this->Tag() != detail::TapeTag::kArray)) {
+    TypeError(Value::ValueKind::kArray);
+  }
+  return TapeArray{tape_, idx_ + 1, tape_->Next(idx_), this->Size()};
+}
+
+inline TapeObject TapeRef::GetObject() const {
+  if (NIH_UNLIKELY(this->Tag() != detail::TapeTag::kObject)) {
+    TypeError(Value::ValueKind::kObject);
+  }
+  return TapeObject{tape_, idx_ + 1, tape_->Next(idx_), this->Size()};
+}
+
+inline std::size_t TapeRef::Size() const {
+  auto tag = this->Tag();
+  if (NIH_UNLIKELY(tag != detail::TapeTag::kArray && tag != detail::TapeTag::kObject)) {
+    TypeError(Value::ValueKind::kArray);
+  }
+  auto n = tape_->Payload(idx_) >> JsonTape::kCountShift;
+  if (NIH_UNLIKELY(n == JsonTape::kMaxCount)) {
+    return this->CountMembers();
+  }
+  return static_cast<std::size_t>(n);
+}
+
+namespace detail {
+template <typename T>
+struct TapeTraits;
+
+template <>
+struct TapeTraits<JsonNumber> {
+  static Value::ValueKind constexpr kKind = Value::ValueKind::kNumber;
+  static float Get(TapeRef const& ref) { return ref.GetNumber(); }
+};
+template <>
+struct TapeTraits<JsonInteger> {
+  static Value::ValueKind constexpr kKind = Value::ValueKind::kInteger;
+  static int64_t Get(TapeRef const& ref) { return ref.GetInteger(); }
+};
+template <>
+struct TapeTraits<JsonBoolean> {
+  static Value::ValueKind constexpr kKind = Value::ValueKind::kBoolean;
+  static bool Get(TapeRef const& ref) { return ref.GetBoolean(); }
+};
+template <>
+struct TapeTraits<JsonString> {
+  static Value::ValueKind constexpr kKind = Value::ValueKind::kString;
+  static ConstStringRef Get(TapeRef const& ref) { return ref.GetString(); }
+};
+template <>
+struct TapeTraits<JsonArray> {
+  static Value::ValueKind constexpr kKind = Value::ValueKind::kArray;
+  static TapeArray Get(TapeRef const& ref) { return ref.GetArray(); }
+};
+template <>
+struct TapeTraits<JsonObject> {
+  static Value::ValueKind constexpr kKind = Value::ValueKind::kObject;
+  static TapeObject Get(TapeRef const& ref) { return ref.GetObject(); }
+};
+template <>
+struct TapeTraits<JsonNull> {
+  static Value::ValueKind constexpr kKind = Value::ValueKind::kNull;
+};
+}  // namespace detail
+
+/**
+ * \brief Check the type of a value in a tape, same as IsA for Json.
+ */
+template <typename T>
+bool IsA(TapeRef const& ref) {
+  return ref.Type() == detail::TapeTraits<std::remove_const_t<T>>::kKind;
+}
+
+/**
+ * \brief Read a value from a tape, same as get for Json except that values are returned
+ *        by copy.  Strings are returned as ConstStringRef, arrays and objects as
+ *        TapeArray and TapeObject views.
+ */
+template <typename T>
+auto get(TapeRef const& ref)  // NOLINT
+    -> decltype(detail::TapeTraits<std::remove_const_t<T>>::Get(ref)) {
+  return detail::TapeTraits<std::remove_const_t<T>>::Get(ref);
+}
+}  // namespace nih
+
+#endif  // NIH_JSON_TAPE_H_
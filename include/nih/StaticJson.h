@@ -0,0 +1,479 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief Compile-time parsing of JSON text embedded in the source.
+ */
+#ifndef NIH_STATIC_JSON_H_
+#define NIH_STATIC_JSON_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <system_error>
+
+#include "Charconv.h"
+#include "Json.h"
+#include "JsonGrammar.h"
+
+namespace nih {
+/**
+ * \brief A value in the flattened document.  Values are stored in document order, the
+ *        members of an object are pairs of a string node for the key and the value.
+ */
+struct StaticNode {
+  Value::ValueKind kind{Value::ValueKind::kNull};
+  /*! \brief Index past the last node of this value. */
+  std::uint32_t next{0};
+  /*! \brief Number of members for containers, length for strings. */
+  std::uint32_t size{0};
+  /*! \brief Offset of a string in the character buffer. */
+  std::uint32_t offset{0};
+  /*! \brief Value of an integer or a boolean. */
+  std::int64_t integer{0};
+  float number{0};
+};
+
+namespace detail {
+/**
+ * \brief Report an error in the embedded JSON text.  This is not constexpr, reaching it
+ *        during constant evaluation is a compile error that names this function.
+ */
+[[noreturn]] void StaticJsonError(char const* msg, std::size_t pos);
+[[noreturn]] void StaticJsonCastError(Value::ValueKind from, Value::ValueKind to);
+[[noreturn]] void StaticJsonKeyError(std::string_view key);
+[[noreturn]] void StaticJsonIndexError(std::size_t i, std::size_t size);
+
+/*! \brief Same as BitCast<float>, for constant expressions. */
+constexpr float FloatFromBits(std::uint32_t bits) {
+  auto exponent = (bits >> IEEE754::kFloatMantissaBits) & 0xffu;
+  auto mantissa = bits & ((1u << IEEE754::kFloatMantissaBits) - 1);
+  float result = 0;
+  if (exponent == 0xffu) {
+    result = mantissa == 0 ? std::numeric_limits<float>::infinity()
+                           : std::numeric_limits<float>::quiet_NaN();
+  } else {
+    // Scaling a double by powers of 2 is exact within the range of float.
+    double value =
+        exponent == 0 ? mantissa : (mantissa | (1u << IEEE754::kFloatMantissaBits));
+    auto e = static_cast<int32_t>(exponent == 0 ? 1 : exponent) -
+             static_cast<int32_t>(IEEE754::kFloatBias + IEEE754::kFloatMantissaBits);
+    for (; e > 0; --e) {
+      value *= 2;
+    }
+    for (; e < 0; ++e) {
+      value /= 2;
+    }
+    result = static_cast<float>(value);
+  }
+  return (bits >> 31) ? -result : result;
+}
+
+struct StaticJsonSize {
+  std::size_t n_nodes{0};
+  std::size_t n_chars{0};
+};
+
+/**
+ * \brief Constexpr counterpart of TextParser.  Accepts the same input as JsonReader
+ *        except for trailing characters after the value and floating point numbers with
+ *        more than 9 significant digits.
+ */
+class StaticParser {
+  // Containers are handled with an explicit stack to stay within the recursion limit of
+  // constant evaluation.
+  static constexpr std::size_t kMaxDepth = 64;
+
+  char const* beg_;
+  char const* p_;
+  char const* end_;
+
+  StaticNode* nodes_{nullptr};
+  std::size_t node_capacity_{0};
+  char* chars_{nullptr};
+  std::size_t char_capacity_{0};
+  bool count_only_;
+
+  std::size_t n_nodes_{0};
+  std::size_t n_chars_{0};
+  // Written instead of the output when only counting.
+  StaticNode scratch_{};
+
+  std::size_t stack_[kMaxDepth]{};
+  bool is_object_[kMaxDepth]{};
+  std::size_t depth_{0};
+
+  struct CharSink {
+    StaticParser* parser;
+
+    constexpr void push_back(char c) { this->append(&c, 1); }  // NOLINT
+    constexpr void append(char const* s, std::size_t n) {      // NOLINT
+      if (!parser->count_only_) {
+        if (parser->n_chars_ + n > parser->char_capacity_) {
+          parser->Error("Not enough space for strings");
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+          parser->chars_[parser->n_chars_ + i] = s[i];
+        }
+      }
+      parser->n_chars_ += n;
+    }
+  };
+
+  constexpr void Error(char const* msg) const {
+    // A constexpr function needs a path without the non-constexpr call.
+    if (msg != nullptr) {
+      StaticJsonError(msg, static_cast<std::size_t>(p_ - beg_));
+    }
+  }
+  constexpr StaticNode* Node(std::size_t i) {
+    return count_only_ ? &scratch_ : &nodes_[i];
+  }
+  constexpr StaticNode* Push(Value::ValueKind kind, bool is_key = false) {
+    if (!is_key && depth_ != 0) {
+      ++this->Node(stack_[depth_ - 1])->size;
+    }
+    if (!count_only_ && n_nodes_ == node_capacity_) {
+      this->Error("Not enough space for values");
+    }
+    if (n_nodes_ == std::numeric_limits<std::uint32_t>::max()) {
+      this->Error("Document is too large");
+    }
+    auto node = this->Node(n_nodes_);
+    ++n_nodes_;
+    node->kind = kind;
+    node->next = static_cast<std::uint32_t>(n_nodes_);
+    return node;
+  }
+
+  constexpr void SkipSpaces() {
+    while (p_ != end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) {
+      ++p_;
+    }
+  }
+  constexpr void Expect(char c) {
+    this->SkipSpaces();
+    if (p_ == end_ || *p_ != c) {
+      this->Error(c == ':' ? "Expecting: \":\"" : "Unexpected character");
+    }
+    ++p_;
+  }
+  constexpr void Literal(std::string_view lit) {
+    if (static_cast<std::size_t>(end_ - p_) < lit.size() ||
+        std::string_view{p_, lit.size()} != lit) {
+      this->Error("Unknown construct");
+    }
+    p_ += lit.size();
+  }
+  // p_ is at the opening quote.
+  constexpr void String(bool is_key) {
+    ++p_;
+    auto node = this->Push(Value::ValueKind::kString, is_key);
+    auto offset = n_chars_;
+    CharSink sink{this};
+    auto error = UnescapeString(&p_, end_, &sink, FindStringSpecialScalar);
+    if (error != nullptr) {
+      this->Error(error);
+    }
+    node->offset = static_cast<std::uint32_t>(offset);
+    node->size = static_cast<std::uint32_t>(n_chars_ - offset);
+  }
+  constexpr void Number() {
+    auto c = *p_;
+    if (c == 'N') {
+      this->Literal("NaN");
+      this->Push(Value::ValueKind::kNumber)->number =
+          std::numeric_limits<float>::quiet_NaN();
+      return;
+    }
+    std::size_t n_signs = c == '-' ? 1 : 0;
+    if (p_ + n_signs != end_ && p_[n_signs] == 'I') {
+      p_ += n_signs;
+      this->Literal("Infinity");
+      auto inf = std::numeric_limits<float>::infinity();
+      this->Push(Value::ValueKind::kNumber)->number = c == '-' ? -inf : inf;
+      return;
+    }
+    auto scan = ScanNumber(p_, end_);
+    if (!scan.valid) {
+      p_ = scan.ptr;
+      this->Error("Expecting digit");
+    }
+    if (scan.is_float) {
+      std::uint32_t bits = 0;
+      auto ret = FromCharFloatBits(p_, static_cast<int>(scan.ptr - p_), &bits);
+      if (ret.ec != std::errc()) {
+        p_ = ret.ptr;
+        this->Error(ret.ec == std::errc::result_out_of_range
+                        ? "Too many digits for a compile-time number"
+                        : "Invalid number");
+      }
+      this->Push(Value::ValueKind::kNumber)->number = FloatFromBits(bits);
+    } else {
+      this->Push(Value::ValueKind::kInteger)->integer = scan.integer;
+    }
+    p_ = scan.ptr;
+  }
+  constexpr void Key() {
+    this->SkipSpaces();
+    if (p_ == end_ || *p_ != '"') {
+      this->Error("Expecting object key");
+    }
+    this->String(true);
+    this->Expect(':');
+  }
+  constexpr void Begin(Value::ValueKind kind) {
+    if (depth_ == kMaxDepth) {
+      this->Error("Document is too deep");
+    }
+    ++p_;
+    this->Push(kind);
+    stack_[depth_] = n_nodes_ - 1;
+    is_object_[depth_] = kind == Value::ValueKind::kObject;
+    ++depth_;
+  }
+  constexpr void End() {
+    --depth_;
+    this->Node(stack_[depth_])->next = static_cast<std::uint32_t>(n_nodes_);
+  }
+
+ public:
+  /*! \brief Only compute the sizes of the buffers. */
+  constexpr explicit StaticParser(std::string_view str)
+      : beg_{str.data()},
+        p_{str.data()},
+        end_{str.data() + str.size()},
+        count_only_{true} {}
+  constexpr StaticParser(std::string_view str, StaticNode* nodes, std::size_t n_nodes,
+                         char* chars, std::size_t n_chars)
+      : beg_{str.data()},
+        p_{str.data()},
+        end_{str.data() + str.size()},
+        nodes_{nodes},
+        node_capacity_{n_nodes},
+        chars_{chars},
+        char_capacity_{n_chars},
+        count_only_{false} {}
+
+  /*! \brief Parse a single value, an empty input is a null value like Json::Load. */
+  constexpr StaticJsonSize Parse() {
+    this->SkipSpaces();
+    if (p_ == end_) {
+      this->Push(Value::ValueKind::kNull);
+      return {n_nodes_, n_chars_};
+    }
+    while (true) {
+      this->SkipSpaces();
+      if (p_ == end_) {
+        this->Error("Unexpected end of input");
+      }
+      bool closed = true;
+      switch (*p_) {
+        case '{': {
+          this->Begin(Value::ValueKind::kObject);
+          this->SkipSpaces();
+          if (p_ != end_ && *p_ == '}') {
+            ++p_;
+            this->End();
+            break;
+          }
+          this->Key();
+          closed = false;
+          break;
+        }
+        case '[': {
+          this->Begin(Value::ValueKind::kArray);
+          this->SkipSpaces();
+          if (p_ != end_ && *p_ == ']') {
+            ++p_;
+            this->End();
+            break;
+          }
+          closed = false;
+          break;
+        }
+        case '"':
+          this->String(false);
+          break;
+        case 't':
+          this->Literal("true");
+          this->Push(Value::ValueKind::kBoolean)->integer = 1;
+          break;
+        case 'f':
+          this->Literal("false");
+          this->Push(Value::ValueKind::kBoolean)->integer = 0;
+          break;
+        case 'n':
+          this->Literal("null");
+          this->Push(Value::ValueKind::kNull);
+          break;
+        default: {
+          auto c = *p_;
+          if (c != '-' && (c < '0' || c > '9') && c != 'N' && c != 'I') {
+            this->Error("Unknown construct");
+          }
+          this->Number();
+        }
+      }
+      if (!closed) {
+        continue;
+      }
+      // Close the containers ended by this value.
+      while (true) {
+        this->SkipSpaces();
+        if (depth_ == 0) {
+          if (p_ != end_) {
+            this->Error("Trailing characters after the document");
+          }
+          return {n_nodes_, n_chars_};
+        }
+        if (p_ == end_) {
+          this->Error("Unexpected end of input");
+        }
+        auto c = *p_++;
+        bool in_object = is_object_[depth_ - 1];
+        if (c == ',') {
+          if (in_object) {
+            this->Key();
+          }
+          break;
+        }
+        if (c != (in_object ? '}' : ']')) {
+          --p_;
+          this->Error(in_object ? "Expecting: \",\" or \"}\""
+                                : "Expecting: \",\" or \"]\"");
+        }
+        this->End();
+      }
+    }
+  }
+};
+
+/*! \brief Sizes of the buffers needed by StaticJson for a document. */
+constexpr StaticJsonSize MeasureStaticJson(std::string_view str) {
+  return StaticParser{str}.Parse();
+}
+}  // namespace detail
+
+/**
+ * \brief Reference to a value in a StaticJson document.
+ */
+class StaticRef {
+  StaticNode const* nodes_;
+  char const* chars_;
+  std::size_t idx_;
+
+  constexpr StaticNode const& Node() const { return nodes_[idx_]; }
+  constexpr void Check(Value::ValueKind kind) const {
+    if (this->Type() != kind) {
+      detail::StaticJsonCastError(this->Type(), kind);
+    }
+  }
+  constexpr std::string_view String(std::size_t i) const {
+    return std::string_view{chars_ + nodes_[i].offset, nodes_[i].size};
+  }
+
+ public:
+  constexpr StaticRef(StaticNode const* nodes, char const* chars, std::size_t idx)
+      : nodes_{nodes}, chars_{chars}, idx_{idx} {}
+
+  constexpr Value::ValueKind Type() const { return this->Node().kind; }
+  std::string TypeStr() const { return Value::TypeStr(this->Type()); }
+  constexpr bool IsNull() const { return this->Type() == Value::ValueKind::kNull; }
+
+  constexpr float GetNumber() const {
+    this->Check(Value::ValueKind::kNumber);
+    return this->Node().number;
+  }
+  constexpr int64_t GetInteger() const {
+    this->Check(Value::ValueKind::kInteger);
+    return this->Node().integer;
+  }
+  constexpr bool GetBoolean() const {
+    this->Check(Value::ValueKind::kBoolean);
+    return this->Node().integer != 0;
+  }
+  constexpr std::string_view GetString() const {
+    this->Check(Value::ValueKind::kString);
+    return this->String(idx_);
+  }
+  /*! \brief Number of members of an array or an object. */
+  constexpr std::size_t Size() const {
+    if (this->Type() != Value::ValueKind::kArray) {
+      this->Check(Value::ValueKind::kObject);
+    }
+    return this->Node().size;
+  }
+
+  /*! \brief Whether an object has the key. */
+  constexpr bool Contains(std::string_view key) const {
+    return this->Find(key) != 0;
+  }
+  /*! \brief Index of the value for a key, 0 if it's not found.  The last one wins for
+   *         duplicated keys, same as Json. */
+  constexpr std::size_t Find(std::string_view key) const {
+    this->Check(Value::ValueKind::kObject);
+    std::size_t found = 0;
+    auto k = idx_ + 1;
+    for (std::size_t i = 0; i < this->Node().size; ++i) {
+      if (this->String(k) == key) {
+        found = k + 1;
+      }
+      k = nodes_[k + 1].next;
+    }
+    return found;
+  }
+  constexpr StaticRef operator[](std::string_view key) const {
+    auto i = this->Find(key);
+    if (i == 0) {
+      detail::StaticJsonKeyError(key);
+    }
+    return StaticRef{nodes_, chars_, i};
+  }
+  constexpr StaticRef operator[](std::size_t i) const {
+    this->Check(Value::ValueKind::kArray);
+    if (i >= this->Node().size) {
+      detail::StaticJsonIndexError(i, this->Node().size);
+    }
+    auto k = idx_ + 1;
+    for (std::size_t j = 0; j < i; ++j) {
+      k = nodes_[k].next;
+    }
+    return StaticRef{nodes_, chars_, k};
+  }
+
+  /*! \brief Copy the value into a Json tree. */
+  Json ToJson() const;
+};
+
+/**
+ * \brief A JSON document parsed during compilation.  Use the NIH_STATIC_JSON macro to
+ *        size the buffers from the text:
+ *
+ * \code
+ *   static constexpr auto kConfig = NIH_STATIC_JSON(R"({"depth": 6, "eta": 0.3})");
+ *   static_assert(kConfig.Root()["depth"].GetInteger() == 6);
+ * \endcode
+ *
+ *   Errors in the text are reported as a call to the non-constexpr
+ *   detail::StaticJsonError in the compiler output, along with the message and position.
+ */
+template <std::size_t kNodes, std::size_t kChars>
+class StaticJson {
+  StaticNode nodes_[kNodes]{};
+  char chars_[kChars + 1]{};
+
+ public:
+  constexpr explicit StaticJson(std::string_view str) {
+    detail::StaticParser{str, nodes_, kNodes, chars_, kChars}.Parse();
+  }
+  constexpr StaticRef Root() const { return StaticRef{nodes_, chars_, 0}; }
+  Json ToJson() const { return this->Root().ToJson(); }
+};
+}  // namespace nih
+
+#define NIH_STATIC_JSON(str)                                 \
+  ::nih::StaticJson<::nih::detail::MeasureStaticJson(str).n_nodes, \
+                    ::nih::detail::MeasureStaticJson(str).n_chars>{str}
+
+#endif  // NIH_STATIC_JSON_H_
@@ -31,12 +31,14 @@
 #include <cinttypes>
 #include <cstring>
 #include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <type_traits>
 
+#include "./charconv_table.h"
 #include "nih/Charconv.h"
-
-#if defined(_MSC_VER)
-#include <intrin.h>
-#endif
+#include "nih/JsonGrammar.h"
 
 /*
  * We did some cleanup from the original implementation instead of doing line to line
@@ -73,8 +75,6 @@ static constexpr char kItoaLut[200] = {
 
 constexpr uint32_t Tens(uint32_t n) { return n == 1 ? 10 : (Tens(n - 1) * 10); }
 
-struct UnsignedFloatBase2;
-
 struct UnsignedFloatBase10 {
   uint32_t mantissa;
   // Decimal exponent's range is -45 to 38
@@ -90,24 +90,6 @@ To BitCast(From&& from) {
   return t;
 }
 
-struct IEEE754 {
-  static constexpr uint32_t kFloatMantissaBits = 23;
-  static constexpr uint32_t kFloatBias = 127;
-  static constexpr uint32_t kFloatExponentBits = 8;
-
-  static void Decode(float f, UnsignedFloatBase2* uf, bool* signbit);
-  static float Encode(UnsignedFloatBase2 const& uf, bool signbit);
-
-  static float Infinity(bool sign) {
-    uint32_t f =
-        ((static_cast<uint32_t>(sign))
-         << (IEEE754::kFloatExponentBits + IEEE754::kFloatMantissaBits)) |
-        (0xffu << IEEE754::kFloatMantissaBits);
-    float result = BitCast<float>(f);
-    return result;
-  }
-};
-
 struct UnsignedFloatBase2 {
   uint32_t mantissa;
   // Decimal exponent's range is -45 to 38
@@ -131,13 +113,10 @@ inline void IEEE754::Decode(float f, UnsignedFloatBase2 *uf, bool *signbit) {
                  ((1u << IEEE754::kFloatExponentBits) - 1);  // remove signbit
 }
 
+inline float IEEE754::Infinity(bool sign) { return BitCast<float>(InfinityBits(sign)); }
+
 inline float IEEE754::Encode(UnsignedFloatBase2 const &uf, bool signbit) {
-  uint32_t f =
-      ((((static_cast<uint32_t>(signbit)) << IEEE754::kFloatExponentBits) |
-        static_cast<uint32_t>(uf.exponent))
-       << IEEE754::kFloatMantissaBits) |
-      uf.mantissa;
-  return BitCast<float>(f);
+  return BitCast<float>(EncodeBits(uf.mantissa, uf.exponent, signbit));
 }
 
 // Represents the interval of information-preserving outputs.
@@ -151,171 +130,6 @@ struct MantissaInteval {
   uint32_t mantissa_high;
 };
 
-struct RyuPowLogUtils {
-  // This table is generated by PrintFloatLookupTable from ryu.  We adopted only the float
-  // 32 table instead of double full table.
-  // f2s_full_table.h
-  uint32_t constexpr static kFloatPow5InvBitcount = 59;
-  static constexpr uint64_t kFloatPow5InvSplit[55] = {
-      576460752303423489u, 461168601842738791u, 368934881474191033u,
-      295147905179352826u, 472236648286964522u, 377789318629571618u,
-      302231454903657294u, 483570327845851670u, 386856262276681336u,
-      309485009821345069u, 495176015714152110u, 396140812571321688u,
-      316912650057057351u, 507060240091291761u, 405648192073033409u,
-      324518553658426727u, 519229685853482763u, 415383748682786211u,
-      332306998946228969u, 531691198313966350u, 425352958651173080u,
-      340282366920938464u, 544451787073501542u, 435561429658801234u,
-      348449143727040987u, 557518629963265579u, 446014903970612463u,
-      356811923176489971u, 570899077082383953u, 456719261665907162u,
-      365375409332725730u, 292300327466180584u, 467680523945888934u,
-      374144419156711148u, 299315535325368918u, 478904856520590269u,
-      383123885216472215u, 306499108173177772u, 490398573077084435u,
-      392318858461667548u, 313855086769334039u, 502168138830934462u,
-      401734511064747569u, 321387608851798056u, 514220174162876889u,
-      411376139330301511u, 329100911464241209u, 526561458342785934u,
-      421249166674228747u, 336999333339382998u, 539198933343012796u,
-      431359146674410237u, 345087317339528190u, 552139707743245103u,
-      441711766194596083u};
-
-  uint32_t constexpr static kFloatPow5Bitcount = 61;
-  static constexpr uint64_t kFloatPow5Split[47] = {
-      1152921504606846976u, 1441151880758558720u, 1801439850948198400u,
-      2251799813685248000u, 1407374883553280000u, 1759218604441600000u,
-      2199023255552000000u, 1374389534720000000u, 1717986918400000000u,
-      2147483648000000000u, 1342177280000000000u, 1677721600000000000u,
-      2097152000000000000u, 1310720000000000000u, 1638400000000000000u,
-      2048000000000000000u, 1280000000000000000u, 1600000000000000000u,
-      2000000000000000000u, 1250000000000000000u, 1562500000000000000u,
-      1953125000000000000u, 1220703125000000000u, 1525878906250000000u,
-      1907348632812500000u, 1192092895507812500u, 1490116119384765625u,
-      1862645149230957031u, 1164153218269348144u, 1455191522836685180u,
-      1818989403545856475u, 2273736754432320594u, 1421085471520200371u,
-      1776356839400250464u, 2220446049250313080u, 1387778780781445675u,
-      1734723475976807094u, 2168404344971008868u, 1355252715606880542u,
-      1694065894508600678u, 2117582368135750847u, 1323488980084844279u,
-      1654361225106055349u, 2067951531382569187u, 1292469707114105741u,
-      1615587133892632177u, 2019483917365790221u};
-
-  static uint32_t Pow5Factor(uint32_t value) noexcept(true) {
-    uint32_t count = 0;
-    for (;;) {
-      const uint32_t q = value / 5;
-      const uint32_t r = value % 5;
-      if (r != 0) {
-        break;
-      }
-      value = q;
-      ++count;
-    }
-    return count;
-  }
-
-  // Returns true if value is divisible by 5^p.
-  static bool MultipleOfPowerOf5(const uint32_t value, const uint32_t p) noexcept(true) {
-    return Pow5Factor(value) >= p;
-  }
-
-  // Returns true if value is divisible by 2^p.
-  static bool MultipleOfPowerOf2(const uint32_t value, const uint32_t p) noexcept(true) {
-#ifdef __GNUC__
-    return static_cast<uint32_t>(__builtin_ctz(value)) >= p;
-#else
-    return (value & ((1u << p) - 1)) == 0;
-#endif  //  __GNUC__
-  }
-
-  // Returns e == 0 ? 1 : ceil(log_2(5^e)).
-  static uint32_t Pow5Bits(const int32_t e) noexcept(true) {
-    return static_cast<uint32_t>(((e * 163391164108059ull) >> 46) + 1);
-  }
-
-  static int32_t Log2Pow5(const int32_t e) {
-    // This approximation works up to the point that the multiplication
-    // overflows at e = 3529. If the multiplication were done in 64 bits, it
-    // would fail at 5^4004 which is just greater than 2^9297.
-    assert(e >= 0);
-    assert(e <= 3528);
-    return static_cast<int32_t>(((static_cast<uint32_t>(e)) * 1217359) >> 19);
-  }
-
-  static int32_t CeilLog2Pow5(const int32_t e) {
-    return RyuPowLogUtils::Log2Pow5(e) + 1;
-  }
-
-  /*
-   * \brief Multiply 32-bit and 64-bit -> 128 bit, then access the higher bits.
-   */
-  static uint32_t MulShift(const uint32_t x, const uint64_t y,
-                           const int32_t shift) noexcept(true) {
-    // For 32-bit * 64-bit: x * y, it can be decomposed into:
-    //
-    //   x * (y_high + y_low) = (x * y_high) + (x * y_low)
-    //
-    // For more general case 64-bit * 64-bit, see https://stackoverflow.com/a/1541458
-    const uint32_t y_low = static_cast<uint32_t>(y);
-    const uint32_t y_high = static_cast<uint32_t>(y >> 32);
-
-    const uint64_t low = static_cast<uint64_t>(x) * y_low;
-    const uint64_t high = static_cast<uint64_t>(x) * y_high;
-
-    const uint64_t sum = (low >> 32) + high;
-    const uint64_t shifted_sum = sum >> (shift - 32);
-
-    return static_cast<uint32_t>(shifted_sum);
-  }
-
-  /*
-   * \brief floor(5^q/2*k) and shift by j
-   */
-  static uint32_t MulPow5InvDivPow2(const uint32_t m, const uint32_t q,
-                                    const int32_t j) noexcept(true) {
-    return MulShift(m, kFloatPow5InvSplit[q], j);
-  }
-
-  /*
-   * \brief floor(2^k/5^q) + 1 and shift by j
-   */
-  static uint32_t MulPow5divPow2(const uint32_t m, const uint32_t i,
-                                 const int32_t j) noexcept(true) {
-    // clang-tidy makes false assumption that can lead to i >= 47, which is impossible.
-    // Can be verified by enumerating all float32 values.
-    return MulShift(m, kFloatPow5Split[i], j);  // NOLINT
-  }
-
-  static uint32_t FloorLog2(const uint32_t value) {
-#if defined(_MSC_VER)
-    unsigned long index;  // NOLINT
-    return _BitScanReverse(&index, value) ? index : 32;
-#else
-    return 31 - __builtin_clz(value);
-#endif
-  }
-
-  /*
-   * \brief floor(e * log_10(2)).
-   */
-  static uint32_t Log10Pow2(const int32_t e) noexcept(true) {
-    // The first value this approximation fails for is 2^1651 which is just
-    // greater than 10^297.
-    assert(e >= 0);
-    assert(e <= 1 << 15);
-    return static_cast<uint32_t>((static_cast<uint64_t>(e) * 169464822037455ull) >> 49);
-  }
-
-  // Returns floor(e * log_10(5)).
-  static uint32_t Log10Pow5(const int32_t expoent) noexcept(true) {
-    // The first value this approximation fails for is 5^2621 which is just
-    // greater than 10^1832.
-    assert(expoent >= 0);
-    assert(expoent <= 1 << 15);
-    return static_cast<uint32_t>(
-        ((static_cast<uint64_t>(expoent)) * 196742565691928ull) >> 48);
-  }
-};
-
-constexpr uint64_t RyuPowLogUtils::kFloatPow5InvSplit[55];
-constexpr uint64_t RyuPowLogUtils::kFloatPow5Split[47];
-
 class PowerBaseComputer {
  private:
   static uint8_t
@@ -743,6 +557,267 @@ to_chars_result ToCharsUnsignedImpl(char *first, char *last,
  */
 from_chars_result FromCharFloatImpl(const char *buffer, const int len,
                                     float *result) {
+  uint32_t bits = 0;
+  auto ret = FromCharFloatBits(buffer, len, &bits);
+  if (ret.ec == std::errc()) {
+    *result = BitCast<float>(bits);
+  }
+  return ret;
+}
+// ====================== Double ==================
+
+/*
+ * 64-bit version of the conversions above, following d2s.c and s2d.c from ryu.  The
+ * 128-bit products use the full lookup tables in charconv_table.h.
+ */
+namespace {
+constexpr uint32_t kDoubleMantissaBits = 52;
+constexpr uint32_t kDoubleExponentBits = 11;
+constexpr int32_t kDoubleBias = 1023;
+
+inline uint32_t FloorLog2(uint64_t value) {
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(value);
+#else
+  uint32_t index = 0;
+  for (; value > 1; value >>= 1) {
+    ++index;
+  }
+  return index;
+#endif  // defined(__GNUC__)
+}
+
+inline uint32_t Pow5Factor(uint64_t value) {
+  uint32_t count = 0;
+  while (value % 5 == 0) {
+    value /= 5;
+    ++count;
+  }
+  return count;
+}
+
+// Returns true if value is divisible by 5^p.
+inline bool MultipleOfPowerOf5(uint64_t value, uint32_t p) {
+  return Pow5Factor(value) >= p;
+}
+
+// Returns true if value is divisible by 2^p, p < 64.
+inline bool MultipleOfPowerOf2(uint64_t value, uint32_t p) {
+  return (value & ((1ull << p) - 1)) == 0;
+}
+
+/*
+ * \brief Multiply 64-bit and 128-bit -> 192 bit, then take the bits from j.
+ */
+inline uint64_t MulShift64(uint64_t m, uint64_t const *mul, int32_t j) {
+  assert(j >= 64 && j < 128);
+#if defined(__SIZEOF_INT128__)
+  using U128 = unsigned __int128;
+  U128 const low = static_cast<U128>(m) * mul[0];
+  U128 const high = static_cast<U128>(m) * mul[1];
+  return static_cast<uint64_t>(((low >> 64) + high) >> (j - 64));
+#else
+  auto umul128 = [](uint64_t a, uint64_t b, uint64_t *hi) {
+    uint64_t const a_lo = static_cast<uint32_t>(a), a_hi = a >> 32;
+    uint64_t const b_lo = static_cast<uint32_t>(b), b_hi = b >> 32;
+    uint64_t const b00 = a_lo * b_lo, b01 = a_lo * b_hi;
+    uint64_t const b10 = a_hi * b_lo, b11 = a_hi * b_hi;
+    uint64_t const mid1 = b10 + (b00 >> 32);
+    uint64_t const mid2 = b01 + static_cast<uint32_t>(mid1);
+    *hi = b11 + (mid1 >> 32) + (mid2 >> 32);
+    return (mid2 << 32) | static_cast<uint32_t>(b00);
+  };
+  uint64_t high0 = 0, high1 = 0;
+  umul128(m, mul[0], &high0);
+  uint64_t const low1 = umul128(m, mul[1], &high1);
+  uint64_t const sum = high0 + low1;
+  if (sum < high0) {
+    ++high1;
+  }
+  auto const dist = j - 64;
+  return dist == 0 ? sum : (high1 << (64 - dist)) | (sum >> dist);
+#endif  // defined(__SIZEOF_INT128__)
+}
+
+struct UnsignedDoubleBase10 {
+  uint64_t mantissa;
+  int32_t exponent;
+};
+
+UnsignedDoubleBase10 Binary2Decimal(uint64_t ieee_mantissa, uint32_t ieee_exponent) {
+  int32_t exp_b2 = 0;
+  uint64_t mantissa_b2 = 0;
+  if (ieee_exponent == 0) {
+    // We subtract 2 so that the bounds computation has 2 additional bits.
+    exp_b2 = 1 - kDoubleBias - static_cast<int32_t>(kDoubleMantissaBits) - 2;
+    mantissa_b2 = ieee_mantissa;
+  } else {
+    exp_b2 = static_cast<int32_t>(ieee_exponent) - kDoubleBias -
+             static_cast<int32_t>(kDoubleMantissaBits) - 2;
+    mantissa_b2 = (1ull << kDoubleMantissaBits) | ieee_mantissa;
+  }
+  bool const accept_bounds = (mantissa_b2 & 1) == 0;
+
+  // Determine the interval of valid decimal representations.
+  uint64_t const mantissa_correct = 4 * mantissa_b2;
+  uint32_t const mantissa_low_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+
+  // Convert to a decimal power base using 128-bit arithmetic.
+  uint64_t out = 0, high = 0, low = 0;
+  int32_t exp_b10 = 0;
+  bool low_is_trailing_zeros = false;
+  bool out_is_trailing_zeros = false;
+  auto mul_shift_all = [&](uint64_t const *mul, int32_t j) {
+    out = MulShift64(mantissa_correct, mul, j);
+    high = MulShift64(mantissa_correct + 2, mul, j);
+    low = MulShift64(mantissa_correct - 1 - mantissa_low_shift, mul, j);
+  };
+  if (exp_b2 >= 0) {
+    // One digit less than needed so that the last removed digit is known.
+    uint32_t const q = RyuPowLogUtils::Log10Pow2(exp_b2) - (exp_b2 > 3);
+    exp_b10 = static_cast<int32_t>(q);
+    int32_t const k =
+        kDoublePow5InvBitcount + RyuPowLogUtils::Pow5Bits(static_cast<int32_t>(q)) - 1;
+    int32_t const i = -exp_b2 + static_cast<int32_t>(q) + k;
+    mul_shift_all(kDoublePow5InvSplit[q], i);
+    if (q <= 21) {
+      // Only one of high, out and low can be a multiple of 5, if any.
+      if (mantissa_correct % 5 == 0) {
+        out_is_trailing_zeros = MultipleOfPowerOf5(mantissa_correct, q);
+      } else if (accept_bounds) {
+        low_is_trailing_zeros =
+            MultipleOfPowerOf5(mantissa_correct - 1 - mantissa_low_shift, q);
+      } else {
+        high -= MultipleOfPowerOf5(mantissa_correct + 2, q);
+      }
+    }
+  } else {
+    uint32_t const q = RyuPowLogUtils::Log10Pow5(-exp_b2) - (-exp_b2 > 1);
+    exp_b10 = static_cast<int32_t>(q) + exp_b2;
+    int32_t const i = -exp_b2 - static_cast<int32_t>(q);
+    int32_t const k = RyuPowLogUtils::Pow5Bits(i) - kDoublePow5Bitcount;
+    int32_t const j = static_cast<int32_t>(q) - k;
+    mul_shift_all(kDoublePow5Split[i], j);
+    if (q <= 1) {
+      // mantissa_correct = 4 * m2, so it always has at least two trailing 0 bits.
+      out_is_trailing_zeros = true;
+      if (accept_bounds) {
+        low_is_trailing_zeros = mantissa_low_shift == 1;
+      } else {
+        --high;
+      }
+    } else if (q < 63) {
+      out_is_trailing_zeros = MultipleOfPowerOf2(mantissa_correct, q);
+    }
+  }
+
+  // Find the shortest decimal representation in the interval.
+  int32_t removed = 0;
+  uint8_t last_removed_digit = 0;
+  uint64_t output = 0;
+  if (low_is_trailing_zeros || out_is_trailing_zeros) {
+    // General case, which happens rarely (~0.7%).
+    while (high / 10 > low / 10) {
+      low_is_trailing_zeros &= low % 10 == 0;
+      out_is_trailing_zeros &= last_removed_digit == 0;
+      last_removed_digit = static_cast<uint8_t>(out % 10);
+      out /= 10;
+      high /= 10;
+      low /= 10;
+      ++removed;
+    }
+    if (low_is_trailing_zeros) {
+      while (low % 10 == 0) {
+        out_is_trailing_zeros &= last_removed_digit == 0;
+        last_removed_digit = static_cast<uint8_t>(out % 10);
+        out /= 10;
+        high /= 10;
+        low /= 10;
+        ++removed;
+      }
+    }
+    if (out_is_trailing_zeros && last_removed_digit == 5 && out % 2 == 0) {
+      // Round even if the exact number is .....50..0.
+      last_removed_digit = 4;
+    }
+    output = out + ((out == low && (!accept_bounds || !low_is_trailing_zeros)) ||
+                    last_removed_digit >= 5);
+  } else {
+    // Specialized for the common case (~99.3%).
+    bool round_up = false;
+    if (high / 100 > low / 100) {
+      // Remove two digits at a time.
+      round_up = out % 100 >= 50;
+      out /= 100;
+      high /= 100;
+      low /= 100;
+      removed += 2;
+    }
+    while (high / 10 > low / 10) {
+      round_up = out % 10 >= 5;
+      out /= 10;
+      high /= 10;
+      low /= 10;
+      ++removed;
+    }
+    output = out + (out == low || round_up);
+  }
+  return {output, exp_b10 + removed};
+}
+
+int32_t PrintBase10Double(UnsignedDoubleBase10 v, bool sign, char *const result) {
+  int32_t index = 0;
+  if (sign) {
+    result[index++] = '-';
+  }
+  // Print the digits one position to the right, then move the first one before the
+  // decimal point.
+  auto const out_length = ShortestDigit10(v.mantissa);
+  ItoaUnsignedImpl(result + index + 1, out_length, v.mantissa);
+  result[index] = result[index + 1];
+  if (out_length > 1) {
+    result[index + 1] = '.';
+    index += out_length + 1;
+  } else {
+    ++index;
+  }
+
+  result[index++] = 'E';
+  int32_t exp = v.exponent + static_cast<int32_t>(out_length) - 1;
+  if (exp < 0) {
+    result[index++] = '-';
+    exp = -exp;
+  }
+  if (exp >= 100) {
+    result[index++] = static_cast<char>('0' + exp / 100);
+    std::memcpy(result + index, kItoaLut + 2 * (exp % 100), 2);
+    index += 2;
+  } else if (exp >= 10) {
+    std::memcpy(result + index, kItoaLut + 2 * exp, 2);
+    index += 2;
+  } else {
+    result[index++] = static_cast<char>('0' + exp);
+  }
+  return index;
+}
+}  // anonymous namespace
+
+int32_t ToCharsDoubleImpl(double f, char *const result) {
+  auto const bits = BitCast<uint64_t>(f);
+  bool const sign = (bits >> (kDoubleMantissaBits + kDoubleExponentBits)) != 0;
+  uint64_t const mantissa = bits & ((1ull << kDoubleMantissaBits) - 1);
+  auto const exponent = static_cast<uint32_t>((bits >> kDoubleMantissaBits) &
+                                              ((1u << kDoubleExponentBits) - 1));
+
+  if (exponent == ((1u << kDoubleExponentBits) - 1) || (exponent == 0 && mantissa == 0)) {
+    // Same output as the float version for NaN, infinity and zero.
+    UnsignedFloatBase2 special{mantissa != 0, exponent != 0};
+    return RyuPrinter::PrintSpecialFloat(sign, special, result);
+  }
+  return PrintBase10Double(Binary2Decimal(mantissa, exponent), sign, result);
+}
+
+from_chars_result FromCharDoubleImpl(const char *buffer, const int len, double *result) {
   if (len == 0) {
     return {buffer, std::errc::invalid_argument};
   }
@@ -750,8 +825,11 @@ from_chars_result FromCharFloatImpl(const char *buffer, const int len,
   int32_t e10digits = 0;
   int32_t dot_ind = len;
   int32_t e_ind = len;
-  uint32_t mantissa_b10 = 0;
+  uint64_t mantissa_b10 = 0;
   int32_t exp_b10 = 0;
+  // Trailing zeros of the mantissa that are not multiplied in yet, so that numbers like
+  // 1.50000000000000000000 don't count as long mantissas.
+  int32_t zeros = 0;
   bool signed_mantissa = false;
   bool signed_exp = false;
   int32_t i = 0;
@@ -771,9 +849,17 @@ from_chars_result FromCharFloatImpl(const char *buffer, const int len,
     if ((c < '0') || (c > '9')) {
       break;
     }
-    if (m10digits >= 9) {
+    if (c == '0' && mantissa_b10 != 0) {
+      ++zeros;
+      continue;
+    }
+    if (m10digits + zeros >= 17) {
       return {buffer + i, std::errc::result_out_of_range};
     }
+    for (; zeros != 0; --zeros) {
+      mantissa_b10 *= 10;
+      ++m10digits;
+    }
     mantissa_b10 = 10 * mantissa_b10 + (c - '0');
     if (mantissa_b10 != 0) {
       m10digits++;
@@ -808,134 +894,374 @@ from_chars_result FromCharFloatImpl(const char *buffer, const int len,
     exp_b10 = -exp_b10;
   }
   exp_b10 -= dot_ind < e_ind ? e_ind - dot_ind - 1 : 0;
-  if (mantissa_b10 == 0) {
-    *result = signed_mantissa ? -0.0f : 0.0f;
-    return {};
-  }
-
-  if ((m10digits + exp_b10 <= -46) || (mantissa_b10 == 0)) {
-    // Number is less than 1e-46, which should be rounded down to 0; return
-    // +/-0.0.
-    uint32_t ieee =
-        (static_cast<uint32_t>(signed_mantissa))
-        << (IEEE754::kFloatExponentBits + IEEE754::kFloatMantissaBits);
-    *result = BitCast<float>(ieee);
-    return {};
-  }
-  if (m10digits + exp_b10 >= 40) {
-    // Number is larger than 1e+39, which should be rounded to +/-Infinity.
-    *result = IEEE754::Infinity(signed_mantissa);
-    return {};
-  }
-
-  // Convert to binary float m2 * 2^e2, while retaining information about
-  // whether the conversion was exact (trailingZeros).
-  int32_t exp_b2;
-  uint32_t mantissa_b2;
-  bool trailing_zeros;
+  exp_b10 += zeros;
+  uint64_t const sign_bit = static_cast<uint64_t>(signed_mantissa)
+                            << (kDoubleMantissaBits + kDoubleExponentBits);
+  if (mantissa_b10 == 0 || m10digits + exp_b10 <= -324) {
+    // Zero, or less than the smallest subnormal, which is rounded down to 0.
+    *result = BitCast<double>(sign_bit);
+    return {buffer + len, std::errc()};
+  }
+  uint64_t const infinity = sign_bit | (0x7ffull << kDoubleMantissaBits);
+  if (m10digits + exp_b10 >= 310) {
+    // Number is larger than 1e+309, which should be rounded to +/-Infinity.
+    *result = BitCast<double>(infinity);
+    return {buffer + len, std::errc()};
+  }
+
+  // Convert to binary float m2 * 2^e2, while retaining information about whether the
+  // conversion was exact (trailing_zeros).  See FromCharFloatBits for details.
+  int32_t exp_b2 = 0;
+  uint64_t mantissa_b2 = 0;
+  bool trailing_zeros = false;
   if (exp_b10 >= 0) {
-    // The length of m * 10^e in bits is:
-    //   log2(m10 * 10^e10) = log2(m10) + e10 log2(10) = log2(m10) + e10 + e10 *
-    //   log2(5)
-    //
-    // We want to compute the IEEE754::kFloatMantissaBits + 1 top-most bits (+1 for the
-    // implicit leading one in IEEE format). We therefore choose a binary output
-    // exponent of
-    //   log2(m10 * 10^e10) - (IEEE754::kFloatMantissaBits + 1).
-    //
-    // We use floor(log2(5^e10)) so that we get at least this many bits; better
-    // to have an additional bit than to not have enough bits.
-    exp_b2 = RyuPowLogUtils::FloorLog2(mantissa_b10) + exp_b10 +
-             RyuPowLogUtils::Log2Pow5(exp_b10) -
-             (IEEE754::kFloatMantissaBits + 1);
-
-    // We now compute [m10 * 10^e10 / 2^e2] = [m10 * 5^e10 / 2^(e2-e10)].
-    // To that end, we use the RyuPowLogUtils::kFloatPow5Bitcount table.
-    int j = exp_b2 - exp_b10 - RyuPowLogUtils::CeilLog2Pow5(exp_b10) +
-            RyuPowLogUtils::kFloatPow5Bitcount;
-    assert(j >= 0);
-    mantissa_b2 = RyuPowLogUtils::MulPow5divPow2(mantissa_b10, exp_b10, j);
-
-    // We also compute if the result is exact, i.e.,
-    //   [m10 * 10^e10 / 2^e2] == m10 * 10^e10 / 2^e2.
-    // This can only be the case if 2^e2 divides m10 * 10^e10, which in turn
-    // requires that the largest power of 2 that divides m10 + e10 is greater
-    // than e2. If e2 is less than e10, then the result must be exact. Otherwise
-    // we use the existing multipleOfPowerOf2 function.
+    exp_b2 = FloorLog2(mantissa_b10) + exp_b10 + RyuPowLogUtils::Log2Pow5(exp_b10) -
+             (kDoubleMantissaBits + 1);
+    int32_t j = exp_b2 - exp_b10 - RyuPowLogUtils::CeilLog2Pow5(exp_b10) +
+                kDoublePow5Bitcount;
+    mantissa_b2 = MulShift64(mantissa_b10, kDoublePow5Split[exp_b10], j);
     trailing_zeros =
         exp_b2 < exp_b10 ||
-        (exp_b2 - exp_b10 < 32 &&
-         RyuPowLogUtils::MultipleOfPowerOf2(mantissa_b10, exp_b2 - exp_b10));
+        (exp_b2 - exp_b10 < 64 && MultipleOfPowerOf2(mantissa_b10, exp_b2 - exp_b10));
   } else {
-    exp_b2 = RyuPowLogUtils::FloorLog2(mantissa_b10) + exp_b10 -
-             RyuPowLogUtils::CeilLog2Pow5(-exp_b10) -
-             (IEEE754::kFloatMantissaBits + 1);
-
-    // We now compute [m10 * 10^e10 / 2^e2] = [m10 / (5^(-e10) 2^(e2-e10))].
-    int j = exp_b2 - exp_b10 + RyuPowLogUtils::CeilLog2Pow5(-exp_b10) - 1 +
-            RyuPowLogUtils::kFloatPow5InvBitcount;
-    mantissa_b2 = RyuPowLogUtils::MulPow5InvDivPow2(mantissa_b10, -exp_b10, j);
-
-    // We also compute if the result is exact, i.e.,
-    //   [m10 / (5^(-e10) 2^(e2-e10))] == m10 / (5^(-e10) 2^(e2-e10))
-    //
-    // If e2-e10 >= 0, we need to check whether (5^(-e10) 2^(e2-e10)) divides
-    // m10, which is the case iff pow5(m10) >= -e10 AND pow2(m10) >= e2-e10.
-    //
-    // If e2-e10 < 0, we have actually computed [m10 * 2^(e10 e2) / 5^(-e10)]
-    // above, and we need to check whether 5^(-e10) divides (m10 * 2^(e10-e2)),
-    // which is the case iff pow5(m10 * 2^(e10-e2)) = pow5(m10) >= -e10.
+    exp_b2 = FloorLog2(mantissa_b10) + exp_b10 - RyuPowLogUtils::CeilLog2Pow5(-exp_b10) -
+             (kDoubleMantissaBits + 1);
+    int32_t j = exp_b2 - exp_b10 + RyuPowLogUtils::CeilLog2Pow5(-exp_b10) - 1 +
+                kDoublePow5InvBitcount;
+    mantissa_b2 = MulShift64(mantissa_b10, kDoublePow5InvSplit[-exp_b10], j);
     trailing_zeros =
         (exp_b2 < exp_b10 ||
-         (exp_b2 - exp_b10 < 32 && RyuPowLogUtils::MultipleOfPowerOf2(
-                                       mantissa_b10, exp_b2 - exp_b10))) &&
-        RyuPowLogUtils::MultipleOfPowerOf5(mantissa_b10, -exp_b10);
+         (exp_b2 - exp_b10 < 64 && MultipleOfPowerOf2(mantissa_b10, exp_b2 - exp_b10))) &&
+        MultipleOfPowerOf5(mantissa_b10, -exp_b10);
   }
 
   // Compute the final IEEE exponent.
-  uint32_t f_e2 =
-      std::max(static_cast<int32_t>(0),
-               static_cast<int32_t>(exp_b2 + IEEE754::kFloatBias +
-                                    RyuPowLogUtils::FloorLog2(mantissa_b2)));
-
-  if (f_e2 > 0xfe) {
-    // Final IEEE exponent is larger than the maximum representable; return
-    // +/-Infinity.
-    *result = IEEE754::Infinity(signed_mantissa);
-    return {};
-  }
-
-  // We need to figure out how much we need to shift m2. The tricky part is that
-  // we need to take the final IEEE exponent into account, so we need to reverse
-  // the bias and also special-case the value 0.
-  int32_t shift = (f_e2 == 0 ? 1 : f_e2) - exp_b2 - IEEE754::kFloatBias -
-                  IEEE754::kFloatMantissaBits;
+  auto f_e2 = static_cast<uint32_t>(
+      std::max(0, exp_b2 + kDoubleBias + static_cast<int32_t>(FloorLog2(mantissa_b2))));
+  if (f_e2 > 0x7fe) {
+    *result = BitCast<double>(infinity);
+    return {buffer + len, std::errc()};
+  }
+  int32_t shift = (f_e2 == 0 ? 1 : static_cast<int32_t>(f_e2)) - exp_b2 - kDoubleBias -
+                  static_cast<int32_t>(kDoubleMantissaBits);
   assert(shift >= 0);
-
-  // We need to round up if the exact value is more than 0.5 above the value we
-  // computed. That's equivalent to checking if the last removed bit was 1 and
-  // either the value was not just trailing zeros or the result would otherwise
-  // be odd.
-  //
-  // We need to update trailingZeros given that we have the exact output
-  // exponent ieee_e2 now.
-  trailing_zeros &= (mantissa_b2 & ((1u << (shift - 1)) - 1)) == 0;
-  uint32_t lastRemovedBit = (mantissa_b2 >> (shift - 1)) & 1;
-  bool roundup = (lastRemovedBit != 0) &&
+  // Round to the nearest even, same as the float version.
+  trailing_zeros &= (mantissa_b2 & ((1ull << (shift - 1)) - 1)) == 0;
+  uint64_t last_removed_bit = (mantissa_b2 >> (shift - 1)) & 1;
+  bool roundup = (last_removed_bit != 0) &&
                  (!trailing_zeros || (((mantissa_b2 >> shift) & 1) != 0));
-
-  uint32_t f_m2 = (mantissa_b2 >> shift) + roundup;
-  assert(f_m2 <= (1u << (IEEE754::kFloatMantissaBits + 1)));
-  f_m2 &= (1u << IEEE754::kFloatMantissaBits) - 1;
+  uint64_t f_m2 = (mantissa_b2 >> shift) + roundup;
+  assert(f_m2 <= (1ull << (kDoubleMantissaBits + 1)));
+  f_m2 &= (1ull << kDoubleMantissaBits) - 1;
   if (f_m2 == 0 && roundup) {
-    // Rounding up may overflow the mantissa.
-    // In this case we move a trailing zero of the mantissa into the exponent.
-    // Due to how the IEEE represents +/-Infinity, we don't need to check for
-    // overflow here.
+    // Rounding up may overflow the mantissa, the carry goes into the exponent.
     f_e2++;
   }
-  *result = IEEE754::Encode({f_m2, f_e2}, signed_mantissa);
-  return {};
+  *result = BitCast<double>(sign_bit |
+                            (static_cast<uint64_t>(f_e2) << kDoubleMantissaBits) | f_m2);
+  return {buffer + len, std::errc()};
+}
+}  // namespace detail
+
+// ====================== Batch ==================
+
+namespace {
+// Bytes that can be written past the end of a value, see WriteUnsigned.
+std::size_t constexpr kBatchSlack = 8;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/*
+ * \brief Decimal digits of v < 10^8, one per byte with the most significant digit in the
+ *        lowest byte.  The 4 halves, then 8 quarters of the number are split in parallel
+ *        within the lanes of a 64-bit integer, divisions are replaced by multiplications
+ *        that are exact in the ranges.
+ */
+inline uint64_t Digits8(uint64_t v) {
+  // Two 32-bit lanes, each holds 4 digits.
+  uint64_t merged = (v / 10000) | ((v % 10000) << 32);
+  uint64_t hundreds = ((merged * 10486) >> 20) & 0x0000007F0000007Full;
+  // Four 16-bit lanes, each holds 2 digits.
+  uint64_t pairs = ((merged - hundreds * 100) << 16) | hundreds;
+  uint64_t tens = ((pairs * 103) >> 10) & 0x000F000F000F000Full;
+  return ((pairs - tens * 10) << 8) | tens;
+}
+
+// Write v < 10^8 without leading zeros, 8 bytes are stored regardless of the length.
+inline char *WriteDigits8(char *out, uint64_t v) {
+  auto digits = Digits8(v);
+#if defined(__GNUC__)
+  auto skip = static_cast<uint32_t>(__builtin_ctzll(digits)) / 8;
+#else
+  uint32_t skip = 0;
+  while (((digits >> (skip * 8)) & 0xff) == 0) {
+    ++skip;
+  }
+#endif  // defined(__GNUC__)
+  digits = (digits + 0x3030303030303030ull) >> (skip * 8);
+  std::memcpy(out, &digits, sizeof(digits));
+  return out + (8 - skip);
+}
+
+// Write all 8 digits of v < 10^8.
+inline char *WriteDigits8Padded(char *out, uint64_t v) {
+  auto digits = Digits8(v) + 0x3030303030303030ull;
+  std::memcpy(out, &digits, sizeof(digits));
+  return out + 8;
+}
+
+char *WriteUnsigned(char *out, uint64_t v) {
+  if (v < 10) {
+    *out = static_cast<char>('0' + v);
+    return out + 1;
+  }
+  if (v < 100) {
+    std::memcpy(out, detail::kItoaLut + v * 2, 2);
+    return out + 2;
+  }
+  auto constexpr k8 = detail::Tens(8);
+  if (v < k8) {
+    return WriteDigits8(out, v);
+  }
+  auto constexpr k16 = static_cast<uint64_t>(k8) * k8;
+  if (v < k16) {
+    out = WriteDigits8(out, v / k8);
+    return WriteDigits8Padded(out, v % k8);
+  }
+  out = WriteDigits8(out, v / k16);
+  out = WriteDigits8Padded(out, (v / k8) % k8);
+  return WriteDigits8Padded(out, v % k8);
+}
+
+char *WriteValue(char *out, int64_t v) {
+  uint64_t u = v;
+  if (v < 0) {
+    *out++ = '-';
+    u = ~u + 1;
+  }
+  return WriteUnsigned(out, u);
+}
+#else
+char *WriteValue(char *out, int64_t v) {
+  return to_chars(out, out + NumericLimits<int64_t>::kToCharsSize, v).ptr;
+}
+#endif  // __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+char *WriteValue(char *out, float v) { return out + detail::ToCharsFloatImpl(v, out); }
+
+template <typename T>
+to_chars_result ToCharsBatchImpl(char *first, char *last, Span<T const> values,
+                                 char delimiter) {
+  using Elem = std::conditional_t<std::is_floating_point<T>::value, T, int64_t>;
+  // Room for a delimiter and a value.
+  auto constexpr kSize = NumericLimits<T>::kToCharsSize + 1;
+  auto write = [delimiter](char *out, std::size_t i, T v) {
+    if (i != 0) {
+      *out++ = delimiter;
+    }
+    return WriteValue(out, static_cast<Elem>(v));
+  };
+
+  char *p = first;
+  std::size_t n = values.size();
+  auto capacity = static_cast<std::size_t>(last - first);
+  auto n_unchecked =
+      capacity < kBatchSlack ? 0 : std::min(n, (capacity - kBatchSlack) / kSize);
+  std::size_t i = 0;
+  for (; i < n_unchecked; ++i) {
+    p = write(p, i, values[i]);
+  }
+  // Close to the end of the buffer, write into a temporary buffer first.
+  for (; i < n; ++i) {
+    char buf[kSize + kBatchSlack];
+    auto len = static_cast<std::size_t>(write(buf, i, values[i]) - buf);
+    if (len > static_cast<std::size_t>(last - p)) {
+      return {p, std::errc::value_too_large};
+    }
+    std::memcpy(p, buf, len);
+    p += len;
+  }
+  return {p, std::errc()};
+}
+}  // anonymous namespace
+
+to_chars_result to_chars(char *first, char *last, Span<float const> values,  // NOLINT
+                         char delimiter) {
+  return ToCharsBatchImpl(first, last, values, delimiter);
+}
+to_chars_result to_chars(char *first, char *last, Span<int64_t const> values,  // NOLINT
+                         char delimiter) {
+  return ToCharsBatchImpl(first, last, values, delimiter);
+}
+to_chars_result to_chars(char *first, char *last, Span<int32_t const> values,  // NOLINT
+                         char delimiter) {
+  return ToCharsBatchImpl(first, last, values, delimiter);
+}
+to_chars_result to_chars(char *first, char *last, Span<uint8_t const> values,  // NOLINT
+                         char delimiter) {
+  return ToCharsBatchImpl(first, last, values, delimiter);
+}
+
+namespace {
+inline bool IsSpace(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+inline char const *SkipSpaces(char const *p, char const *end) {
+  while (p != end && IsSpace(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+inline bool IsDigit(char const *p, char const *end) {
+  return p != end && *p >= '0' && *p <= '9';
+}
+
+// Find the start of the next value after the one ending at `p`, nullptr if there's no
+// delimiter.
+char const *SkipDelimiter(char const *p, char const *end, char delimiter) {
+  auto q = SkipSpaces(p, end);
+  if (IsSpace(delimiter)) {
+    return q == p ? nullptr : q;
+  }
+  if (q == end || *q != delimiter) {
+    return nullptr;
+  }
+  return SkipSpaces(q + 1, end);
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// Whether the 8 bytes are all decimal digits.
+inline bool IsDigits8(uint64_t chunk) {
+  return ((chunk & 0xF0F0F0F0F0F0F0F0ull) |
+          (((chunk + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) ==
+         0x3333333333333333ull;
+}
+
+// Value of 8 digits with the most significant one in the lowest byte, the reverse of
+// Digits8.  Adjacent digits are combined pairwise in the lanes, then the 4 pairs.
+inline uint64_t ParseDigits8(uint64_t chunk) {
+  uint64_t constexpr kMask = 0x000000FF000000FFull;
+  uint64_t constexpr kMul1 = 100 + (1000000ull << 32);
+  uint64_t constexpr kMul2 = 1 + (10000ull << 32);
+  chunk -= 0x3030303030303030ull;
+  chunk = (chunk * 10) + (chunk >> 8);
+  return (((chunk & kMask) * kMul1) + (((chunk >> 16) & kMask) * kMul2)) >> 32;
+}
+#endif  // __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+// Parse an integer without fraction and exponent, returns nullptr if it doesn't fit in T.
+template <typename T>
+char const *ParseIntegerToken(char const *p, char const *end, T *out) {
+  bool negative = p != end && *p == '-';
+  p += negative;
+  if (!IsDigit(p, end)) {
+    return nullptr;
+  }
+  // 19 digits don't overflow uint64_t, longer numbers are out of range for int64_t.
+  auto digits_end = p + std::min<std::ptrdiff_t>(end - p, 19);
+  uint64_t v = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while (digits_end - p >= 8) {
+    uint64_t chunk;
+    std::memcpy(&chunk, p, sizeof(chunk));
+    if (!IsDigits8(chunk)) {
+      break;
+    }
+    v = v * detail::Tens(8) + ParseDigits8(chunk);
+    p += 8;
+  }
+#endif  // __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while (p != digits_end && *p >= '0' && *p <= '9') {
+    v = v * 10 + static_cast<uint64_t>(*p - '0');
+    ++p;
+  }
+  if (p != end && ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E')) {
+    return nullptr;
+  }
+  auto limit = static_cast<uint64_t>(std::numeric_limits<T>::max()) + negative;
+  if (v > limit) {
+    return nullptr;
+  }
+  *out = static_cast<T>(negative ? 0 - v : v);
+  return p;
+}
+
+char const *ParseFloatToken(char const *p, char const *end, float *out,
+                            bool fractions_only) {
+  auto literal = [&](char const *lit, std::size_t n) {
+    return static_cast<std::size_t>(end - p) >= n && std::memcmp(p, lit, n) == 0;
+  };
+  if (!IsDigit(p + (p != end && *p == '-'), end)) {
+    if (literal("NaN", 3)) {
+      *out = std::numeric_limits<float>::quiet_NaN();
+      return p + 3;
+    }
+    if (literal("Infinity", 8)) {
+      *out = std::numeric_limits<float>::infinity();
+      return p + 8;
+    }
+    if (literal("-Infinity", 9)) {
+      *out = -std::numeric_limits<float>::infinity();
+      return p + 9;
+    }
+    return nullptr;
+  }
+  auto scan = detail::ScanNumber(p, end);
+  if (!scan.valid || (fractions_only && !scan.is_float)) {
+    return nullptr;
+  }
+  auto ret = detail::FromCharFloatImpl(p, static_cast<int>(scan.ptr - p), out);
+  if (ret.ec != std::errc()) {
+    // Mantissa longer than what Ryu handles.
+    std::string copy{p, scan.ptr};
+    *out = std::strtof(copy.c_str(), nullptr);
+  }
+  return scan.ptr;
+}
+
+template <typename T, typename Parse>
+from_chars_batch_result FromCharsBatchImpl(char const *first, char const *last,
+                                           Span<T> values, char delimiter, Parse parse) {
+  from_chars_batch_result result{first, 0};
+  auto p = SkipSpaces(first, last);
+  while (result.n < values.size()) {
+    auto next = parse(p, last, &values[result.n]);
+    if (next == nullptr) {
+      break;
+    }
+    result.ptr = next;
+    ++result.n;
+    p = SkipDelimiter(next, last, delimiter);
+    if (p == nullptr) {
+      break;
+    }
+  }
+  return result;
+}
+}  // anonymous namespace
+
+namespace detail {
+from_chars_batch_result FromCharsFloatBatch(const char *first, const char *last,
+                                            Span<float> values, char delimiter,
+                                            bool fractions_only) {
+  return FromCharsBatchImpl(first, last, values, delimiter,
+                            [fractions_only](char const *p, char const *end, float *out) {
+                              return ParseFloatToken(p, end, out, fractions_only);
+                            });
 }
 }  // namespace detail
+
+from_chars_batch_result from_chars(const char *first, const char *last,  // NOLINT
+                                   Span<float> values, char delimiter) {
+  return detail::FromCharsFloatBatch(first, last, values, delimiter, false);
+}
+from_chars_batch_result from_chars(const char *first, const char *last,  // NOLINT
+                                   Span<int64_t> values, char delimiter) {
+  return FromCharsBatchImpl(first, last, values, delimiter,
+                            ParseIntegerToken<int64_t>);
+}
+from_chars_batch_result from_chars(const char *first, const char *last,  // NOLINT
+                                   Span<int32_t> values, char delimiter) {
+  return FromCharsBatchImpl(first, last, values, delimiter,
+                            ParseIntegerToken<int32_t>);
+}
 }  // namespace nih
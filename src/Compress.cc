@@ -0,0 +1,367 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include "nih/Compress.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nih/Intrinsics.h"
+#include "nih/JsonIO.h"
+#include "nih/Logging.h"
+
+namespace nih {
+namespace {
+// The codec follows the LZ4 block format: a token holds the literal length in the high
+// nibble and the match length (minus kMinMatch) in the low nibble, both extended by 255
+// runs.  Offsets are 16-bit little-endian.  The last sequence carries literals only.
+size_t constexpr kMinMatch = 4;
+size_t constexpr kHashLog = 16;
+size_t constexpr kMaxOffset = (1 << 16) - 1;
+// Matches must stop this far from the end, the tail is always emitted as literals.
+size_t constexpr kLastLiterals = 5;
+size_t constexpr kMFLimit = 12;
+// Each input byte decodes to at most 255 bytes, reached by the length extension bytes.
+size_t constexpr kMaxExpansion = 255;
+
+uint32_t Read32(char const* ptr) {
+  uint32_t v;
+  std::memcpy(&v, ptr, sizeof(v));
+  return v;
+}
+
+uint32_t Hash(uint32_t seq) { return (seq * 2654435761U) >> (32 - kHashLog); }
+
+char* WriteLength(size_t len, char* op) {
+  while (len >= 255) {
+    *op++ = static_cast<char>(255);
+    len -= 255;
+  }
+  *op++ = static_cast<char>(len);
+  return op;
+}
+
+char* WriteSequence(char const* literals, size_t n_literals, size_t offset,
+                    size_t match_len, char* op) {
+  auto token = op++;
+  uint8_t t = static_cast<uint8_t>(std::min(n_literals, size_t{15}) << 4);
+  if (n_literals >= 15) {
+    op = WriteLength(n_literals - 15, op);
+  }
+  std::memcpy(op, literals, n_literals);
+  op += n_literals;
+  if (match_len != 0) {
+    *op++ = static_cast<char>(offset & 0xff);
+    *op++ = static_cast<char>(offset >> 8);
+    auto len = match_len - kMinMatch;
+    t |= static_cast<uint8_t>(std::min(len, size_t{15}));
+    if (len >= 15) {
+      op = WriteLength(len - 15, op);
+    }
+  }
+  *token = static_cast<char>(t);
+  return op;
+}
+
+void CorruptBlock() { LOG(FATAL) << "Corrupted compressed block."; }
+
+size_t ReadLength(uint8_t const** ip, uint8_t const* end) {
+  size_t len = 0;
+  uint8_t b;
+  do {
+    if (NIH_UNLIKELY(*ip == end)) {
+      CorruptBlock();
+    }
+    b = *(*ip)++;
+    len += b;
+  } while (b == 255);
+  return len;
+}
+
+/*
+ * Run `fn(i)` for i in [0, n) on at most `n_threads` threads.  The first exception is
+ * propagated to the caller.
+ */
+template <typename Fn>
+void ParallelFor(size_t n, int32_t n_threads, Fn&& fn) {
+  if (n_threads <= 0) {
+    n_threads = std::max(static_cast<int32_t>(std::thread::hardware_concurrency()), 1);
+  }
+  size_t n_workers = std::min(static_cast<size_t>(n_threads), n);
+  if (n_workers <= 1) {
+    for (size_t i = 0; i < n; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next{0};
+  std::exception_ptr exc;
+  std::mutex lock;
+  auto work = [&]() {
+    try {
+      for (size_t i = next++; i < n; i = next++) {
+        fn(i);
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> guard{lock};
+      if (!exc) {
+        exc = std::current_exception();
+      }
+      next = n;
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < n_workers; ++i) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto& t : workers) {
+    t.join();
+  }
+  if (exc) {
+    std::rethrow_exception(exc);
+  }
+}
+
+char constexpr kMagic[] = {'N', 'I', 'H', 'Z'};
+uint8_t constexpr kVersion = 1;
+uint32_t constexpr kStored = 1U << 31;
+size_t constexpr kHeaderSize = sizeof(kMagic) + 4 + 4 + 4 + 8;
+
+template <typename T>
+void WriteBE(T v, char** op) {
+  v = ToBigEndian(v);
+  std::memcpy(*op, &v, sizeof(v));
+  *op += sizeof(v);
+}
+
+template <typename T>
+T ReadBE(char const** ip) {
+  T v;
+  std::memcpy(&v, *ip, sizeof(v));
+  *ip += sizeof(v);
+  return ToBigEndian(v);
+}
+}  // anonymous namespace
+
+size_t LZCompressBound(size_t n) { return n + n / 255 + 16; }
+
+size_t LZCompress(char const* src, size_t n, char* dst) {
+  char* op = dst;
+  size_t anchor = 0;
+  if (n >= kMFLimit) {
+    std::vector<uint32_t> table(size_t{1} << kHashLog, 0);
+    size_t ip = 1;
+    table[Hash(Read32(src))] = 0;
+    size_t const limit = n - kMFLimit;
+    size_t const match_limit = n - kLastLiterals;
+    while (ip < limit) {
+      auto seq = Read32(src + ip);
+      auto h = Hash(seq);
+      size_t ref = table[h];
+      table[h] = static_cast<uint32_t>(ip);
+      if (ip - ref > kMaxOffset || Read32(src + ref) != seq) {
+        // Skip faster over data that doesn't compress.
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+      // Extend backward over pending literals, then forward.
+      while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+        --ip;
+        --ref;
+      }
+      size_t len = kMinMatch;
+      while (ip + len < match_limit && src[ref + len] == src[ip + len]) {
+        ++len;
+      }
+      op = WriteSequence(src + anchor, ip - anchor, ip - ref, len, op);
+      ip += len;
+      anchor = ip;
+    }
+  }
+  op = WriteSequence(src + anchor, n - anchor, 0, 0, op);
+  return op - dst;
+}
+
+void LZDecompress(char const* src, size_t n, char* dst, size_t n_out) {
+  auto ip = reinterpret_cast<uint8_t const*>(src);
+  auto const in_end = ip + n;
+  size_t out = 0;
+  while (true) {
+    if (NIH_UNLIKELY(ip == in_end)) {
+      CorruptBlock();
+    }
+    uint8_t token = *ip++;
+    size_t n_literals = token >> 4;
+    if (n_literals == 15) {
+      n_literals += ReadLength(&ip, in_end);
+    }
+    if (NIH_UNLIKELY(n_literals > static_cast<size_t>(in_end - ip) ||
+                     n_literals > n_out - out)) {
+      CorruptBlock();
+    }
+    std::memcpy(dst + out, ip, n_literals);
+    ip += n_literals;
+    out += n_literals;
+    if (ip == in_end) {
+      break;
+    }
+
+    if (NIH_UNLIKELY(in_end - ip < 2)) {
+      CorruptBlock();
+    }
+    size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+    size_t len = token & 0xf;
+    if (len == 15) {
+      len += ReadLength(&ip, in_end);
+    }
+    len += kMinMatch;
+    if (NIH_UNLIKELY(offset == 0 || offset > out || len > n_out - out)) {
+      CorruptBlock();
+    }
+    char* op = dst + out;
+    char const* ref = op - offset;
+    if (offset >= len) {
+      std::memcpy(op, ref, len);
+    } else {
+      // Overlapping copy repeats the last `offset` bytes.
+      for (size_t i = 0; i < len; ++i) {
+        op[i] = ref[i];
+      }
+    }
+    out += len;
+  }
+  if (NIH_UNLIKELY(out != n_out)) {
+    CorruptBlock();
+  }
+}
+
+bool IsCompressed(ConstStringRef str) {
+  return str.size() >= sizeof(kMagic) &&
+         std::memcmp(str.data(), kMagic, sizeof(kMagic)) == 0;
+}
+
+void DumpCompressed(Json json, std::vector<char>* out, std::ios::openmode mode,
+                    size_t block_size, int32_t n_threads) {
+  if (block_size == 0 || block_size >= kStored) {
+    LOG(FATAL) << "Invalid block size: " << block_size;
+  }
+  std::vector<char> raw;
+  Json::Dump(json, &raw, mode);
+
+  size_t n_blocks = (raw.size() + block_size - 1) / block_size;
+  std::vector<std::vector<char>> blocks(n_blocks);
+  ParallelFor(n_blocks, n_threads, [&](size_t i) {
+    auto beg = i * block_size;
+    auto size = std::min(block_size, raw.size() - beg);
+    auto& block = blocks[i];
+    block.resize(LZCompressBound(size));
+    block.resize(LZCompress(raw.data() + beg, size, block.data()));
+    if (block.size() >= size) {
+      block.assign(raw.data() + beg, raw.data() + beg + size);
+    }
+  });
+
+  size_t total = kHeaderSize + n_blocks * sizeof(uint32_t);
+  for (auto const& block : blocks) {
+    total += block.size();
+  }
+  out->resize(total);
+  char* op = out->data();
+  std::memcpy(op, kMagic, sizeof(kMagic));
+  op += sizeof(kMagic);
+  *op++ = static_cast<char>(kVersion);
+  *op++ = (mode & std::ios::binary) ? 'U' : 'J';
+  WriteBE(uint16_t{0}, &op);
+  WriteBE(static_cast<uint32_t>(block_size), &op);
+  WriteBE(static_cast<uint32_t>(n_blocks), &op);
+  WriteBE(static_cast<uint64_t>(raw.size()), &op);
+  for (size_t i = 0; i < n_blocks; ++i) {
+    auto beg = i * block_size;
+    auto size = std::min(block_size, raw.size() - beg);
+    uint32_t n_bytes = static_cast<uint32_t>(blocks[i].size());
+    WriteBE(blocks[i].size() == size ? (n_bytes | kStored) : n_bytes, &op);
+  }
+  for (auto const& block : blocks) {
+    std::memcpy(op, block.data(), block.size());
+    op += block.size();
+  }
+}
+
+Json LoadCompressed(ConstStringRef str, int32_t n_threads, UBJByteOrder order) {
+  if (!IsCompressed(str) || str.size() < kHeaderSize) {
+    LOG(FATAL) << "Not a compressed Json document.";
+  }
+  char const* ip = str.data() + sizeof(kMagic);
+  auto version = static_cast<uint8_t>(*ip++);
+  if (version != kVersion) {
+    LOG(FATAL) << "Unsupported compressed Json version: " << static_cast<int>(version);
+  }
+  char format = *ip++;
+  if (format != 'U' && format != 'J') {
+    LOG(FATAL) << "Unknown compressed Json format: " << format;
+  }
+  ReadBE<uint16_t>(&ip);
+  size_t block_size = ReadBE<uint32_t>(&ip);
+  size_t n_blocks = ReadBE<uint32_t>(&ip);
+  size_t raw_size = ReadBE<uint64_t>(&ip);
+  if (block_size == 0 || n_blocks > (str.size() - kHeaderSize) / sizeof(uint32_t)) {
+    LOG(FATAL) << "Invalid compressed Json header.";
+  }
+
+  std::vector<size_t> offsets(n_blocks + 1, kHeaderSize + n_blocks * sizeof(uint32_t));
+  std::vector<bool> stored(n_blocks);
+  for (size_t i = 0; i < n_blocks; ++i) {
+    auto n_bytes = ReadBE<uint32_t>(&ip);
+    stored[i] = n_bytes & kStored;
+    offsets[i + 1] = offsets[i] + (n_bytes & ~kStored);
+  }
+  if (offsets.back() != str.size()) {
+    LOG(FATAL) << "Invalid compressed Json block index.";
+  }
+  // Check the sizes against what the blocks can decode to before allocating, so that a
+  // corrupted header can't request more memory than the input can fill.
+  auto max_decoded = [&](size_t i) {
+    auto n_bytes = offsets[i + 1] - offsets[i];
+    return stored[i] ? n_bytes : n_bytes * kMaxExpansion;
+  };
+  size_t max_raw = 0;
+  for (size_t i = 0; i < n_blocks; ++i) {
+    max_raw += max_decoded(i);
+  }
+  if (raw_size > max_raw || n_blocks != (raw_size + block_size - 1) / block_size) {
+    LOG(FATAL) << "Invalid compressed Json header.";
+  }
+  for (size_t i = 0; i < n_blocks; ++i) {
+    if (std::min(block_size, raw_size - i * block_size) > max_decoded(i)) {
+      LOG(FATAL) << "Invalid compressed Json block size.";
+    }
+  }
+
+  std::string raw(raw_size, '\0');
+  ParallelFor(n_blocks, n_threads, [&](size_t i) {
+    auto beg = i * block_size;
+    auto size = std::min(block_size, raw_size - beg);
+    auto src = str.data() + offsets[i];
+    auto n_bytes = offsets[i + 1] - offsets[i];
+    if (stored[i]) {
+      if (n_bytes != size) {
+        CorruptBlock();
+      }
+      std::memcpy(&raw[beg], src, size);
+    } else {
+      LZDecompress(src, n_bytes, &raw[beg], size);
+    }
+  });
+  return Json::Load(ConstStringRef{raw}, format == 'U' ? std::ios::binary : std::ios::in,
+                    order);
+}
+}  // namespace nih
@@ -3,36 +3,66 @@
  */
 #include "nih/Json.h"
 
+#if defined(__unix__)
+#include <sys/stat.h>
+#endif  // defined(__unix__)
+
+#include <algorithm>
 #include <cctype>
+#include <cerrno>
 #include <cmath>
 #include <cstddef>
+#include <cstdio>
+#include <cstring>
 #include <iterator>
 #include <limits>
 #include <sstream>
+#include <thread>
 
 #include "./math.h"
+#include "./number.h"
+#include "./ubj_parser.h"
+#include "./unicode.h"
 #include "nih/Charconv.h"
+#include "nih/Compress.h"
+#include "nih/IO.h"
 #include "nih/Intrinsics.h"
 #include "nih/JsonIO.h"
 #include "nih/Logging.h"
 #include "nih/StringRef.h"
+#include "nih/uri.h"
 
 namespace nih {
 
-void JsonWriter::Save(Json json) { json.Ptr()->Save(this); }
+void JsonWriter::Save(Json json) { Write(this, json.GetValue()); }
 
 void JsonWriter::Visit(JsonArray const* arr) {
-  this->WriteArray(arr, [](auto const& v) { return v; });
-}
-void JsonWriter::Visit(F32Array const* arr) {
-  this->WriteArray(arr, [](float v) { return Json{v}; });
+  this->WriteArray(arr, [](Json const& v) -> Json const& { return v; });
 }
 namespace {
-auto to_i64 = [](auto v) { return Json{static_cast<int64_t>(v)}; };
+template <typename T>
+void WriteTextArray(Span<T const> values, std::vector<char>* stream) {
+  auto ori_size = stream->size();
+  stream->resize(ori_size + values.size() * (NumericLimits<T>::kToCharsSize + 1) + 2);
+  char* out = stream->data() + ori_size;
+  *out++ = '[';
+  auto ret = to_chars(out, stream->data() + stream->size(), values);
+  NIH_ASSERT_T(ret.ec == std::errc());
+  *ret.ptr++ = ']';
+  stream->resize(ret.ptr - stream->data());
+}
+
+template <typename T, Value::ValueKind kind>
+void WriteTextArray(JsonTypedArray<T, kind> const* arr, std::vector<char>* stream) {
+  auto const& vec = arr->GetArray();
+  WriteTextArray(Span<T const>{vec.data(), vec.size()}, stream);
+}
 }  // anonymous namespace
-void JsonWriter::Visit(U8Array const* arr) { this->WriteArray(arr, to_i64); }
-void JsonWriter::Visit(I32Array const* arr) { this->WriteArray(arr, to_i64); }
-void JsonWriter::Visit(I64Array const* arr) { this->WriteArray(arr, to_i64); }
+
+void JsonWriter::Visit(F32Array const* arr) { WriteTextArray(arr, stream_); }
+void JsonWriter::Visit(U8Array const* arr) { WriteTextArray(arr, stream_); }
+void JsonWriter::Visit(I32Array const* arr) { WriteTextArray(arr, stream_); }
+void JsonWriter::Visit(I64Array const* arr) { WriteTextArray(arr, stream_); }
 
 void JsonWriter::Visit(JsonObject const* obj) {
   stream_->emplace_back('{');
@@ -43,7 +73,7 @@ void JsonWriter::Visit(JsonObject const* obj) {
     auto s = String{value.first};
     this->Visit(&s);
     stream_->emplace_back(':');
-    this->Save(value.second);
+    Write(this, value.second.GetValue());
 
     if (i != size - 1) {
       stream_->emplace_back(',');
@@ -54,26 +84,50 @@ void JsonWriter::Visit(JsonObject const* obj) {
   stream_->emplace_back('}');
 }
 
-void JsonWriter::Visit(JsonNumber const* num) {
+namespace {
+void AppendBytes(std::vector<char>* stream, char const* ptr, std::size_t n) {
+  auto ori_size = stream->size();
+  stream->resize(ori_size + n);
+  std::memcpy(stream->data() + ori_size, ptr, n);
+}
+
+void WriteTextNumber(std::vector<char>* stream, float v) {
   char number[NumericLimits<float>::kToCharsSize];
-  auto res = to_chars(number, number + sizeof(number), num->GetNumber());
-  auto end = res.ptr;
-  auto ori_size = stream_->size();
-  stream_->resize(stream_->size() + end - number);
-  std::memcpy(stream_->data() + ori_size, number, end - number);
+  auto res = to_chars(number, number + sizeof(number), v);
+  AppendBytes(stream, number, res.ptr - number);
 }
 
-void JsonWriter::Visit(JsonInteger const* num) {
+void WriteTextNumber(std::vector<char>* stream, double v) {
+  char number[NumericLimits<double>::kToCharsSize];
+  auto res = to_chars(number, number + sizeof(number), v);
+  AppendBytes(stream, number, res.ptr - number);
+}
+
+void WriteTextInteger(std::vector<char>* stream, int64_t i) {
   char i2s_buffer_[NumericLimits<int64_t>::kToCharsSize];
-  auto i = num->GetInteger();
   auto ret =
       to_chars(i2s_buffer_, i2s_buffer_ + NumericLimits<int64_t>::kToCharsSize, i);
   auto end = ret.ptr;
   NIH_ASSERT_T(ret.ec == std::errc());
-  auto digits = std::distance(i2s_buffer_, end);
-  auto ori_size = stream_->size();
-  stream_->resize(ori_size + digits);
-  std::memcpy(stream_->data() + ori_size, i2s_buffer_, digits);
+  AppendBytes(stream, i2s_buffer_, std::distance(i2s_buffer_, end));
+}
+}  // anonymous namespace
+
+void JsonWriter::Visit(JsonNumber const* num) {
+  if (num->HasRaw()) {
+    auto raw = num->GetRaw();
+    AppendBytes(stream_, raw.data(), raw.size());
+    return;
+  }
+  if (num->IsDouble()) {
+    WriteTextNumber(stream_, num->GetDouble());
+    return;
+  }
+  WriteTextNumber(stream_, num->GetNumber());
+}
+
+void JsonWriter::Visit(JsonInteger const* num) {
+  WriteTextInteger(stream_, num->GetInteger());
 }
 
 void JsonWriter::Visit(JsonNull const*) {
@@ -86,44 +140,99 @@ void JsonWriter::Visit(JsonNull const*) {
   buf[s + 3] = 'l';
 }
 
-void JsonWriter::Visit(JsonString const* str) {
-  std::string buffer;
-  buffer += '"';
-  auto const& string = str->GetString();
-  for (size_t i = 0; i < string.length(); i++) {
-    const char ch = string[i];
-    if (ch == '\\') {
-      if (i < string.size() && string[i + 1] == 'u') {
-        buffer += "\\";
+namespace {
+// Write a UTF-16 code unit as `\uXXXX` with lower case hex digits.
+char* WriteEscapedUnit(uint32_t unit, char* out) {
+  char constexpr kHex[] = "0123456789abcdef";
+  out[0] = '\\';
+  out[1] = 'u';
+  out[2] = kHex[(unit >> 12) & 0xF];
+  out[3] = kHex[(unit >> 8) & 0xF];
+  out[4] = kHex[(unit >> 4) & 0xF];
+  out[5] = kHex[unit & 0xF];
+  return out + 6;
+}
+
+void WriteTextStr(std::vector<char>* stream, ConstStringRef string, bool ensure_ascii) {
+  char const* p = string.data();
+  char const* const end = p + string.size();
+  // Each input byte expands to at most 6 output bytes (`\u001f`, or a 4-byte sequence
+  // written as a surrogate pair).
+  auto ori_size = stream->size();
+  stream->resize(ori_size + string.size() * 6 + 2);
+  char* out = stream->data() + ori_size;
+  *out++ = '"';
+  while (true) {
+    auto run = detail::FindStringSpecial(p, end);
+    std::memcpy(out, p, run - p);
+    out += run - p;
+    p = run;
+    if (p == end) {
+      break;
+    }
+    auto c = static_cast<uint8_t>(*p);
+    char escaped = 0;
+    switch (c) {
+      case '"':
+        escaped = '"';
+        break;
+      case '\\':
+        escaped = '\\';
+        break;
+      case '\b':
+        escaped = 'b';
+        break;
+      case '\f':
+        escaped = 'f';
+        break;
+      case '\n':
+        escaped = 'n';
+        break;
+      case '\r':
+        escaped = 'r';
+        break;
+      case '\t':
+        escaped = 't';
+        break;
+      default:
+        break;
+    }
+    if (escaped != 0) {
+      *out++ = '\\';
+      *out++ = escaped;
+      ++p;
+    } else if (c < 0x20) {
+      out = WriteEscapedUnit(c, out);
+      ++p;
+    } else {
+      auto n = detail::UTF8SequenceLength(p, end);
+      if (NIH_UNLIKELY(n == 0)) {
+        stream->resize(ori_size);
+        LOG(FATAL) << "Invalid UTF-8 in string at byte " << (p - string.data()) << ".";
+      }
+      if (ensure_ascii) {
+        auto code = detail::DecodeUTF8(p, n);
+        if (code >= 0x10000) {
+          code -= 0x10000;
+          out = WriteEscapedUnit(0xD800 + (code >> 10), out);
+          out = WriteEscapedUnit(0xDC00 + (code & 0x3FF), out);
+        } else {
+          out = WriteEscapedUnit(code, out);
+        }
       } else {
-        buffer += "\\\\";
+        std::memcpy(out, p, n);
+        out += n;
       }
-    } else if (ch == '"') {
-      buffer += "\\\"";
-    } else if (ch == '\b') {
-      buffer += "\\b";
-    } else if (ch == '\f') {
-      buffer += "\\f";
-    } else if (ch == '\n') {
-      buffer += "\\n";
-    } else if (ch == '\r') {
-      buffer += "\\r";
-    } else if (ch == '\t') {
-      buffer += "\\t";
-    } else if (static_cast<uint8_t>(ch) <= 0x1f) {
-      // Unit separator
-      char buf[8];
-      snprintf(buf, sizeof buf, "\\u%04x", ch);
-      buffer += buf;
-    } else {
-      buffer += ch;
+      p += n;
     }
   }
-  buffer += '"';
+  *out++ = '"';
+  stream->resize(out - stream->data());
+}
+}  // anonymous namespace
 
-  auto s = stream_->size();
-  stream_->resize(s + buffer.size());
-  std::memcpy(stream_->data() + s, buffer.data(), buffer.size());
+void JsonWriter::Visit(JsonString const* str) {
+  WriteTextStr(stream_, str->GetString(), ensure_ascii_);
 }
 
 void JsonWriter::Visit(JsonBoolean const* boolean) {
@@ -147,9 +256,79 @@ void JsonWriter::Visit(JsonBoolean const* boolean) {
   }
 }
 
+namespace {
+// Hashing helpers for Value::Hash.
+uint64_t constexpr kHashPrime1 = 0x9E3779B185EBCA87ULL;
+uint64_t constexpr kHashPrime2 = 0xC2B2AE3D27D4EB4FULL;
+
+uint64_t RotL(uint64_t v, int r) { return (v << r) | (v >> (64 - r)); }
+
+// Final avalanche from splitmix64.
+uint64_t Mix(uint64_t h) {
+  h ^= h >> 30;
+  h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 27;
+  h *= 0x94D049BB133111EBULL;
+  h ^= h >> 31;
+  return h;
+}
+
+uint64_t Combine(uint64_t h, uint64_t v) { return RotL(h ^ (v * kHashPrime2), 31) * kHashPrime1; }
+
+uint64_t HashBytes(char const* ptr, size_t n, uint64_t h) {
+  h = Combine(h, n);
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, ptr + i, sizeof(word));
+    h = Combine(h, word);
+  }
+  if (i == n) {
+    // `ptr` can be null for empty strings and arrays.
+    return h;
+  }
+  uint64_t tail{0};
+  std::memcpy(&tail, ptr + i, n - i);
+  return Combine(h, tail);
+}
+
+uint64_t HashSeed(Value::ValueKind kind) { return Mix(static_cast<uint64_t>(kind) + 1); }
+
+// Values that compare equal must have the same bits: all NaNs are equal, all
+// infinities are equal and 0 == -0.
+uint64_t CanonicalBits(float v) {
+  if (std::isnan(v)) {
+    return 1;
+  }
+  if (std::isinf(v)) {
+    return 2;
+  }
+  if (v == 0) {
+    return 0;
+  }
+  uint32_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  return static_cast<uint64_t>(bits) << 2;
+}
+uint64_t CanonicalBits(double v) {
+  if (std::isnan(v)) {
+    return 1;
+  }
+  if (std::isinf(v)) {
+    return 2;
+  }
+  if (v == 0) {
+    return 0;
+  }
+  uint64_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  return bits;
+}
+}  // anonymous namespace
+
 // Value
-std::string Value::TypeStr() const {
-  switch (kind_) {
+std::string Value::TypeStr(ValueKind kind) {
+  switch (kind) {
     case ValueKind::kString:
       return "String";
     case ValueKind::kNumber:
@@ -176,6 +355,18 @@ std::string Value::TypeStr() const {
   return "";
 }
 
+void Value::Save(JsonWriter* writer) const {
+  visit(*this, [writer](auto const& v) { writer->Visit(&v); });
+}
+
+bool Value::operator==(Value const& rhs) const {
+  return visit(*this, [&rhs](auto const& lhs) { return lhs == rhs; });
+}
+
+uint64_t Value::Hash() const {
+  return visit(*this, [](auto const& v) { return v.ComputeHash(); });
+}
+
 // Only used for keeping old compilers happy about non-reaching return
 // statement.
 Json& DummyJsonObject() {
@@ -196,6 +387,7 @@ Json& Value::operator[](int) {
 // Json Object
 JsonObject::JsonObject(JsonObject&& that) noexcept : Value(ValueKind::kObject) {
   std::swap(that.object_, this->object_);
+  that.hash_.Invalidate();
 }
 
 JsonObject::JsonObject(Map&& object) noexcept
@@ -208,7 +400,16 @@ bool JsonObject::operator==(Value const& rhs) const {
   return object_ == Cast<JsonObject const>(&rhs)->GetObject();
 }
 
-void JsonObject::Save(JsonWriter* writer) const { writer->Visit(this); }
+uint64_t JsonObject::ComputeHash() const {
+  return hash_.Get([this] {
+    auto h = Combine(HashSeed(Type()), object_.size());
+    for (auto const& kv : object_) {
+      h = HashBytes(kv.first.data(), kv.first.size(), h);
+      h = Combine(h, kv.second.Hash());
+    }
+    return Mix(h);
+  });
+}
 
 // Json String
 bool JsonString::operator==(Value const& rhs) const {
@@ -218,12 +419,14 @@ bool JsonString::operator==(Value const& rhs) const {
   return Cast<JsonString const>(&rhs)->GetString() == str_;
 }
 
-// FIXME: UTF-8 parsing support.
-void JsonString::Save(JsonWriter* writer) const { writer->Visit(this); }
+uint64_t JsonString::ComputeHash() const {
+  return Mix(HashBytes(str_.data(), str_.size(), HashSeed(Type())));
+}
 
 // Json Array
 JsonArray::JsonArray(JsonArray&& that) noexcept : Value(ValueKind::kArray) {
   std::swap(that.vec_, this->vec_);
+  that.hash_.Invalidate();
 }
 
 bool JsonArray::operator==(Value const& rhs) const {
@@ -237,7 +440,15 @@ bool JsonArray::operator==(Value const& rhs) const {
   return std::equal(arr.cbegin(), arr.cend(), vec_.cbegin());
 }
 
-void JsonArray::Save(JsonWriter* writer) const { writer->Visit(this); }
+uint64_t JsonArray::ComputeHash() const {
+  return hash_.Get([this] {
+    auto h = Combine(HashSeed(Type()), vec_.size());
+    for (auto const& v : vec_) {
+      h = Combine(h, v.Hash());
+    }
+    return Mix(h);
+  });
+}
 
 // typed array
 namespace {
@@ -252,11 +463,6 @@ std::enable_if_t<std::is_integral<T>::value, bool> IsInfMSVCWar(T) {
 }
 }  // namespace
 
-template <typename T, Value::ValueKind kind>
-void JsonTypedArray<T, kind>::Save(JsonWriter* writer) const {
-  writer->Visit(this);
-}
-
 template <typename T, Value::ValueKind kind>
 bool JsonTypedArray<T, kind>::operator==(Value const& rhs) const {
   if (!IsA<JsonTypedArray<T, kind>>(&rhs)) {
@@ -285,27 +491,106 @@ bool JsonTypedArray<T, kind>::operator==(Value const& rhs) const {
   return std::equal(arr.cbegin(), arr.cend(), vec_.cbegin());
 }
 
+template <typename T, Value::ValueKind kind>
+uint64_t JsonTypedArray<T, kind>::ComputeHash() const {
+  return hash_.Get([this] {
+    auto h = HashSeed(kind);
+    if (std::is_same<float, T>::value) {
+      h = Combine(h, vec_.size());
+      for (auto v : vec_) {
+        h = Combine(h, CanonicalBits(static_cast<float>(v)));
+      }
+    } else {
+      h = HashBytes(reinterpret_cast<char const*>(vec_.data()), vec_.size() * sizeof(T),
+                    h);
+    }
+    return Mix(h);
+  });
+}
+
 template class JsonTypedArray<float, Value::ValueKind::kNumberArray>;
 template class JsonTypedArray<uint8_t, Value::ValueKind::kU8Array>;
 template class JsonTypedArray<int32_t, Value::ValueKind::kI32Array>;
 template class JsonTypedArray<int64_t, Value::ValueKind::kI64Array>;
 
 // Json Number
-bool JsonNumber::operator==(Value const& rhs) const {
-  if (!IsA<JsonNumber>(&rhs)) {
-    return false;
+JsonNumber::JsonNumber(ConstStringRef raw)
+    : Value{ValueKind::kNumber},
+      state_{kRaw},
+      raw_size_{static_cast<uint8_t>(raw.size())} {
+  NIH_ASSERT_T(raw.size() != 0 && raw.size() <= kMaxRawSize);
+  std::memcpy(raw_, raw.data(), raw.size());
+}
+
+void JsonNumber::Materialize() const {
+  uint8_t expected = kRaw;
+  if (!state_.compare_exchange_strong(expected, kConverting, std::memory_order_acquire)) {
+    // Another thread is converting the same number.
+    while (state_.load(std::memory_order_acquire) != kReady) {
+      std::this_thread::yield();
+    }
+    return;
   }
-  auto r_num = Cast<JsonNumber const>(&rhs)->GetNumber();
-  if (std::isinf(number_)) {
+  Float f;
+  auto ret = from_chars(raw_, raw_ + raw_size_, f);
+  if (NIH_UNLIKELY(ret.ec != std::errc())) {
+    char copy[kMaxRawSize + 1];
+    std::memcpy(copy, raw_, raw_size_);
+    copy[raw_size_] = '\0';
+    f = std::strtof(copy, nullptr);
+  }
+  number_ = f;
+  state_.store(kReady, std::memory_order_release);
+}
+
+double JsonNumber::GetDouble() const {
+  if (is_double_) {
+    return double_;
+  }
+  if (raw_size_ == 0) {
+    return static_cast<double>(this->GetNumber());
+  }
+  double d;
+  auto ret = from_chars(raw_, raw_ + raw_size_, d);
+  if (NIH_UNLIKELY(ret.ec != std::errc())) {
+    char copy[kMaxRawSize + 1];
+    std::memcpy(copy, raw_, raw_size_);
+    copy[raw_size_] = '\0';
+    d = std::strtod(copy, nullptr);
+  }
+  return d;
+}
+
+namespace {
+template <typename T>
+bool NumberEqual(T l_num, T r_num) {
+  if (std::isinf(l_num)) {
     return std::isinf(r_num);
   }
-  if (std::isnan(number_)) {
+  if (std::isnan(l_num)) {
     return std::isnan(r_num);
   }
-  return number_ - r_num == 0;
+  return l_num - r_num == 0;
+}
+
+// The value used for comparison.  Numbers set from a double keep their precision, all
+// other numbers, including the ones parsed from text, are floats.  A double is only
+// equal to a float when it's exactly representable as float.
+double ComparedValue(JsonNumber const& num) {
+  return num.IsDouble() ? num.GetDouble() : static_cast<double>(num.GetNumber());
+}
+}  // anonymous namespace
+
+bool JsonNumber::operator==(Value const& rhs) const {
+  if (!IsA<JsonNumber>(&rhs)) {
+    return false;
+  }
+  return NumberEqual(ComparedValue(*this), ComparedValue(*Cast<JsonNumber const>(&rhs)));
 }
 
-void JsonNumber::Save(JsonWriter* writer) const { writer->Visit(this); }
+uint64_t JsonNumber::ComputeHash() const {
+  return Mix(Combine(HashSeed(Type()), CanonicalBits(ComparedValue(*this))));
+}
 
 // Json Integer
 bool JsonInteger::operator==(Value const& rhs) const {
@@ -315,7 +600,9 @@ bool JsonInteger::operator==(Value const& rhs) const {
   return integer_ == Cast<JsonInteger const>(&rhs)->GetInteger();
 }
 
-void JsonInteger::Save(JsonWriter* writer) const { writer->Visit(this); }
+uint64_t JsonInteger::ComputeHash() const {
+  return Mix(Combine(HashSeed(Type()), static_cast<uint64_t>(integer_)));
+}
 
 // Json Null
 bool JsonNull::operator==(Value const& rhs) const {
@@ -325,7 +612,7 @@ bool JsonNull::operator==(Value const& rhs) const {
   return true;
 }
 
-void JsonNull::Save(JsonWriter* writer) const { writer->Visit(this); }
+uint64_t JsonNull::ComputeHash() const { return HashSeed(Type()); }
 
 // Json Boolean
 bool JsonBoolean::operator==(Value const& rhs) const {
@@ -335,7 +622,9 @@ bool JsonBoolean::operator==(Value const& rhs) const {
   return boolean_ == Cast<JsonBoolean const>(&rhs)->GetBoolean();
 }
 
-void JsonBoolean::Save(JsonWriter* writer) const { writer->Visit(this); }
+uint64_t JsonBoolean::ComputeHash() const {
+  return Mix(Combine(HashSeed(Type()), boolean_));
+}
 
 size_t constexpr JsonReader::kMaxNumLength;
 
@@ -399,6 +688,9 @@ void JsonReader::Error(std::string msg) const {
       portion += "\\n";
     } else if (c == '\0') {
       portion += "\\0";
+    } else if (static_cast<uint8_t>(c) < 0x20 || static_cast<uint8_t>(c) > 0x7e) {
+      // Binary formats share this error path, don't leak raw bytes into the log.
+      portion += '.';
     } else {
       portion += c;
     }
@@ -448,43 +740,17 @@ void ParseStr(std::string const& str) {
 }
 
 Json JsonReader::ParseString() {
-  char ch{GetConsecutiveChar('\"')};  // NOLINT
+  GetConsecutiveChar('\"');
+  char const* const beg = raw_str_.c_str();
+  char const* p = beg + cursor_.Pos();
   std::string str;
-  while (true) {
-    ch = GetNextChar();
-    if (ch == '\\') {
-      char next = static_cast<char>(GetNextChar());
-      switch (next) {
-        case 'r':
-          str += u8"\r";
-          break;
-        case 'n':
-          str += u8"\n";
-          break;
-        case '\\':
-          str += u8"\\";
-          break;
-        case 't':
-          str += u8"\t";
-          break;
-        case '\"':
-          str += u8"\"";
-          break;
-        case 'u':
-          str += ch;
-          str += 'u';
-          break;
-        default:
-          Error("Unknown escape");
-      }
-    } else {
-      if (ch == '\"') break;
-      str += ch;
-    }
-    if (ch == EOF || ch == '\r' || ch == '\n') {
-      Expect('\"', ch);
-    }
+  auto error = detail::UnescapeString(&p, beg + raw_str_.size(), &str);
+  if (NIH_UNLIKELY(error != nullptr)) {
+    // Point the cursor past the offending byte.
+    cursor_.Forward(p - (beg + cursor_.Pos()) + 1);
+    Error(error);
   }
+  cursor_.Forward(p - (beg + cursor_.Pos()));
   return Json(std::move(str));
 }
 
@@ -504,11 +770,12 @@ Json JsonReader::ParseArray() {
   std::vector<Json> data;
 
   char ch{GetConsecutiveChar('[')};  // NOLINT
+  SkipSpaces();
+  if (PeekNextChar() == ']') {
+    GetConsecutiveChar(']');
+    return Json(std::move(data));
+  }
   while (true) {
-    if (PeekNextChar() == ']') {
-      GetConsecutiveChar(']');
-      return Json(std::move(data));
-    }
     auto obj = Parse();
     data.emplace_back(obj);
     ch = GetNextNonSpaceChar();
@@ -565,9 +832,8 @@ Json JsonReader::ParseObject() {
 }
 
 Json JsonReader::ParseNumber() {
-  // Adopted from sajson with some simplifications and small optimizations.
   char const* p = raw_str_.c_str() + cursor_.Pos();
-  char const* const beg = p;  // keep track of current pointer
+  char const* const end = raw_str_.c_str() + raw_str_.size();
 
   // TODO(trivialfis): Add back all the checks for number
   if (NIH_UNLIKELY(*p == 'N')) {
@@ -576,101 +842,35 @@ Json JsonReader::ParseNumber() {
     GetConsecutiveChar('N');
     return Json(static_cast<Number::Float>(std::numeric_limits<float>::quiet_NaN()));
   }
-
-  bool negative = false;
-  switch (*p) {
-    case '-': {
-      negative = true;
-      ++p;
-      break;
-    }
-    case '+': {
-      negative = false;
-      ++p;
-      break;
-    }
-    default: {
-      break;
-    }
-  }
-
-  if (NIH_UNLIKELY(*p == 'I')) {
-    cursor_.Forward(std::distance(beg, p));  // +/-
+  std::size_t n_signs = *p == '-' ? 1 : 0;
+  if (NIH_UNLIKELY(p + n_signs != end && p[n_signs] == 'I')) {
+    cursor_.Forward(n_signs);  // -
     for (auto i : {'I', 'n', 'f', 'i', 'n', 'i', 't', 'y'}) {
       GetConsecutiveChar(i);
     }
     auto f = std::numeric_limits<float>::infinity();
-    if (negative) {
+    if (*p == '-') {
       f = -f;
     }
     return Json(static_cast<Number::Float>(f));
   }
 
-  bool is_float = false;
-
-  int64_t i = 0;
-
-  if (*p == '0') {
-    i = 0;
-    p++;
-  }
-
-  while (NIH_LIKELY(*p >= '0' && *p <= '9')) {
-    i = i * 10 + (*p - '0');
-    p++;
-  }
-
-  if (*p == '.') {
-    p++;
-    is_float = true;
-
-    while (*p >= '0' && *p <= '9') {
-      i = i * 10 + (*p - '0');
-      p++;
-    }
-  }
-
-  if (*p == 'E' || *p == 'e') {
-    is_float = true;
-    p++;
-
-    switch (*p) {
-      case '-':
-      case '+': {
-        p++;
-        break;
-      }
-      default:
-        break;
-    }
-
-    if (NIH_LIKELY(*p >= '0' && *p <= '9')) {
-      p++;
-      while (*p >= '0' && *p <= '9') {
-        p++;
-      }
-    } else {
-      Error("Expecting digit");
-    }
+  auto scan = detail::ScanNumber(p, end);
+  if (NIH_UNLIKELY(!scan.valid)) {
+    Error("Expecting digit");
   }
-
-  auto moved = std::distance(beg, p);
+  auto moved = static_cast<std::size_t>(scan.ptr - p);
   this->cursor_.Forward(moved);
 
-  if (is_float) {
-    float f;
-    auto ret = from_chars(beg, p, f);
-    if (NIH_UNLIKELY(ret.ec != std::errc())) {
-      // Compatible with old format that generates very long mantissa from std stream.
-      f = std::strtof(beg, nullptr);
-    }
-    return Json(static_cast<Number::Float>(f));
-  } else {
-    if (negative) {
-      i = -i;
+  if (scan.is_float) {
+    // Only numbers in the RFC 8259 form are retained for lazy conversion so that the
+    // writer never emits a number it can't read back.
+    if (scan.canonical && moved <= JsonNumber::kMaxRawSize) {
+      return Json{JsonNumber{ConstStringRef{p, moved}}};
     }
-    return Json(JsonInteger(i));
+    return Json(static_cast<Number::Float>(detail::ParseFloat(p, scan.ptr)));
   }
+  return Json(JsonInteger(scan.integer));
 }
 
 Json JsonReader::ParseBoolean() {
@@ -694,10 +894,10 @@ Json JsonReader::ParseBoolean() {
   return Json{JsonBoolean{result}};
 }
 
-Json Json::Load(ConstStringRef str, std::ios::openmode mode) {
+Json Json::Load(ConstStringRef str, std::ios::openmode mode, UBJByteOrder order) {
   Json json;
   if (mode & std::ios::binary) {
-    UBJReader reader{str};
+    UBJReader reader{str, order};
     json = Json::Load(&reader);
   } else {
     JsonReader reader(str);
@@ -706,6 +906,15 @@ Json Json::Load(ConstStringRef str, std::ios::openmode mode) {
   return json;
 }
 
+Json Json::LoadFile(std::string const& path, std::ios::openmode mode,
+                    UBJByteOrder order) {
+  MappedFile file{path, MappedFile::Advice::kSequential};
+  if (IsCompressed(file.Ref())) {
+    return LoadCompressed(file.Ref(), 0, order);
+  }
+  return Json::Load(file.Ref(), mode, order);
+}
+
 Json Json::Load(JsonReader* reader) {
   Json json{reader->Load()};
   return json;
@@ -731,158 +940,130 @@ void Json::Dump(Json json, std::vector<char>* str, std::ios::openmode mode) {
 
 void Json::Dump(Json json, JsonWriter* writer) { writer->Save(json); }
 
+void Json::Share() const {
+  // Iterative walk, documents can be deeper than the stack allows.
+  std::vector<Value const*> stack{ptr_.get()};
+  while (!stack.empty()) {
+    auto node = stack.back();
+    stack.pop_back();
+    IntrusivePtrRefCount(node).Share();
+    if (IsA<JsonObject>(node)) {
+      for (auto const& kv : Cast<JsonObject const>(node)->GetObject()) {
+        stack.push_back(&kv.second.GetValue());
+      }
+    } else if (IsA<JsonArray>(node)) {
+      for (auto const& v : Cast<JsonArray const>(node)->GetArray()) {
+        stack.push_back(&v.GetValue());
+      }
+    }
+  }
+}
+
 static_assert(std::is_nothrow_move_constructible<Json>::value);
 static_assert(std::is_nothrow_move_constructible<Object>::value);
 static_assert(std::is_nothrow_move_constructible<Array>::value);
 static_assert(std::is_nothrow_move_constructible<String>::value);
 
-Json UBJReader::ParseArray() {
-  auto marker = PeekNextChar();
-
-  if (marker == '$') {  // typed array
-    GetNextChar();      // remove $
-    marker = GetNextChar();
-    auto type = marker;
-    GetConsecutiveChar('#');
-    GetConsecutiveChar('L');
-    auto n = this->ReadPrimitive<int64_t>();
-
-    marker = PeekNextChar();
-    switch (type) {
-      case 'd':
-        return ParseTypedArray<F32Array>(n);
-      case 'U':
-        return ParseTypedArray<U8Array>(n);
-      case 'l':
-        return ParseTypedArray<I32Array>(n);
-      case 'L':
-        return ParseTypedArray<I64Array>(n);
-      default:
-        LOG(FATAL) << "`" + std::string{type} +
-                          "` is not supported for typed array.";  // NOLINT
-    }
-  }
-  std::vector<Json> results;
-  if (marker == '#') {  // array with length optimization
-    GetNextChar();
-    GetConsecutiveChar('L');
-    auto n = this->ReadPrimitive<int64_t>();
-    results.resize(n);
-    for (int64_t i = 0; i < n; ++i) {
-      results[i] = Parse();
-    }
-  } else {  // normal array
-    while (marker != ']') {
-      results.emplace_back(Parse());
-      marker = PeekNextChar();
-    }
-    GetConsecutiveChar(']');
-  }
+Json UBJReader::Load() { return detail::UBJParser<UBJReader>{this}.Parse(); }
 
-  return Json{results};
-}
+// UBJStreamReader
+size_t constexpr UBJStreamReader::kDefaultBufferSize;
 
-std::string UBJReader::DecodeStr() {
-  // only L is supported right now.
-  GetConsecutiveChar('L');
-  auto bsize = this->ReadPrimitive<int64_t>();
+UBJStreamReader::UBJStreamReader(std::string const& path, size_t buffer_size,
+                                 UBJByteOrder order)
+    : JsonReader{ConstStringRef{"", 0}}, order_{order} {
+  fd_ = std::fopen(path.c_str(), "rb");
+  if (!fd_) {
+    LOG(FATAL) << "Opening " << path << " failed: " << std::strerror(errno);
+  }
+  owned_ = true;
+  this->Init(buffer_size);
+}
 
-  std::string str;
-  str.resize(bsize);
-  auto ptr = raw_str_.c_str() + cursor_.Pos();
-  std::memcpy(&str[0], ptr, bsize);
-  this->cursor_.Forward(bsize);
-  return str;
+UBJStreamReader::UBJStreamReader(FileScheme* file, size_t buffer_size,
+                                 UBJByteOrder order)
+    : JsonReader{ConstStringRef{"", 0}}, fd_{file->descriptor()}, order_{order} {
+  this->Init(buffer_size);
 }
 
-Json UBJReader::ParseObject() {
-  auto marker = PeekNextChar();
-  Object::Map results;
+UBJStreamReader::~UBJStreamReader() {
+  if (owned_) {
+    std::fclose(fd_);
+  }
+}
 
-  while (marker != '}') {
-    auto str = this->DecodeStr();
-    results.emplace(str, this->Parse());
-    marker = PeekNextChar();
+void UBJStreamReader::Init(size_t buffer_size) {
+  // The primitives are read from the buffer, it must be able to hold the largest one.
+  buffer_.resize(std::max(buffer_size, sizeof(int64_t)));
+#if defined(__unix__)
+  struct stat st;
+  auto pos = std::ftell(fd_);
+  if (fstat(fileno(fd_), &st) == 0 && S_ISREG(st.st_mode) && pos >= 0 &&
+      pos <= st.st_size) {
+    sized_ = true;
+    remaining_ = st.st_size - pos;
   }
+#endif  // defined(__unix__)
+}
 
-  GetConsecutiveChar('}');
-  return Json{std::move(results)};
+void UBJStreamReader::Error(std::string msg) const {
+  msg += ", around byte offset: " + std::to_string(consumed_);
+  LOG(FATAL) << msg;
 }
 
-Json UBJReader::Load() {
-  Json result = Parse();
-  return result;
+void UBJStreamReader::Fill() {
+  auto n_unread = end_ - beg_;
+  if (beg_ != 0) {
+    std::memmove(buffer_.data(), buffer_.data() + beg_, n_unread);
+  }
+  beg_ = 0;
+  end_ = n_unread;
+  auto n_read = std::fread(buffer_.data() + end_, 1, buffer_.size() - end_, fd_);
+  end_ += n_read;
+  remaining_ -= sized_ ? std::min(n_read, remaining_) : 0;
 }
 
-Json UBJReader::Parse() {
-  while (true) {
-    char c = PeekNextChar();
-    if (c == -1) {
-      break;
+void UBJStreamReader::Ensure(size_t n) {
+  while (NIH_UNLIKELY(end_ - beg_ < n)) {
+    auto n_buffered = end_ - beg_;
+    this->Fill();
+    if (end_ - beg_ == n_buffered) {
+      Error("Unexpected end of input");
     }
+  }
+}
 
-    GetNextChar();
-    switch (c) {
-      case '{':
-        return ParseObject();
-      case '[':
-        return ParseArray();
-      case 'Z': {
-        return Json{nullptr};
-      }
-      case 'T': {
-        return Json{JsonBoolean{true}};
-      }
-      case 'F': {
-        return Json{JsonBoolean{true}};
-      }
-      case 'd': {
-        auto v = this->ReadPrimitive<float>();
-        return Json{v};
-      }
-      case 'S': {
-        auto str = this->DecodeStr();
-        return Json{str};
-      }
-      case 'i': {
-        Integer::Int i = this->ReadPrimitive<int8_t>();
-        return Json{i};
-      }
-      case 'U': {
-        Integer::Int i = this->ReadPrimitive<uint8_t>();
-        return Json{i};
-      }
-      case 'I': {
-        Integer::Int i = this->ReadPrimitive<int16_t>();
-        return Json{i};
-      }
-      case 'l': {
-        Integer::Int i = this->ReadPrimitive<int32_t>();
-        return Json{i};
-      }
-      case 'L': {
-        auto i = this->ReadPrimitive<int64_t>();
-        return Json{i};
-      }
-      case 'C': {
-        Integer::Int i = this->ReadPrimitive<char>();
-        return Json{i};
-      }
-      case 'D': {
-        LOG(FATAL) << "f64 is not supported.";
-        break;
-      }
-      case 'H': {
-        LOG(FATAL) << "High precision number is not supported.";
-        break;
-      }
-      default:
-        Error("Unknown construct");
+void UBJStreamReader::ReadBytes(char* out, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  auto n_buffered = std::min(n, end_ - beg_);
+  std::memcpy(out, buffer_.data() + beg_, n_buffered);
+  beg_ += n_buffered;
+  consumed_ += n_buffered;
+  out += n_buffered;
+  n -= n_buffered;
+  if (n == 0) {
+    return;
+  }
+  if (n >= buffer_.size()) {
+    // Large payload, bypass the buffer.
+    auto n_read = std::fread(out, 1, n, fd_);
+    remaining_ -= sized_ ? std::min(n_read, remaining_) : 0;
+    consumed_ += n_read;
+    if (n_read != n) {
+      Error("Unexpected end of input");
     }
+  } else {
+    this->Ensure(n);
+    std::memcpy(out, buffer_.data() + beg_, n);
+    beg_ += n;
+    consumed_ += n;
   }
-  return {};
 }
 
+Json UBJStreamReader::Load() { return detail::UBJParser<UBJStreamReader>{this}.Parse(); }
+
 namespace {
 template <typename T>
 void WritePrimitive(T v, std::vector<char>* stream) {
@@ -893,7 +1074,7 @@ void WritePrimitive(T v, std::vector<char>* stream) {
   std::memcpy(ptr, &v, sizeof(v));
 }
 
-void EncodeStr(std::vector<char>* stream, std::string const& string) {
+void EncodeStr(std::vector<char>* stream, ConstStringRef string) {
   stream->push_back('L');
 
   int64_t bsize = string.size();
@@ -907,51 +1088,121 @@ void EncodeStr(std::vector<char>* stream, std::string const& string) {
 }
 }  // anonymous namespace
 
-void UBJWriter::Visit(JsonArray const* arr) {
-  stream_->emplace_back('[');
-  auto const& vec = arr->GetArray();
-  int64_t n = vec.size();
-  stream_->push_back('#');
-  stream_->push_back('L');
-  WritePrimitive(n, stream_);
-  for (auto const& v : vec) {
-    this->Save(v);
-  }
-}
-
-template <typename T, Value::ValueKind kind>
-void WriteTypedArray(JsonTypedArray<T, kind> const* arr, std::vector<char>* stream) {
-  stream->emplace_back('[');
-  stream->push_back('$');
+namespace {
+template <typename T>
+char TypedArrayMarker() {
   if (std::is_same<T, float>::value) {
-    stream->push_back('d');
+    return 'd';
   } else if (std::is_same<T, int8_t>::value) {
-    stream->push_back('i');
+    return 'i';
   } else if (std::is_same<T, uint8_t>::value) {
-    stream->push_back('U');
+    return 'U';
   } else if (std::is_same<T, int32_t>::value) {
-    stream->push_back('l');
+    return 'l';
   } else if (std::is_same<T, int64_t>::value) {
-    stream->push_back('L');
-  } else {
-    LOG(FATAL) << "Not implemented";
+    return 'L';
   }
+  LOG(FATAL) << "Not implemented";
+  return 0;
+}
 
+/**
+ * \brief Write n elements as a typed array of T, the i^th element is `get(i)`.
+ */
+template <typename T, typename Fn>
+void WriteTypedArray(std::size_t n, Fn&& get, std::vector<char>* stream) {
+  stream->emplace_back('[');
+  stream->push_back('$');
+  stream->push_back(TypedArrayMarker<T>());
   stream->push_back('#');
   stream->push_back('L');
 
-  int64_t n = arr->Size();
-  WritePrimitive(n, stream);
+  WritePrimitive(static_cast<int64_t>(n), stream);
   auto s = stream->size();
-  stream->resize(s + arr->Size() * sizeof(T));
-  auto const& vec = arr->GetArray();
-  for (int64_t i = 0; i < n; ++i) {
-    auto v = ToBigEndian(vec[i]);
+  stream->resize(s + n * sizeof(T));
+  for (std::size_t i = 0; i < n; ++i) {
+    auto v = ToBigEndian(static_cast<T>(get(i)));
     std::memcpy(stream->data() + s, &v, sizeof(v));
     s += sizeof(v);
   }
 }
 
+/**
+ * \brief Write the array as a typed array if its elements are all integers or all
+ *        numbers.  Returns false if nothing is written.
+ */
+bool WriteHomogeneousArray(std::vector<Json> const& vec, std::vector<char>* stream) {
+  if (vec.empty()) {
+    return false;
+  }
+  auto kind = vec.front().GetValue().Type();
+  if (kind != Value::ValueKind::kInteger && kind != Value::ValueKind::kNumber) {
+    return false;
+  }
+  auto lo = std::numeric_limits<int64_t>::max(), hi = std::numeric_limits<int64_t>::min();
+  for (auto const& v : vec) {
+    auto const& value = v.GetValue();
+    if (value.Type() != kind) {
+      return false;
+    }
+    if (kind == Value::ValueKind::kInteger) {
+      auto i = Cast<JsonInteger const>(&value)->GetInteger();
+      lo = std::min(lo, i);
+      hi = std::max(hi, i);
+    } else if (!Cast<JsonNumber const>(&value)->IsExactFloat()) {
+      // Doubles are written as they are.
+      return false;
+    }
+  }
+
+  if (kind == Value::ValueKind::kNumber) {
+    auto get = [&](std::size_t i) {
+      return Cast<JsonNumber const>(&vec[i].GetValue())->GetNumber();
+    };
+    WriteTypedArray<float>(vec.size(), get, stream);
+    return true;
+  }
+  auto get = [&](std::size_t i) {
+    return Cast<JsonInteger const>(&vec[i].GetValue())->GetInteger();
+  };
+  if (lo >= 0 && hi <= std::numeric_limits<uint8_t>::max()) {
+    WriteTypedArray<uint8_t>(vec.size(), get, stream);
+  } else if (lo >= std::numeric_limits<int32_t>::min() &&
+             hi <= std::numeric_limits<int32_t>::max()) {
+    WriteTypedArray<int32_t>(vec.size(), get, stream);
+  } else {
+    WriteTypedArray<int64_t>(vec.size(), get, stream);
+  }
+  return true;
+}
+}  // anonymous namespace
+
+void UBJWriter::Visit(JsonArray const* arr) {
+  auto const& vec = arr->GetArray();
+  if (typed_arrays_ && WriteHomogeneousArray(vec, stream_)) {
+    return;
+  }
+  stream_->emplace_back('[');
+  int64_t n = vec.size();
+  stream_->push_back('#');
+  stream_->push_back('L');
+  WritePrimitive(n, stream_);
+  for (auto const& v : vec) {
+    Write(this, v.GetValue());
+  }
+}
+
+template <typename T>
+void WriteTypedArray(Span<T const> arr, std::vector<char>* stream) {
+  WriteTypedArray<T>(arr.size(), [&](std::size_t i) { return arr[i]; }, stream);
+}
+
+template <typename T, Value::ValueKind kind>
+void WriteTypedArray(JsonTypedArray<T, kind> const* arr, std::vector<char>* stream) {
+  auto const& vec = arr->GetArray();
+  WriteTypedArray(Span<T const>{vec.data(), vec.size()}, stream);
+}
+
 void UBJWriter::Visit(F32Array const* arr) { WriteTypedArray(arr, stream_); }
 void UBJWriter::Visit(U8Array const* arr) { WriteTypedArray(arr, stream_); }
 void UBJWriter::Visit(I32Array const* arr) { WriteTypedArray(arr, stream_); }
@@ -962,36 +1213,46 @@ void UBJWriter::Visit(JsonObject const* obj) {
   for (auto const& value : obj->GetObject()) {
     auto const& key = value.first;
     EncodeStr(stream_, key);
-    this->Save(value.second);
+    Write(this, value.second.GetValue());
   }
   stream_->emplace_back('}');
 }
 
 void UBJWriter::Visit(JsonNumber const* num) {
+  if (!num->IsExactFloat()) {
+    stream_->push_back('D');
+    WritePrimitive(num->GetDouble(), stream_);
+    return;
+  }
   stream_->push_back('d');
   auto val = num->GetNumber();
   WritePrimitive(val, stream_);
 }
 
-void UBJWriter::Visit(JsonInteger const* num) {
-  auto i = num->GetInteger();
+namespace {
+void WriteUBJInteger(int64_t i, std::vector<char>* stream) {
   if (i > std::numeric_limits<int8_t>::min() &&
       i < std::numeric_limits<int8_t>::max()) {
-    stream_->push_back('i');
-    WritePrimitive(static_cast<int8_t>(i), stream_);
+    stream->push_back('i');
+    WritePrimitive(static_cast<int8_t>(i), stream);
   } else if (i > std::numeric_limits<int16_t>::min() &&
              i < std::numeric_limits<int16_t>::max()) {
-    stream_->push_back('I');
-    WritePrimitive(static_cast<int16_t>(i), stream_);
+    stream->push_back('I');
+    WritePrimitive(static_cast<int16_t>(i), stream);
   } else if (i > std::numeric_limits<int32_t>::min() &&
              i < std::numeric_limits<int32_t>::max()) {
-    stream_->push_back('l');
-    WritePrimitive(static_cast<int32_t>(i), stream_);
+    stream->push_back('l');
+    WritePrimitive(static_cast<int32_t>(i), stream);
   } else {
-    stream_->push_back('L');
-    WritePrimitive(i, stream_);
+    stream->push_back('L');
+    WritePrimitive(i, stream);
   }
 }
+}  // anonymous namespace
+
+void UBJWriter::Visit(JsonInteger const* num) {
+  WriteUBJInteger(num->GetInteger(), stream_);
+}
 
 void UBJWriter::Visit(JsonNull const*) { stream_->push_back('Z'); }
 
@@ -1004,5 +1265,173 @@ void UBJWriter::Visit(JsonBoolean const* boolean) {
   stream_->push_back(boolean->GetBoolean() ? 'T' : 'F');
 }
 
-void UBJWriter::Save(Json json) { json.Ptr()->Save(this); }
+void UBJWriter::Save(Json json) { Write(this, json.GetValue()); }
+
+void JsonStreamWriter::BeforeValue() {
+  if (stack_.empty()) {
+    if (NIH_UNLIKELY(done_)) {
+      LOG(FATAL) << "A document can only have one top-level value.";
+    }
+    return;
+  }
+  auto& top = stack_.back();
+  if (top.is_object) {
+    if (NIH_UNLIKELY(!top.has_key)) {
+      LOG(FATAL) << "Expecting a key before the value in an object.";
+    }
+    top.has_key = false;
+  } else if (!top.empty && !binary_) {
+    stream_->push_back(',');
+  }
+  top.empty = false;
+}
+
+void JsonStreamWriter::Begin(bool is_object) {
+  this->BeforeValue();
+  stack_.push_back(Frame{is_object, false, true});
+  stream_->push_back(is_object ? '{' : '[');
+}
+
+JsonStreamWriter& JsonStreamWriter::End() {
+  if (NIH_UNLIKELY(stack_.empty())) {
+    LOG(FATAL) << "No open object or array to end.";
+  }
+  auto top = stack_.back();
+  if (NIH_UNLIKELY(top.has_key)) {
+    LOG(FATAL) << "Missing value for the last key in object.";
+  }
+  stack_.pop_back();
+  stream_->push_back(top.is_object ? '}' : ']');
+  this->AfterValue();
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::Key(ConstStringRef key) {
+  if (NIH_UNLIKELY(stack_.empty() || !stack_.back().is_object)) {
+    LOG(FATAL) << "Key `" << key << "` is written outside of an object.";
+  }
+  auto& top = stack_.back();
+  if (NIH_UNLIKELY(top.has_key)) {
+    LOG(FATAL) << "Missing value for the last key in object.";
+  }
+  if (binary_) {
+    EncodeStr(stream_, key);
+  } else {
+    if (!top.empty) {
+      stream_->push_back(',');
+    }
+    WriteTextStr(stream_, key, ensure_ascii_);
+    stream_->push_back(':');
+  }
+  top.has_key = true;
+  top.empty = false;
+  return *this;
+}
+
+void JsonStreamWriter::IntegerOverflow(uint64_t v) const {
+  LOG(FATAL) << "Integer " << v << " is out of the range of int64_t.";
+}
+
+JsonStreamWriter& JsonStreamWriter::Value(int64_t v) {
+  this->BeforeValue();
+  if (binary_) {
+    WriteUBJInteger(v, stream_);
+  } else {
+    WriteTextInteger(stream_, v);
+  }
+  this->AfterValue();
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::Value(float v) {
+  this->BeforeValue();
+  if (binary_) {
+    stream_->push_back('d');
+    WritePrimitive(v, stream_);
+  } else {
+    WriteTextNumber(stream_, v);
+  }
+  this->AfterValue();
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::Value(double v) {
+  auto f = static_cast<float>(v);
+  if (binary_ && (static_cast<double>(f) == v || std::isnan(v))) {
+    return this->Value(f);
+  }
+  this->BeforeValue();
+  if (binary_) {
+    stream_->push_back('D');
+    WritePrimitive(v, stream_);
+  } else {
+    WriteTextNumber(stream_, v);
+  }
+  this->AfterValue();
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::Value(bool v) {
+  this->BeforeValue();
+  if (binary_) {
+    stream_->push_back(v ? 'T' : 'F');
+  } else if (v) {
+    AppendBytes(stream_, "true", 4);
+  } else {
+    AppendBytes(stream_, "false", 5);
+  }
+  this->AfterValue();
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::Value(ConstStringRef v) {
+  this->BeforeValue();
+  if (binary_) {
+    stream_->push_back('S');
+    EncodeStr(stream_, v);
+  } else {
+    WriteTextStr(stream_, v, ensure_ascii_);
+  }
+  this->AfterValue();
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::Value(Json const& v) {
+  this->BeforeValue();
+  if (binary_) {
+    UBJWriter{stream_}.Save(v);
+  } else {
+    JsonWriter{stream_, ensure_ascii_}.Save(v);
+  }
+  this->AfterValue();
+  return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::Null() {
+  this->BeforeValue();
+  if (binary_) {
+    stream_->push_back('Z');
+  } else {
+    AppendBytes(stream_, "null", 4);
+  }
+  this->AfterValue();
+  return *this;
+}
+
+template <typename T>
+JsonStreamWriter& JsonStreamWriter::Array(Span<T const> values) {
+  this->BeforeValue();
+  if (binary_) {
+    WriteTypedArray(values, stream_);
+  } else {
+    WriteTextArray(values, stream_);
+  }
+  this->AfterValue();
+  return *this;
+}
+
+template JsonStreamWriter& JsonStreamWriter::Array(Span<float const> values);
+template JsonStreamWriter& JsonStreamWriter::Array(Span<uint8_t const> values);
+template JsonStreamWriter& JsonStreamWriter::Array(Span<int32_t const> values);
+template JsonStreamWriter& JsonStreamWriter::Array(Span<int64_t const> values);
 }  // namespace nih
\ No newline at end of file
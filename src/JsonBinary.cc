@@ -0,0 +1,726 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief MessagePack and CBOR encodings for Json.
+ */
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "nih/Json.h"
+#include "nih/JsonIO.h"
+#include "nih/Logging.h"
+
+namespace nih {
+namespace {
+template <typename T>
+void WriteBE(T v, std::vector<char>* stream) {
+  v = ToBigEndian(v);
+  auto s = stream->size();
+  stream->resize(s + sizeof(v));
+  std::memcpy(stream->data() + s, &v, sizeof(v));
+}
+
+void WriteBytes(char const* ptr, size_t n, std::vector<char>* stream) {
+  auto s = stream->size();
+  stream->resize(s + n);
+  std::memcpy(stream->data() + s, ptr, n);
+}
+
+/*! \brief Write elements of a typed array in big endian. */
+template <typename T>
+void WriteTypedPayload(std::vector<T> const& vec, std::vector<char>* stream) {
+  auto s = stream->size();
+  stream->resize(s + vec.size() * sizeof(T));
+  auto ptr = stream->data() + s;
+  for (auto v : vec) {
+    v = ToBigEndian(v);
+    std::memcpy(ptr, &v, sizeof(v));
+    ptr += sizeof(v);
+  }
+}
+
+template <typename T, std::enable_if_t<sizeof(T) == 1>* = nullptr>
+T FromLittleEndian(T v) {
+  return v;
+}
+
+template <typename T, std::enable_if_t<sizeof(T) != 1>* = nullptr>
+T FromLittleEndian(T v) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  auto constexpr kS = sizeof(T);
+  std::conditional_t<kS == 2, uint16_t, std::conditional_t<kS == 4, uint32_t, uint64_t>>
+      u;
+  std::memcpy(&u, &v, sizeof(u));
+  u = BuiltinBSwap(u);
+  std::memcpy(&v, &u, sizeof(u));
+#endif  // __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return v;
+}
+
+/*! \brief Decode typed array elements from raw bytes. */
+template <typename TypedArray>
+Json DecodeTypedArray(char const* ptr, size_t n_bytes, bool little_endian) {
+  using T = typename TypedArray::Type;
+  TypedArray results{n_bytes / sizeof(T)};
+  auto& vec = results.GetArray();
+  std::memcpy(vec.data(), ptr, vec.size() * sizeof(T));
+  for (auto& v : vec) {
+    v = little_endian ? FromLittleEndian(v) : ToBigEndian(v);
+  }
+  return Json{std::move(results)};
+}
+
+// From RFC 8949 appendix D.
+float HalfToFloat(uint16_t half) {
+  int32_t exp = (half >> 10) & 0x1f;
+  int32_t mant = half & 0x3ff;
+  float val;
+  if (exp == 0) {
+    val = std::ldexp(static_cast<float>(mant), -24);
+  } else if (exp != 31) {
+    val = std::ldexp(static_cast<float>(mant + 1024), exp - 25);
+  } else {
+    val = mant == 0 ? std::numeric_limits<float>::infinity()
+                    : std::numeric_limits<float>::quiet_NaN();
+  }
+  return (half & 0x8000) ? -val : val;
+}
+}  // anonymous namespace
+
+// MessagePack
+Json MsgPackReader::Load() { return Parse(); }
+
+std::string MsgPackReader::DecodeStr(size_t n) {
+  auto ptr = this->Consume(n);
+  return std::string{ptr, n};
+}
+
+Json MsgPackReader::ParseArray(size_t n) {
+  // Each element occupies at least 1 byte.
+  if (NIH_UNLIKELY(n > Remaining())) {
+    Error("Invalid length of array: " + std::to_string(n));
+  }
+  std::vector<Json> results(n);
+  for (size_t i = 0; i < n; ++i) {
+    results[i] = Parse();
+  }
+  return Json{std::move(results)};
+}
+
+Json MsgPackReader::ParseObject(size_t n) {
+  if (NIH_UNLIKELY(n > Remaining() / 2)) {
+    Error("Invalid length of map: " + std::to_string(n));
+  }
+  Object::Map results;
+  for (size_t i = 0; i < n; ++i) {
+    auto marker = static_cast<uint8_t>(GetNextChar());
+    size_t len;
+    if ((marker & 0xe0) == 0xa0) {
+      len = marker & 0x1f;
+    } else if (marker == 0xd9) {
+      len = ReadPrimitive<uint8_t>();
+    } else if (marker == 0xda) {
+      len = ReadPrimitive<uint16_t>();
+    } else if (marker == 0xdb) {
+      len = ReadPrimitive<uint32_t>();
+    } else {
+      Error("Key of map must be a string.");
+      return {};
+    }
+    auto key = this->DecodeStr(len);
+    results.emplace(std::move(key), this->Parse());
+  }
+  return Json{std::move(results)};
+}
+
+template <typename TypedArray>
+Json MsgPackReader::ParseTypedArray(size_t n_bytes) {
+  using T = typename TypedArray::Type;
+  if (NIH_UNLIKELY(n_bytes % sizeof(T) != 0)) {
+    Error("Invalid length of typed array: " + std::to_string(n_bytes));
+  }
+  auto ptr = this->Consume(n_bytes);
+  return DecodeTypedArray<TypedArray>(ptr, n_bytes, false);
+}
+
+Json MsgPackReader::ParseExt(size_t n_bytes) {
+  auto type = ReadPrimitive<int8_t>();
+  switch (type) {
+    case MsgPackWriter::kF32Array:
+      return ParseTypedArray<F32Array>(n_bytes);
+    case MsgPackWriter::kI32Array:
+      return ParseTypedArray<I32Array>(n_bytes);
+    case MsgPackWriter::kI64Array:
+      return ParseTypedArray<I64Array>(n_bytes);
+    default:
+      Error("Unsupported extension type: " + std::to_string(type));
+  }
+  return {};
+}
+
+Json MsgPackReader::Parse() {
+  if (NIH_UNLIKELY(Remaining() == 0)) {
+    Error("Unexpected end of input");
+  }
+  auto marker = static_cast<uint8_t>(GetNextChar());
+  if (marker <= 0x7f) {
+    return Json{static_cast<Integer::Int>(marker)};
+  }
+  if (marker >= 0xe0) {
+    return Json{static_cast<Integer::Int>(static_cast<int8_t>(marker))};
+  }
+  if ((marker & 0xf0) == 0x80) {
+    return ParseObject(marker & 0x0f);
+  }
+  if ((marker & 0xf0) == 0x90) {
+    return ParseArray(marker & 0x0f);
+  }
+  if ((marker & 0xe0) == 0xa0) {
+    return Json{DecodeStr(marker & 0x1f)};
+  }
+
+  switch (marker) {
+    case 0xc0:
+      return Json{nullptr};
+    case 0xc2:
+      return Json{JsonBoolean{false}};
+    case 0xc3:
+      return Json{JsonBoolean{true}};
+    case 0xc4:
+      return ParseTypedArray<U8Array>(ReadPrimitive<uint8_t>());
+    case 0xc5:
+      return ParseTypedArray<U8Array>(ReadPrimitive<uint16_t>());
+    case 0xc6:
+      return ParseTypedArray<U8Array>(ReadPrimitive<uint32_t>());
+    case 0xc7:
+      return ParseExt(ReadPrimitive<uint8_t>());
+    case 0xc8:
+      return ParseExt(ReadPrimitive<uint16_t>());
+    case 0xc9:
+      return ParseExt(ReadPrimitive<uint32_t>());
+    case 0xca:
+      return Json{ReadPrimitive<float>()};
+    case 0xcb:
+      return Json{ReadPrimitive<double>()};
+    case 0xcc:
+      return Json{static_cast<Integer::Int>(ReadPrimitive<uint8_t>())};
+    case 0xcd:
+      return Json{static_cast<Integer::Int>(ReadPrimitive<uint16_t>())};
+    case 0xce:
+      return Json{static_cast<Integer::Int>(ReadPrimitive<uint32_t>())};
+    case 0xcf: {
+      auto u = ReadPrimitive<uint64_t>();
+      if (NIH_UNLIKELY(u > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))) {
+        Error("Integer overflow.");
+      }
+      return Json{static_cast<Integer::Int>(u)};
+    }
+    case 0xd0:
+      return Json{static_cast<Integer::Int>(ReadPrimitive<int8_t>())};
+    case 0xd1:
+      return Json{static_cast<Integer::Int>(ReadPrimitive<int16_t>())};
+    case 0xd2:
+      return Json{static_cast<Integer::Int>(ReadPrimitive<int32_t>())};
+    case 0xd3:
+      return Json{ReadPrimitive<int64_t>()};
+    case 0xd4:
+      return ParseExt(1);
+    case 0xd5:
+      return ParseExt(2);
+    case 0xd6:
+      return ParseExt(4);
+    case 0xd7:
+      return ParseExt(8);
+    case 0xd8:
+      return ParseExt(16);
+    case 0xd9:
+      return Json{DecodeStr(ReadPrimitive<uint8_t>())};
+    case 0xda:
+      return Json{DecodeStr(ReadPrimitive<uint16_t>())};
+    case 0xdb:
+      return Json{DecodeStr(ReadPrimitive<uint32_t>())};
+    case 0xdc:
+      return ParseArray(ReadPrimitive<uint16_t>());
+    case 0xdd:
+      return ParseArray(ReadPrimitive<uint32_t>());
+    case 0xde:
+      return ParseObject(ReadPrimitive<uint16_t>());
+    case 0xdf:
+      return ParseObject(ReadPrimitive<uint32_t>());
+    default:
+      Error("Unknown construct");
+  }
+  return {};
+}
+
+namespace {
+/**
+ * \brief Write the header for str, bin and ext families, where the 16-bit and 32-bit
+ *        markers follow the 8-bit one.  Use fix_limit = 0 for families without a
+ *        fixed length variant.
+ */
+void MsgPackHeader(size_t n, uint8_t fix_marker, size_t fix_limit, uint8_t marker8,
+                   std::vector<char>* stream) {
+  if (n < fix_limit) {
+    stream->push_back(static_cast<char>(fix_marker | n));
+  } else if (n <= std::numeric_limits<uint8_t>::max()) {
+    stream->push_back(static_cast<char>(marker8));
+    WriteBE(static_cast<uint8_t>(n), stream);
+  } else if (n <= std::numeric_limits<uint16_t>::max()) {
+    stream->push_back(static_cast<char>(marker8 + 1));
+    WriteBE(static_cast<uint16_t>(n), stream);
+  } else {
+    NIH_ASSERT_LE(n, std::numeric_limits<uint32_t>::max()) << "Payload is too large.";
+    stream->push_back(static_cast<char>(marker8 + 2));
+    WriteBE(static_cast<uint32_t>(n), stream);
+  }
+}
+
+/*! \brief Write the header for arrays and maps. */
+void MsgPackContainer(size_t n, uint8_t fix_marker, uint8_t marker16,
+                      std::vector<char>* stream) {
+  if (n < 16) {
+    stream->push_back(static_cast<char>(fix_marker | n));
+  } else if (n <= std::numeric_limits<uint16_t>::max()) {
+    stream->push_back(static_cast<char>(marker16));
+    WriteBE(static_cast<uint16_t>(n), stream);
+  } else {
+    NIH_ASSERT_LE(n, std::numeric_limits<uint32_t>::max()) << "Container is too large.";
+    stream->push_back(static_cast<char>(marker16 + 1));
+    WriteBE(static_cast<uint32_t>(n), stream);
+  }
+}
+
+void MsgPackStr(std::string const& str, std::vector<char>* stream) {
+  MsgPackHeader(str.size(), 0xa0, 32, 0xd9, stream);
+  WriteBytes(str.data(), str.size(), stream);
+}
+
+template <typename T>
+void MsgPackExtArray(std::vector<T> const& vec, int8_t type, std::vector<char>* stream) {
+  size_t n_bytes = vec.size() * sizeof(T);
+  MsgPackHeader(n_bytes, 0, 0, 0xc7, stream);
+  WriteBE(type, stream);
+  WriteTypedPayload(vec, stream);
+}
+}  // anonymous namespace
+
+void MsgPackWriter::Visit(JsonArray const* arr) {
+  auto const& vec = arr->GetArray();
+  MsgPackContainer(vec.size(), 0x90, 0xdc, stream_);
+  for (auto const& v : vec) {
+    Write(this, v.GetValue());
+  }
+}
+
+void MsgPackWriter::Visit(F32Array const* arr) {
+  MsgPackExtArray(arr->GetArray(), kF32Array, stream_);
+}
+void MsgPackWriter::Visit(U8Array const* arr) {
+  auto const& vec = arr->GetArray();
+  MsgPackHeader(vec.size(), 0, 0, 0xc4, stream_);
+  WriteBytes(reinterpret_cast<char const*>(vec.data()), vec.size(), stream_);
+}
+void MsgPackWriter::Visit(I32Array const* arr) {
+  MsgPackExtArray(arr->GetArray(), kI32Array, stream_);
+}
+void MsgPackWriter::Visit(I64Array const* arr) {
+  MsgPackExtArray(arr->GetArray(), kI64Array, stream_);
+}
+
+void MsgPackWriter::Visit(JsonObject const* obj) {
+  auto const& map = obj->GetObject();
+  MsgPackContainer(map.size(), 0x80, 0xde, stream_);
+  for (auto const& kv : map) {
+    MsgPackStr(kv.first, stream_);
+    Write(this, kv.second.GetValue());
+  }
+}
+
+void MsgPackWriter::Visit(JsonNumber const* num) {
+  if (!num->IsExactFloat()) {
+    stream_->push_back(static_cast<char>(0xcb));
+    WriteBE(num->GetDouble(), stream_);
+    return;
+  }
+  stream_->push_back(static_cast<char>(0xca));
+  WriteBE(num->GetNumber(), stream_);
+}
+
+void MsgPackWriter::Visit(JsonInteger const* num) {
+  auto i = num->GetInteger();
+  if (i >= 0) {
+    if (i <= 0x7f) {
+      stream_->push_back(static_cast<char>(i));
+    } else if (i <= std::numeric_limits<uint8_t>::max()) {
+      stream_->push_back(static_cast<char>(0xcc));
+      WriteBE(static_cast<uint8_t>(i), stream_);
+    } else if (i <= std::numeric_limits<uint16_t>::max()) {
+      stream_->push_back(static_cast<char>(0xcd));
+      WriteBE(static_cast<uint16_t>(i), stream_);
+    } else if (i <= std::numeric_limits<uint32_t>::max()) {
+      stream_->push_back(static_cast<char>(0xce));
+      WriteBE(static_cast<uint32_t>(i), stream_);
+    } else {
+      stream_->push_back(static_cast<char>(0xcf));
+      WriteBE(static_cast<uint64_t>(i), stream_);
+    }
+  } else {
+    if (i >= -32) {
+      stream_->push_back(static_cast<char>(i));
+    } else if (i >= std::numeric_limits<int8_t>::min()) {
+      stream_->push_back(static_cast<char>(0xd0));
+      WriteBE(static_cast<int8_t>(i), stream_);
+    } else if (i >= std::numeric_limits<int16_t>::min()) {
+      stream_->push_back(static_cast<char>(0xd1));
+      WriteBE(static_cast<int16_t>(i), stream_);
+    } else if (i >= std::numeric_limits<int32_t>::min()) {
+      stream_->push_back(static_cast<char>(0xd2));
+      WriteBE(static_cast<int32_t>(i), stream_);
+    } else {
+      stream_->push_back(static_cast<char>(0xd3));
+      WriteBE(i, stream_);
+    }
+  }
+}
+
+void MsgPackWriter::Visit(JsonNull const*) { stream_->push_back(static_cast<char>(0xc0)); }
+
+void MsgPackWriter::Visit(JsonString const* str) { MsgPackStr(str->GetString(), stream_); }
+
+void MsgPackWriter::Visit(JsonBoolean const* boolean) {
+  stream_->push_back(static_cast<char>(boolean->GetBoolean() ? 0xc3 : 0xc2));
+}
+
+void MsgPackWriter::Save(Json json) { Write(this, json.GetValue()); }
+
+// CBOR
+namespace {
+enum CBORMajor : uint8_t {
+  kUnsigned = 0,
+  kNegative = 1,
+  kBytes = 2,
+  kText = 3,
+  kArray = 4,
+  kMap = 5,
+  kTag = 6,
+  kSimple = 7
+};
+
+std::uint8_t constexpr kIndefinite = 31;
+std::uint8_t constexpr kBreak = 0xff;
+
+// RFC 8746 typed array tags, 0b010_f_s_e_ll
+std::uint64_t constexpr kTagU8 = 64;
+std::uint64_t constexpr kTagI32BE = 74;
+std::uint64_t constexpr kTagI64BE = 75;
+std::uint64_t constexpr kTagI32LE = 78;
+std::uint64_t constexpr kTagI64LE = 79;
+std::uint64_t constexpr kTagF32BE = 81;
+std::uint64_t constexpr kTagF32LE = 85;
+
+void CBORHeader(uint8_t major, uint64_t arg, std::vector<char>* stream) {
+  auto m = static_cast<uint8_t>(major << 5);
+  if (arg < 24) {
+    stream->push_back(static_cast<char>(m | arg));
+  } else if (arg <= std::numeric_limits<uint8_t>::max()) {
+    stream->push_back(static_cast<char>(m | 24));
+    WriteBE(static_cast<uint8_t>(arg), stream);
+  } else if (arg <= std::numeric_limits<uint16_t>::max()) {
+    stream->push_back(static_cast<char>(m | 25));
+    WriteBE(static_cast<uint16_t>(arg), stream);
+  } else if (arg <= std::numeric_limits<uint32_t>::max()) {
+    stream->push_back(static_cast<char>(m | 26));
+    WriteBE(static_cast<uint32_t>(arg), stream);
+  } else {
+    stream->push_back(static_cast<char>(m | 27));
+    WriteBE(arg, stream);
+  }
+}
+
+template <typename T>
+void CBORTypedArray(std::vector<T> const& vec, uint64_t tag, std::vector<char>* stream) {
+  CBORHeader(kTag, tag, stream);
+  CBORHeader(kBytes, vec.size() * sizeof(T), stream);
+  WriteTypedPayload(vec, stream);
+}
+}  // anonymous namespace
+
+Json CBORReader::Load() { return Parse(); }
+
+bool CBORReader::AtBreak() {
+  if (NIH_UNLIKELY(Remaining() == 0)) {
+    Error("Unexpected end of input");
+  }
+  if (static_cast<uint8_t>(PeekNextChar()) == kBreak) {
+    GetNextChar();
+    return true;
+  }
+  return false;
+}
+
+bool CBORReader::ReadArgument(uint8_t info, uint64_t* arg) {
+  switch (info) {
+    case 24:
+      *arg = ReadPrimitive<uint8_t>();
+      return true;
+    case 25:
+      *arg = ReadPrimitive<uint16_t>();
+      return true;
+    case 26:
+      *arg = ReadPrimitive<uint32_t>();
+      return true;
+    case 27:
+      *arg = ReadPrimitive<uint64_t>();
+      return true;
+    case kIndefinite:
+      return false;
+    default:
+      if (NIH_UNLIKELY(info > 27)) {
+        Error("Invalid additional information: " + std::to_string(info));
+      }
+      *arg = info;
+      return true;
+  }
+}
+
+std::string CBORReader::DecodeStr(uint8_t info, uint8_t major) {
+  uint64_t n;
+  if (ReadArgument(info, &n)) {
+    if (NIH_UNLIKELY(n > Remaining())) {
+      Error("Invalid length of string: " + std::to_string(n));
+    }
+    auto ptr = this->Consume(n);
+    return std::string{ptr, n};
+  }
+  // Indefinite length, concatenate the definite length chunks.
+  std::string result;
+  while (!AtBreak()) {
+    auto head = static_cast<uint8_t>(GetNextChar());
+    if (NIH_UNLIKELY((head >> 5) != major || (head & 0x1f) == kIndefinite)) {
+      Error("Invalid chunk in indefinite length string.");
+    }
+    result += DecodeStr(head & 0x1f, major);
+  }
+  return result;
+}
+
+Json CBORReader::ParseArray(uint8_t info) {
+  std::vector<Json> results;
+  uint64_t n;
+  if (ReadArgument(info, &n)) {
+    // Each element occupies at least 1 byte.
+    if (NIH_UNLIKELY(n > Remaining())) {
+      Error("Invalid length of array: " + std::to_string(n));
+    }
+    results.resize(n);
+    for (uint64_t i = 0; i < n; ++i) {
+      results[i] = Parse();
+    }
+  } else {
+    while (!AtBreak()) {
+      results.emplace_back(Parse());
+    }
+  }
+  return Json{std::move(results)};
+}
+
+Json CBORReader::ParseObject(uint8_t info) {
+  Object::Map results;
+  auto parse_kv = [&] {
+    auto head = static_cast<uint8_t>(GetNextChar());
+    if (NIH_UNLIKELY((head >> 5) != kText)) {
+      Error("Key of map must be a text string.");
+    }
+    auto key = DecodeStr(head & 0x1f, kText);
+    results.emplace(std::move(key), Parse());
+  };
+  uint64_t n;
+  if (ReadArgument(info, &n)) {
+    if (NIH_UNLIKELY(n > Remaining() / 2)) {
+      Error("Invalid length of map: " + std::to_string(n));
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+      parse_kv();
+    }
+  } else {
+    while (!AtBreak()) {
+      parse_kv();
+    }
+  }
+  return Json{std::move(results)};
+}
+
+template <typename TypedArray>
+Json CBORReader::ParseTypedArray(bool little_endian) {
+  using T = typename TypedArray::Type;
+  auto head = static_cast<uint8_t>(GetNextChar());
+  if (NIH_UNLIKELY((head >> 5) != kBytes)) {
+    Error("Typed array must be a byte string.");
+  }
+  auto bytes = DecodeStr(head & 0x1f, kBytes);
+  if (NIH_UNLIKELY(bytes.size() % sizeof(T) != 0)) {
+    Error("Invalid length of typed array: " + std::to_string(bytes.size()));
+  }
+  return DecodeTypedArray<TypedArray>(bytes.data(), bytes.size(), little_endian);
+}
+
+Json CBORReader::ParseTag(uint64_t tag) {
+  switch (tag) {
+    case kTagU8:
+      return ParseTypedArray<U8Array>(false);
+    case kTagI32BE:
+      return ParseTypedArray<I32Array>(false);
+    case kTagI32LE:
+      return ParseTypedArray<I32Array>(true);
+    case kTagI64BE:
+      return ParseTypedArray<I64Array>(false);
+    case kTagI64LE:
+      return ParseTypedArray<I64Array>(true);
+    case kTagF32BE:
+      return ParseTypedArray<F32Array>(false);
+    case kTagF32LE:
+      return ParseTypedArray<F32Array>(true);
+    default:
+      // Semantic tags like date time are not represented in Json.
+      return Parse();
+  }
+}
+
+Json CBORReader::ParseSimple(uint8_t info) {
+  switch (info) {
+    case 20:
+      return Json{JsonBoolean{false}};
+    case 21:
+      return Json{JsonBoolean{true}};
+    case 22:  // null
+    case 23:  // undefined
+      return Json{nullptr};
+    case 25:
+      return Json{HalfToFloat(ReadPrimitive<uint16_t>())};
+    case 26:
+      return Json{ReadPrimitive<float>()};
+    case 27:
+      return Json{ReadPrimitive<double>()};
+    default:
+      Error("Unsupported simple value: " + std::to_string(info));
+  }
+  return {};
+}
+
+Json CBORReader::Parse() {
+  if (NIH_UNLIKELY(Remaining() == 0)) {
+    Error("Unexpected end of input");
+  }
+  auto head = static_cast<uint8_t>(GetNextChar());
+  uint8_t major = head >> 5;
+  uint8_t info = head & 0x1f;
+  uint64_t arg{0};
+  switch (major) {
+    case kUnsigned: {
+      if (NIH_UNLIKELY(!ReadArgument(info, &arg) ||
+                       arg > static_cast<uint64_t>(
+                                 std::numeric_limits<int64_t>::max()))) {
+        Error("Invalid unsigned integer.");
+      }
+      return Json{static_cast<Integer::Int>(arg)};
+    }
+    case kNegative: {
+      if (NIH_UNLIKELY(!ReadArgument(info, &arg) ||
+                       arg > static_cast<uint64_t>(
+                                 std::numeric_limits<int64_t>::max()))) {
+        Error("Invalid negative integer.");
+      }
+      return Json{static_cast<Integer::Int>(-1 - static_cast<int64_t>(arg))};
+    }
+    case kBytes: {
+      auto bytes = DecodeStr(info, kBytes);
+      return DecodeTypedArray<U8Array>(bytes.data(), bytes.size(), false);
+    }
+    case kText:
+      return Json{DecodeStr(info, kText)};
+    case kArray:
+      return ParseArray(info);
+    case kMap:
+      return ParseObject(info);
+    case kTag: {
+      if (NIH_UNLIKELY(!ReadArgument(info, &arg))) {
+        Error("Invalid tag.");
+      }
+      return ParseTag(arg);
+    }
+    case kSimple:
+    default:
+      return ParseSimple(info);
+  }
+}
+
+void CBORWriter::Visit(JsonArray const* arr) {
+  auto const& vec = arr->GetArray();
+  CBORHeader(kArray, vec.size(), stream_);
+  for (auto const& v : vec) {
+    Write(this, v.GetValue());
+  }
+}
+
+void CBORWriter::Visit(F32Array const* arr) {
+  CBORTypedArray(arr->GetArray(), kTagF32BE, stream_);
+}
+void CBORWriter::Visit(U8Array const* arr) {
+  CBORTypedArray(arr->GetArray(), kTagU8, stream_);
+}
+void CBORWriter::Visit(I32Array const* arr) {
+  CBORTypedArray(arr->GetArray(), kTagI32BE, stream_);
+}
+void CBORWriter::Visit(I64Array const* arr) {
+  CBORTypedArray(arr->GetArray(), kTagI64BE, stream_);
+}
+
+void CBORWriter::Visit(JsonObject const* obj) {
+  auto const& map = obj->GetObject();
+  CBORHeader(kMap, map.size(), stream_);
+  for (auto const& kv : map) {
+    CBORHeader(kText, kv.first.size(), stream_);
+    WriteBytes(kv.first.data(), kv.first.size(), stream_);
+    Write(this, kv.second.GetValue());
+  }
+}
+
+void CBORWriter::Visit(JsonNumber const* num) {
+  if (!num->IsExactFloat()) {
+    stream_->push_back(static_cast<char>((kSimple << 5) | 27));
+    WriteBE(num->GetDouble(), stream_);
+    return;
+  }
+  stream_->push_back(static_cast<char>((kSimple << 5) | 26));
+  WriteBE(num->GetNumber(), stream_);
+}
+
+void CBORWriter::Visit(JsonInteger const* num) {
+  auto i = num->GetInteger();
+  if (i >= 0) {
+    CBORHeader(kUnsigned, static_cast<uint64_t>(i), stream_);
+  } else {
+    CBORHeader(kNegative, static_cast<uint64_t>(-(i + 1)), stream_);
+  }
+}
+
+void CBORWriter::Visit(JsonNull const*) {
+  stream_->push_back(static_cast<char>((kSimple << 5) | 22));
+}
+
+void CBORWriter::Visit(JsonString const* str) {
+  auto const& s = str->GetString();
+  CBORHeader(kText, s.size(), stream_);
+  WriteBytes(s.data(), s.size(), stream_);
+}
+
+void CBORWriter::Visit(JsonBoolean const* boolean) {
+  stream_->push_back(static_cast<char>((kSimple << 5) | (boolean->GetBoolean() ? 21 : 20)));
+}
+
+void CBORWriter::Save(Json json) { Write(this, json.GetValue()); }
+}  // namespace nih
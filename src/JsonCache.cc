@@ -0,0 +1,168 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include "nih/JsonCache.h"
+
+#if defined(__unix__)
+#include <sys/stat.h>
+#endif  // defined(__unix__)
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iterator>
+#include <system_error>
+
+#include "nih/JsonMemory.h"
+#include "nih/Logging.h"
+
+namespace nih {
+FileIdentity FileIdentity::Stat(std::string const& path) {
+  FileIdentity identity;
+#if defined(__unix__)
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    LOG(FATAL) << "Failed to stat " << path << ": " << strerror(errno);
+  }
+  identity.device = static_cast<uint64_t>(st.st_dev);
+  identity.inode = static_cast<uint64_t>(st.st_ino);
+  identity.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                      static_cast<int64_t>(st.st_mtim.tv_nsec);
+  identity.size = static_cast<uint64_t>(st.st_size);
+#else
+  std::error_code ec;
+  auto mtime = std::filesystem::last_write_time(path, ec);
+  auto size = ec ? 0 : std::filesystem::file_size(path, ec);
+  if (ec) {
+    LOG(FATAL) << "Failed to stat " << path << ": " << ec.message();
+  }
+  identity.mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          mtime.time_since_epoch())
+                          .count();
+  identity.size = static_cast<uint64_t>(size);
+#endif  // defined(__unix__)
+  return identity;
+}
+
+void JsonFileCache::Erase(std::map<Key, Entry>::iterator it) {
+  stats_.bytes -= it->second.bytes;
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+}
+
+void JsonFileCache::Evict() {
+  auto it = lru_.end();
+  while (stats_.bytes > budget_ && it != lru_.begin()) {
+    auto victim = std::prev(it);
+    auto entry = entries_.find(*victim);
+    if (entry->second.loaded) {
+      this->Erase(entry);
+      ++stats_.evictions;
+    } else {
+      it = victim;
+    }
+  }
+}
+
+JsonFileCache::Key JsonFileCache::MakeKey(std::string const& path,
+                                          std::ios::openmode mode, UBJByteOrder order) {
+  bool binary = (mode & std::ios::binary) != 0;
+  // The byte order doesn't matter for text.
+  return Key{path, binary, binary ? order : UBJByteOrder::kBigEndian};
+}
+
+JsonFileCache::Handle JsonFileCache::Load(std::string const& path,
+                                          std::ios::openmode mode, UBJByteOrder order) {
+  auto identity = FileIdentity::Stat(path);
+  auto key = MakeKey(path, mode, order);
+
+  std::promise<Handle> promise;
+  std::shared_future<Handle> document;
+  uint64_t id = 0;
+  {
+    std::lock_guard<std::mutex> guard{lock_};
+    auto it = entries_.find(key);
+    if (it != entries_.cend() && it->second.identity == identity) {
+      ++stats_.hits;
+      lru_.splice(lru_.begin(), lru_, it->second.lru);
+      document = it->second.document;
+    } else {
+      if (it != entries_.cend()) {
+        this->Erase(it);
+      }
+      ++stats_.misses;
+      id = ++next_id_;
+      document = promise.get_future().share();
+      lru_.push_front(key);
+      Entry entry;
+      entry.identity = identity;
+      entry.document = document;
+      entry.id = id;
+      entry.lru = lru_.begin();
+      entries_.emplace(key, std::move(entry));
+    }
+  }
+  if (id == 0) {
+    // Waits for the loading thread, rethrows its error.
+    return document.get();
+  }
+
+  // Parse without holding the lock, other files can be loaded concurrently.
+  Handle handle;
+  std::size_t bytes = 0;
+  try {
+    auto json = std::make_shared<Json>(Json::LoadFile(path, mode, order));
+    json->Share();
+    bytes = GetMemoryUsage(*json).Total();
+    handle = std::move(json);
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> guard{lock_};
+      auto it = entries_.find(key);
+      if (it != entries_.cend() && it->second.id == id) {
+        this->Erase(it);
+      }
+    }
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+  promise.set_value(handle);
+
+  std::lock_guard<std::mutex> guard{lock_};
+  auto it = entries_.find(key);
+  if (it != entries_.cend() && it->second.id == id) {
+    it->second.bytes = bytes;
+    it->second.loaded = true;
+    stats_.bytes += bytes;
+    this->Evict();
+  }
+  return handle;
+}
+
+bool JsonFileCache::Erase(std::string const& path, std::ios::openmode mode,
+                          UBJByteOrder order) {
+  std::lock_guard<std::mutex> guard{lock_};
+  auto it = entries_.find(MakeKey(path, mode, order));
+  if (it == entries_.cend()) {
+    return false;
+  }
+  this->Erase(it);
+  return true;
+}
+
+void JsonFileCache::Clear() {
+  std::lock_guard<std::mutex> guard{lock_};
+  entries_.clear();
+  lru_.clear();
+  stats_.bytes = 0;
+}
+
+JsonFileCache::Stats JsonFileCache::GetStats() const {
+  std::lock_guard<std::mutex> guard{lock_};
+  auto stats = stats_;
+  stats.n_entries = entries_.size();
+  return stats;
+}
+}  // namespace nih
@@ -0,0 +1,335 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include "nih/JsonColumnar.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "./text_parser.h"
+#include "nih/Json.h"
+#include "nih/Logging.h"
+
+namespace nih {
+std::string JsonColumn::TypeStr(Type type) {
+  switch (type) {
+    case Type::kNumber:
+      return "Number";
+    case Type::kInteger:
+      return "Integer";
+    case Type::kBoolean:
+      return "Boolean";
+    case Type::kString:
+      return "String";
+  }
+  return "";
+}
+
+JsonColumn const* JsonColumns::Find(ConstStringRef name) const {
+  for (auto const& column : columns) {
+    if (column.name.size() == name.size() &&
+        std::equal(column.name.cbegin(), column.name.cend(), name.data())) {
+      return &column;
+    }
+  }
+  return nullptr;
+}
+
+namespace {
+using Type = JsonColumn::Type;
+
+/**
+ * \brief Append the values of a column.  Values are stored in the buffer of the current
+ *        type, which is padded with 0 for the preceding null values.
+ */
+class ColumnBuilder {
+  JsonColumn column_;
+  bool has_type_{false};
+  std::size_t n_{0};
+
+  std::vector<int64_t> integers_;
+  std::vector<float> numbers_;
+  std::vector<uint8_t> booleans_;
+  std::vector<int32_t> codes_;
+  std::unordered_map<std::string, int32_t> index_;
+
+  void SetType(Type type) {
+    if (!has_type_) {
+      has_type_ = true;
+      column_.type = type;
+      return;
+    }
+    if (column_.type == type) {
+      return;
+    }
+    if (column_.type == Type::kInteger && type == Type::kNumber) {
+      numbers_.assign(integers_.cbegin(), integers_.cend());
+      integers_ = {};
+      column_.type = Type::kNumber;
+      return;
+    }
+    if (column_.type == Type::kNumber && type == Type::kInteger) {
+      return;
+    }
+    LOG(FATAL) << "Column `" << column_.name
+               << "` has values of different types: " << JsonColumn::TypeStr(column_.type)
+               << " and " << JsonColumn::TypeStr(type);
+  }
+  void SetValid(bool valid) {
+    if (n_ % 8 == 0) {
+      column_.validity.push_back(0);
+    }
+    column_.validity.back() |= static_cast<uint8_t>(valid) << (n_ % 8);
+    column_.null_count += !valid;
+    ++n_;
+  }
+  template <typename T, typename V>
+  void Append(std::vector<T>* values, V v) {
+    values->resize(n_);
+    values->push_back(static_cast<T>(v));
+    this->SetValid(true);
+  }
+  template <typename TypedArray, typename T>
+  static Json MakeArray(std::vector<T>* values, std::size_t n) {
+    TypedArray arr;
+    auto& vec = arr.GetArray();
+    vec.assign(values->cbegin(), values->cend());
+    vec.resize(n);
+    values->clear();
+    return Json{std::move(arr)};
+  }
+
+ public:
+  ColumnBuilder(ConstStringRef name, std::size_t n_nulls) {
+    column_.name.assign(name.data(), name.size());
+    for (std::size_t i = 0; i < n_nulls; ++i) {
+      this->SetValid(false);
+    }
+  }
+  /*! \brief Number of rows in this column. */
+  std::size_t Size() const { return n_; }
+  ConstStringRef Name() const { return ConstStringRef{column_.name}; }
+
+  void Null() { this->SetValid(false); }
+  void Integer(int64_t v) {
+    this->SetType(Type::kInteger);
+    if (column_.type == Type::kNumber) {
+      this->Append(&numbers_, v);
+    } else {
+      this->Append(&integers_, v);
+    }
+  }
+  void Number(float v) {
+    this->SetType(Type::kNumber);
+    this->Append(&numbers_, v);
+  }
+  void Boolean(bool v) {
+    this->SetType(Type::kBoolean);
+    this->Append(&booleans_, v);
+  }
+  void String(ConstStringRef v) {
+    this->SetType(Type::kString);
+    std::string str{v.data(), v.size()};
+    auto it = index_.find(str);
+    if (it == index_.cend()) {
+      if (NIH_UNLIKELY(column_.dictionary.size() >
+                       static_cast<std::size_t>(std::numeric_limits<int32_t>::max()))) {
+        LOG(FATAL) << "Too many distinct strings in column `" << column_.name << "`.";
+      }
+      auto code = static_cast<int32_t>(column_.dictionary.size());
+      column_.dictionary.push_back(str);
+      it = index_.emplace(std::move(str), code).first;
+    }
+    this->Append(&codes_, it->second);
+  }
+
+  JsonColumn Finish() {
+    auto n = n_;
+    switch (column_.type) {
+      case Type::kNumber:
+        column_.values = MakeArray<F32Array>(&numbers_, n);
+        break;
+      case Type::kInteger:
+        column_.values = MakeArray<I64Array>(&integers_, n);
+        break;
+      case Type::kBoolean:
+        column_.values = MakeArray<U8Array>(&booleans_, n);
+        break;
+      case Type::kString:
+        if (column_.dictionary.size() <= 256) {
+          column_.values = MakeArray<U8Array>(&codes_, n);
+        } else {
+          column_.values = MakeArray<I32Array>(&codes_, n);
+        }
+        break;
+    }
+    index_.clear();
+    return std::move(column_);
+  }
+};
+
+/**
+ * \brief Assign the values of each row to the columns, columns missing from a row get a
+ *        null value.
+ */
+class ColumnsBuilder {
+  std::vector<ColumnBuilder> columns_;
+  std::unordered_map<std::string, std::size_t> index_;
+  std::size_t n_rows_{0};
+  // Position of the next key in the current row.  Records usually have the same keys in
+  // the same order, the column at this position is tried before the hash lookup.
+  std::size_t pos_{0};
+
+  std::size_t Find(ConstStringRef key) {
+    if (pos_ < columns_.size()) {
+      auto name = columns_[pos_].Name();
+      if (name.size() == key.size() &&
+          std::equal(name.cbegin(), name.cend(), key.cbegin())) {
+        return pos_;
+      }
+    }
+    std::string name{key.data(), key.size()};
+    auto it = index_.find(name);
+    if (it == index_.cend()) {
+      it = index_.emplace(std::move(name), columns_.size()).first;
+      columns_.emplace_back(key, n_rows_);
+    }
+    return it->second;
+  }
+
+ public:
+  /*! \brief Column of a key in the current row. */
+  ColumnBuilder* Column(ConstStringRef key) {
+    auto column = &columns_[this->Find(key)];
+    ++pos_;
+    if (NIH_UNLIKELY(column->Size() != n_rows_)) {
+      LOG(FATAL) << "Duplicated key `" << key << "` in row " << n_rows_ << ".";
+    }
+    return column;
+  }
+  void EndRow() {
+    pos_ = 0;
+    ++n_rows_;
+    for (auto& column : columns_) {
+      if (column.Size() != n_rows_) {
+        column.Null();
+      }
+    }
+  }
+  JsonColumns Finish() {
+    JsonColumns result;
+    result.n_rows = n_rows_;
+    result.columns.reserve(columns_.size());
+    for (auto& column : columns_) {
+      result.columns.emplace_back(column.Finish());
+    }
+    return result;
+  }
+};
+
+/**
+ * \brief Handler of detail::TextParser for an array of objects.
+ */
+class RecordsHandler {
+  ColumnsBuilder* builder_;
+  ColumnBuilder* column_{nullptr};
+  std::size_t depth_{0};
+  std::string buffer_;
+
+  [[noreturn]] void Error(char const* what) const {
+    std::string where;
+    if (column_) {
+      where = " in column `" + std::string(column_->Name()) + "`";
+    }
+    LOG(FATAL) << "Expecting an array of objects with scalar values, got " << what
+               << where << ".";
+    std::abort();  // not reachable, LOG(FATAL) throws.
+  }
+  ColumnBuilder* Value(char const* what) {
+    if (NIH_UNLIKELY(depth_ != 2)) {
+      this->Error(what);
+    }
+    return column_;
+  }
+
+ public:
+  explicit RecordsHandler(ColumnsBuilder* builder) : builder_{builder} {}
+
+  void Null() { this->Value("null")->Null(); }
+  void Boolean(bool v) { this->Value("boolean")->Boolean(v); }
+  void Integer(int64_t v) { this->Value("integer")->Integer(v); }
+  void Number(float v) { this->Value("number")->Number(v); }
+  std::string* BeginString() {
+    this->Value("string");
+    buffer_.clear();
+    return &buffer_;
+  }
+  void EndString() { column_->String(ConstStringRef{buffer_}); }
+  std::string* BeginKey() {
+    buffer_.clear();
+    return &buffer_;
+  }
+  void EndKey() { column_ = builder_->Column(ConstStringRef{buffer_}); }
+  void BeginObject() {
+    if (NIH_UNLIKELY(depth_ != 1)) {
+      this->Error("object");
+    }
+    ++depth_;
+  }
+  void EndObject() {
+    --depth_;
+    column_ = nullptr;
+    builder_->EndRow();
+  }
+  void BeginArray() {
+    if (NIH_UNLIKELY(depth_ != 0)) {
+      this->Error("array");
+    }
+    ++depth_;
+  }
+  void EndArray() { --depth_; }
+};
+}  // anonymous namespace
+
+JsonColumns ToColumns(Json const& records) {
+  ColumnsBuilder builder;
+  auto const& rows = get<Array const>(records);
+  for (std::size_t i = 0; i < rows.size(); ++i) {
+    auto const& row = rows[i];
+    if (NIH_UNLIKELY(!IsA<Object>(row))) {
+      LOG(FATAL) << "Expecting an object for row " << i << ", got "
+                 << Value::TypeStr(row.GetValue().Type()) << ".";
+    }
+    for (auto const& kv : get<Object const>(row)) {
+      auto column = builder.Column(ConstStringRef{kv.first});
+      visit(kv.second,
+            overloaded{[&](JsonNumber const& v) { column->Number(v.GetNumber()); },
+                       [&](JsonInteger const& v) { column->Integer(v.GetInteger()); },
+                       [&](JsonBoolean const& v) { column->Boolean(v.GetBoolean()); },
+                       [&](JsonString const& v) { column->String(v.GetString()); },
+                       [&](JsonNull const&) { column->Null(); },
+                       [&](auto const&) {
+                         LOG(FATAL) << "Column `" << kv.first << "` has a value of type "
+                                    << Value::TypeStr(kv.second.GetValue().Type())
+                                    << ", only scalars are supported.";
+                       }});
+    }
+    builder.EndRow();
+  }
+  return builder.Finish();
+}
+
+JsonColumns LoadColumns(ConstStringRef str) {
+  ColumnsBuilder builder;
+  RecordsHandler handler{&builder};
+  detail::TextParser<RecordsHandler>{str, &handler}.Parse();
+  return builder.Finish();
+}
+}  // namespace nih
@@ -0,0 +1,139 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include "nih/JsonMemory.h"
+
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "nih/Json.h"
+#include "nih/JsonPointer.h"
+
+namespace nih {
+namespace {
+// Color, parent, left and right of a red-black tree node.
+std::size_t constexpr kMapNodeOverhead = 4 * sizeof(void*);
+
+class MemoryCounter {
+  std::unordered_set<Value const*> shared_;
+  std::vector<MemoryUsageEntry>* entries_;
+  std::size_t max_depth_;
+  std::size_t min_bytes_;
+  std::size_t inline_capacity_{std::string{}.capacity()};
+
+  void AddString(std::string const& str, MemoryUsage* usage) const {
+    if (str.capacity() <= inline_capacity_) {
+      return;
+    }
+    usage->strings += str.size() + 1;
+    usage->slack += str.capacity() - str.size();
+    usage->n_allocs++;
+  }
+
+  template <typename Vec>
+  void AddVector(Vec const& vec, MemoryUsage* usage) const {
+    using T = typename Vec::value_type;
+    usage->arrays += vec.size() * sizeof(T);
+    usage->slack += (vec.capacity() - vec.size()) * sizeof(T);
+    usage->n_allocs += vec.capacity() != 0;
+  }
+
+ public:
+  MemoryCounter(std::vector<MemoryUsageEntry>* entries, std::size_t max_depth,
+                std::size_t min_bytes)
+      : entries_{entries}, max_depth_{max_depth}, min_bytes_{min_bytes} {}
+
+  MemoryUsage Count(Json const& json, std::string* path, std::size_t depth) {
+    MemoryUsage usage;
+    auto const& value = json.GetValue();
+    if (IntrusivePtrRefCount(&value).Count() > 1 && !shared_.insert(&value).second) {
+      return usage;
+    }
+    usage.n_values = 1;
+    usage.n_allocs = 1;
+    auto record = entries_ && depth <= max_depth_;
+    // Whether the children are recorded and need a path.
+    auto descend = record && depth < max_depth_;
+    visit(value, overloaded{
+                     [&](JsonString const& str) {
+                       usage.nodes += sizeof(str);
+                       AddString(str.GetString(), &usage);
+                     },
+                     [&](JsonArray const& arr) {
+                       usage.nodes += sizeof(arr);
+                       AddVector(arr.GetArray(), &usage);
+                       auto const& vec = arr.GetArray();
+                       auto n = path->size();
+                       for (std::size_t i = 0; i < vec.size(); ++i) {
+                         if (descend) {
+                           *path += '/';
+                           *path += std::to_string(i);
+                         }
+                         usage += this->Count(vec[i], path, depth + 1);
+                         path->resize(n);
+                       }
+                     },
+                     [&](JsonObject const& obj) {
+                       usage.nodes += sizeof(obj);
+                       auto n = path->size();
+                       for (auto const& kv : obj.GetObject()) {
+                         usage.map_nodes += kMapNodeOverhead + sizeof(kv);
+                         usage.n_allocs++;
+                         AddString(kv.first, &usage);
+                         if (descend) {
+                           *path += '/';
+                           *path += EscapePointerToken(kv.first);
+                         }
+                         usage += this->Count(kv.second, path, depth + 1);
+                         path->resize(n);
+                       }
+                     },
+                     [&](auto const& v) {
+                       usage.nodes += sizeof(v);
+                       using T = std::remove_cv_t<std::remove_reference_t<decltype(v)>>;
+                       if constexpr (std::is_same<T, F32Array>::value ||
+                                     std::is_same<T, U8Array>::value ||
+                                     std::is_same<T, I32Array>::value ||
+                                     std::is_same<T, I64Array>::value) {
+                         AddVector(v.GetArray(), &usage);
+                       }
+                     }});
+    if (record && usage.Total() >= min_bytes_) {
+      entries_->push_back(MemoryUsageEntry{*path, usage});
+    }
+    return usage;
+  }
+};
+}  // anonymous namespace
+
+MemoryUsage& MemoryUsage::operator+=(MemoryUsage const& that) {
+  nodes += that.nodes;
+  strings += that.strings;
+  arrays += that.arrays;
+  slack += that.slack;
+  map_nodes += that.map_nodes;
+  n_values += that.n_values;
+  n_allocs += that.n_allocs;
+  return *this;
+}
+
+MemoryUsage GetMemoryUsage(Json const& json) {
+  std::string path;
+  return MemoryCounter{nullptr, 0, 0}.Count(json, &path, 0);
+}
+
+std::vector<MemoryUsageEntry> GetMemoryBreakdown(Json const& json, std::size_t max_depth,
+                                                 std::size_t min_bytes) {
+  std::vector<MemoryUsageEntry> entries;
+  std::string path;
+  MemoryCounter{&entries, max_depth, min_bytes}.Count(json, &path, 0);
+  std::stable_sort(entries.begin(), entries.end(), [](auto const& l, auto const& r) {
+    return l.usage.Total() > r.usage.Total();
+  });
+  return entries;
+}
+}  // namespace nih
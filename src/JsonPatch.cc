@@ -0,0 +1,442 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include "nih/JsonPatch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nih/Json.h"
+#include "nih/JsonPointer.h"
+#include "nih/Logging.h"
+
+namespace nih {
+namespace {
+// Unchanged elements between two modified ranges of a typed array are merged into a
+// single splice when the gap is shorter than this, an operation costs more than a few
+// elements.
+size_t constexpr kMergeGap = 8;
+
+Json MakeOp(char const* op, std::string const& path) {
+  Json j{Object{}};
+  j["op"] = String{op};
+  j["path"] = String{path};
+  return j;
+}
+
+template <typename T>
+bool ElementEqual(T l, T r) {
+  return l == r;
+}
+bool ElementEqual(float l, float r) { return l == r || (std::isnan(l) && std::isnan(r)); }
+
+template <typename TypedArray>
+void DiffTypedArray(Json const& from, Json const& to, std::string const& path,
+                    std::vector<Json>* ops) {
+  auto const& l = get<TypedArray const>(from);
+  auto const& r = get<TypedArray const>(to);
+  size_t common = std::min(l.size(), r.size());
+  size_t n = std::max(l.size(), r.size());
+  auto differ = [&](size_t i) { return i >= common || !ElementEqual(l[i], r[i]); };
+
+  std::vector<std::pair<size_t, size_t>> ranges;
+  size_t n_changed = 0;
+  for (size_t i = 0; i < n;) {
+    if (!differ(i)) {
+      ++i;
+      continue;
+    }
+    size_t end = i + 1;
+    for (size_t j = end; j < n && j - end < kMergeGap; ++j) {
+      if (differ(j)) {
+        end = j + 1;
+      }
+    }
+    ranges.emplace_back(i, end);
+    n_changed += end - i;
+    i = end;
+  }
+  if (ranges.empty()) {
+    return;
+  }
+  if (n_changed * 2 >= r.size()) {
+    // Use a single splice instead of "replace" to retain the array type when the patch
+    // is saved as text.
+    ranges.clear();
+    ranges.emplace_back(0, n);
+  }
+
+  // Only the last range can change the length of the array, offsets of the preceding
+  // ranges remain valid after applying each splice in order.
+  for (auto const& range : ranges) {
+    size_t beg = range.first;
+    size_t length = beg < l.size() ? std::min(range.second, l.size()) - beg : 0;
+    size_t count = beg < r.size() ? std::min(range.second, r.size()) - beg : 0;
+    TypedArray values{count};
+    std::copy_n(r.cbegin() + beg, count, values.GetArray().begin());
+
+    auto op = MakeOp("splice", path);
+    op["offset"] = Integer{static_cast<Integer::Int>(beg)};
+    op["length"] = Integer{static_cast<Integer::Int>(length)};
+    op["value"] = std::move(values);
+    ops->emplace_back(std::move(op));
+  }
+}
+
+void DiffImpl(Json const& from, Json const& to, std::string* path,
+              std::vector<Json>* ops) {
+  if (from.Ptr() == to.Ptr()) {
+    return;
+  }
+  auto kind = from.GetValue().Type();
+  if (kind != to.GetValue().Type()) {
+    auto op = MakeOp("replace", *path);
+    op["value"] = to;
+    ops->emplace_back(std::move(op));
+    return;
+  }
+
+  auto n_prefix = path->size();
+  switch (kind) {
+    case Value::ValueKind::kObject: {
+      auto const& l = get<Object const>(from);
+      auto const& r = get<Object const>(to);
+      auto l_it = l.cbegin();
+      auto r_it = r.cbegin();
+      while (l_it != l.cend() || r_it != r.cend()) {
+        bool removed = r_it == r.cend() || (l_it != l.cend() && l_it->first < r_it->first);
+        bool added = !removed && (l_it == l.cend() || r_it->first < l_it->first);
+        auto const& key = removed ? l_it->first : r_it->first;
+        *path += '/';
+        *path += EscapePointerToken(key);
+        if (removed) {
+          ops->emplace_back(MakeOp("remove", *path));
+          ++l_it;
+        } else if (added) {
+          auto op = MakeOp("add", *path);
+          op["value"] = r_it->second;
+          ops->emplace_back(std::move(op));
+          ++r_it;
+        } else {
+          DiffImpl(l_it->second, r_it->second, path, ops);
+          ++l_it;
+          ++r_it;
+        }
+        path->resize(n_prefix);
+      }
+      break;
+    }
+    case Value::ValueKind::kArray: {
+      auto const& l = get<Array const>(from);
+      auto const& r = get<Array const>(to);
+      size_t common = std::min(l.size(), r.size());
+      for (size_t i = 0; i < common; ++i) {
+        *path += '/';
+        *path += std::to_string(i);
+        DiffImpl(l[i], r[i], path, ops);
+        path->resize(n_prefix);
+      }
+      // Remove from the back so that the indices remain valid.
+      for (size_t i = l.size(); i > common; --i) {
+        ops->emplace_back(MakeOp("remove", *path + '/' + std::to_string(i - 1)));
+      }
+      for (size_t i = common; i < r.size(); ++i) {
+        auto op = MakeOp("add", *path + '/' + std::to_string(i));
+        op["value"] = r[i];
+        ops->emplace_back(std::move(op));
+      }
+      break;
+    }
+    case Value::ValueKind::kNumberArray:
+      DiffTypedArray<F32Array>(from, to, *path, ops);
+      break;
+    case Value::ValueKind::kU8Array:
+      DiffTypedArray<U8Array>(from, to, *path, ops);
+      break;
+    case Value::ValueKind::kI32Array:
+      DiffTypedArray<I32Array>(from, to, *path, ops);
+      break;
+    case Value::ValueKind::kI64Array:
+      DiffTypedArray<I64Array>(from, to, *path, ops);
+      break;
+    default: {
+      if (!(from == to)) {
+        auto op = MakeOp("replace", *path);
+        op["value"] = to;
+        ops->emplace_back(std::move(op));
+      }
+      break;
+    }
+  }
+}
+
+/**
+ * \brief Parse an array index.  "-" refers to the end of array when `allow_end` is true.
+ */
+size_t ParseIndex(std::string const& token, size_t size, bool allow_end) {
+  if (allow_end && token == "-") {
+    return size;
+  }
+  bool valid = !token.empty() && token.size() < 20 && (token == "0" || token[0] != '0') &&
+               std::all_of(token.cbegin(), token.cend(),
+                           [](char c) { return c >= '0' && c <= '9'; });
+  if (!valid) {
+    LOG(FATAL) << "Invalid array index: `" << token << "`";
+  }
+  auto idx = std::stoull(token);
+  if (idx > size || (!allow_end && idx == size)) {
+    LOG(FATAL) << "Array index out of bound: " << idx << ", size: " << size;
+  }
+  return idx;
+}
+
+Json* Child(Json* parent, std::string const& token) {
+  if (IsA<Object>(*parent)) {
+    auto& obj = get<Object>(*parent);
+    auto it = obj.find(token);
+    if (it == obj.cend()) {
+      LOG(FATAL) << "Key not found: `" << token << "`";
+    }
+    return &it->second;
+  }
+  if (IsA<Array>(*parent)) {
+    auto& arr = get<Array>(*parent);
+    return &arr[ParseIndex(token, arr.size(), false)];
+  }
+  LOG(FATAL) << "Can't index into " << parent->GetValue().TypeStr() << " with `"
+             << token << "`";
+  return nullptr;
+}
+
+bool HasOtherOwners(Json const& json) {
+  return IntrusivePtrRefCount(&json.GetValue()).Count() > 1;
+}
+
+template <typename TypedArray>
+Json CloneTypedArray(Json const& json) {
+  auto const& vec = get<TypedArray const>(json);
+  TypedArray copy{vec.size()};
+  std::copy(vec.cbegin(), vec.cend(), copy.GetArray().begin());
+  return Json{std::move(copy)};
+}
+
+/**
+ * \brief Replace a container shared with other Json objects by a shallow copy before it's
+ *        modified, so that patching doesn't leak into other documents.
+ */
+void Detach(Json* json) {
+  if (!HasOtherOwners(*json)) {
+    return;
+  }
+  switch (json->GetValue().Type()) {
+    case Value::ValueKind::kObject: {
+      auto map = get<Object const>(*json);
+      *json = Object{std::move(map)};
+      break;
+    }
+    case Value::ValueKind::kArray: {
+      auto vec = get<Array const>(*json);
+      *json = Array{std::move(vec)};
+      break;
+    }
+    case Value::ValueKind::kNumberArray:
+      *json = CloneTypedArray<F32Array>(*json);
+      break;
+    case Value::ValueKind::kU8Array:
+      *json = CloneTypedArray<U8Array>(*json);
+      break;
+    case Value::ValueKind::kI32Array:
+      *json = CloneTypedArray<I32Array>(*json);
+      break;
+    case Value::ValueKind::kI64Array:
+      *json = CloneTypedArray<I64Array>(*json);
+      break;
+    default:
+      // Scalars are replaced instead of being modified.
+      break;
+  }
+}
+
+/**
+ * \brief Follow the first `n` tokens.  Containers along the path are detached when the
+ *        result is going to be modified.
+ */
+Json* Resolve(Json* doc, std::vector<std::string> const& tokens, size_t n,
+              bool modify) {
+  for (size_t i = 0; i < n; ++i) {
+    if (modify) {
+      Detach(doc);
+    }
+    doc = Child(doc, tokens[i]);
+  }
+  if (modify) {
+    Detach(doc);
+  }
+  return doc;
+}
+
+Json const& Member(Json const& op, std::string const& key) {
+  auto const& obj = get<Object const>(op);
+  auto it = obj.find(key);
+  if (it == obj.cend()) {
+    LOG(FATAL) << "Patch operation is missing `" << key << "`.";
+  }
+  return it->second;
+}
+
+void Add(Json* doc, std::vector<std::string> const& tokens, Json value) {
+  if (tokens.empty()) {
+    *doc = std::move(value);
+    return;
+  }
+  auto parent = Resolve(doc, tokens, tokens.size() - 1, true);
+  auto const& key = tokens.back();
+  if (IsA<Object>(*parent)) {
+    get<Object>(*parent)[key] = std::move(value);
+  } else if (IsA<Array>(*parent)) {
+    auto& arr = get<Array>(*parent);
+    auto idx = ParseIndex(key, arr.size(), true);
+    arr.insert(arr.begin() + idx, std::move(value));
+  } else {
+    LOG(FATAL) << "Can't add a member to " << parent->GetValue().TypeStr();
+  }
+}
+
+Json Remove(Json* doc, std::vector<std::string> const& tokens) {
+  if (tokens.empty()) {
+    LOG(FATAL) << "Can't remove the document root.";
+  }
+  auto parent = Resolve(doc, tokens, tokens.size() - 1, true);
+  auto const& key = tokens.back();
+  auto removed = *Child(parent, key);
+  if (IsA<Object>(*parent)) {
+    get<Object>(*parent).erase(key);
+  } else {
+    auto& arr = get<Array>(*parent);
+    arr.erase(arr.begin() + ParseIndex(key, arr.size(), false));
+  }
+  return removed;
+}
+
+template <typename T>
+T ToElement(Json const& value) {
+  if (IsA<Integer>(value)) {
+    return static_cast<T>(get<Integer const>(value));
+  }
+  if (IsA<Number>(value)) {
+    return static_cast<T>(get<Number const>(value));
+  }
+  LOG(FATAL) << "Invalid typed array element: " << value.GetValue().TypeStr();
+  return T{};
+}
+
+template <typename Vec, typename Values>
+void SpliceImpl(Vec* vec, size_t offset, size_t length, Values const& values) {
+  if (offset > vec->size() || length > vec->size() - offset) {
+    LOG(FATAL) << "Invalid splice range [" << offset << ", " << offset + length
+               << ") for array of size " << vec->size();
+  }
+  auto beg = vec->begin() + offset;
+  if (length == values.size()) {
+    std::copy(values.cbegin(), values.cend(), beg);
+  } else {
+    beg = vec->erase(beg, beg + length);
+    vec->insert(beg, values.cbegin(), values.cend());
+  }
+}
+
+template <typename TypedArray>
+void SpliceTypedArray(Json* target, size_t offset, size_t length, Json const& value) {
+  using T = typename TypedArray::Type;
+  auto& vec = get<TypedArray>(*target);
+  if (IsA<TypedArray>(value)) {
+    SpliceImpl(&vec, offset, length, get<TypedArray const>(value));
+  } else {
+    // The typed array has been loaded from text.
+    std::vector<T> values;
+    for (auto const& v : get<Array const>(value)) {
+      values.push_back(ToElement<T>(v));
+    }
+    SpliceImpl(&vec, offset, length, values);
+  }
+}
+
+void Splice(Json* target, size_t offset, size_t length, Json const& value) {
+  switch (target->GetValue().Type()) {
+    case Value::ValueKind::kArray:
+      SpliceImpl(&get<Array>(*target), offset, length, get<Array const>(value));
+      break;
+    case Value::ValueKind::kNumberArray:
+      SpliceTypedArray<F32Array>(target, offset, length, value);
+      break;
+    case Value::ValueKind::kU8Array:
+      SpliceTypedArray<U8Array>(target, offset, length, value);
+      break;
+    case Value::ValueKind::kI32Array:
+      SpliceTypedArray<I32Array>(target, offset, length, value);
+      break;
+    case Value::ValueKind::kI64Array:
+      SpliceTypedArray<I64Array>(target, offset, length, value);
+      break;
+    default:
+      LOG(FATAL) << "Can't splice " << target->GetValue().TypeStr();
+  }
+}
+
+size_t ToSize(Json const& value) {
+  auto v = get<Integer const>(value);
+  if (v < 0) {
+    LOG(FATAL) << "Expecting a non-negative integer, got: " << v;
+  }
+  return static_cast<size_t>(v);
+}
+}  // anonymous namespace
+
+Json Diff(Json const& from, Json const& to) {
+  std::vector<Json> ops;
+  std::string path;
+  DiffImpl(from, to, &path, &ops);
+  return Json{Array{std::move(ops)}};
+}
+
+void Patch(Json* doc, Json const& patch) {
+  for (auto const& op : get<Array const>(patch)) {
+    auto const& name = get<String const>(Member(op, "op"));
+    auto path = JsonPointer{get<String const>(Member(op, "path"))}.Tokens();
+    if (name == "add") {
+      Add(doc, path, Member(op, "value"));
+    } else if (name == "remove") {
+      Remove(doc, path);
+    } else if (name == "replace") {
+      auto target = path.empty() ? doc : Resolve(doc, path, path.size() - 1, true);
+      if (!path.empty()) {
+        target = Child(target, path.back());
+      }
+      *target = Member(op, "value");
+    } else if (name == "move") {
+      auto from = JsonPointer{get<String const>(Member(op, "from"))}.Tokens();
+      if (from.size() < path.size() && std::equal(from.cbegin(), from.cend(), path.cbegin())) {
+        LOG(FATAL) << "Can't move a value into one of its children.";
+      }
+      Add(doc, path, Remove(doc, from));
+    } else if (name == "copy") {
+      auto from = JsonPointer{get<String const>(Member(op, "from"))}.Tokens();
+      Add(doc, path, *Resolve(doc, from, from.size(), false));
+    } else if (name == "test") {
+      if (!(*Resolve(doc, path, path.size(), false) == Member(op, "value"))) {
+        LOG(FATAL) << "Test operation failed for path: "
+                   << get<String const>(Member(op, "path"));
+      }
+    } else if (name == "splice") {
+      Splice(Resolve(doc, path, path.size(), true), ToSize(Member(op, "offset")),
+             ToSize(Member(op, "length")), Member(op, "value"));
+    } else {
+      LOG(FATAL) << "Unknown patch operation: " << name;
+    }
+  }
+}
+}  // namespace nih
@@ -0,0 +1,746 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include "nih/JsonPointer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif  // defined(__SSE2__)
+
+#include "nih/Json.h"
+#include "nih/JsonIO.h"
+#include "nih/Logging.h"
+
+namespace nih {
+namespace {
+int64_t ParseArrayIndex(std::string const& token) {
+  // Leading zeros are not allowed, and 18 digits always fit into int64_t.
+  if (token.empty() || token.size() > 18 || (token.size() > 1 && token[0] == '0')) {
+    return -1;
+  }
+  int64_t idx = 0;
+  for (auto c : token) {
+    if (c < '0' || c > '9') {
+      return -1;
+    }
+    idx = idx * 10 + (c - '0');
+  }
+  return idx;
+}
+}  // anonymous namespace
+
+JsonPointer::JsonPointer(std::string const& pointer) {
+  if (pointer.empty()) {
+    return;
+  }
+  if (pointer.front() != '/') {
+    LOG(FATAL) << "Invalid JSON pointer: " << pointer;
+  }
+  for (std::size_t i = 0; i < pointer.size(); ++i) {
+    char c = pointer[i];
+    if (c == '/') {
+      tokens_.emplace_back();
+    } else if (c == '~') {
+      char next = i + 1 < pointer.size() ? pointer[i + 1] : '\0';
+      if (next != '0' && next != '1') {
+        LOG(FATAL) << "Invalid escape in JSON pointer: " << pointer;
+      }
+      tokens_.back() += next == '0' ? '~' : '/';
+      ++i;
+    } else {
+      tokens_.back() += c;
+    }
+  }
+  for (auto const& token : tokens_) {
+    indices_.push_back(ParseArrayIndex(token));
+  }
+}
+
+JsonPointer JsonPointer::FromTokens(std::vector<std::string> tokens) {
+  JsonPointer ptr;
+  ptr.tokens_ = std::move(tokens);
+  for (auto const& token : ptr.tokens_) {
+    ptr.indices_.push_back(ParseArrayIndex(token));
+  }
+  return ptr;
+}
+
+std::string JsonPointer::ToString() const {
+  std::string str;
+  for (auto const& token : tokens_) {
+    str += '/';
+    str += EscapePointerToken(token);
+  }
+  return str;
+}
+
+Json const* JsonPointer::Find(Json const& doc) const {
+  Json const* node = &doc;
+  for (std::size_t i = 0; i < tokens_.size(); ++i) {
+    if (IsA<Object>(*node)) {
+      auto const& obj = get<Object const>(*node);
+      auto it = obj.find(tokens_[i]);
+      if (it == obj.cend()) {
+        return nullptr;
+      }
+      node = &it->second;
+    } else if (IsA<Array>(*node)) {
+      auto const& arr = get<Array const>(*node);
+      if (indices_[i] < 0 || static_cast<std::size_t>(indices_[i]) >= arr.size()) {
+        return nullptr;
+      }
+      node = &arr[indices_[i]];
+    } else {
+      return nullptr;
+    }
+  }
+  return node;
+}
+
+Json* JsonPointer::Find(Json* doc) const {
+  return const_cast<Json*>(this->Find(static_cast<Json const&>(*doc)));
+}
+
+std::string EscapePointerToken(std::string const& key) {
+  if (key.find_first_of("~/") == std::string::npos) {
+    return key;
+  }
+  std::string escaped;
+  for (auto c : key) {
+    if (c == '~') {
+      escaped += "~0";
+    } else if (c == '/') {
+      escaped += "~1";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+/**
+ * \brief Trie of the requested paths.
+ */
+struct JsonProjection::Node {
+  std::map<std::string, std::unique_ptr<Node>, std::less<>> children;
+  // Children with a valid array index, sorted by the index.
+  std::vector<std::pair<int64_t, Node const*>> indices;
+  // Index of the path ending at this node, -1 if there's none.
+  int64_t result{-1};
+};
+
+namespace {
+using Node = JsonProjection::Node;
+
+template <typename TypedArray>
+Json TypedElement(TypedArray const& arr, std::size_t i) {
+  auto v = arr.GetArray()[i];
+  if constexpr (std::is_floating_point<decltype(v)>::value) {
+    return Json{Number{v}};
+  } else {
+    return Json{Integer{static_cast<Integer::Int>(v)}};
+  }
+}
+
+/**
+ * \brief Collect the requested paths from a parsed value.
+ */
+void ExtractParsed(Json const& value, Node const& node, std::vector<std::string> const& keys,
+                   Json* out) {
+  if (node.result >= 0) {
+    (*out)[keys[node.result]] = value;
+  }
+  if (node.children.empty()) {
+    return;
+  }
+  auto typed = [&](auto const& arr) {
+    for (auto const& kv : node.indices) {
+      if (static_cast<std::size_t>(kv.first) < arr.Size() && kv.second->result >= 0) {
+        (*out)[keys[kv.second->result]] = TypedElement(arr, kv.first);
+      }
+    }
+  };
+  visit(value, overloaded{[&](Object const& obj) {
+                            auto const& map = obj.GetObject();
+                            for (auto const& kv : node.children) {
+                              auto it = map.find(kv.first);
+                              if (it != map.cend()) {
+                                ExtractParsed(it->second, *kv.second, keys, out);
+                              }
+                            }
+                          },
+                          [&](Array const& arr) {
+                            auto const& vec = arr.GetArray();
+                            for (auto const& kv : node.indices) {
+                              if (static_cast<std::size_t>(kv.first) < vec.size()) {
+                                ExtractParsed(vec[kv.first], *kv.second, keys, out);
+                              }
+                            }
+                          },
+                          [&](F32Array const& arr) { typed(arr); },
+                          [&](U8Array const& arr) { typed(arr); },
+                          [&](I32Array const& arr) { typed(arr); },
+                          [&](I64Array const& arr) { typed(arr); },
+                          [](auto const&) {}});
+}
+
+/**
+ * \brief Find the first byte in [p, end) that's one of the characters in `set`.
+ */
+template <std::size_t n>
+char const* FindAny(char const* p, char const* end, char const (&set)[n]) {
+  static_assert(n > 1);
+#if defined(__SSE2__)
+  while (end - p >= 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+    auto m = _mm_cmpeq_epi8(v, _mm_set1_epi8(set[0]));
+    for (std::size_t i = 1; i < n - 1; ++i) {
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(set[i])));
+    }
+    auto mask = _mm_movemask_epi8(m);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif  // defined(__SSE2__)
+  for (; p != end; ++p) {
+    for (std::size_t i = 0; i < n - 1; ++i) {
+      if (*p == set[i]) {
+        return p;
+      }
+    }
+  }
+  return end;
+}
+
+class ScannerBase {
+ protected:
+  char const* beg_;
+  char const* p_;
+  char const* end_;
+  std::vector<std::string> const& keys_;
+  Json* out_;
+
+  [[noreturn]] void Error(char const* msg) const {
+    LOG(FATAL) << msg << " around byte offset " << (p_ - beg_);
+    std::abort();  // not reachable, LOG(FATAL) throws.
+  }
+  void Need(std::size_t n) const {
+    if (NIH_UNLIKELY(static_cast<std::size_t>(end_ - p_) < n)) {
+      Error("Unexpected end of input");
+    }
+  }
+
+ public:
+  ScannerBase(ConstStringRef str, std::vector<std::string> const& keys, Json* out)
+      : beg_{str.data()}, p_{str.data()}, end_{str.data() + str.size()}, keys_{keys},
+        out_{out} {}
+};
+
+/**
+ * \brief Projection on JSON text.  Skipped values are only scanned for brackets and
+ *        string boundaries.
+ */
+class TextScanner : public ScannerBase {
+  std::string key_buffer_;
+
+  void SkipSpaces() {
+    while (p_ != end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) {
+      ++p_;
+    }
+  }
+  // p_ is at the opening quote.
+  void SkipString() {
+    ++p_;
+    while (true) {
+      p_ = FindAny(p_, end_, "\"\\");
+      if (NIH_UNLIKELY(p_ == end_)) {
+        Error("Unterminated string");
+      }
+      if (*p_ == '"') {
+        ++p_;
+        return;
+      }
+      p_ += 2;  // escaped character
+      if (NIH_UNLIKELY(p_ > end_)) {
+        p_ = end_;
+        Error("Unterminated string");
+      }
+    }
+  }
+  // Skip until the container opened `depth` levels above is closed.
+  void SkipContainer(std::size_t depth) {
+    while (depth != 0) {
+      p_ = FindAny(p_, end_, "\"[]{}");
+      if (NIH_UNLIKELY(p_ == end_)) {
+        Error("Unterminated container");
+      }
+      switch (*p_) {
+        case '"':
+          SkipString();
+          break;
+        case '[':
+        case '{':
+          ++depth;
+          ++p_;
+          break;
+        default:
+          --depth;
+          ++p_;
+          break;
+      }
+    }
+  }
+  void SkipValue() {
+    SkipSpaces();
+    if (NIH_UNLIKELY(p_ == end_)) {
+      Error("Unexpected end of input");
+    }
+    switch (*p_) {
+      case '"':
+        SkipString();
+        break;
+      case '[':
+      case '{':
+        ++p_;
+        SkipContainer(1);
+        break;
+      default: {
+        // Number or literal.
+        auto beg = p_;
+        while (p_ != end_ && *p_ != ',' && *p_ != ']' && *p_ != '}' && *p_ != ' ' &&
+               *p_ != '\n' && *p_ != '\r' && *p_ != '\t') {
+          ++p_;
+        }
+        if (NIH_UNLIKELY(p_ == beg)) {
+          Error("Unexpected character");
+        }
+      }
+    }
+  }
+  // p_ is at the opening quote.
+  std::string_view ReadKey() {
+    auto beg = p_;
+    auto close = FindAny(p_ + 1, end_, "\"\\");
+    if (close != end_ && *close == '"') {
+      p_ = close + 1;
+      return std::string_view{beg + 1, static_cast<std::size_t>(close - beg - 1)};
+    }
+    // Keys with escapes are rare, decode them with the reader.
+    SkipString();
+    auto key = Json::Load(ConstStringRef{beg, static_cast<std::size_t>(p_ - beg)});
+    key_buffer_ = get<String const>(key);
+    return key_buffer_;
+  }
+  void Expect(char c, char const* msg) {
+    SkipSpaces();
+    if (NIH_UNLIKELY(p_ == end_ || *p_ != c)) {
+      Error(msg);
+    }
+    ++p_;
+  }
+  // Returns true if the container is closed.
+  bool NextMember(char close) {
+    SkipSpaces();
+    if (NIH_UNLIKELY(p_ == end_)) {
+      Error("Unterminated container");
+    }
+    if (*p_ == close) {
+      ++p_;
+      return true;
+    }
+    if (NIH_UNLIKELY(*p_ != ',')) {
+      Error("Expecting `,`");
+    }
+    ++p_;
+    return false;
+  }
+
+  void ExtractObject(Node const& node) {
+    ++p_;  // {
+    SkipSpaces();
+    if (p_ != end_ && *p_ == '}') {
+      ++p_;
+      return;
+    }
+    auto remaining = node.children.size();
+    do {
+      SkipSpaces();
+      if (NIH_UNLIKELY(p_ == end_ || *p_ != '"')) {
+        Error("Expecting object key");
+      }
+      auto it = node.children.find(ReadKey());
+      Expect(':', "Expecting `:`");
+      if (it != node.children.cend()) {
+        this->Extract(*it->second);
+        if (--remaining == 0) {
+          SkipContainer(1);
+          return;
+        }
+      } else {
+        SkipValue();
+      }
+    } while (!NextMember('}'));
+  }
+
+  void ExtractArray(Node const& node) {
+    ++p_;  // [
+    SkipSpaces();
+    if (p_ != end_ && *p_ == ']') {
+      ++p_;
+      return;
+    }
+    auto next = node.indices.cbegin();
+    int64_t idx = 0;
+    do {
+      if (next == node.indices.cend()) {
+        SkipContainer(1);
+        return;
+      }
+      if (next->first == idx) {
+        this->Extract(*next->second);
+        ++next;
+      } else {
+        SkipValue();
+      }
+      ++idx;
+    } while (!NextMember(']'));
+  }
+
+ public:
+  using ScannerBase::ScannerBase;
+
+  void Extract(Node const& node) {
+    SkipSpaces();
+    if (node.result >= 0) {
+      auto beg = p_;
+      SkipValue();
+      auto value = Json::Load(ConstStringRef{beg, static_cast<std::size_t>(p_ - beg)});
+      ExtractParsed(value, node, keys_, out_);
+      return;
+    }
+    if (NIH_UNLIKELY(p_ == end_)) {
+      Error("Unexpected end of input");
+    }
+    if (*p_ == '{') {
+      ExtractObject(node);
+    } else if (*p_ == '[') {
+      ExtractArray(node);
+    } else {
+      SkipValue();
+    }
+  }
+};
+
+/**
+ * \brief Projection on UBJSON.  Strings and typed arrays are skipped using their length
+ *        prefixes.
+ */
+class UBJScanner : public ScannerBase {
+  std::size_t Length() {
+    Need(1 + sizeof(int64_t));
+    if (NIH_UNLIKELY(*p_ != 'L')) {
+      Error("Expecting `L` for length");
+    }
+    ++p_;
+    int64_t n;
+    std::memcpy(&n, p_, sizeof(n));
+    n = ToBigEndian(n);
+    p_ += sizeof(n);
+    if (NIH_UNLIKELY(n < 0)) {
+      Error("Negative length");
+    }
+    return static_cast<std::size_t>(n);
+  }
+  void Skip(std::size_t n) {
+    Need(n);
+    p_ += n;
+  }
+  // Size of a typed array element.
+  std::size_t ElementSize(char type) {
+    switch (type) {
+      case 'U':
+        return 1;
+      case 'd':
+      case 'l':
+        return 4;
+      case 'L':
+        return 8;
+      default:
+        Error("Unsupported type for typed array");
+    }
+  }
+  void SkipObjectRest() {
+    while (true) {
+      Need(1);
+      if (*p_ == '}') {
+        ++p_;
+        return;
+      }
+      Skip(Length());
+      SkipValue();
+    }
+  }
+  void SkipArrayRest() {
+    while (true) {
+      Need(1);
+      if (*p_ == ']') {
+        ++p_;
+        return;
+      }
+      SkipValue();
+    }
+  }
+  void SkipValue() {
+    Need(1);
+    switch (*p_++) {
+      case '{':
+        SkipObjectRest();
+        break;
+      case '[': {
+        Need(1);
+        if (*p_ == '$') {
+          ++p_;
+          Need(2);
+          auto size = ElementSize(*p_++);
+          if (NIH_UNLIKELY(*p_++ != '#')) {
+            Error("Expecting `#` for typed array");
+          }
+          auto n = Length();
+          if (NIH_UNLIKELY(n > static_cast<std::size_t>(end_ - p_) / size)) {
+            Error("Invalid length of typed array");
+          }
+          p_ += n * size;
+        } else if (*p_ == '#') {
+          ++p_;
+          auto n = Length();
+          for (std::size_t i = 0; i < n; ++i) {
+            SkipValue();
+          }
+        } else {
+          SkipArrayRest();
+        }
+        break;
+      }
+      case 'Z':
+      case 'T':
+      case 'F':
+        break;
+      case 'i':
+      case 'U':
+      case 'C':
+        Skip(1);
+        break;
+      case 'I':
+        Skip(2);
+        break;
+      case 'l':
+      case 'd':
+        Skip(4);
+        break;
+      case 'L':
+      case 'D':
+        Skip(8);
+        break;
+      case 'S':
+        Skip(Length());
+        break;
+      default:
+        --p_;
+        Error("Unknown construct");
+    }
+  }
+
+  template <typename T>
+  void ExtractTyped(Node const& node, std::size_t n) {
+    for (auto const& kv : node.indices) {
+      if (static_cast<std::size_t>(kv.first) >= n || kv.second->result < 0) {
+        continue;
+      }
+      T v;
+      std::memcpy(&v, p_ + kv.first * sizeof(T), sizeof(T));
+      v = ToBigEndian(v);
+      if constexpr (std::is_floating_point<T>::value) {
+        (*out_)[keys_[kv.second->result]] = Json{Number{v}};
+      } else {
+        (*out_)[keys_[kv.second->result]] = Json{Integer{static_cast<Integer::Int>(v)}};
+      }
+    }
+  }
+
+  void ExtractObject(Node const& node) {
+    ++p_;  // {
+    auto remaining = node.children.size();
+    while (true) {
+      Need(1);
+      if (*p_ == '}') {
+        ++p_;
+        return;
+      }
+      auto n = Length();
+      Need(n);
+      auto it = node.children.find(std::string_view{p_, n});
+      p_ += n;
+      if (it != node.children.cend()) {
+        this->Extract(*it->second);
+        if (--remaining == 0) {
+          SkipObjectRest();
+          return;
+        }
+      } else {
+        SkipValue();
+      }
+    }
+  }
+
+  void ExtractArray(Node const& node) {
+    ++p_;  // [
+    Need(1);
+    if (*p_ == '$') {
+      ++p_;
+      Need(2);
+      auto type = *p_++;
+      auto size = ElementSize(type);
+      if (NIH_UNLIKELY(*p_++ != '#')) {
+        Error("Expecting `#` for typed array");
+      }
+      auto n = Length();
+      if (NIH_UNLIKELY(n > static_cast<std::size_t>(end_ - p_) / size)) {
+        Error("Invalid length of typed array");
+      }
+      switch (type) {
+        case 'U':
+          ExtractTyped<uint8_t>(node, n);
+          break;
+        case 'd':
+          ExtractTyped<float>(node, n);
+          break;
+        case 'l':
+          ExtractTyped<int32_t>(node, n);
+          break;
+        default:
+          ExtractTyped<int64_t>(node, n);
+          break;
+      }
+      p_ += n * size;
+      return;
+    }
+    bool counted = *p_ == '#';
+    std::size_t n = 0;
+    if (counted) {
+      ++p_;
+      n = Length();
+    }
+    auto next = node.indices.cbegin();
+    for (int64_t idx = 0;; ++idx) {
+      if (counted) {
+        if (static_cast<std::size_t>(idx) == n) {
+          return;
+        }
+      } else {
+        Need(1);
+        if (*p_ == ']') {
+          ++p_;
+          return;
+        }
+      }
+      if (next != node.indices.cend() && next->first == idx) {
+        this->Extract(*next->second);
+        ++next;
+      } else if (next == node.indices.cend() && !counted) {
+        SkipArrayRest();
+        return;
+      } else {
+        SkipValue();
+      }
+    }
+  }
+
+ public:
+  using ScannerBase::ScannerBase;
+
+  void Extract(Node const& node) {
+    if (node.result >= 0) {
+      auto beg = p_;
+      SkipValue();
+      UBJReader reader{ConstStringRef{beg, static_cast<std::size_t>(p_ - beg)}};
+      auto value = Json::Load(&reader);
+      ExtractParsed(value, node, keys_, out_);
+      return;
+    }
+    Need(1);
+    if (*p_ == '{') {
+      ExtractObject(node);
+    } else if (*p_ == '[') {
+      ExtractArray(node);
+    } else {
+      SkipValue();
+    }
+  }
+};
+
+void BuildIndices(Node* node) {
+  for (auto const& kv : node->children) {
+    auto idx = ParseArrayIndex(kv.first);
+    if (idx >= 0) {
+      node->indices.emplace_back(idx, kv.second.get());
+    }
+    BuildIndices(kv.second.get());
+  }
+  std::sort(node->indices.begin(), node->indices.end(),
+            [](auto const& l, auto const& r) { return l.first < r.first; });
+}
+}  // anonymous namespace
+
+JsonProjection::JsonProjection(std::vector<JsonPointer> paths) : paths_{std::move(paths)} {
+  auto root = std::make_shared<Node>();
+  for (std::size_t i = 0; i < paths_.size(); ++i) {
+    keys_.push_back(paths_[i].ToString());
+    auto node = root.get();
+    for (auto const& token : paths_[i].Tokens()) {
+      auto& child = node->children[token];
+      if (!child) {
+        child = std::make_unique<Node>();
+      }
+      node = child.get();
+    }
+    node->result = static_cast<int64_t>(i);
+  }
+  BuildIndices(root.get());
+  root_ = std::move(root);
+}
+
+JsonProjection::JsonProjection(std::vector<std::string> const& paths)
+    : JsonProjection{[&] {
+        std::vector<JsonPointer> pointers;
+        for (auto const& path : paths) {
+          pointers.emplace_back(path);
+        }
+        return pointers;
+      }()} {}
+
+Json JsonProjection::Extract(Json const& doc) const {
+  Json out{Object{}};
+  ExtractParsed(doc, *root_, keys_, &out);
+  return out;
+}
+
+Json JsonProjection::Extract(ConstStringRef str, std::ios::openmode mode) const {
+  Json out{Object{}};
+  if (mode & std::ios::binary) {
+    UBJScanner{str, keys_, &out}.Extract(*root_);
+  } else {
+    TextScanner{str, keys_, &out}.Extract(*root_);
+  }
+  return out;
+}
+}  // namespace nih
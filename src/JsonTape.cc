@@ -0,0 +1,487 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include "nih/JsonTape.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./text_parser.h"
+#include "nih/IO.h"
+#include "nih/Json.h"
+#include "nih/Logging.h"
+
+namespace nih {
+using detail::TapeTag;
+
+/**
+ * \brief Handler of detail::TextParser that writes the tape.
+ */
+class TapeBuilder {
+  std::vector<uint64_t>& words_;
+  std::string& strings_;
+
+  struct Open {
+    std::size_t header;
+    std::size_t count;
+  };
+  std::vector<Open> stack_;
+
+  void Push(TapeTag tag, uint64_t payload = 0) {
+    words_.push_back(JsonTape::MakeWord(tag, payload));
+  }
+  // Count a member of the innermost container.
+  void Member() {
+    if (!stack_.empty()) {
+      ++stack_.back().count;
+    }
+  }
+  void Begin(TapeTag tag) {
+    this->Member();
+    stack_.push_back(Open{words_.size(), 0});
+    this->Push(tag);
+  }
+  void End() {
+    auto open = stack_.back();
+    stack_.pop_back();
+    auto end = words_.size();
+    if (NIH_UNLIKELY(end > 0xFFFFFFFF)) {
+      LOG(FATAL) << "Document is too large for a tape.";
+    }
+    auto count = std::min<uint64_t>(open.count, JsonTape::kMaxCount);
+    auto tag = static_cast<TapeTag>(words_[open.header] >> JsonTape::kTagShift);
+    words_[open.header] = JsonTape::MakeWord(tag, (count << JsonTape::kCountShift) | end);
+  }
+
+ public:
+  explicit TapeBuilder(JsonTape* tape)
+      : words_{tape->words_}, strings_{tape->strings_} {
+    words_.clear();
+    strings_.clear();
+  }
+
+  void Null() {
+    this->Member();
+    this->Push(TapeTag::kNull);
+  }
+  void Boolean(bool v) {
+    this->Member();
+    this->Push(v ? TapeTag::kTrue : TapeTag::kFalse);
+  }
+  void Integer(int64_t i) {
+    this->Member();
+    auto constexpr kMin = -(int64_t{1} << 55), kMax = (int64_t{1} << 55) - 1;
+    if (i >= kMin && i <= kMax) {
+      this->Push(TapeTag::kInteger, static_cast<uint64_t>(i) & JsonTape::kPayloadMask);
+    } else {
+      this->Push(TapeTag::kInteger64);
+      words_.push_back(static_cast<uint64_t>(i));
+    }
+  }
+  void Number(float f) {
+    this->Member();
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    this->Push(TapeTag::kNumber, bits);
+  }
+  /*! \brief Start a key, bytes are appended to the returned buffer. */
+  std::string* BeginKey() {
+    auto offset = strings_.size();
+    if (NIH_UNLIKELY(offset > JsonTape::kPayloadMask)) {
+      LOG(FATAL) << "Strings in the document are too large for a tape.";
+    }
+    this->Push(TapeTag::kString, offset);
+    strings_.resize(offset + sizeof(uint32_t));
+    return &strings_;
+  }
+  void EndKey() {
+    auto offset = static_cast<std::size_t>(words_.back() & JsonTape::kPayloadMask);
+    auto n = strings_.size() - offset - sizeof(uint32_t);
+    if (NIH_UNLIKELY(n > std::numeric_limits<uint32_t>::max())) {
+      LOG(FATAL) << "String is too long for a tape: " << n;
+    }
+    auto n32 = static_cast<uint32_t>(n);
+    std::memcpy(&strings_[offset], &n32, sizeof(n32));
+  }
+  std::string* BeginString() {
+    this->Member();
+    return this->BeginKey();
+  }
+  void EndString() { this->EndKey(); }
+  void BeginObject() { this->Begin(TapeTag::kObject); }
+  void BeginArray() { this->Begin(TapeTag::kArray); }
+  void EndObject() { this->End(); }
+  void EndArray() { this->End(); }
+
+  void Key(ConstStringRef str) {
+    this->BeginKey()->append(str.data(), str.size());
+    this->EndKey();
+  }
+  void String(ConstStringRef str) {
+    this->BeginString()->append(str.data(), str.size());
+    this->EndString();
+  }
+};
+
+namespace {
+void BuildFromJson(Json const& json, TapeBuilder* builder) {
+  auto typed = [&](auto const& arr) {
+    builder->BeginArray();
+    for (auto v : arr.GetArray()) {
+      if constexpr (std::is_floating_point<decltype(v)>::value) {
+        builder->Number(v);
+      } else {
+        builder->Integer(static_cast<int64_t>(v));
+      }
+    }
+    builder->EndArray();
+  };
+  visit(json, overloaded{[&](JsonObject const& obj) {
+                           builder->BeginObject();
+                           for (auto const& kv : obj.GetObject()) {
+                             builder->Key(kv.first);
+                             BuildFromJson(kv.second, builder);
+                           }
+                           builder->EndObject();
+                         },
+                         [&](JsonArray const& arr) {
+                           builder->BeginArray();
+                           for (auto const& v : arr.GetArray()) {
+                             BuildFromJson(v, builder);
+                           }
+                           builder->EndArray();
+                         },
+                         [&](F32Array const& arr) { typed(arr); },
+                         [&](U8Array const& arr) { typed(arr); },
+                         [&](I32Array const& arr) { typed(arr); },
+                         [&](I64Array const& arr) { typed(arr); },
+                         [&](JsonString const& str) { builder->String(str.GetString()); },
+                         [&](JsonNumber const& num) {
+                           if (NIH_UNLIKELY(!num.IsExactFloat())) {
+                             LOG(FATAL) << "Tape stores numbers as float, "
+                                        << num.GetDouble() << " can't be stored exactly.";
+                           }
+                           builder->Number(num.GetNumber());
+                         },
+                         [&](JsonInteger const& i) { builder->Integer(i.GetInteger()); },
+                         [&](JsonBoolean const& b) { builder->Boolean(b.GetBoolean()); },
+                         [&](JsonNull const&) { builder->Null(); }});
+}
+}  // anonymous namespace
+
+JsonTape JsonTape::Load(ConstStringRef str) {
+  JsonTape tape;
+  TapeBuilder builder{&tape};
+  // A rough estimation, most values are a word for every few bytes of input.
+  tape.words_.reserve(str.size() / 8 + 1);
+  detail::TextParser<TapeBuilder>{str, &builder}.Parse();
+  tape.words_.shrink_to_fit();
+  tape.strings_.shrink_to_fit();
+  tape.Bind(tape);
+  return tape;
+}
+
+JsonTape JsonTape::FromJson(Json const& json) {
+  JsonTape tape;
+  TapeBuilder builder{&tape};
+  BuildFromJson(json, &builder);
+  tape.Bind(tape);
+  return tape;
+}
+
+namespace {
+/**
+ * \brief Header of a saved tape, followed by the words and then the string bytes.
+ */
+struct ImageHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  // Written as a native integer to detect images from a machine of different byte order.
+  uint64_t byte_order;
+  uint64_t n_words;
+  uint64_t n_string_bytes;
+};
+static_assert(sizeof(ImageHeader) % sizeof(uint64_t) == 0, "Words must be aligned.");
+
+char constexpr kImageMagic[8] = {'N', 'I', 'H', 'T', 'A', 'P', 'E', '\0'};
+uint32_t constexpr kImageVersion = 1;
+uint64_t constexpr kByteOrderMark = 0x0102030405060708;
+}  // anonymous namespace
+
+void JsonTape::Save(std::vector<char>* out) const {
+  ImageHeader header{};
+  std::memcpy(header.magic, kImageMagic, sizeof(kImageMagic));
+  header.version = kImageVersion;
+  header.byte_order = kByteOrderMark;
+  header.n_words = n_words_;
+  header.n_string_bytes = n_string_bytes_;
+
+  auto n_word_bytes = n_words_ * sizeof(uint64_t);
+  out->resize(sizeof(header) + n_word_bytes + n_string_bytes_);
+  auto ptr = out->data();
+  std::memcpy(ptr, &header, sizeof(header));
+  std::memcpy(ptr + sizeof(header), word_ptr_, n_word_bytes);
+  if (n_string_bytes_ != 0) {
+    std::memcpy(ptr + sizeof(header) + n_word_bytes, string_ptr_, n_string_bytes_);
+  }
+}
+
+void JsonTape::Save(std::string const& path) const {
+  std::vector<char> image;
+  this->Save(&image);
+  std::ofstream fout{path, std::ios::binary | std::ios::out | std::ios::trunc};
+  if (!fout) {
+    LOG(FATAL) << "Opening " << path << " failed: " << strerror(errno);
+  }
+  fout.write(image.data(), image.size());
+  if (!fout) {
+    LOG(FATAL) << "Failed to write " << path << ": " << strerror(errno);
+  }
+}
+
+JsonTape JsonTape::FromImage(std::shared_ptr<void const> image, ConstStringRef bytes) {
+  ImageHeader header;
+  if (bytes.size() < sizeof(header)) {
+    LOG(FATAL) << "Invalid tape image, size: " << bytes.size();
+  }
+  if (reinterpret_cast<std::uintptr_t>(bytes.data()) % alignof(uint64_t) != 0) {
+    LOG(FATAL) << "Tape image must be aligned to " << alignof(uint64_t) << " bytes.";
+  }
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  if (std::memcmp(header.magic, kImageMagic, sizeof(kImageMagic)) != 0) {
+    LOG(FATAL) << "Invalid tape image, wrong magic number.";
+  }
+  if (header.version != kImageVersion) {
+    LOG(FATAL) << "Unsupported tape image version: " << header.version;
+  }
+  if (header.byte_order != kByteOrderMark) {
+    LOG(FATAL) << "Tape image is written by a machine with different byte order.";
+  }
+  auto n_bytes = bytes.size() - sizeof(header);
+  if (header.n_words > n_bytes / sizeof(uint64_t) ||
+      header.n_string_bytes != n_bytes - header.n_words * sizeof(uint64_t)) {
+    LOG(FATAL) << "Invalid tape image, size: " << bytes.size()
+               << ", words: " << header.n_words
+               << ", string bytes: " << header.n_string_bytes;
+  }
+
+  JsonTape tape;
+  tape.words_.clear();
+  tape.image_ = std::move(image);
+  tape.word_ptr_ = reinterpret_cast<uint64_t const*>(bytes.data() + sizeof(header));
+  tape.n_words_ = header.n_words;
+  tape.string_ptr_ = bytes.data() + sizeof(header) + header.n_words * sizeof(uint64_t);
+  tape.n_string_bytes_ = header.n_string_bytes;
+  tape.Validate();
+  return tape;
+}
+
+JsonTape JsonTape::Map(std::string const& path) {
+  auto file = std::make_shared<MappedFile>(path, MappedFile::Advice::kRandom);
+  auto bytes = file->Ref();
+  return FromImage(std::move(file), bytes);
+}
+
+JsonTape JsonTape::View(ConstStringRef image) {
+  // Not owned, only marks the tape as reading from an image.
+  std::shared_ptr<void const> borrowed{image.data(), [](void const*) {}};
+  return FromImage(std::move(borrowed), image);
+}
+
+void JsonTape::Validate() const {
+  auto fail = [](char const* msg, std::size_t i) {
+    LOG(FATAL) << "Invalid tape image, " << msg << " at word: " << i;
+  };
+  if (n_words_ == 0) {
+    fail("empty tape", 0);
+  }
+  struct Frame {
+    std::size_t header;
+    std::size_t end;
+    std::size_t count;
+    bool is_object;
+    bool expect_key;
+  };
+  std::vector<Frame> stack;
+  std::size_t i = 0;
+  while (true) {
+    // Close the containers ending here.
+    while (!stack.empty() && stack.back().end == i) {
+      auto const& frame = stack.back();
+      if (frame.is_object && !frame.expect_key) {
+        fail("key without value", i);
+      }
+      auto count = std::min<uint64_t>(frame.count, kMaxCount);
+      if ((this->Payload(frame.header) >> kCountShift) != count) {
+        fail("wrong number of members", frame.header);
+      }
+      stack.pop_back();
+    }
+    if (stack.empty() && i != 0) {
+      if (i != n_words_) {
+        fail("trailing data", i);
+      }
+      return;
+    }
+
+    auto limit = stack.empty() ? n_words_ : stack.back().end;
+    bool is_key = false;
+    if (!stack.empty()) {
+      auto& frame = stack.back();
+      if (frame.is_object) {
+        is_key = frame.expect_key;
+        frame.expect_key = !frame.expect_key;
+      }
+      frame.count += !is_key;
+    }
+    auto tag = this->Tag(i);
+    if (is_key && tag != TapeTag::kString) {
+      fail("expecting a key", i);
+    }
+    switch (tag) {
+      case TapeTag::kNull:
+      case TapeTag::kFalse:
+      case TapeTag::kTrue:
+      case TapeTag::kInteger:
+      case TapeTag::kNumber:
+        ++i;
+        break;
+      case TapeTag::kInteger64:
+        if (i + 2 > limit) {
+          fail("truncated integer", i);
+        }
+        i += 2;
+        break;
+      case TapeTag::kString: {
+        auto offset = this->Payload(i);
+        uint32_t n;
+        if (offset > n_string_bytes_ || n_string_bytes_ - offset < sizeof(n)) {
+          fail("string out of bounds", i);
+        }
+        std::memcpy(&n, string_ptr_ + offset, sizeof(n));
+        if (n_string_bytes_ - offset - sizeof(n) < n) {
+          fail("string out of bounds", i);
+        }
+        ++i;
+        break;
+      }
+      case TapeTag::kObject:
+      case TapeTag::kArray: {
+        auto end = static_cast<std::size_t>(this->Payload(i) & 0xFFFFFFFF);
+        if (end <= i || end > limit) {
+          fail("container out of bounds", i);
+        }
+        stack.push_back(Frame{i, end, 0, tag == TapeTag::kObject, true});
+        ++i;
+        break;
+      }
+      default:
+        fail("unknown tag", i);
+    }
+  }
+}
+
+void TapeRef::TypeError(Value::ValueKind expected) const {
+  LOG(FATAL) << "Invalid cast, from " + this->TypeStr() + " to " +
+                    Value::TypeStr(expected);
+  std::abort();  // not reachable, LOG(FATAL) throws.
+}
+
+std::size_t TapeRef::CountMembers() const {
+  std::size_t n = 0;
+  auto end = tape_->Next(idx_);
+  bool is_object = this->Tag() == TapeTag::kObject;
+  for (auto i = idx_ + 1; i != end; i = tape_->Next(is_object ? i + 1 : i)) {
+    ++n;
+  }
+  return n;
+}
+
+Value::ValueKind TapeRef::Type() const {
+  switch (this->Tag()) {
+    case TapeTag::kFalse:
+    case TapeTag::kTrue:
+      return Value::ValueKind::kBoolean;
+    case TapeTag::kInteger:
+    case TapeTag::kInteger64:
+      return Value::ValueKind::kInteger;
+    case TapeTag::kNumber:
+      return Value::ValueKind::kNumber;
+    case TapeTag::kString:
+      return Value::ValueKind::kString;
+    case TapeTag::kObject:
+      return Value::ValueKind::kObject;
+    case TapeTag::kArray:
+      return Value::ValueKind::kArray;
+    case TapeTag::kNull:
+      break;
+  }
+  return Value::ValueKind::kNull;
+}
+
+TapeRef TapeRef::operator[](ConstStringRef key) const {
+  auto obj = this->GetObject();
+  auto it = obj.find(key);
+  if (NIH_UNLIKELY(it == obj.end())) {
+    LOG(FATAL) << "Key `" << key << "` doesn't exist.";
+  }
+  return (*it).second;
+}
+
+TapeRef TapeRef::operator[](std::size_t i) const { return this->GetArray()[i]; }
+
+TapeRef TapeArray::operator[](std::size_t i) const {
+  if (NIH_UNLIKELY(i >= size_)) {
+    LOG(FATAL) << "Index out of range: " << i << ", size: " << size_;
+  }
+  auto idx = beg_;
+  for (std::size_t k = 0; k < i; ++k) {
+    idx = tape_->Next(idx);
+  }
+  return TapeRef{tape_, idx};
+}
+
+Json TapeRef::ToJson() const {
+  switch (this->Tag()) {
+    case TapeTag::kNull:
+      return Json{JsonNull{}};
+    case TapeTag::kFalse:
+    case TapeTag::kTrue:
+      return Json{JsonBoolean{this->GetBoolean()}};
+    case TapeTag::kInteger:
+    case TapeTag::kInteger64:
+      return Json{JsonInteger{this->GetInteger()}};
+    case TapeTag::kNumber:
+      return Json{JsonNumber{this->GetNumber()}};
+    case TapeTag::kString: {
+      auto str = this->GetString();
+      return Json{JsonString{std::string{str.data(), str.size()}}};
+    }
+    case TapeTag::kObject: {
+      JsonObject::Map map;
+      for (auto const& kv : this->GetObject()) {
+        map[std::string{kv.first.data(), kv.first.size()}] = kv.second.ToJson();
+      }
+      return Json{JsonObject{std::move(map)}};
+    }
+    case TapeTag::kArray: {
+      std::vector<Json> values;
+      values.reserve(this->Size());
+      for (auto v : this->GetArray()) {
+        values.emplace_back(v.ToJson());
+      }
+      return Json{JsonArray{std::move(values)}};
+    }
+  }
+  return Json{};
+}
+}  // namespace nih
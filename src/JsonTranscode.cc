@@ -0,0 +1,441 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+#include "./text_parser.h"
+#include "nih/Charconv.h"
+#include "nih/Intrinsics.h"
+#include "nih/Json.h"
+#include "nih/JsonIO.h"
+#include "nih/Logging.h"
+#include "nih/Span.h"
+
+namespace nih {
+namespace {
+/**
+ * \brief Forward parser events to a JsonStreamWriter.  When writing UBJSON, elements of
+ *        the innermost array are held back as long as they are numbers of the same kind,
+ *        the array is then written as a typed array.
+ */
+class TranscodeHandler {
+  JsonStreamWriter* writer_;
+  bool typed_arrays_;
+  std::string buffer_;
+  // Keys of the open objects, reused between objects at the same depth.
+  std::vector<std::unordered_set<std::string>> keys_;
+  std::size_t depth_{0};
+
+  // The innermost array is not written yet.
+  bool pending_{false};
+  std::vector<int64_t> integers_;
+  std::vector<float> numbers_;
+  std::vector<uint8_t> u8_;
+  std::vector<int32_t> i32_;
+
+  // Write the pending array as a normal array.
+  void Flush() {
+    if (!pending_) {
+      return;
+    }
+    pending_ = false;
+    writer_->BeginArray();
+    for (auto v : integers_) {
+      writer_->Value(v);
+    }
+    for (auto v : numbers_) {
+      writer_->Value(v);
+    }
+    integers_.clear();
+    numbers_.clear();
+  }
+  // Append numbers to `out` until the run ends, returns past the last one.
+  template <typename T>
+  char const* Run(char const* p, char const* end, std::vector<T>* out) {
+    char const* last = p;
+    while (true) {
+      auto n = out->size();
+      out->resize(std::max(n * 2, std::size_t{64}));
+      Span<T> values{out->data() + n, out->size() - n};
+      from_chars_batch_result ret;
+      if constexpr (std::is_same<T, float>::value) {
+        ret = detail::FromCharsFloatBatch(p, end, values, ',', true);
+      } else {
+        ret = from_chars(p, end, values);
+      }
+      out->resize(n + ret.n);
+      if (ret.n != 0) {
+        last = ret.ptr;
+      }
+      if (ret.n != values.size()) {
+        return last;
+      }
+      // The buffer is full, continue after the delimiter.
+      p = last;
+      while (p != end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+        ++p;
+      }
+      if (p == end || *p != ',') {
+        return last;
+      }
+      ++p;
+    }
+  }
+  // Use the narrowest typed array that holds all the integers.
+  void WriteIntegers() {
+    auto minmax = std::minmax_element(integers_.cbegin(), integers_.cend());
+    auto lo = *minmax.first, hi = *minmax.second;
+    if (lo >= 0 && hi <= std::numeric_limits<uint8_t>::max()) {
+      u8_.assign(integers_.cbegin(), integers_.cend());
+      writer_->Array(Span<uint8_t const>{u8_.data(), u8_.size()});
+    } else if (lo >= std::numeric_limits<int32_t>::min() &&
+               hi <= std::numeric_limits<int32_t>::max()) {
+      i32_.assign(integers_.cbegin(), integers_.cend());
+      writer_->Array(Span<int32_t const>{i32_.data(), i32_.size()});
+    } else {
+      writer_->Array(Span<int64_t const>{integers_.data(), integers_.size()});
+    }
+  }
+
+ public:
+  TranscodeHandler(JsonStreamWriter* writer, bool typed_arrays)
+      : writer_{writer}, typed_arrays_{typed_arrays} {}
+
+  void Null() {
+    this->Flush();
+    writer_->Null();
+  }
+  void Boolean(bool v) {
+    this->Flush();
+    writer_->Value(v);
+  }
+  void Integer(int64_t i) {
+    if (pending_ && numbers_.empty()) {
+      integers_.push_back(i);
+      return;
+    }
+    this->Flush();
+    writer_->Value(i);
+  }
+  void Number(float f) {
+    if (pending_ && integers_.empty()) {
+      numbers_.push_back(f);
+      return;
+    }
+    this->Flush();
+    writer_->Value(f);
+  }
+  void Number(double d) {
+    auto f = static_cast<float>(d);
+    if (static_cast<double>(f) == d || d != d) {
+      this->Number(f);
+      return;
+    }
+    this->Flush();
+    writer_->Value(d);
+  }
+  // Parse the leading numbers of a pending array in batch.  Integers and floats are kept
+  // apart as if they were reported one by one.
+  char const* NumberRun(char const* p, char const* end) {
+    if (!pending_) {
+      return p;
+    }
+    auto ret = this->Run(p, end, &integers_);
+    if (ret == p) {
+      ret = this->Run(p, end, &numbers_);
+    }
+    return ret;
+  }
+  std::string* BeginString() {
+    this->Flush();
+    buffer_.clear();
+    return &buffer_;
+  }
+  void EndString() { writer_->Value(ConstStringRef{buffer_}); }
+  std::string* BeginKey() {
+    buffer_.clear();
+    return &buffer_;
+  }
+  void EndKey() {
+    // The readers don't agree on which of the duplicated values is kept.
+    if (NIH_UNLIKELY(!keys_[depth_ - 1].insert(buffer_).second)) {
+      LOG(FATAL) << "Duplicate key `" << buffer_ << "` in object.";
+    }
+    writer_->Key(ConstStringRef{buffer_});
+  }
+  void BeginObject() {
+    this->Flush();
+    if (depth_ == keys_.size()) {
+      keys_.emplace_back();
+    } else {
+      keys_[depth_].clear();
+    }
+    ++depth_;
+    writer_->BeginObject();
+  }
+  void BeginArray() {
+    this->Flush();
+    if (typed_arrays_) {
+      pending_ = true;
+    } else {
+      writer_->BeginArray();
+    }
+  }
+  void EndObject() {
+    --depth_;
+    writer_->End();
+  }
+  void EndArray() {
+    if (!pending_) {
+      writer_->End();
+      return;
+    }
+    pending_ = false;
+    if (!integers_.empty()) {
+      this->WriteIntegers();
+    } else if (!numbers_.empty()) {
+      writer_->Array(Span<float const>{numbers_.data(), numbers_.size()});
+    } else {
+      writer_->BeginArray().End();
+    }
+    integers_.clear();
+    numbers_.clear();
+  }
+  template <typename T>
+  void TypedArray(Span<T const> values) {
+    this->Flush();
+    writer_->Array(values);
+  }
+};
+
+/**
+ * \brief Parse UBJSON and report the values to `Handler` in document order, see
+ *        detail::TextParser for the handler.  Typed arrays are reported with
+ *        `TypedArray`.  Accepts the same input as UBJReader.
+ */
+template <typename Handler>
+class UBJParser {
+  char const* beg_;
+  char const* p_;
+  char const* end_;
+  Handler* handler_;
+
+  struct Frame {
+    bool is_object;
+    bool counted;
+    int64_t remaining;
+  };
+  std::vector<Frame> stack_;
+
+  std::vector<uint8_t> u8_;
+  std::vector<int32_t> i32_;
+  std::vector<int64_t> i64_;
+  std::vector<float> f32_;
+
+  [[noreturn]] void Error(char const* msg) const {
+    LOG(FATAL) << msg << ", around byte offset: " << (p_ - beg_);
+    std::abort();  // not reachable, LOG(FATAL) throws.
+  }
+  void Need(std::size_t n) const {
+    if (NIH_UNLIKELY(static_cast<std::size_t>(end_ - p_) < n)) {
+      Error("Unexpected end of input");
+    }
+  }
+  template <typename T>
+  T Read() {
+    Need(sizeof(T));
+    T v;
+    std::memcpy(&v, p_, sizeof(v));
+    p_ += sizeof(v);
+    return ToBigEndian(v);
+  }
+  int64_t Length() {
+    Need(1);
+    if (NIH_UNLIKELY(*p_ != 'L')) {
+      Error("Only `L` is supported for length");
+    }
+    ++p_;
+    auto n = Read<int64_t>();
+    if (NIH_UNLIKELY(n < 0 || n > end_ - p_)) {
+      Error("Invalid length");
+    }
+    return n;
+  }
+  void String(std::string* out) {
+    auto n = static_cast<std::size_t>(Length());
+    out->append(p_, n);
+    p_ += n;
+  }
+  template <typename T>
+  void TypedArray(std::vector<T>* buffer, int64_t n) {
+    if (NIH_UNLIKELY(static_cast<std::size_t>(n) >
+                     static_cast<std::size_t>(end_ - p_) / sizeof(T))) {
+      Error("Invalid length of typed array");
+    }
+    buffer->resize(n);
+    std::memcpy(buffer->data(), p_, n * sizeof(T));
+    p_ += n * sizeof(T);
+    for (auto& v : *buffer) {
+      v = ToBigEndian(v);
+    }
+    handler_->TypedArray(Span<T const>{buffer->data(), buffer->size()});
+  }
+  // Returns true if a container is opened.
+  bool Value() {
+    Need(1);
+    switch (*p_++) {
+      case '{':
+        handler_->BeginObject();
+        stack_.push_back(Frame{true, false, 0});
+        return true;
+      case '[': {
+        Need(1);
+        if (*p_ == '$') {
+          ++p_;
+          Need(2);
+          auto type = *p_++;
+          if (NIH_UNLIKELY(*p_++ != '#')) {
+            Error("Expecting `#` for typed array");
+          }
+          auto n = Length();
+          switch (type) {
+            case 'd':
+              TypedArray(&f32_, n);
+              break;
+            case 'U':
+              TypedArray(&u8_, n);
+              break;
+            case 'l':
+              TypedArray(&i32_, n);
+              break;
+            case 'L':
+              TypedArray(&i64_, n);
+              break;
+            default:
+              Error("Unsupported type for typed array");
+          }
+          return false;
+        }
+        handler_->BeginArray();
+        if (*p_ == '#') {
+          ++p_;
+          stack_.push_back(Frame{false, true, Length()});
+        } else {
+          stack_.push_back(Frame{false, false, 0});
+        }
+        return true;
+      }
+      case 'Z':
+        handler_->Null();
+        break;
+      case 'T':
+        handler_->Boolean(true);
+        break;
+      case 'F':
+        handler_->Boolean(false);
+        break;
+      case 'd':
+        handler_->Number(Read<float>());
+        break;
+      case 'S':
+        String(handler_->BeginString());
+        handler_->EndString();
+        break;
+      case 'i':
+        handler_->Integer(Read<int8_t>());
+        break;
+      case 'U':
+        handler_->Integer(Read<uint8_t>());
+        break;
+      case 'I':
+        handler_->Integer(Read<int16_t>());
+        break;
+      case 'l':
+        handler_->Integer(Read<int32_t>());
+        break;
+      case 'L':
+        handler_->Integer(Read<int64_t>());
+        break;
+      case 'C':
+        handler_->Integer(Read<char>());
+        break;
+      case 'D':
+        handler_->Number(Read<double>());
+        break;
+      case 'H':
+        Error("High precision number is not supported");
+      default:
+        --p_;
+        Error("Unknown construct");
+    }
+    return false;
+  }
+
+ public:
+  UBJParser(ConstStringRef str, Handler* handler)
+      : beg_{str.data()}, p_{str.data()}, end_{str.data() + str.size()},
+        handler_{handler} {}
+
+  void Parse() {
+    if (p_ == end_) {
+      handler_->Null();
+      return;
+    }
+    while (true) {
+      bool opened = this->Value();
+      // Find the next value, closing the finished containers.
+      while (!stack_.empty()) {
+        auto& top = stack_.back();
+        if (!opened && top.counted) {
+          --top.remaining;
+        }
+        opened = false;
+        if (top.is_object) {
+          Need(1);
+          if (*p_ == '}') {
+            ++p_;
+            stack_.pop_back();
+            handler_->EndObject();
+            continue;
+          }
+          String(handler_->BeginKey());
+          handler_->EndKey();
+          break;
+        }
+        if (top.counted ? top.remaining == 0 : (Need(1), *p_ == ']')) {
+          p_ += top.counted ? 0 : 1;
+          stack_.pop_back();
+          handler_->EndArray();
+          continue;
+        }
+        break;
+      }
+      if (stack_.empty()) {
+        return;
+      }
+    }
+  }
+};
+}  // anonymous namespace
+
+void Transcode(ConstStringRef input, std::ios::openmode from, std::vector<char>* out,
+               std::ios::openmode to, bool typed_arrays) {
+  bool binary = (to & std::ios::binary) != 0;
+  JsonStreamWriter writer{out, to};
+  TranscodeHandler handler{&writer, typed_arrays && binary};
+  if (from & std::ios::binary) {
+    UBJParser<TranscodeHandler>{input, &handler}.Parse();
+  } else {
+    detail::TextParser<TranscodeHandler>{input, &handler}.Parse();
+  }
+}
+}  // namespace nih
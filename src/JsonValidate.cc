@@ -0,0 +1,499 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief Validation of Json documents without constructing the tree.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "./unicode.h"
+#include "nih/Json.h"
+#include "nih/JsonIO.h"
+
+namespace nih {
+namespace {
+// Nesting is checked with recursion, bound it to keep the stack usage in check.
+size_t constexpr kMaxValidateDepth = 4096;
+
+/**
+ * \brief Common state of the validators.  Error messages are static strings so that
+ *        nothing is allocated until the caller asks for the message.
+ */
+class ValidatorBase {
+ protected:
+  char const* beg_;
+  char const* p_;
+  char const* end_;
+  char const* error_{nullptr};
+  size_t error_pos_{0};
+
+  bool Fail(char const* msg) {
+    error_ = msg;
+    error_pos_ = p_ - beg_;
+    return false;
+  }
+  size_t Remaining() const { return end_ - p_; }
+
+ public:
+  explicit ValidatorBase(ConstStringRef str)
+      : beg_{str.data()}, p_{str.data()}, end_{str.data() + str.size()} {}
+
+  std::string Message() const {
+    return std::string{error_} + " around byte offset " + std::to_string(error_pos_);
+  }
+};
+
+/**
+ * \brief RFC 8259 text validator.  `NaN` and `Infinity` are accepted as they are
+ *        produced by the writer.
+ */
+class TextValidator : public ValidatorBase {
+  void SkipSpaces() {
+    while (p_ != end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) {
+      ++p_;
+    }
+  }
+  bool IsDigit() const { return p_ != end_ && *p_ >= '0' && *p_ <= '9'; }
+
+  bool Literal(char const* lit) {
+    auto n = std::strlen(lit);
+    if (Remaining() < n || std::memcmp(p_, lit, n) != 0) {
+      return Fail("Invalid literal");
+    }
+    p_ += n;
+    return true;
+  }
+
+  bool Hex4(uint32_t* code) {
+    if (Remaining() < 4) {
+      return Fail("Incomplete unicode escape");
+    }
+    if (!detail::ParseHex4(p_, code)) {
+      return Fail("Invalid unicode escape");
+    }
+    p_ += 4;
+    return true;
+  }
+
+  bool String() {
+    ++p_;  // "
+    while (true) {
+      p_ = detail::FindStringSpecial(p_, end_);
+      if (p_ == end_) {
+        return Fail("Unterminated string");
+      }
+      auto c = static_cast<uint8_t>(*p_);
+      if (c == '"') {
+        ++p_;
+        return true;
+      }
+      if (c == '\\') {
+        ++p_;
+        if (p_ == end_) {
+          return Fail("Unterminated string");
+        }
+        switch (*p_++) {
+          case '"':
+          case '\\':
+          case '/':
+          case 'b':
+          case 'f':
+          case 'n':
+          case 'r':
+          case 't':
+            break;
+          case 'u': {
+            uint32_t code;
+            if (!Hex4(&code)) {
+              return false;
+            }
+            if (detail::IsLowSurrogate(code)) {
+              return Fail("Unpaired low surrogate");
+            }
+            if (detail::IsHighSurrogate(code)) {
+              if (Remaining() < 2 || p_[0] != '\\' || p_[1] != 'u') {
+                return Fail("Unpaired high surrogate");
+              }
+              p_ += 2;
+              if (!Hex4(&code)) {
+                return false;
+              }
+              if (!detail::IsLowSurrogate(code)) {
+                return Fail("Unpaired high surrogate");
+              }
+            }
+            break;
+          }
+          default:
+            --p_;
+            return Fail("Invalid escape");
+        }
+      } else if (c < 0x20) {
+        return Fail("Control character in string");
+      } else {
+        auto n = detail::UTF8SequenceLength(p_, end_);
+        if (n == 0) {
+          return Fail("Invalid UTF-8");
+        }
+        p_ += n;
+      }
+    }
+  }
+
+  bool Number() {
+    if (*p_ == 'N') {
+      return Literal("NaN");
+    }
+    if (*p_ == '-') {
+      ++p_;
+    }
+    if (p_ != end_ && *p_ == 'I') {
+      return Literal("Infinity");
+    }
+    if (!IsDigit()) {
+      return Fail("Invalid number");
+    }
+    if (*p_ == '0') {
+      ++p_;
+    } else {
+      while (IsDigit()) {
+        ++p_;
+      }
+    }
+    if (p_ != end_ && *p_ == '.') {
+      ++p_;
+      if (!IsDigit()) {
+        return Fail("Invalid number");
+      }
+      while (IsDigit()) {
+        ++p_;
+      }
+    }
+    if (p_ != end_ && (*p_ == 'e' || *p_ == 'E')) {
+      ++p_;
+      if (p_ != end_ && (*p_ == '+' || *p_ == '-')) {
+        ++p_;
+      }
+      if (!IsDigit()) {
+        return Fail("Invalid number");
+      }
+      while (IsDigit()) {
+        ++p_;
+      }
+    }
+    return true;
+  }
+
+  bool Array(size_t depth) {
+    ++p_;  // [
+    SkipSpaces();
+    if (p_ != end_ && *p_ == ']') {
+      ++p_;
+      return true;
+    }
+    while (true) {
+      if (!Value(depth + 1)) {
+        return false;
+      }
+      SkipSpaces();
+      if (p_ == end_) {
+        return Fail("Unterminated array");
+      }
+      if (*p_ == ']') {
+        ++p_;
+        return true;
+      }
+      if (*p_ != ',') {
+        return Fail("Expecting `,` or `]`");
+      }
+      ++p_;
+    }
+  }
+
+  bool Object(size_t depth) {
+    ++p_;  // {
+    SkipSpaces();
+    if (p_ != end_ && *p_ == '}') {
+      ++p_;
+      return true;
+    }
+    while (true) {
+      SkipSpaces();
+      if (p_ == end_ || *p_ != '"') {
+        return Fail("Expecting object key");
+      }
+      if (!String()) {
+        return false;
+      }
+      SkipSpaces();
+      if (p_ == end_ || *p_ != ':') {
+        return Fail("Expecting `:`");
+      }
+      ++p_;
+      if (!Value(depth + 1)) {
+        return false;
+      }
+      SkipSpaces();
+      if (p_ == end_) {
+        return Fail("Unterminated object");
+      }
+      if (*p_ == '}') {
+        ++p_;
+        return true;
+      }
+      if (*p_ != ',') {
+        return Fail("Expecting `,` or `}`");
+      }
+      ++p_;
+    }
+  }
+
+  bool Value(size_t depth) {
+    if (depth > kMaxValidateDepth) {
+      return Fail("Exceeded maximum nesting depth");
+    }
+    SkipSpaces();
+    if (p_ == end_) {
+      return Fail("Unexpected end of input");
+    }
+    switch (*p_) {
+      case '{':
+        return Object(depth);
+      case '[':
+        return Array(depth);
+      case '"':
+        return String();
+      case 't':
+        return Literal("true");
+      case 'f':
+        return Literal("false");
+      case 'n':
+        return Literal("null");
+      default:
+        return Number();
+    }
+  }
+
+ public:
+  using ValidatorBase::ValidatorBase;
+
+  bool Run() {
+    if (!Value(0)) {
+      return false;
+    }
+    SkipSpaces();
+    if (p_ != end_) {
+      return Fail("Trailing characters after document");
+    }
+    return true;
+  }
+};
+
+/**
+ * \brief Validator for the UBJSON subset accepted by UBJReader, with UTF-8 checks for
+ *        strings.
+ */
+class UBJValidator : public ValidatorBase {
+  bool Skip(size_t n) {
+    if (Remaining() < n) {
+      return Fail("Unexpected end of input");
+    }
+    p_ += n;
+    return true;
+  }
+
+  bool Length(size_t* n) {
+    if (p_ == end_ || *p_ != 'L') {
+      return Fail("Expecting `L` for length");
+    }
+    ++p_;
+    if (Remaining() < sizeof(int64_t)) {
+      return Fail("Unexpected end of input");
+    }
+    int64_t v;
+    std::memcpy(&v, p_, sizeof(v));
+    v = ToBigEndian(v);
+    if (v < 0) {
+      return Fail("Negative length");
+    }
+    p_ += sizeof(v);
+    *n = static_cast<size_t>(v);
+    return true;
+  }
+
+  bool String() {
+    size_t n;
+    if (!Length(&n)) {
+      return false;
+    }
+    if (n > Remaining()) {
+      return Fail("Invalid length of string");
+    }
+    auto invalid = detail::FindInvalidUTF8(p_, p_ + n);
+    if (invalid != p_ + n) {
+      p_ = invalid;
+      return Fail("Invalid UTF-8");
+    }
+    p_ += n;
+    return true;
+  }
+
+  bool Array(size_t depth) {
+    if (p_ != end_ && *p_ == '$') {
+      ++p_;
+      if (p_ == end_) {
+        return Fail("Unexpected end of input");
+      }
+      size_t elem_size;
+      switch (*p_++) {
+        case 'U':
+          elem_size = 1;
+          break;
+        case 'd':
+        case 'l':
+          elem_size = 4;
+          break;
+        case 'L':
+          elem_size = 8;
+          break;
+        default:
+          --p_;
+          return Fail("Unsupported type for typed array");
+      }
+      if (p_ == end_ || *p_ != '#') {
+        return Fail("Expecting `#` for typed array");
+      }
+      ++p_;
+      size_t n;
+      if (!Length(&n)) {
+        return false;
+      }
+      if (n > Remaining() / elem_size) {
+        return Fail("Invalid length of typed array");
+      }
+      p_ += n * elem_size;
+      return true;
+    }
+    if (p_ != end_ && *p_ == '#') {
+      ++p_;
+      size_t n;
+      if (!Length(&n)) {
+        return false;
+      }
+      if (n > Remaining()) {
+        return Fail("Invalid length of array");
+      }
+      for (size_t i = 0; i < n; ++i) {
+        if (!Value(depth + 1)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    while (true) {
+      if (p_ == end_) {
+        return Fail("Unterminated array");
+      }
+      if (*p_ == ']') {
+        ++p_;
+        return true;
+      }
+      if (!Value(depth + 1)) {
+        return false;
+      }
+    }
+  }
+
+  bool Object(size_t depth) {
+    while (true) {
+      if (p_ == end_) {
+        return Fail("Unterminated object");
+      }
+      if (*p_ == '}') {
+        ++p_;
+        return true;
+      }
+      if (!String() || !Value(depth + 1)) {
+        return false;
+      }
+    }
+  }
+
+  bool Value(size_t depth) {
+    if (depth > kMaxValidateDepth) {
+      return Fail("Exceeded maximum nesting depth");
+    }
+    if (p_ == end_) {
+      return Fail("Unexpected end of input");
+    }
+    switch (*p_++) {
+      case '{':
+        return Object(depth);
+      case '[':
+        return Array(depth);
+      case 'Z':
+      case 'T':
+      case 'F':
+        return true;
+      case 'i':
+      case 'U':
+        return Skip(1);
+      case 'I':
+        return Skip(2);
+      case 'l':
+      case 'd':
+        return Skip(4);
+      case 'L':
+      case 'D':
+        return Skip(8);
+      case 'C': {
+        if (p_ == end_ || static_cast<uint8_t>(*p_) >= 0x80) {
+          return Fail("Invalid char");
+        }
+        ++p_;
+        return true;
+      }
+      case 'S':
+        return String();
+      default:
+        --p_;
+        return Fail("Unknown construct");
+    }
+  }
+
+ public:
+  using ValidatorBase::ValidatorBase;
+
+  bool Run() {
+    if (!Value(0)) {
+      return false;
+    }
+    if (p_ != end_) {
+      return Fail("Trailing bytes after document");
+    }
+    return true;
+  }
+};
+
+template <typename Validator>
+bool RunValidator(ConstStringRef str, std::string* error) {
+  Validator validator{str};
+  if (validator.Run()) {
+    return true;
+  }
+  if (error) {
+    *error = validator.Message();
+  }
+  return false;
+}
+}  // anonymous namespace
+
+bool Json::Validate(ConstStringRef str, std::ios::openmode mode, std::string* error) {
+  if (mode & std::ios::binary) {
+    return RunValidator<UBJValidator>(str, error);
+  }
+  return RunValidator<TextValidator>(str, error);
+}
+}  // namespace nih
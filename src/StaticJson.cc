@@ -0,0 +1,75 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include "nih/StaticJson.h"
+
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "nih/Json.h"
+#include "nih/Logging.h"
+
+namespace nih {
+namespace detail {
+void StaticJsonError(char const* msg, std::size_t pos) {
+  LOG(FATAL) << msg << ", around character position: " << pos;
+  std::abort();  // not reachable, LOG(FATAL) throws.
+}
+
+void StaticJsonCastError(Value::ValueKind from, Value::ValueKind to) {
+  LOG(FATAL) << "Invalid cast, from " << Value::TypeStr(from) << " to "
+             << Value::TypeStr(to);
+  std::abort();
+}
+
+void StaticJsonKeyError(std::string_view key) {
+  LOG(FATAL) << "Key `" << key << "` doesn't exist.";
+  std::abort();
+}
+
+void StaticJsonIndexError(std::size_t i, std::size_t size) {
+  LOG(FATAL) << "Index out of range: " << i << ", size: " << size;
+  std::abort();
+}
+}  // namespace detail
+
+Json StaticRef::ToJson() const {
+  switch (this->Type()) {
+    case Value::ValueKind::kNull:
+      return Json{JsonNull{}};
+    case Value::ValueKind::kBoolean:
+      return Json{JsonBoolean{this->GetBoolean()}};
+    case Value::ValueKind::kInteger:
+      return Json{JsonInteger{this->GetInteger()}};
+    case Value::ValueKind::kNumber:
+      return Json{JsonNumber{this->GetNumber()}};
+    case Value::ValueKind::kString:
+      return Json{JsonString{std::string{this->GetString()}}};
+    case Value::ValueKind::kObject: {
+      JsonObject::Map map;
+      auto k = idx_ + 1;
+      for (std::size_t i = 0; i < this->Size(); ++i) {
+        map[std::string{this->String(k)}] = StaticRef{nodes_, chars_, k + 1}.ToJson();
+        k = nodes_[k + 1].next;
+      }
+      return Json{JsonObject{std::move(map)}};
+    }
+    case Value::ValueKind::kArray: {
+      std::vector<Json> values;
+      values.reserve(this->Size());
+      auto k = idx_ + 1;
+      for (std::size_t i = 0; i < this->Size(); ++i) {
+        values.emplace_back(StaticRef{nodes_, chars_, k}.ToJson());
+        k = nodes_[k].next;
+      }
+      return Json{JsonArray{std::move(values)}};
+    }
+    default:
+      break;
+  }
+  return Json{};
+}
+}  // namespace nih
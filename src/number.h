@@ -0,0 +1,33 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief Internal number parsing shared by the Json reader and the tape builder.
+ */
+#ifndef NIH_SRC_NUMBER_H_
+#define NIH_SRC_NUMBER_H_
+
+#include <cstdint>
+#include <cstdlib>  // std::strtof
+#include <string>
+#include <system_error>
+
+#include "nih/Charconv.h"
+#include "nih/JsonGrammar.h"
+
+namespace nih {
+namespace detail {
+/*! \brief Convert the text of a floating point number found by ScanNumber. */
+inline float ParseFloat(char const* beg, char const* end) {
+  float f;
+  auto ret = from_chars(beg, end, f);
+  if (ret.ec != std::errc()) {
+    // Compatible with old format that generates very long mantissa from std stream.
+    std::string copy{beg, end};
+    f = std::strtof(copy.c_str(), nullptr);
+  }
+  return f;
+}
+}  // namespace detail
+}  // namespace nih
+
+#endif  // NIH_SRC_NUMBER_H_
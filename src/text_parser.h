@@ -0,0 +1,244 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief Internal event based parser for JSON text, shared by the tape builder and the
+ *        transcoder.
+ */
+#ifndef NIH_SRC_TEXT_PARSER_H_
+#define NIH_SRC_TEXT_PARSER_H_
+
+#include <cstddef>
+#include <cstdlib>  // std::abort
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "./number.h"
+#include "./unicode.h"
+#include "nih/Intrinsics.h"
+#include "nih/Logging.h"
+#include "nih/StringRef.h"
+
+namespace nih {
+namespace detail {
+// Whether the handler has the optional NumberRun method.
+template <typename Handler, typename = void>
+struct HasNumberRun : public std::false_type {};
+template <typename Handler>
+struct HasNumberRun<Handler,
+                    std::void_t<decltype(std::declval<Handler&>().NumberRun(
+                        std::declval<char const*>(), std::declval<char const*>()))>>
+    : public std::true_type {};
+
+/**
+ * \brief Parse JSON text and report the values to `Handler` in document order.
+ *        Containers are handled with an explicit stack, so deeply nested documents don't
+ *        overflow the call stack.  Accepts the same input as JsonReader.
+ *
+ *   The handler has the following methods:
+ *
+ *   - Null(), Boolean(bool), Integer(int64_t), Number(float)
+ *   - BeginObject(), EndObject(), BeginArray(), EndArray()
+ *   - BeginString() and BeginKey() return a std::string* that the decoded bytes are
+ *     appended to, followed by EndString() and EndKey() respectively.
+ *   - Optionally NumberRun(char const* p, char const* end), called after BeginArray when
+ *     the array is not empty.  The handler may parse a run of numbers itself, it returns
+ *     past the last one or `p` if it parsed none.
+ */
+template <typename Handler>
+class TextParser {
+  char const* beg_;
+  char const* p_;
+  char const* end_;
+  Handler* handler_;
+  // Whether each of the open containers is an object.
+  std::vector<bool> stack_;
+
+  [[noreturn]] void Error(char const* msg) const {
+    LOG(FATAL) << msg << ", around character position: " << (p_ - beg_);
+    std::abort();  // not reachable, LOG(FATAL) throws.
+  }
+  void SkipSpaces() {
+    while (p_ != end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) {
+      ++p_;
+    }
+  }
+  void Expect(char c) {
+    SkipSpaces();
+    if (NIH_UNLIKELY(p_ == end_ || *p_ != c)) {
+      std::string msg = "Expecting: \"";
+      msg += c;
+      msg += '"';
+      Error(msg.c_str());
+    }
+    ++p_;
+  }
+  void Literal(char const* lit, std::size_t n) {
+    if (NIH_UNLIKELY(static_cast<std::size_t>(end_ - p_) < n ||
+                     std::memcmp(p_, lit, n) != 0)) {
+      Error("Unknown construct");
+    }
+    p_ += n;
+  }
+  // p_ is at the opening quote.
+  void String(std::string* buf) {
+    ++p_;
+    auto error = UnescapeString(&p_, end_, buf);
+    if (NIH_UNLIKELY(error != nullptr)) {
+      Error(error);
+    }
+  }
+  void Number() {
+    auto c = *p_;
+    if (c == 'N') {
+      Literal("NaN", 3);
+      handler_->Number(std::numeric_limits<float>::quiet_NaN());
+      return;
+    }
+    std::size_t n_signs = c == '-' ? 1 : 0;
+    if (p_ + n_signs != end_ && p_[n_signs] == 'I') {
+      p_ += n_signs;
+      Literal("Infinity", 8);
+      auto inf = std::numeric_limits<float>::infinity();
+      handler_->Number(c == '-' ? -inf : inf);
+      return;
+    }
+    auto scan = ScanNumber(p_, end_);
+    if (NIH_UNLIKELY(!scan.valid)) {
+      p_ = scan.ptr;
+      Error("Expecting digit");
+    }
+    if (scan.is_float) {
+      handler_->Number(ParseFloat(p_, scan.ptr));
+    } else {
+      handler_->Integer(scan.integer);
+    }
+    p_ = scan.ptr;
+  }
+  void Key() {
+    SkipSpaces();
+    if (NIH_UNLIKELY(p_ == end_ || *p_ != '"')) {
+      Error("Expecting object key");
+    }
+    String(handler_->BeginKey());
+    handler_->EndKey();
+    Expect(':');
+  }
+  void End(bool is_object) {
+    stack_.pop_back();
+    if (is_object) {
+      handler_->EndObject();
+    } else {
+      handler_->EndArray();
+    }
+  }
+
+ public:
+  TextParser(ConstStringRef str, Handler* handler)
+      : beg_{str.data()}, p_{str.data()}, end_{str.data() + str.size()},
+        handler_{handler} {}
+
+  /*! \brief Parse a single value, an empty input is a null value like Json::Load. */
+  void Parse() {
+    SkipSpaces();
+    if (p_ == end_) {
+      handler_->Null();
+      return;
+    }
+    while (true) {
+      // Parse a value.
+      SkipSpaces();
+      if (NIH_UNLIKELY(p_ == end_)) {
+        Error("Unexpected end of input");
+      }
+      switch (*p_) {
+        case '{': {
+          ++p_;
+          handler_->BeginObject();
+          stack_.push_back(true);
+          SkipSpaces();
+          if (p_ != end_ && *p_ == '}') {
+            ++p_;
+            this->End(true);
+            break;
+          }
+          Key();
+          continue;
+        }
+        case '[': {
+          ++p_;
+          handler_->BeginArray();
+          stack_.push_back(false);
+          SkipSpaces();
+          if (p_ != end_ && *p_ == ']') {
+            ++p_;
+            this->End(false);
+            break;
+          }
+          if constexpr (HasNumberRun<Handler>::value) {
+            auto run_end = handler_->NumberRun(p_, end_);
+            if (run_end != p_) {
+              // Continue after the last number of the run.
+              p_ = run_end;
+              break;
+            }
+          }
+          continue;
+        }
+        case '"':
+          String(handler_->BeginString());
+          handler_->EndString();
+          break;
+        case 't':
+          Literal("true", 4);
+          handler_->Boolean(true);
+          break;
+        case 'f':
+          Literal("false", 5);
+          handler_->Boolean(false);
+          break;
+        case 'n':
+          Literal("null", 4);
+          handler_->Null();
+          break;
+        default: {
+          auto c = *p_;
+          if (NIH_UNLIKELY(c != '-' && (c < '0' || c > '9') && c != 'N' && c != 'I')) {
+            Error("Unknown construct");
+          }
+          Number();
+        }
+      }
+      // Close the containers ended by this value.
+      while (true) {
+        if (stack_.empty()) {
+          return;
+        }
+        SkipSpaces();
+        if (NIH_UNLIKELY(p_ == end_)) {
+          Error("Unexpected end of input");
+        }
+        auto c = *p_++;
+        bool in_object = stack_.back();
+        if (c == ',') {
+          if (in_object) {
+            Key();
+          }
+          break;
+        }
+        if (NIH_UNLIKELY(c != (in_object ? '}' : ']'))) {
+          --p_;
+          Error(in_object ? "Expecting: \",\" or \"}\"" : "Expecting: \",\" or \"]\"");
+        }
+        this->End(in_object);
+      }
+    }
+  }
+};
+}  // namespace detail
+}  // namespace nih
+
+#endif  // NIH_SRC_TEXT_PARSER_H_
@@ -0,0 +1,209 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief Internal UBJSON parser, shared by the in-memory and the streaming readers.
+ */
+#ifndef NIH_SRC_UBJ_PARSER_H_
+#define NIH_SRC_UBJ_PARSER_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nih/Intrinsics.h"
+#include "nih/Json.h"
+
+namespace nih {
+namespace detail {
+/**
+ * \brief Parse UBJSON from a byte source into Json.
+ *
+ *   `Source` provides:
+ *
+ *   - `bool AtEnd()`: whether the input is exhausted.
+ *   - `char GetNextChar()`, `char PeekNextChar()`: only called when not at end.
+ *   - `T ReadPrimitive<T>()`: a number in host byte order, throws on truncated input.
+ *   - `T FromUBJ(T v)`: convert a number read with `ReadBytes` to host byte order.
+ *   - `void ReadBytes(char* out, std::size_t n)`: throws on truncated input.
+ *   - `bool Fits(int64_t n, std::size_t size)`: whether the input can hold `n` items of
+ *     `size` bytes, false for negative `n`.
+ *   - `bool Sized()`: whether `Fits` is checked against the size of the input.  When
+ *     it's not, containers grow as the data arrives instead of being allocated upfront,
+ *     so a corrupt length fails at the end of input.
+ *   - `void Error(std::string msg)`: throws with the location of the error.
+ */
+template <typename Source>
+class UBJParser {
+  // Largest allocation made ahead of the data for input of unknown size.
+  static std::size_t constexpr kMaxReserveBytes = std::size_t{1} << 20;
+
+  Source* src_;
+
+  // Number of items of `size` bytes to allocate before reading them.
+  std::size_t ReserveSize(int64_t n, std::size_t size) const {
+    if (src_->Sized()) {
+      return static_cast<std::size_t>(n);
+    }
+    return std::min(static_cast<std::size_t>(n), kMaxReserveBytes / size);
+  }
+  // Read `n` items into a vector or a string, `n` must be checked by `Fits`.
+  template <typename Vec>
+  void ReadItems(int64_t n, Vec* out) {
+    using T = typename Vec::value_type;
+    std::size_t n_read = 0;
+    while (n_read < static_cast<std::size_t>(n)) {
+      auto chunk = ReserveSize(n - n_read, sizeof(T));
+      out->resize(n_read + chunk);
+      src_->ReadBytes(reinterpret_cast<char*>(out->data() + n_read), chunk * sizeof(T));
+      n_read += chunk;
+    }
+  }
+
+  char GetNextChar() {
+    if (NIH_UNLIKELY(src_->AtEnd())) {
+      src_->Error("Unexpected end of input");
+    }
+    return src_->GetNextChar();
+  }
+  char PeekNextChar() {
+    if (NIH_UNLIKELY(src_->AtEnd())) {
+      src_->Error("Unexpected end of input");
+    }
+    return src_->PeekNextChar();
+  }
+  void GetConsecutiveChar(char expected_char) {
+    char got = GetNextChar();
+    if (NIH_UNLIKELY(got != expected_char)) {
+      src_->Error(std::string{"Expecting: \""} + expected_char + "\", got: \"" + got +
+                  "\"");
+    }
+  }
+  int64_t ReadLength(char const* what) {
+    GetConsecutiveChar('L');
+    auto n = src_->template ReadPrimitive<int64_t>();
+    if (NIH_UNLIKELY(!src_->Fits(n, 1))) {
+      src_->Error(std::string{"Invalid length of "} + what + ": " + std::to_string(n));
+    }
+    return n;
+  }
+
+  template <typename TypedArray>
+  Json ParseTypedArray(int64_t n) {
+    using T = typename TypedArray::Type;
+    if (NIH_UNLIKELY(!src_->Fits(n, sizeof(T)))) {
+      src_->Error("Invalid length of typed array: " + std::to_string(n));
+    }
+    TypedArray results;
+    auto& vec = results.GetArray();
+    this->ReadItems(n, &vec);
+    for (auto& v : vec) {
+      v = src_->FromUBJ(v);
+    }
+    return Json{std::move(results)};
+  }
+
+  std::string DecodeStr() {
+    auto n = ReadLength("string");
+    std::string str;
+    this->ReadItems(n, &str);
+    return str;
+  }
+
+  Json ParseArray() {
+    auto marker = PeekNextChar();
+    if (marker == '$') {  // typed array
+      GetNextChar();
+      auto type = GetNextChar();
+      GetConsecutiveChar('#');
+      GetConsecutiveChar('L');
+      auto n = src_->template ReadPrimitive<int64_t>();
+      switch (type) {
+        case 'd':
+          return ParseTypedArray<F32Array>(n);
+        case 'U':
+          return ParseTypedArray<U8Array>(n);
+        case 'l':
+          return ParseTypedArray<I32Array>(n);
+        case 'L':
+          return ParseTypedArray<I64Array>(n);
+        default:
+          src_->Error("`" + std::string{type} + "` is not supported for typed array.");
+      }
+    }
+    std::vector<Json> results;
+    if (marker == '#') {  // array with length optimization
+      GetNextChar();
+      // Each element occupies at least 1 byte.
+      auto n = ReadLength("array");
+      results.reserve(ReserveSize(n, sizeof(Json)));
+      for (int64_t i = 0; i < n; ++i) {
+        results.emplace_back(Parse());
+      }
+    } else {  // normal array
+      while (marker != ']') {
+        results.emplace_back(Parse());
+        marker = PeekNextChar();
+      }
+      GetNextChar();
+    }
+    return Json{std::move(results)};
+  }
+
+  Json ParseObject() {
+    Object::Map results;
+    while (PeekNextChar() != '}') {
+      auto key = this->DecodeStr();
+      results.emplace(std::move(key), this->Parse());
+    }
+    GetNextChar();
+    return Json{std::move(results)};
+  }
+
+ public:
+  explicit UBJParser(Source* src) : src_{src} {}
+
+  Json Parse() {
+    char c = GetNextChar();
+    switch (c) {
+      case '{':
+        return ParseObject();
+      case '[':
+        return ParseArray();
+      case 'Z':
+        return Json{nullptr};
+      case 'T':
+        return Json{JsonBoolean{true}};
+      case 'F':
+        return Json{JsonBoolean{false}};
+      case 'd':
+        return Json{src_->template ReadPrimitive<float>()};
+      case 'S':
+        return Json{this->DecodeStr()};
+      case 'i':
+        return Json{static_cast<Integer::Int>(src_->template ReadPrimitive<int8_t>())};
+      case 'U':
+        return Json{static_cast<Integer::Int>(src_->template ReadPrimitive<uint8_t>())};
+      case 'I':
+        return Json{static_cast<Integer::Int>(src_->template ReadPrimitive<int16_t>())};
+      case 'l':
+        return Json{static_cast<Integer::Int>(src_->template ReadPrimitive<int32_t>())};
+      case 'L':
+        return Json{src_->template ReadPrimitive<int64_t>()};
+      case 'C':
+        return Json{static_cast<Integer::Int>(src_->template ReadPrimitive<char>())};
+      case 'D':
+        return Json{src_->template ReadPrimitive<double>()};
+      case 'H':
+        src_->Error("High precision number is not supported.");
+        break;
+      default:
+        src_->Error("Unknown construct");
+    }
+    return {};
+  }
+};
+}  // namespace detail
+}  // namespace nih
+#endif  // NIH_SRC_UBJ_PARSER_H_
@@ -0,0 +1,123 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ *
+ * \brief Internal UTF-8 helpers shared by the Json readers, writer and the validator.
+ */
+#ifndef NIH_SRC_UNICODE_H_
+#define NIH_SRC_UNICODE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "nih/JsonGrammar.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif  // defined(__SSE2__)
+
+namespace nih {
+namespace detail {
+/**
+ * \brief Skip ASCII bytes, returns the first non-ASCII byte or `end`.
+ */
+inline char const* SkipASCII(char const* p, char const* end) {
+#if defined(__SSE2__)
+  while (end - p >= 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+    auto mask = _mm_movemask_epi8(v);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif  // defined(__SSE2__)
+  while (end - p >= 8) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    if (word & 0x8080808080808080ULL) {
+      break;
+    }
+    p += 8;
+  }
+  while (p != end && static_cast<uint8_t>(*p) < 0x80) {
+    ++p;
+  }
+  return p;
+}
+
+/**
+ * \brief Find the first byte that doesn't start a well-formed UTF-8 sequence, `end` if
+ *        the whole input is valid.
+ */
+inline char const* FindInvalidUTF8(char const* p, char const* end) {
+  while (p != end) {
+    p = SkipASCII(p, end);
+    if (p == end) {
+      break;
+    }
+    auto n = UTF8SequenceLength(p, end);
+    if (n == 0) {
+      return p;
+    }
+    p += n;
+  }
+  return end;
+}
+
+/**
+ * \brief Find the first byte in a JSON string that can't be copied verbatim: a quote, a
+ *        backslash, a control character or the first byte of a non-ASCII sequence.
+ *        Returns `end` if there's none.
+ */
+inline char const* FindStringSpecial(char const* p, char const* end) {
+  // Escapes often come in runs, check the first byte before loading a whole block.
+  if (p != end && IsStringSpecial(*p)) {
+    return p;
+  }
+#if defined(__SSE2__)
+  auto const quote = _mm_set1_epi8('"');
+  auto const backslash = _mm_set1_epi8('\\');
+  auto const space = _mm_set1_epi8(0x20);
+  while (end - p >= 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+    // Signed comparison, bytes above 0x7f are negative and less than the space.
+    auto m = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash));
+    m = _mm_or_si128(m, _mm_cmplt_epi8(v, space));
+    auto mask = _mm_movemask_epi8(m);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#else
+  uint64_t constexpr kOnes = 0x0101010101010101ULL, kHigh = 0x8080808080808080ULL;
+  auto has_zero = [=](uint64_t x) { return (x - kOnes) & ~x & kHigh; };
+  while (end - p >= 8) {
+    uint64_t w;
+    std::memcpy(&w, p, sizeof(w));
+    auto special = has_zero(w ^ (kOnes * '"')) | has_zero(w ^ (kOnes * '\\')) |
+                   ((w - kOnes * 0x20) & ~w & kHigh) | (w & kHigh);
+    if (special) {
+      break;
+    }
+    p += 8;
+  }
+#endif  // defined(__SSE2__)
+  return FindStringSpecialScalar(p, end);
+}
+
+/**
+ * \brief Decode the body of a JSON string and append it to `out`, see the generic
+ *        version in JsonGrammar.h.
+ */
+inline char const* UnescapeString(char const** pp, char const* end, std::string* out) {
+  return UnescapeString(pp, end, out, [](char const* p, char const* last) {
+    return FindStringSpecial(p, last);
+  });
+}
+}  // namespace detail
+}  // namespace nih
+
+#endif  // NIH_SRC_UNICODE_H_
@@ -22,8 +22,11 @@
  */
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <limits>
 #include <cmath>
+#include <string>
+#include <vector>
 #include "nih/Charconv.h"
 
 namespace nih {
@@ -211,4 +214,192 @@ TEST(Ryu, TrailingZeros) {
   TestRyuParse(99999992.0f, "99999989.5");
 }
 
+namespace {
+double Int64Bits2Double(uint64_t bits) {
+  double d;
+  memcpy(&d, &bits, sizeof(double));
+  return d;
+}
+
+void TestRyuDouble(char const* res, double v) {
+  char result[NumericLimits<double>::kToCharsSize];
+  auto ret = to_chars(result, result + sizeof(result), v);
+  *ret.ptr = '\0';
+  EXPECT_STREQ(res, result);
+}
+
+void TestRyuParseDouble(double d, std::string in) {
+  double res;
+  auto ret = from_chars(in.c_str(), in.c_str() + in.size(), res);
+  ASSERT_EQ(ret.ec, std::errc());
+  ASSERT_EQ(ret.ptr, in.c_str() + in.size());
+  ASSERT_EQ(d, res);
+}
+}  // anonymous namespace
+
+TEST(RyuDouble, Basic) {
+  TestRyuDouble("0E0", 0.0);
+  TestRyuDouble("-0E0", -0.0);
+  TestRyuDouble("1E0", 1.0);
+  TestRyuDouble("-1E0", -1.0);
+  TestRyuDouble("NaN", NAN);
+  TestRyuDouble("Infinity", INFINITY);
+  TestRyuDouble("-Infinity", -INFINITY);
+  TestRyuDouble("1E-1", 0.1);
+  TestRyuDouble("2.220446049250313E-16", std::numeric_limits<double>::epsilon());
+}
+
+TEST(RyuDouble, MinAndMax) {
+  TestRyuDouble("1.7976931348623157E308", Int64Bits2Double(0x7fefffffffffffff));
+  TestRyuDouble("5E-324", Int64Bits2Double(1));
+}
+
+TEST(RyuDouble, Regression) {
+  TestRyuDouble("-2.109808898695963E16", -2.109808898695963E16);
+  TestRyuDouble("4.940656E-318", 4.940656E-318);
+  TestRyuDouble("1.18575755E-316", 1.18575755E-316);
+  TestRyuDouble("2.989102097996E-312", 2.989102097996E-312);
+  TestRyuDouble("9.0608011534336E15", 9.0608011534336E15);
+  TestRyuDouble("4.708356024711512E18", 4.708356024711512E18);
+  TestRyuDouble("9.409340012568248E18", 9.409340012568248E18);
+  TestRyuDouble("1.2345678E0", 1.2345678);
+}
+
+TEST(RyuDouble, LooksLikePow5) {
+  TestRyuDouble("5.764607523034235E39", Int64Bits2Double(0x4830F0CF064DD592));
+  TestRyuDouble("1.152921504606847E40", Int64Bits2Double(0x4840F0CF064DD592));
+  TestRyuDouble("2.305843009213694E40", Int64Bits2Double(0x4850F0CF064DD592));
+}
+
+TEST(RyuDouble, Parse) {
+  TestRyuParseDouble(0.0, "0");
+  TestRyuParseDouble(-0.0, "-0");
+  TestRyuParseDouble(1.0, "1");
+  TestRyuParseDouble(0.1, "0.1");
+  TestRyuParseDouble(123456789.0, "123456789");
+  TestRyuParseDouble(1.7976931348623157e308, "1.7976931348623157e308");
+  TestRyuParseDouble(5e-324, "5e-324");
+  TestRyuParseDouble(2.2250738585072014e-308, "2.2250738585072014E-308");
+  TestRyuParseDouble(INFINITY, "1e309");
+  TestRyuParseDouble(0.0, "1e-400");
+  TestRyuParseDouble(100.0, "100.000000000000000000000");
+  TestRyuParseDouble(3.0540412e5, "305404.12");
+}
+
+TEST(RyuDouble, RoundTrip) {
+  uint64_t bits = 0x123456789abcdef1;
+  for (std::size_t i = 0; i < 4096; ++i) {
+    bits = bits * 6364136223846793005ull + 1442695040888963407ull;
+    auto d = Int64Bits2Double(bits);
+    if (std::isnan(d) || std::isinf(d)) {
+      continue;
+    }
+    char result[NumericLimits<double>::kToCharsSize];
+    auto ret = to_chars(result, result + sizeof(result), d);
+    double back;
+    auto from_ret = from_chars(result, ret.ptr, back);
+    ASSERT_EQ(from_ret.ec, std::errc());
+    ASSERT_EQ(d, back);
+  }
+}
+
+
+TEST(ToCharsBatch, Integer) {
+  std::vector<int64_t> values{0, -1, 7, 99, 100, 12345678, -123456789, 10000000000000000,
+                              std::numeric_limits<int64_t>::max(),
+                              std::numeric_limits<int64_t>::min()};
+  std::string expected;
+  for (auto v : values) {
+    expected += (expected.empty() ? "" : ",") + std::to_string(v);
+  }
+  std::vector<char> buf(values.size() * (NumericLimits<int64_t>::kToCharsSize + 1));
+  auto ret = to_chars(buf.data(), buf.data() + buf.size(),
+                      Span<int64_t const>{values.data(), values.size()});
+  ASSERT_EQ(ret.ec, std::errc());
+  ASSERT_EQ(std::string(buf.data(), ret.ptr), expected);
+
+  // Stops after the last value that fits.
+  ret = to_chars(buf.data(), buf.data() + 10, Span<int64_t const>{values.data(), 6});
+  ASSERT_EQ(ret.ec, std::errc::value_too_large);
+  ASSERT_EQ(std::string(buf.data(), ret.ptr), "0,-1,7,99");
+
+  std::vector<uint8_t> u8{0, 9, 10, 255};
+  ret = to_chars(buf.data(), buf.data() + buf.size(), Span<uint8_t const>{u8.data(), 4},
+                 ' ');
+  ASSERT_EQ(std::string(buf.data(), ret.ptr), "0 9 10 255");
+  std::vector<int32_t> i32{std::numeric_limits<int32_t>::min(), 1};
+  ret = to_chars(buf.data(), buf.data() + buf.size(), Span<int32_t const>{i32.data(), 2});
+  ASSERT_EQ(std::string(buf.data(), ret.ptr), "-2147483648,1");
+
+  ret = to_chars(buf.data(), buf.data(), Span<int32_t const>{});
+  ASSERT_EQ(ret.ec, std::errc());
+  ASSERT_EQ(ret.ptr, buf.data());
+}
+
+TEST(ToCharsBatch, Float) {
+  std::vector<float> values{0.0f, -1.5f, 0.1f, NAN, -INFINITY, 3.4028235e+38f, 1e-45f};
+  std::vector<char> buf(values.size() * (NumericLimits<float>::kToCharsSize + 1));
+  for (std::size_t size : {buf.size(), std::size_t{20}}) {
+    auto ret =
+        to_chars(buf.data(), buf.data() + size, Span<float const>{values.data(), 7});
+    std::string out{buf.data(), ret.ptr};
+    std::string expected = "0E0,-1.5E0,1E-1,NaN,-Infinity,3.4028235E38,1E-45";
+    if (size == buf.size()) {
+      ASSERT_EQ(ret.ec, std::errc());
+      ASSERT_EQ(out, expected);
+    } else {
+      ASSERT_EQ(ret.ec, std::errc::value_too_large);
+      ASSERT_EQ(out, "0E0,-1.5E0,1E-1,NaN");
+    }
+  }
+}
+
+TEST(FromCharsBatch, Integer) {
+  std::string str = "1, -2,3 ,\n4,9223372036854775807,-9223372036854775808 ,5.5";
+  std::vector<int64_t> values(8);
+  auto ret = from_chars(str.data(), str.data() + str.size(), Span<int64_t>{values});
+  ASSERT_EQ(ret.n, 6);
+  ASSERT_EQ(std::string(str.c_str(), ret.ptr), str.substr(0, str.find(" ,5.5")));
+  std::vector<int64_t> expected{1, -2, 3, 4, std::numeric_limits<int64_t>::max(),
+                                std::numeric_limits<int64_t>::min()};
+  ASSERT_TRUE(std::equal(expected.cbegin(), expected.cend(), values.cbegin()));
+
+  // Full span.
+  ret = from_chars(str.data(), str.data() + str.size(), Span<int64_t>{values.data(), 2});
+  ASSERT_EQ(ret.n, 2);
+  ASSERT_EQ(std::string(str.c_str(), ret.ptr), "1, -2");
+
+  // Out of range for int32, and a number longer than 8 digits.
+  std::vector<int32_t> i32(4);
+  str = "-2147483648 123456789\t2147483648";
+  ret = from_chars(str.data(), str.data() + str.size(), Span<int32_t>{i32}, ' ');
+  ASSERT_EQ(ret.n, 2);
+  ASSERT_EQ(i32[0], std::numeric_limits<int32_t>::min());
+  ASSERT_EQ(i32[1], 123456789);
+
+  for (std::string bad : {"", " ", "+1", "-", "1e3", "a", ",1", "99999999999999999999"}) {
+    ret = from_chars(bad.data(), bad.data() + bad.size(), Span<int64_t>{values});
+    ASSERT_EQ(ret.n, 0) << bad;
+    ASSERT_EQ(ret.ptr, bad.data()) << bad;
+  }
+}
+
+TEST(FromCharsBatch, Float) {
+  std::string str = "  1.5 2 -3e2\n\nNaN -Infinity 0.1 1.5000000000000000000000001 x";
+  std::vector<float> values(8);
+  auto ret = from_chars(str.data(), str.data() + str.size(), Span<float>{values}, ' ');
+  ASSERT_EQ(ret.n, 7);
+  ASSERT_EQ(*ret.ptr, ' ');
+  ASSERT_EQ(values[0], 1.5f);
+  ASSERT_EQ(values[1], 2.0f);
+  ASSERT_EQ(values[2], -300.0f);
+  ASSERT_TRUE(std::isnan(values[3]));
+  ASSERT_EQ(values[4], -INFINITY);
+  ASSERT_EQ(values[5], 0.1f);
+  ASSERT_EQ(values[6], 1.5f);
+
+  // Comma delimiter doesn't match spaces alone.
+  ret = from_chars(str.data(), str.data() + str.size(), Span<float>{values});
+  ASSERT_EQ(ret.n, 1);
+}
 }  // namespace nih
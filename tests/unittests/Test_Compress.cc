@@ -0,0 +1,161 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "nih/Compress.h"
+#include "nih/Json.h"
+#include "nih/Tempfile.h"
+
+namespace nih {
+std::string GetModelStr();
+
+namespace {
+void TestLZRoundTrip(std::string const& data) {
+  std::vector<char> compressed(LZCompressBound(data.size()));
+  compressed.resize(LZCompress(data.data(), data.size(), compressed.data()));
+  std::string decompressed(data.size(), '\0');
+  LZDecompress(compressed.data(), compressed.size(), &decompressed[0], data.size());
+  ASSERT_EQ(decompressed, data);
+}
+
+Json MakeCompressTestDoc() {
+  auto str = GetModelStr();
+  Json json = Json::Load(ConstStringRef{str});
+  std::vector<Json> trees;
+  for (size_t i = 0; i < 64; ++i) {
+    trees.emplace_back(json["gbm"]);
+  }
+  json["trees"] = Array{std::move(trees)};
+  F32Array weights{4096};
+  for (size_t i = 0; i < weights.Size(); ++i) {
+    weights.Set(i, static_cast<float>(i % 16) / 4.0f);
+  }
+  json["weights"] = std::move(weights);
+  return json;
+}
+}  // anonymous namespace
+
+TEST(LZ, RoundTrip) {
+  TestLZRoundTrip("");
+  TestLZRoundTrip("a");
+  TestLZRoundTrip("abcdefghijkl");
+  TestLZRoundTrip(std::string(100000, 'a'));
+
+  std::string repeated;
+  for (size_t i = 0; i < 1000; ++i) {
+    repeated += "{\"split_index\": " + std::to_string(i % 17) + "},";
+  }
+  TestLZRoundTrip(repeated);
+  std::vector<char> compressed(LZCompressBound(repeated.size()));
+  ASSERT_LT(LZCompress(repeated.data(), repeated.size(), compressed.data()),
+            repeated.size() / 4);
+
+  std::mt19937 rng{0};
+  std::string noise(70000, '\0');
+  for (auto& c : noise) {
+    c = static_cast<char>(rng());
+  }
+  TestLZRoundTrip(noise);
+  ASSERT_LE(LZCompressBound(noise.size()), noise.size() + noise.size() / 255 + 16);
+}
+
+TEST(LZ, Corrupted) {
+  std::string data;
+  for (size_t i = 0; i < 1000; ++i) {
+    data += std::to_string(i % 13);
+  }
+  std::vector<char> compressed(LZCompressBound(data.size()));
+  compressed.resize(LZCompress(data.data(), data.size(), compressed.data()));
+  std::string out(data.size(), '\0');
+  ASSERT_ANY_THROW(LZDecompress(compressed.data(), compressed.size() - 1, &out[0],
+                                data.size()));
+  ASSERT_ANY_THROW(LZDecompress(compressed.data(), compressed.size(), &out[0],
+                                data.size() - 1));
+  std::string larger(data.size() + 1, '\0');
+  ASSERT_ANY_THROW(LZDecompress(compressed.data(), compressed.size(), &larger[0],
+                                larger.size()));
+}
+
+TEST(Compress, RoundTrip) {
+  auto json = MakeCompressTestDoc();
+  for (auto mode : {std::ios::binary, std::ios::in}) {
+    std::vector<char> raw;
+    Json::Dump(json, &raw, mode);
+    // Typed arrays are loaded as normal arrays from text.
+    auto expected = Json::Load(ConstStringRef{raw.data(), raw.size()}, mode);
+    for (size_t block_size : {size_t{1000}, size_t{4096}, kCompressBlockSize}) {
+      std::vector<char> out;
+      DumpCompressed(json, &out, mode, block_size, 4);
+      ConstStringRef ref{out.data(), out.size()};
+      ASSERT_TRUE(IsCompressed(ref));
+      if (block_size >= 4096) {
+        ASSERT_LT(out.size(), raw.size() / 4);
+      }
+      ASSERT_EQ(LoadCompressed(ref, 1), expected);
+      ASSERT_EQ(LoadCompressed(ref, 4), expected);
+    }
+  }
+
+  std::vector<char> out;
+  DumpCompressed(Json{Object{}}, &out);
+  ASSERT_EQ(LoadCompressed(ConstStringRef{out.data(), out.size()}), Json{Object{}});
+}
+
+TEST(Compress, Invalid) {
+  auto json = MakeCompressTestDoc();
+  std::vector<char> out;
+  DumpCompressed(json, &out, std::ios::binary, 4096);
+
+  ASSERT_ANY_THROW(LoadCompressed(ConstStringRef{out.data(), out.size() - 1}));
+  ASSERT_ANY_THROW(LoadCompressed(ConstStringRef{out.data(), 16}));
+  auto corrupted = out;
+  corrupted[4] = 2;  // version
+  ASSERT_ANY_THROW(LoadCompressed(ConstStringRef{corrupted.data(), corrupted.size()}));
+  corrupted = out;
+  corrupted[24 + 3] ^= 0x1;  // size of the first block
+  ASSERT_ANY_THROW(LoadCompressed(ConstStringRef{corrupted.data(), corrupted.size()}, 4));
+
+  // Sizes in the header that the blocks can't decode to are rejected before allocating.
+  std::vector<char> small;
+  DumpCompressed(Json{Integer{1}}, &small, std::ios::binary);
+  ASSERT_EQ(small.size(), 24ul + 4 + 2);  // header, one block index and a stored block
+  corrupted = small;
+  std::fill_n(corrupted.begin() + 8, 4, 0);
+  corrupted[8] = 0x04;  // 64MiB block size
+  std::fill_n(corrupted.begin() + 16, 8, 0);
+  corrupted[20] = 0x04;  // 64MiB raw size
+  try {
+    LoadCompressed(ConstStringRef{corrupted.data(), corrupted.size()});
+    FAIL();
+  } catch (std::exception const& e) {
+    ASSERT_NE(std::string{e.what()}.find("header"), std::string::npos);
+  }
+  corrupted = small;
+  std::fill_n(corrupted.begin() + 16, 8, '\xff');  // raw size overflows the block count
+  ASSERT_ANY_THROW(LoadCompressed(ConstStringRef{corrupted.data(), corrupted.size()}));
+
+  std::string text = R"({"foo": 1})";
+  ASSERT_FALSE(IsCompressed(ConstStringRef{text}));
+}
+
+TEST(Compress, LoadFile) {
+  auto json = MakeCompressTestDoc();
+  std::vector<char> out;
+  DumpCompressed(json, &out, std::ios::binary, 4096);
+
+  TemporaryDirectory tempdir;
+  auto path = (tempdir.path() / "model.nihz").string();
+  {
+    std::ofstream fout{path, std::ios::binary | std::ios::out};
+    fout.write(out.data(), out.size());
+  }
+  ASSERT_EQ(Json::LoadFile(path), json);
+}
+}  // namespace nih
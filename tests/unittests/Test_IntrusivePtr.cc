@@ -32,6 +32,35 @@ class ForIntrusivePtrTest {
 
   explicit ForIntrusivePtrTest(NotCopyConstructible a) : data{a.data} {}
 };
+
+template <typename Policy>
+class ForPolicyTest {
+ public:
+  mutable IntrusivePtrCellImpl<Policy> ref;
+  bool* deleted;
+
+  friend IntrusivePtrCellImpl<Policy> &
+  IntrusivePtrRefCount(ForPolicyTest const *t) noexcept {  // NOLINT
+    return t->ref;
+  }
+
+  explicit ForPolicyTest(bool* d) : deleted{d} {}
+  ~ForPolicyTest() { *deleted = true; }
+};
+
+template <typename Policy>
+void TestPolicy() {
+  bool deleted = false;
+  IntrusivePtr<ForPolicyTest<Policy>> ptr{new ForPolicyTest<Policy>{&deleted}};
+  {
+    auto copy = ptr;
+    ASSERT_EQ(ptr.use_count(), 2);
+  }
+  ASSERT_EQ(ptr.use_count(), 1);
+  ASSERT_FALSE(deleted);
+  ptr.reset();
+  ASSERT_TRUE(deleted);
+}
 }  // anonymous namespace
 
 TEST(IntrusivePtr, Basic) {
@@ -106,4 +135,41 @@ TEST(IntrusivePtr, Basic) {
   ASSERT_EQ(ptr_1, ptr_1);
   ASSERT_EQ(ptr_1 < ptr_2, ptr_1.get() < ptr_2.get());
 }
+
+TEST(IntrusivePtr, Policy) {
+  // The layout doesn't depend on NDEBUG.
+  static_assert(sizeof(DeferredRefCount) == sizeof(int64_t));
+  TestPolicy<AtomicRefCount>();
+  TestPolicy<PlainRefCount>();
+  TestPolicy<DeferredRefCount>();
+
+  {
+    DeferredRefCount::LocalScope scope;
+    TestPolicy<DeferredRefCount>();
+  }
+
+  bool deleted = false;
+  using Deferred = ForPolicyTest<DeferredRefCount>;
+  {
+    IntrusivePtr<Deferred> atomic{new Deferred{&deleted}};
+    ASSERT_TRUE(IntrusivePtrRefCount(atomic.get()).IsShared());
+  }
+  ASSERT_TRUE(deleted);
+  deleted = false;
+
+  IntrusivePtr<Deferred> ptr;
+  {
+    DeferredRefCount::LocalScope scope;
+    ptr.reset(new Deferred{&deleted});
+  }
+  auto copy = ptr;
+  ASSERT_FALSE(IntrusivePtrRefCount(ptr.get()).IsShared());
+  IntrusivePtrRefCount(ptr.get()).Share();
+  ASSERT_TRUE(IntrusivePtrRefCount(ptr.get()).IsShared());
+  ASSERT_EQ(ptr.use_count(), 2);
+  copy.reset();
+  ASSERT_EQ(ptr.use_count(), 1);
+  ptr.reset();
+  ASSERT_TRUE(deleted);
+}
 } // namespace nih
@@ -8,12 +8,20 @@
 #include <functional>
 #include <map>
 #include <numeric>  // std::iota
+#include <thread>
+#include <unordered_map>
+
+#if defined(__unix__)
+#include <unistd.h>  // pipe
+#endif  // defined(__unix__)
 
 #include <nih/IO.h>
 #include <nih/Logging.h>
 #include <nih/Tempfile.h>
 #include "nih/Json.h"
+#include <nih/JsonCache.h>
 #include <nih/JsonIO.h>
+#include <nih/uri.h>
 
 namespace nih {
 namespace {
@@ -396,6 +404,62 @@ TEST(Json, AssigningNumber) {
   }
 }
 
+TEST(Json, LazyNumber) {
+  {
+    // Parsed numbers are written back with their original text.
+    std::string str = R"([1.0000001, 0.1, 3.14159265358979, -2E-4, 1e+30])";
+    auto json = Json::Load(ConstStringRef{str});
+    auto const& arr = get<Array const>(json);
+    for (auto const& v : arr) {
+      ASSERT_TRUE(Cast<Number const>(&v.GetValue())->HasRaw());
+    }
+    std::string out;
+    Json::Dump(json, &out);
+    ASSERT_EQ(out, str.substr(0, 1) + "1.0000001,0.1,3.14159265358979,-2E-4,1e+30]");
+    auto const& num = get<Number const>(arr[1]);
+    ASSERT_EQ(num, 0.1f);
+  }
+  {
+    // Non-canonical and long numbers are converted eagerly.
+    for (std::string str : {"1.5000000000000000000000001", "01.5"}) {
+      auto json = Json::Load(ConstStringRef{str});
+      ASSERT_FALSE(Cast<Number const>(&json.GetValue())->HasRaw()) << str;
+      ASSERT_EQ(get<Number const>(json), 1.5f) << str;
+    }
+  }
+  {
+    // Modifying the number drops the raw text.
+    std::string str = "0.1";
+    auto json = Json::Load(ConstStringRef{str});
+    auto h = json.Hash();
+    ASSERT_EQ(json, Json{Number{0.1f}});
+    ASSERT_EQ(h, Json{Number{0.1f}}.Hash());
+    get<Number>(json) = 2.5f;
+    ASSERT_FALSE(Cast<Number const>(&json.GetValue())->HasRaw());
+    std::string out;
+    Json::Dump(json, &out);
+    ASSERT_EQ(out, "2.5E0");
+    ASSERT_NE(json.Hash(), h);
+  }
+  {
+    // Concurrent reads of the same number.
+    std::string str = "[0.3333333]";
+    auto json = Json::Load(ConstStringRef{str});
+    auto const& num = get<Array const>(json)[0];
+    std::vector<std::thread> workers;
+    std::vector<float> results(8);
+    for (size_t i = 0; i < results.size(); ++i) {
+      workers.emplace_back([&, i] { results[i] = get<Number const>(num); });
+    }
+    for (auto& t : workers) {
+      t.join();
+    }
+    for (auto v : results) {
+      ASSERT_EQ(v, 0.3333333f);
+    }
+  }
+}
+
 TEST(Json, AssigningString) {
   {
     // right value
@@ -443,6 +507,36 @@ TEST(Json, LoadDump) {
   ASSERT_EQ(load_back, origin);
 }
 
+TEST(Json, LoadFile) {
+  std::string ori_buffer = GetModelStr();
+  Json origin{Json::Load(ConstStringRef{ori_buffer})};
+
+  TemporaryDirectory tempdir;
+  auto path = (tempdir.path() / "model.json").string();
+  auto write = [&](std::string const& data) {
+    std::ofstream fout{path, std::ios::binary | std::ios::out};
+    fout.write(data.data(), data.size());
+  };
+
+  write(ori_buffer);
+  ASSERT_EQ(Json::LoadFile(path), origin);
+
+  std::string binary;
+  Json::Dump(origin, &binary, std::ios::binary);
+  write(binary);
+  ASSERT_EQ(Json::LoadFile(path, std::ios::binary), origin);
+
+  // Number at the end of a page-sized file, the parser must not read past the mapping.
+  std::string number = "12345";
+  std::string padded(4096 - number.size(), ' ');
+  write(padded + number);
+  auto integer = Json::LoadFile(path);
+  ASSERT_EQ(get<Integer const>(integer), 12345);
+  write(padded.substr(2) + "1.5e2");
+  auto number_f = Json::LoadFile(path);
+  ASSERT_EQ(get<Number const>(number_f), 150.0f);
+}
+
 TEST(Json, Invalid) {
   {
     std::string str = "}";
@@ -497,6 +591,67 @@ TEST(Json, CopyUnicode) {
   ASSERT_NE(dumped_string.find("\\u20ac"), std::string::npos);
 }
 
+TEST(Json, Unicode) {
+  auto load = [](std::string const& str) { return Json::Load(ConstStringRef{str}); };
+  auto dump = [](Json const& json, bool ensure_ascii) {
+    std::vector<char> buffer;
+    JsonWriter writer{&buffer, ensure_ascii};
+    Json::Dump(json, &writer);
+    return std::string{buffer.cbegin(), buffer.cend()};
+  };
+  {
+    // Escapes are decoded into UTF-8, including surrogate pairs.
+    auto json = load(R"(["\ud834\udd1e", "\u20AC", "\u0416", "\u00f6", "\u0041"])");
+    auto const& arr = get<Array const>(json);
+    std::vector<std::string> expected{"\xf0\x9d\x84\x9e", "\xe2\x82\xac", "\xd0\x96",
+                                      "\xc3\xb6", "A"};
+    for (size_t i = 0; i < expected.size(); ++i) {
+      ASSERT_EQ(get<String const>(arr[i]), expected[i]);
+    }
+    ASSERT_EQ(dump(json, true), R"(["\ud834\udd1e","\u20ac","\u0416","\u00f6","A"])");
+    ASSERT_EQ(dump(json, false), "[\"\xf0\x9d\x84\x9e\",\"\xe2\x82\xac\",\"\xd0\x96\","
+                                 "\"\xc3\xb6\",\"A\"]");
+    // Both forms are read back to the same document.
+    ASSERT_EQ(load(dump(json, true)), json);
+    ASSERT_EQ(load(dump(json, false)), json);
+  }
+  {
+    // Other escapes.
+    auto json = load(R"("a\/b\bc\fd\\u0041\"\u0001")");
+    auto const& str = get<String const>(json);
+    ASSERT_EQ(str, std::string{"a/b\bc\fd\\u0041\"\x01"});
+    ASSERT_EQ(dump(json, true), R"("a/b\bc\fd\\u0041\"\u0001")");
+    ASSERT_EQ(load(dump(json, true)), json);
+  }
+  {
+    // Long mixed strings go through the vectorized scan.
+    std::string long_str;
+    for (size_t i = 0; i < 64; ++i) {
+      long_str += "feature_" + std::to_string(i) + "\xc3\xa9\t\"";
+    }
+    Json json{String{long_str}};
+    ASSERT_EQ(load(dump(json, true)), json);
+    ASSERT_EQ(load(dump(json, false)), json);
+  }
+  {
+    // Invalid UTF-8 is rejected by both the reader and the writer.
+    for (std::string str : {"\"\xff\"", "\"\xc3\"", "\"\xed\xa0\x80\"",
+                            "\"abcdefghijklmnopq\xc0\xaf\""}) {
+      ASSERT_THROW({ load(str); }, std::exception) << str;
+    }
+    for (std::string str : {"a\xff" "b", "caf\xe9", "abcdefghijklmnopq\xc0\xaf"}) {
+      Json json{String{str}};
+      ASSERT_THROW({ dump(json, false); }, std::exception) << str;
+      ASSERT_THROW({ dump(json, true); }, std::exception) << str;
+    }
+    // Binary formats keep the bytes.
+    Json json{String{"caf\xe9"}};
+    std::vector<char> out;
+    Json::Dump(json, &out, std::ios::binary);
+    ASSERT_EQ(Json::Load(ConstStringRef{out.data(), out.size()}, std::ios::binary), json);
+  }
+}
+
 TEST(Json, WrongCasts) {
   {
     Json json = Json{String{"str"}};
@@ -614,6 +769,333 @@ TEST(Json, TypedArray) {
   }
 }
 
+TEST(Json, Validate) {
+  auto str = GetModelStr();
+  ASSERT_TRUE(Json::Validate(ConstStringRef{str}));
+  Json model = Json::Load(ConstStringRef{str});
+  std::string dumped;
+  Json::Dump(model, &dumped);
+  ASSERT_TRUE(Json::Validate(ConstStringRef{dumped}));
+
+  for (std::string valid : {"0", "-0.5e+10", "1E-2", " [] ", "{}", "null", "NaN",
+                            "-Infinity", R"("\u00e9\ud83d\ude00\/\b\f")",
+                            "\"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\"",
+                            R"({"a": [1, {"b": true}], "c": false})"}) {
+    std::string error;
+    ASSERT_TRUE(Json::Validate(ConstStringRef{valid}, std::ios::in, &error))
+        << valid << ": " << error;
+  }
+  for (std::string invalid :
+       {"", " ", "01", "1.", ".5", "+1", "1e", "[1,]", "[1 2]", "{\"a\" 1}", "{a: 1}",
+        "{\"a\": 1,}", "[", "\"abc", "tru", "nul", "{} {}", "\"\\x\"", "\"\\u12\"",
+        "\"\\ud83d\"", "\"\\ude00\"", "\"\\ud83d\\u0041\"", "\"a\tb\"",
+        "\"\xc3\x28\"", "\"\xe0\x80\xaf\"", "\"\xed\xa0\x80\"", "\"\xf4\x90\x80\x80\"",
+        "\"\xff\""}) {
+    std::string error;
+    ASSERT_FALSE(Json::Validate(ConstStringRef{invalid}, std::ios::in, &error))
+        << invalid;
+    ASSERT_NE(error.find("byte offset"), std::string::npos);
+  }
+
+  std::string deep(5000, '[');
+  deep += std::string(5000, ']');
+  ASSERT_FALSE(Json::Validate(ConstStringRef{deep}));
+}
+
+TEST(Json, Hash) {
+  auto str = GetModelStr();
+  Json a = Json::Load(ConstStringRef{str});
+  Json b = Json::Load(ConstStringRef{str});
+  ASSERT_NE(a.Ptr(), b.Ptr());
+  ASSERT_EQ(a.Hash(), b.Hash());
+  ASSERT_EQ(a, b);
+
+  // Mutation through the non-const accessors invalidates the cache along the path.
+  b["gbm"]["trees"][0]["nodes"][3]["leaf"] = Number{1.0f};
+  ASSERT_NE(a.Hash(), b.Hash());
+  ASSERT_FALSE(a == b);
+  b["gbm"]["trees"][0]["nodes"][3]["leaf"] = a["gbm"]["trees"][0]["nodes"][3]["leaf"];
+  ASSERT_EQ(a.Hash(), b.Hash());
+  get<Array>(b["gbm"]["tree_info"]).emplace_back(Integer{1});
+  ASSERT_FALSE(a == b);
+  get<Array>(b["gbm"]["tree_info"]).pop_back();
+  ASSERT_EQ(a, b);
+  get<String>(b["objective"]) += "x";
+  ASSERT_FALSE(a == b);
+
+  // Equal values have equal hashes.
+  auto check_equal = [](Json const& l, Json const& r) {
+    ASSERT_EQ(l, r);
+    ASSERT_EQ(l.Hash(), r.Hash());
+  };
+  check_equal(Json{Number{0.0f}}, Json{Number{-0.0f}});
+  check_equal(Json{Number{std::nanf("")}}, Json{Number{-std::nanf("")}});
+  check_equal(Json{Number{std::numeric_limits<float>::infinity()}},
+              Json{Number{-std::numeric_limits<float>::infinity()}});
+  F32Array l_arr{2}, r_arr{2};
+  l_arr.Set(0, 0.0f);
+  r_arr.Set(0, -0.0f);
+  l_arr.Set(1, std::nanf(""));
+  r_arr.Set(1, std::nanf(""));
+  check_equal(Json{std::move(l_arr)}, Json{std::move(r_arr)});
+
+  // Different kinds never compare equal.
+  ASSERT_NE(Json{Integer{1}}.Hash(), Json{Number{1.0f}}.Hash());
+  ASSERT_NE(Json{Array{}}.Hash(), Json{Object{}}.Hash());
+  ASSERT_NE(Json{I32Array{}}.Hash(), Json{I64Array{}}.Hash());
+  ASSERT_NE(Json{String{""}}.Hash(), Json{Null{}}.Hash());
+
+  std::unordered_map<Json, int32_t> memo;
+  memo[a] = 1;
+  memo[b] = 2;
+  memo[Json::Load(ConstStringRef{str})] = 3;
+  ASSERT_EQ(memo.size(), 2ul);
+  ASSERT_EQ(memo.at(a), 3);
+}
+
+TEST(Json, HashStaleAncestor) {
+  {
+    // Mutation through a reference obtained before hashing.
+    Json a{Object{}};
+    Json& ref = a["x"];
+    ref = Integer{1};
+    a.Hash();
+    ref = Integer{2};
+    Json expected{Object{}};
+    expected["x"] = Integer{2};
+    ASSERT_EQ(a, expected);
+  }
+  {
+    // Mutation of a child shared with a hashed root.
+    Json child{Array{}};
+    get<Array>(child).emplace_back(Integer{1});
+    Json root{Object{}};
+    root["c"] = child;
+    root.Hash();
+    get<Array>(child).emplace_back(Integer{2});
+    Json expected = Json::Load(ConstStringRef{R"({"c": [1, 2]})"});
+    ASSERT_EQ(root, expected);
+    ASSERT_FALSE(root == Json::Load(ConstStringRef{R"({"c": [1]})"}));
+  }
+}
+
+TEST(Json, Share) {
+  ASSERT_TRUE(Json::Load(ConstStringRef{GetModelStr()}).IsShared());
+
+  Json json;
+  {
+    Json::LocalScope scope;
+    json = Json::Load(ConstStringRef{GetModelStr()});
+  }
+  ASSERT_FALSE(json.IsShared());
+  json.Share();
+  ASSERT_TRUE(json.IsShared());
+  auto const& trees = get<Array const>(json["gbm"]["trees"]);
+  ASSERT_TRUE(trees[0].IsShared());
+
+  // Copy and release subtrees concurrently.
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < 4; ++i) {
+    workers.emplace_back([&] {
+      for (size_t k = 0; k < 1000; ++k) {
+        Json copy = json;
+        Json tree = trees[k % trees.size()];
+      }
+    });
+  }
+  for (auto& t : workers) {
+    t.join();
+  }
+  ASSERT_EQ(IntrusivePtrRefCount(&json.GetValue()).Count(), 1);
+  ASSERT_EQ(IntrusivePtrRefCount(&trees[0].GetValue()).Count(), 1);
+}
+
+TEST(Json, Visit) {
+  auto json = Json::Load(ConstStringRef{GetModelStr()});
+  // Count the leaves with a generic lambda that recurses through containers.
+  std::function<size_t(Json const&)> n_leaves = [&](Json const& j) {
+    return visit(j, overloaded{[&](Object const& obj) {
+                                 size_t n = 0;
+                                 for (auto const& kv : obj.GetObject()) {
+                                   n += n_leaves(kv.second);
+                                 }
+                                 return n;
+                               },
+                               [&](Array const& arr) {
+                                 size_t n = 0;
+                                 for (auto const& v : arr.GetArray()) {
+                                   n += n_leaves(v);
+                                 }
+                                 return n;
+                               },
+                               [](auto const&) { return size_t{1}; }});
+  };
+  std::string str;
+  Json::Dump(json, &str);
+  ASSERT_EQ(n_leaves(json), n_leaves(Json::Load(ConstStringRef{str})));
+  ASSERT_GT(n_leaves(json), 10ul);
+
+  // Typed arrays and mutable access.
+  Json arr{I32Array{3}};
+  visit(arr, overloaded{[](I32Array& v) { v.Set(1, 7); }, [](auto&) { FAIL(); }});
+  ASSERT_EQ(get<I32Array const>(arr)[1], 7);
+  auto kind = visit(Json{Number{1.0f}}, [](auto const& v) { return v.TypeStr(); });
+  ASSERT_EQ(kind, "Number");
+
+  // Invalid casts are still reported.
+  Json str_json{String{"s"}};
+  ASSERT_THROW({ get<Number const>(str_json); }, std::exception);
+}
+
+TEST(Json, StreamWriter) {
+  std::vector<float> weights{0.5f, -1.25f, 3.0f};
+  std::vector<int32_t> ids{1, -2, 1 << 20};
+  Json nested{Object{}};
+  nested["k"] = String{"v"};
+
+  Json expected{Object{}};
+  expected["step"] = Integer{3};
+  expected["loss"] = Number{0.25f};
+  expected["ok"] = Boolean{true};
+  expected["name"] = String{"a\"b\n\xe2\x82\xac"};
+  expected["none"] = Null{};
+  expected["nested"] = nested;
+  expected["empty"] = Object{};
+  expected["list"] = Array{std::vector<Json>{Json{Integer{1}}, Json{String{"x"}},
+                                             Json{Array{}}}};
+  expected["weights"] = F32Array{3};
+  std::copy(weights.cbegin(), weights.cend(), get<F32Array>(expected["weights"]).begin());
+  expected["ids"] = I32Array{3};
+  std::copy(ids.cbegin(), ids.cend(), get<I32Array>(expected["ids"]).begin());
+
+  for (auto mode : {std::ios::out, std::ios::binary}) {
+    std::vector<char> out;
+    JsonStreamWriter writer{&out, mode};
+    writer.BeginObject()
+        .Key("step")
+        .Value(3)
+        .Key("loss")
+        .Value(0.25f)
+        .Key("ok")
+        .Value(true)
+        .Key("name")
+        .Value("a\"b\n\xe2\x82\xac")
+        .Key("none")
+        .Null()
+        .Key("nested")
+        .Value(nested)
+        .Key("empty")
+        .BeginObject()
+        .End()
+        .Key("list")
+        .BeginArray()
+        .Value(int64_t{1})
+        .Value(std::string{"x"})
+        .BeginArray()
+        .End()
+        .End()
+        .Key("weights")
+        .Array(Span<float const>{weights.data(), weights.size()})
+        .Key("ids")
+        .Array(Span<int32_t const>{ids.data(), ids.size()});
+    ASSERT_FALSE(writer.Done());
+    writer.End();
+    ASSERT_TRUE(writer.Done());
+
+    auto loaded = Json::Load(ConstStringRef{out.data(), out.size()},
+                             mode == std::ios::binary ? std::ios::binary : std::ios::in);
+    if (mode == std::ios::binary) {
+      ASSERT_EQ(loaded, expected);
+    } else {
+      // Typed arrays are written as normal arrays in text.
+      std::string dumped;
+      Json::Dump(expected, &dumped);
+      ASSERT_EQ(loaded, Json::Load(ConstStringRef{dumped}));
+      ASSERT_EQ(std::string(out.data(), out.size()).find('{'), 0ul);
+    }
+  }
+
+  std::vector<char> out;
+  JsonStreamWriter writer{&out};
+  ASSERT_THROW({ writer.Key("k"); }, std::exception);
+  writer.BeginObject();
+  ASSERT_THROW({ writer.Value(1); }, std::exception);
+  writer.Key("k");
+  ASSERT_THROW({ writer.Key("k"); }, std::exception);
+  ASSERT_THROW({ writer.End(); }, std::exception);
+  writer.Value(1).End();
+  ASSERT_EQ(std::string(out.data(), out.size()), R"({"k":1})");
+  ASSERT_THROW({ writer.Value(2); }, std::exception);
+  ASSERT_THROW({ writer.End(); }, std::exception);
+
+  out.clear();
+  JsonStreamWriter unsigned_writer{&out};
+  unsigned_writer.BeginArray()
+      .Value(std::numeric_limits<uint32_t>::max())
+      .Value(static_cast<uint64_t>(std::numeric_limits<int64_t>::max()));
+  ASSERT_THROW({ unsigned_writer.Value(std::numeric_limits<uint64_t>::max()); },
+               std::exception);
+  unsigned_writer.End();
+  ASSERT_EQ(std::string(out.data(), out.size()), "[4294967295,9223372036854775807]");
+}
+
+TEST(Json, Double) {
+  double third = 1.0 / 3.0;
+  {
+    Json json{third};
+    auto const& num = *Cast<Number const>(&json.GetValue());
+    ASSERT_TRUE(num.IsDouble());
+    ASSERT_FALSE(num.IsExactFloat());
+    ASSERT_EQ(num.GetDouble(), third);
+    ASSERT_EQ(num.GetNumber(), static_cast<float>(third));
+    // Compared in double precision.
+    ASSERT_FALSE(json == Json{Number{static_cast<float>(third)}});
+    ASSERT_EQ(json, Json{third});
+    ASSERT_EQ(json.Hash(), Json{third}.Hash());
+    ASSERT_FALSE(Json{0.1} == Json{0.10000000000000002});
+    ASSERT_NE(Json{0.1}.Hash(), Json{0.10000000000000002}.Hash());
+    // Numbers parsed from text are floats, comparison is transitive.
+    auto parsed = Json::Load(ConstStringRef{"0.1"});
+    ASSERT_EQ(parsed, Json{Number{0.1f}});
+    ASSERT_EQ(parsed.Hash(), Json{Number{0.1f}}.Hash());
+    ASSERT_FALSE(Json{Number{0.1f}} == Json{0.1});
+    ASSERT_FALSE(parsed == Json{0.1});
+    ASSERT_FALSE(Json{static_cast<double>(0.1f)} == Json{0.1});
+    // Doubles that are exact floats compare equal to the float.
+    ASSERT_EQ(Json{0.5}, Json{Number{0.5f}});
+    ASSERT_EQ(Json{0.5}.Hash(), Json{Number{0.5f}}.Hash());
+    ASSERT_EQ(Json{static_cast<double>(0.1f)}, parsed);
+    ASSERT_EQ(Json{static_cast<double>(0.1f)}.Hash(), parsed.Hash());
+    ASSERT_EQ(Json{-0.0}.Hash(), Json{Number{0.0f}}.Hash());
+
+    std::string out;
+    Json::Dump(json, &out);
+    ASSERT_EQ(out, "3.333333333333333E-1");
+    auto loaded = Json::Load(ConstStringRef{out});
+    ASSERT_EQ(Cast<Number const>(&loaded.GetValue())->GetDouble(), third);
+  }
+  {
+    ASSERT_EQ(Cast<Number const>(&Json{Number{0.1f}}.GetValue())->GetDouble(),
+              static_cast<double>(0.1f));
+    auto json = Json::Load(ConstStringRef{"0.1"});
+    ASSERT_EQ(Cast<Number const>(&json.GetValue())->GetDouble(), 0.1);
+  }
+  {
+    // Modifying the number drops the double.
+    Json json{third};
+    get<Number>(json) = 2.5f;
+    auto const& num = *Cast<Number const>(&json.GetValue());
+    ASSERT_FALSE(num.IsDouble());
+    ASSERT_EQ(num.GetDouble(), 2.5);
+  }
+  {
+    std::vector<char> out;
+    JsonStreamWriter writer{&out};
+    writer.BeginArray().Value(third).Value(0.5).End();
+    ASSERT_EQ(std::string(out.data(), out.size()), "[3.333333333333333E-1,5E-1]");
+  }
+}
+
 TEST(UBJson, Basic) {
   auto run_test = [](ConstStringRef str) {
     auto json = Json::Load(str);
@@ -651,4 +1133,445 @@ TEST(UBJson, Basic) {
     ASSERT_FLOAT_EQ(2.71, get<Number>(get<Array>(ret["test"])[0]));
   }
 }
+
+TEST(UBJson, Double) {
+  double third = 1.0 / 3.0;
+  std::vector<char> stream;
+  UBJWriter writer{&stream, true};
+  Json::Dump(Json{third}, &writer);
+  ASSERT_EQ(stream.size(), 9);
+  ASSERT_EQ(stream[0], 'D');
+  auto loaded =
+      Json::Load(ConstStringRef{stream.data(), stream.size()}, std::ios::binary);
+  ASSERT_EQ(Cast<Number const>(&loaded.GetValue())->GetDouble(), third);
+  ASSERT_TRUE(Json::Validate(ConstStringRef{stream.data(), stream.size()},
+                             std::ios::binary));
+
+  // Doubles that fit in a float are written as float.
+  stream.clear();
+  Json::Dump(Json{0.5}, &writer);
+  ASSERT_EQ(stream.size(), 5);
+  ASSERT_EQ(stream[0], 'd');
+
+  // Not compacted into a float typed array.
+  stream.clear();
+  Json::Dump(Json{Array{std::vector<Json>{Json{0.5}, Json{third}}}}, &writer);
+  loaded = Json::Load(ConstStringRef{stream.data(), stream.size()}, std::ios::binary);
+  ASSERT_TRUE(IsA<Array>(loaded));
+  ASSERT_EQ(Cast<Number const>(&loaded[1].GetValue())->GetDouble(), third);
+
+  std::vector<char> text;
+  Transcode(ConstStringRef{stream.data(), stream.size()}, std::ios::binary, &text,
+            std::ios::in);
+  ASSERT_EQ(std::string(text.data(), text.size()), "[5E-1,3.333333333333333E-1]");
+}
+
+TEST(UBJson, Truncated) {
+  Json json{Object{}};
+  json["str"] = String{"some string"};
+  I64Array i64{16};
+  std::iota(i64.GetArray().begin(), i64.GetArray().end(), 0);
+  json["i64"] = std::move(i64);
+
+  std::string binary;
+  Json::Dump(json, &binary, std::ios::binary);
+  for (size_t n : {binary.size() - 1, binary.size() / 2, size_t{3}}) {
+    auto truncated = binary.substr(0, n);
+    ASSERT_ANY_THROW(Json::Load(ConstStringRef{truncated}, std::ios::binary));
+  }
+
+  // End of input and unknown markers, in memory and streamed.
+  TemporaryDirectory tempdir;
+  auto path = tempdir.path() / "invalid.ubj";
+  for (std::string invalid : {std::string{}, std::string{"\xff"}, std::string{"[Z"},
+                              std::string{"[\xff]"}, std::string{"{L"}}) {
+    ASSERT_ANY_THROW(Json::Load(ConstStringRef{invalid}, std::ios::binary));
+    {
+      std::ofstream fout{path, std::ios::binary | std::ios::out};
+      fout.write(invalid.data(), invalid.size());
+    }
+    UBJStreamReader reader{path.string()};
+    ASSERT_ANY_THROW(Json::Load(&reader));
+  }
+}
+
+TEST(UBJson, Stream) {
+  auto str = GetModelStr();
+  Json json = Json::Load(ConstStringRef{str});
+  size_t n = 4096;
+  F32Array f32{n};
+  std::iota(f32.GetArray().begin(), f32.GetArray().end(), -8);
+  json["f32"] = std::move(f32);
+  json["flag"] = Boolean{false};
+
+  std::string binary;
+  Json::Dump(json, &binary, std::ios::binary);
+
+  TemporaryDirectory tempdir;
+  auto path = tempdir.path() / "model.ubj";
+  {
+    std::ofstream fout{path, std::ios::binary | std::ios::out};
+    fout.write(binary.data(), binary.size());
+  }
+
+  // Small buffer to exercise refilling and direct reads.
+  for (size_t buffer_size : {size_t{8}, size_t{64}, UBJStreamReader::kDefaultBufferSize}) {
+    UBJStreamReader reader{path.string(), buffer_size};
+    auto loaded = Json::Load(&reader);
+    ASSERT_EQ(loaded, json);
+    ASSERT_FALSE(get<Boolean const>(loaded["flag"]));
+  }
+  {
+    FileScheme file{Uri{path.string()}, "r"};
+    UBJStreamReader reader{&file};
+    ASSERT_EQ(Json::Load(&reader), json);
+  }
+  {
+    std::ofstream fout{path, std::ios::binary | std::ios::out};
+    fout.write(binary.data(), binary.size() / 2);
+  }
+  {
+    UBJStreamReader reader{path.string(), 32};
+    ASSERT_ANY_THROW(Json::Load(&reader));
+  }
+}
+
+#if defined(__unix__)
+TEST(UBJson, StreamUnsized) {
+  // Read through a pipe, the size of the input is not known.
+  auto load_pipe = [](std::string const& data, std::string* error) {
+    int fds[2];
+    NIH_ASSERT_EQ(pipe(fds), 0);
+    std::thread writer{[&] {
+      for (size_t n = 0; n < data.size();) {
+        auto ret = write(fds[1], data.data() + n, data.size() - n);
+        NIH_ASSERT_GT(ret, 0);
+        n += ret;
+      }
+      close(fds[1]);
+    }};
+    auto fd = fdopen(fds[0], "rb");
+    Json json;
+    try {
+      FileScheme file{Uri{"pipe"}, fd, "rb"};
+      UBJStreamReader reader{&file};
+      json = Json::Load(&reader);
+    } catch (std::exception const& e) {
+      *error = e.what();
+    }
+    writer.join();
+    std::fclose(fd);
+    return json;
+  };
+
+  Json json{Object{}};
+  F32Array f32{size_t{1} << 19};
+  std::iota(f32.GetArray().begin(), f32.GetArray().end(), 0);
+  json["f32"] = std::move(f32);
+  json["str"] = String{std::string((size_t{1} << 21) + 3, 'a')};
+  json["arr"] = Array{std::vector<Json>(1024, Json{Integer{7}})};
+  std::string binary;
+  Json::Dump(json, &binary, std::ios::binary);
+  std::string error;
+  ASSERT_EQ(load_pipe(binary, &error), json);
+  ASSERT_TRUE(error.empty()) << error;
+
+  // A corrupt length is not allocated ahead of the data.
+  std::string huge{'L', 0, 0, 1, 0, 0, 0, 0, 0};
+  for (std::string prefix : {"S", "[$d#", "[#"}) {
+    error.clear();
+    load_pipe(prefix + huge + "ZZZZ", &error);
+    ASSERT_NE(error.find("Unexpected end of input"), std::string::npos) << error;
+  }
+}
+#endif  // defined(__unix__)
+
+TEST(UBJson, Validate) {
+  auto str = GetModelStr();
+  Json json = Json::Load(ConstStringRef{str});
+  F32Array f32{16};
+  json["f32"] = std::move(f32);
+  I64Array i64{3};
+  json["i64"] = std::move(i64);
+  json["integers"] = Array{std::vector<Json>{Json{Integer{1}}, Json{Integer{1 << 20}},
+                                             Json{Integer{int64_t{1} << 40}}}};
+  std::string binary;
+  Json::Dump(json, &binary, std::ios::binary);
+  ASSERT_TRUE(Json::Validate(ConstStringRef{binary}, std::ios::binary));
+
+  for (size_t n = 0; n < binary.size(); n += 7) {
+    ASSERT_FALSE(Json::Validate(ConstStringRef{binary.data(), n}, std::ios::binary));
+  }
+  auto trailing = binary + "Z";
+  ASSERT_FALSE(Json::Validate(ConstStringRef{trailing}, std::ios::binary));
+
+  std::string bad_utf8{'S', 'L', 0, 0, 0, 0, 0, 0, 0, 2, '\xc3', '\x28'};
+  std::string error;
+  ASSERT_FALSE(Json::Validate(ConstStringRef{bad_utf8}, std::ios::binary, &error));
+  ASSERT_NE(error.find("UTF-8"), std::string::npos);
+  bad_utf8.back() = '\xa9';
+  ASSERT_TRUE(Json::Validate(ConstStringRef{bad_utf8}, std::ios::binary));
+
+  std::string huge_typed{'[', '$', 'd', '#', 'L', 0x7f, 0, 0, 0, 0, 0, 0, 0};
+  ASSERT_FALSE(Json::Validate(ConstStringRef{huge_typed}, std::ios::binary));
+  std::string f64{'D', 0, 0, 0, 0, 0, 0, 0, 0};
+  ASSERT_TRUE(Json::Validate(ConstStringRef{f64}, std::ios::binary));
+  ASSERT_FALSE(Json::Validate(ConstStringRef{f64.data(), 8}, std::ios::binary));
+  std::string unknown{'H', 'i', 1, '1'};
+  ASSERT_FALSE(Json::Validate(ConstStringRef{unknown}, std::ios::binary));
+}
+
+TEST(UBJson, BigEndian) {
+  Json json{Integer{256}};
+  std::vector<char> binary;
+  Json::Dump(json, &binary, std::ios::binary);
+  ASSERT_EQ(binary, (std::vector<char>{'I', 0x01, 0x00}));
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+TEST(UBJson, LegacyByteOrder) {
+  // Written by UBJWriter on x86-64 before numbers were stored in big endian.
+  std::vector<uint8_t> bytes{
+      0x7b, 0x4c, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x66, 0x64,
+      0x00, 0x00, 0x00, 0x3f, 0x4c, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x66, 0x33, 0x32, 0x5b, 0x24, 0x64, 0x23, 0x4c, 0x02, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0, 0x3f, 0x00, 0x00, 0x00,
+      0xc0, 0x4c, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x66, 0x6c,
+      0x61, 0x67, 0x54, 0x4c, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x69, 0x33, 0x32, 0x5b, 0x24, 0x6c, 0x23, 0x4c, 0x02, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x70, 0x11, 0x01, 0x00,
+      0x4c, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x6e, 0x61, 0x6d,
+      0x65, 0x53, 0x4c, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x6c,
+      0x65, 0x67, 0x61, 0x63, 0x79, 0x4c, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x6e, 0x65, 0x67, 0x69, 0xfd, 0x4c, 0x04, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x6e, 0x6f, 0x6e, 0x65, 0x5a, 0x4c, 0x07, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x76, 0x65, 0x72, 0x73, 0x69, 0x6f,
+      0x6e, 0x5b, 0x23, 0x4c, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x69, 0x01, 0x6c, 0x70, 0x11, 0x01, 0x00, 0x4c, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x01, 0x00, 0x00, 0x7d};
+  ConstStringRef legacy{reinterpret_cast<char const*>(bytes.data()), bytes.size()};
+
+  Json expected{Object{}};
+  expected["name"] = String{"legacy"};
+  expected["version"] = Array{std::vector<Json>{
+      Json{Integer{1}}, Json{Integer{70000}}, Json{Integer{int64_t{1} << 40}}}};
+  expected["neg"] = Integer{-3};
+  expected["f"] = Number{0.5f};
+  expected["flag"] = Boolean{true};
+  expected["none"] = Null{};
+  F32Array f32{2};
+  f32.Set(0, 1.5f);
+  f32.Set(1, -2.0f);
+  expected["f32"] = std::move(f32);
+  I32Array i32{2};
+  i32.Set(0, 1);
+  i32.Set(1, 70000);
+  expected["i32"] = std::move(i32);
+
+  // The lengths are out of range in big endian.
+  ASSERT_ANY_THROW(Json::Load(legacy, std::ios::binary));
+  ASSERT_EQ(Json::Load(legacy, std::ios::binary, UBJByteOrder::kLegacyHost), expected);
+
+  TemporaryDirectory tempdir;
+  auto path = (tempdir.path() / "legacy.ubj").string();
+  {
+    std::ofstream fout{path, std::ios::binary | std::ios::out};
+    fout.write(legacy.data(), legacy.size());
+  }
+  ASSERT_ANY_THROW(Json::LoadFile(path, std::ios::binary));
+  ASSERT_EQ(Json::LoadFile(path, std::ios::binary, UBJByteOrder::kLegacyHost), expected);
+  UBJStreamReader stream{path, UBJStreamReader::kDefaultBufferSize,
+                         UBJByteOrder::kLegacyHost};
+  ASSERT_EQ(Json::Load(&stream), expected);
+
+  JsonFileCache cache;
+  ASSERT_EQ(*cache.Load(path, std::ios::binary, UBJByteOrder::kLegacyHost), expected);
+  ASSERT_ANY_THROW(cache.Load(path, std::ios::binary));
+  ASSERT_EQ(cache.GetStats().hits, 0ul);
+  ASSERT_TRUE(cache.Erase(path, std::ios::binary, UBJByteOrder::kLegacyHost));
+
+  // Convert by writing it back.
+  std::string converted;
+  Json::Dump(Json::Load(legacy, std::ios::binary, UBJByteOrder::kLegacyHost), &converted,
+             std::ios::binary);
+  ASSERT_EQ(Json::Load(ConstStringRef{converted}, std::ios::binary), expected);
+}
+#endif  // __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+TEST(UBJson, TypedArrayCompaction) {
+  auto str = GetModelStr();
+  Json json = Json::Load(ConstStringRef{str});
+  auto make = [](std::vector<int64_t> const& values) {
+    std::vector<Json> arr;
+    for (auto v : values) {
+      arr.emplace_back(Integer{v});
+    }
+    return Json{Array{std::move(arr)}};
+  };
+  json["u8"] = make({0, 7, 255});
+  json["i32"] = make({-1, 256, std::numeric_limits<int32_t>::max()});
+  json["i64"] = make({0, std::numeric_limits<int64_t>::min()});
+  json["f32"] = Array{std::vector<Json>{Json{Number{1.5f}}, Json{Number{-2.0f}}}};
+  json["mixed"] = Array{std::vector<Json>{Json{Integer{1}}, Json{Number{2.5f}}}};
+  json["empty"] = Array{};
+  std::vector<int64_t> indices(128);
+  std::iota(indices.begin(), indices.end(), 0);
+  json["indices"] = make(indices);
+
+  std::vector<char> plain;
+  Json::Dump(json, &plain, std::ios::binary);
+  std::vector<char> compact;
+  UBJWriter writer{&compact, true};
+  Json::Dump(json, &writer);
+  ASSERT_LT(compact.size(), plain.size());
+
+  auto loaded =
+      Json::Load(ConstStringRef{compact.data(), compact.size()}, std::ios::binary);
+  ASSERT_TRUE(IsA<U8Array>(loaded["u8"]));
+  ASSERT_EQ(get<U8Array const>(loaded["u8"])[2], 255);
+  ASSERT_TRUE(IsA<I32Array>(loaded["i32"]));
+  ASSERT_EQ(get<I32Array const>(loaded["i32"])[0], -1);
+  ASSERT_TRUE(IsA<I64Array>(loaded["i64"]));
+  ASSERT_EQ(get<I64Array const>(loaded["i64"])[1], std::numeric_limits<int64_t>::min());
+  ASSERT_TRUE(IsA<F32Array>(loaded["f32"]));
+  ASSERT_EQ(get<F32Array const>(loaded["f32"])[1], -2.0f);
+  ASSERT_TRUE(IsA<Array>(loaded["mixed"]));
+  ASSERT_TRUE(IsA<Array>(loaded["empty"]));
+  ASSERT_TRUE(IsA<U8Array>(loaded["indices"]));
+
+  // Same values as the plain output.
+  std::vector<char> text;
+  Json::Dump(loaded, &text);
+  ASSERT_EQ(Json::Load(ConstStringRef{text.data(), text.size()}),
+            Json::Load(ConstStringRef{plain.data(), plain.size()}, std::ios::binary));
+}
+
+namespace {
+Json MakeBinaryTestDoc() {
+  auto str = GetModelStr();
+  Json json = Json::Load(ConstStringRef{str});
+  size_t n = 300;
+  F32Array f32{n};
+  std::iota(f32.GetArray().begin(), f32.GetArray().end(), -8);
+  json["f32"] = std::move(f32);
+  U8Array u8{n};
+  std::iota(u8.GetArray().begin(), u8.GetArray().end(), 0);
+  json["u8"] = std::move(u8);
+  I32Array i32{n};
+  std::iota(i32.GetArray().begin(), i32.GetArray().end(), -70000);
+  json["i32"] = std::move(i32);
+  I64Array i64{n};
+  std::iota(i64.GetArray().begin(), i64.GetArray().end(), -(int64_t{1} << 40));
+  json["i64"] = std::move(i64);
+  std::vector<Json> integers;
+  for (int64_t i : {int64_t{0}, int64_t{-1}, int64_t{-33}, int64_t{127}, int64_t{128},
+                    int64_t{-129}, int64_t{70000}, int64_t{-70000}, int64_t{1} << 40,
+                    -(int64_t{1} << 40), std::numeric_limits<int64_t>::max(),
+                    std::numeric_limits<int64_t>::min()}) {
+    integers.emplace_back(Integer{i});
+  }
+  json["integers"] = Array{std::move(integers)};
+  json["long string"] = String{std::string(1000, 'a')};
+  json["flags"] = Array{std::vector<Json>{Json{Boolean{true}}, Json{Boolean{false}},
+                                          Json{Null{}}}};
+  json["double"] = Json{1.0 / 3.0};
+  return json;
+}
+
+template <typename Reader, typename Writer>
+void TestBinaryRoundTrip() {
+  auto json = MakeBinaryTestDoc();
+  std::vector<char> buffer;
+  Writer writer{&buffer};
+  Json::Dump(json, &writer);
+  Reader reader{ConstStringRef{buffer.data(), buffer.size()}};
+  auto loaded = Json::Load(&reader);
+  ASSERT_EQ(loaded, json);
+  ASSERT_TRUE(IsA<F32Array>(loaded["f32"]));
+  ASSERT_TRUE(IsA<U8Array>(loaded["u8"]));
+  ASSERT_TRUE(IsA<I32Array>(loaded["i32"]));
+  ASSERT_TRUE(IsA<I64Array>(loaded["i64"]));
+  ASSERT_EQ(Cast<Number const>(&loaded["double"].GetValue())->GetDouble(), 1.0 / 3.0);
+
+  for (size_t n : {buffer.size() - 1, buffer.size() / 2}) {
+    Reader truncated{ConstStringRef{buffer.data(), n}};
+    ASSERT_ANY_THROW(Json::Load(&truncated));
+  }
+}
+
+template <typename Reader>
+void TestBinaryTruncated(std::vector<uint8_t> const& bytes) {
+  Reader reader{ConstStringRef{reinterpret_cast<char const*>(bytes.data()),
+                               bytes.size()}};
+  ASSERT_ANY_THROW(Json::Load(&reader));
+}
+}  // anonymous namespace
+
+TEST(MsgPack, RoundTrip) { TestBinaryRoundTrip<MsgPackReader, MsgPackWriter>(); }
+
+TEST(MsgPack, Interop) {
+  // {"a": 1, "b": [1, 2.5]}
+  std::vector<uint8_t> bytes{0x82, 0xa1, 0x61, 0x01, 0xa1, 0x62, 0x92,
+                             0x01, 0xca, 0x40, 0x20, 0x00, 0x00};
+  MsgPackReader reader{ConstStringRef{reinterpret_cast<char const*>(bytes.data()),
+                                      bytes.size()}};
+  auto json = Json::Load(&reader);
+  ASSERT_EQ(get<Integer const>(json["a"]), 1);
+  ASSERT_EQ(get<Number const>(json["b"][1]), 2.5f);
+
+  std::vector<char> out;
+  MsgPackWriter writer{&out};
+  Json::Dump(json, &writer);
+  ASSERT_EQ(out, std::vector<char>(bytes.cbegin(), bytes.cend()));
+}
+
+TEST(MsgPack, Truncated) {
+  TestBinaryTruncated<MsgPackReader>({});
+  // {"a": <missing>}
+  TestBinaryTruncated<MsgPackReader>({0x81, 0xa1, 0x61});
+  // [1, <missing>]
+  TestBinaryTruncated<MsgPackReader>({0x92, 0x01});
+}
+
+TEST(CBOR, RoundTrip) { TestBinaryRoundTrip<CBORReader, CBORWriter>(); }
+
+TEST(CBOR, Interop) {
+  // {"a": 1, "b": [-2, 2.5]}
+  std::vector<uint8_t> bytes{0xa2, 0x61, 0x61, 0x01, 0x61, 0x62, 0x82,
+                             0x21, 0xfa, 0x40, 0x20, 0x00, 0x00};
+  CBORReader reader{ConstStringRef{reinterpret_cast<char const*>(bytes.data()),
+                                   bytes.size()}};
+  auto json = Json::Load(&reader);
+  ASSERT_EQ(get<Integer const>(json["a"]), 1);
+  ASSERT_EQ(get<Integer const>(json["b"][0]), -2);
+  ASSERT_EQ(get<Number const>(json["b"][1]), 2.5f);
+
+  std::vector<char> out;
+  CBORWriter writer{&out};
+  Json::Dump(json, &writer);
+  ASSERT_EQ(out, std::vector<char>(bytes.cbegin(), bytes.cend()));
+
+  // Indefinite length array [_ 1.0 (half), tag(85) h'0000803f'], little endian f32.
+  std::vector<uint8_t> indefinite{0x9f, 0xf9, 0x3c, 0x00, 0xd8, 0x55, 0x44,
+                                  0x00, 0x00, 0x80, 0x3f, 0xff};
+  CBORReader indef_reader{ConstStringRef{
+      reinterpret_cast<char const*>(indefinite.data()), indefinite.size()}};
+  json = Json::Load(&indef_reader);
+  ASSERT_EQ(get<Number const>(json[0]), 1.0f);
+  ASSERT_EQ(get<F32Array const>(json[1]).at(0), 1.0f);
+}
+
+TEST(CBOR, Truncated) {
+  TestBinaryTruncated<CBORReader>({});
+  // [_ 1, 2, <missing break>
+  TestBinaryTruncated<CBORReader>({0x9f, 0x01, 0x02});
+  // {_ "a": <missing>
+  TestBinaryTruncated<CBORReader>({0xbf, 0x61, 0x61});
+  // {"a": <missing>}
+  TestBinaryTruncated<CBORReader>({0xa1, 0x61, 0x61});
+  // (_ "a", <missing break>
+  TestBinaryTruncated<CBORReader>({0x7f, 0x61, 0x61});
+  // A lone break is not a value.
+  TestBinaryTruncated<CBORReader>({0xff});
+}
 }  // namespace nih
@@ -0,0 +1,147 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <ios>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nih/Compress.h"
+#include "nih/Json.h"
+#include "nih/JsonCache.h"
+#include "nih/JsonMemory.h"
+#include "nih/Tempfile.h"
+
+namespace nih {
+std::string GetModelStr();
+namespace {
+void WriteFile(std::string const& path, std::string const& content) {
+  std::ofstream fout{path, std::ios::binary | std::ios::trunc};
+  fout << content;
+}
+}  // anonymous namespace
+
+TEST(JsonCache, Load) {
+  TemporaryDirectory tmpdir;
+  auto path = (tmpdir.path() / "config.json").string();
+  WriteFile(path, R"({"a": 1})");
+
+  JsonFileCache cache;
+  auto first = cache.Load(path);
+  auto second = cache.Load(path);
+  ASSERT_EQ(first.get(), second.get());
+  ASSERT_TRUE(first->IsShared());
+  ASSERT_EQ(get<Integer const>((*first)["a"]), 1);
+  auto stats = cache.GetStats();
+  ASSERT_EQ(stats.hits, 1ul);
+  ASSERT_EQ(stats.misses, 1ul);
+  ASSERT_EQ(stats.n_entries, 1ul);
+  ASSERT_EQ(stats.bytes, GetMemoryUsage(*first).Total());
+
+  // Changed size.
+  WriteFile(path, R"({"a": 10})");
+  auto changed = cache.Load(path);
+  ASSERT_NE(changed.get(), first.get());
+  ASSERT_EQ(get<Integer const>((*changed)["a"]), 10);
+  // The old handle is still valid.
+  ASSERT_EQ(get<Integer const>((*first)["a"]), 1);
+
+  // Replaced with a file of the same size.
+  auto tmp = (tmpdir.path() / "config.tmp").string();
+  WriteFile(tmp, R"({"a": 20})");
+  ASSERT_EQ(std::rename(tmp.c_str(), path.c_str()), 0);
+  auto replaced = cache.Load(path);
+  ASSERT_EQ(get<Integer const>((*replaced)["a"]), 20);
+  stats = cache.GetStats();
+  ASSERT_EQ(stats.misses, 3ul);
+  ASSERT_EQ(stats.n_entries, 1ul);
+
+  // UBJSON is cached separately.
+  auto ubj_path = (tmpdir.path() / "config.ubj").string();
+  std::vector<char> ubj;
+  Json::Dump(*replaced, &ubj, std::ios::binary);
+  WriteFile(ubj_path, std::string{ubj.data(), ubj.size()});
+  ASSERT_EQ(*cache.Load(ubj_path, std::ios::binary), *replaced);
+  ASSERT_EQ(cache.GetStats().n_entries, 2ul);
+
+  // Compressed containers are loaded like Json::LoadFile.
+  auto compressed_path = (tmpdir.path() / "config.ubj.nih").string();
+  std::vector<char> compressed;
+  DumpCompressed(*replaced, &compressed);
+  WriteFile(compressed_path, std::string{compressed.data(), compressed.size()});
+  ASSERT_EQ(*cache.Load(compressed_path, std::ios::binary), *replaced);
+
+  ASSERT_TRUE(cache.Erase(path));
+  ASSERT_FALSE(cache.Erase(path));
+  cache.Clear();
+  stats = cache.GetStats();
+  ASSERT_EQ(stats.n_entries, 0ul);
+  ASSERT_EQ(stats.bytes, 0ul);
+
+  // Errors are not cached.
+  WriteFile(path, "{");
+  ASSERT_THROW({ cache.Load(path); }, std::exception);
+  ASSERT_EQ(cache.GetStats().n_entries, 0ul);
+  ASSERT_THROW({ cache.Load((tmpdir.path() / "missing.json").string()); },
+               std::exception);
+}
+
+TEST(JsonCache, Eviction) {
+  TemporaryDirectory tmpdir;
+  std::string doc = R"({"key": [1, 2, 3, 4], "name": "a long string value"})";
+  std::vector<std::string> paths;
+  for (int i = 0; i < 3; ++i) {
+    paths.push_back((tmpdir.path() / (std::to_string(i) + ".json")).string());
+    WriteFile(paths.back(), doc);
+  }
+  auto bytes = GetMemoryUsage(Json::Load(ConstStringRef{doc})).Total();
+  JsonFileCache cache{bytes * 2};
+  auto first = cache.Load(paths[0]);
+  cache.Load(paths[1]);
+  // Touch the first one so that the second one is the least recently used.
+  cache.Load(paths[0]);
+  cache.Load(paths[2]);
+  auto stats = cache.GetStats();
+  ASSERT_EQ(stats.evictions, 1ul);
+  ASSERT_EQ(stats.n_entries, 2ul);
+  ASSERT_LE(stats.bytes, bytes * 2);
+
+  cache.Load(paths[0]);
+  ASSERT_EQ(cache.GetStats().misses, 3ul);
+  cache.Load(paths[1]);
+  ASSERT_EQ(cache.GetStats().misses, 4ul);
+
+  // Documents larger than the budget are returned but not kept.
+  JsonFileCache tiny{1};
+  auto large = tiny.Load(paths[0]);
+  ASSERT_EQ(*large, *first);
+  ASSERT_EQ(tiny.GetStats().n_entries, 0ul);
+}
+
+TEST(JsonCache, SingleFlight) {
+  TemporaryDirectory tmpdir;
+  auto path = (tmpdir.path() / "model.json").string();
+  WriteFile(path, GetModelStr());
+
+  JsonFileCache cache;
+  std::size_t n_threads = 8;
+  std::vector<JsonFileCache::Handle> results(n_threads);
+  std::vector<std::thread> workers;
+  for (std::size_t i = 0; i < n_threads; ++i) {
+    workers.emplace_back([&, i] { results[i] = cache.Load(path); });
+  }
+  for (auto& t : workers) {
+    t.join();
+  }
+  for (auto const& result : results) {
+    ASSERT_EQ(result.get(), results.front().get());
+  }
+  auto stats = cache.GetStats();
+  ASSERT_EQ(stats.misses, 1ul);
+  ASSERT_EQ(stats.hits, n_threads - 1);
+}
+}  // namespace nih
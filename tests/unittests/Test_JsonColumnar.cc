@@ -0,0 +1,101 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "nih/Json.h"
+#include "nih/JsonColumnar.h"
+
+namespace nih {
+namespace {
+void CheckRecords(JsonColumns const& table) {
+  ASSERT_EQ(table.n_rows, 4ul);
+  ASSERT_EQ(table.columns.size(), 5ul);
+  ASSERT_EQ(table.Find("missing"), nullptr);
+
+  auto id = table.Find("id");
+  ASSERT_NE(id, nullptr);
+  ASSERT_EQ(id->type, JsonColumn::Type::kInteger);
+  ASSERT_EQ(get<I64Array const>(id->values), (std::vector<int64_t>{1, 2, 3, 4}));
+  ASSERT_EQ(id->null_count, 0ul);
+
+  // Integers are promoted, the missing value is 0.
+  auto price = table.Find("price");
+  ASSERT_EQ(price->type, JsonColumn::Type::kNumber);
+  ASSERT_EQ(get<F32Array const>(price->values),
+            (std::vector<float>{1.5f, 2.0f, 0.0f, 4.25f}));
+  ASSERT_TRUE(price->IsValid(1));
+  ASSERT_FALSE(price->IsValid(2));
+  ASSERT_EQ(price->null_count, 1ul);
+
+  auto name = table.Find("name");
+  ASSERT_EQ(name->type, JsonColumn::Type::kString);
+  ASSERT_EQ(name->dictionary, (std::vector<std::string>{"b", "a"}));
+  ASSERT_EQ(get<U8Array const>(name->values), (std::vector<uint8_t>{0, 1, 0, 0}));
+  ASSERT_FALSE(name->IsValid(3));
+
+  auto flag = table.Find("flag");
+  ASSERT_EQ(flag->type, JsonColumn::Type::kBoolean);
+  ASSERT_EQ(get<U8Array const>(flag->values), (std::vector<uint8_t>{1, 0, 0, 0}));
+  ASSERT_EQ(flag->validity, (std::vector<uint8_t>{0b0011}));
+
+  // Only appears in the last row.
+  auto late = table.Find("late");
+  ASSERT_EQ(late->type, JsonColumn::Type::kInteger);
+  ASSERT_EQ(late->validity, (std::vector<uint8_t>{0b1000}));
+  ASSERT_EQ(get<I64Array const>(late->values), (std::vector<int64_t>{0, 0, 0, 7}));
+}
+}  // anonymous namespace
+
+TEST(JsonColumnar, Convert) {
+  std::string str = R"([
+    {"id": 1, "price": 1.5, "name": "b", "flag": true},
+    {"id": 2, "price": 2, "name": "a", "flag": false},
+    {"id": 3, "name": "b", "price": null},
+    {"id": 4, "price": 4.25, "name": null, "late": 7}
+  ])";
+  auto table = LoadColumns(ConstStringRef{str});
+  CheckRecords(table);
+  ASSERT_EQ(table.columns.front().name, "id");
+  auto from_json = ToColumns(Json::Load(ConstStringRef{str}));
+  CheckRecords(from_json);
+  // Keys of a Json object are sorted.
+  ASSERT_EQ(from_json.columns.front().name, "flag");
+
+  auto empty = LoadColumns(ConstStringRef{"[]"});
+  ASSERT_EQ(empty.n_rows, 0ul);
+  ASSERT_TRUE(empty.columns.empty());
+
+  // Large dictionaries use 32-bit codes, validity spans several bytes.
+  std::vector<Json> rows;
+  for (int i = 0; i < 300; ++i) {
+    Object row;
+    row["key"] = String{std::to_string(i % 290)};
+    rows.emplace_back(std::move(row));
+  }
+  auto large = ToColumns(Json{Array{std::move(rows)}});
+  auto key = large.Find("key");
+  ASSERT_EQ(key->dictionary.size(), 290ul);
+  ASSERT_EQ(get<I32Array const>(key->values)[295], 5);
+  ASSERT_EQ(key->validity.size(), 38ul);
+  ASSERT_TRUE(key->IsValid(299));
+}
+
+TEST(JsonColumnar, Invalid) {
+  for (auto bad : {R"({"a": 1})", R"([1])", R"([{"a": [1]}])", R"([{"a": {}}])",
+                   R"([{"a": 1}, {"a": "s"}])", R"([{"a": true}, {"a": 1}])",
+                   R"([{"a": 1, "a": 2}])", R"([{"a": 1})", "[[]]", ""}) {
+    ASSERT_THROW({ LoadColumns(ConstStringRef{bad}); }, std::exception) << bad;
+  }
+  for (auto bad :
+       {R"({"a": 1})", R"([1])", R"([{"a": [1]}])", R"([{"a": 1}, {"a": "s"}])"}) {
+    ASSERT_THROW({ ToColumns(Json::Load(ConstStringRef{bad})); }, std::exception) << bad;
+  }
+  // Repeated keys are resolved by Json::Load before ToColumns sees them.
+  auto table = ToColumns(Json::Load(ConstStringRef{R"([{"a": 1, "a": 2}])"}));
+  ASSERT_EQ(get<I64Array const>(table.Find("a")->values)[0], 2);
+}
+}  // namespace nih
@@ -0,0 +1,88 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "nih/Json.h"
+#include "nih/JsonMemory.h"
+
+namespace nih {
+std::string GetModelStr();
+
+TEST(JsonMemory, Usage) {
+  {
+    Json json{I64Array{100}};
+    auto usage = GetMemoryUsage(json);
+    ASSERT_EQ(usage.n_values, 1ul);
+    ASSERT_EQ(usage.arrays, 100 * sizeof(int64_t));
+    ASSERT_EQ(usage.nodes, sizeof(I64Array));
+    ASSERT_EQ(usage.n_allocs, 2ul);
+  }
+  {
+    std::vector<Json> vec;
+    vec.reserve(8);
+    vec.emplace_back(String{std::string(100, 'a')});
+    vec.emplace_back(String{"short"});
+    Json json{Array{std::move(vec)}};
+    auto usage = GetMemoryUsage(json);
+    ASSERT_EQ(usage.n_values, 3ul);
+    ASSERT_EQ(usage.arrays, 2 * sizeof(Json));
+    ASSERT_EQ(usage.slack % sizeof(Json), 0ul);
+    ASSERT_GE(usage.slack, 6 * sizeof(Json));
+    ASSERT_EQ(usage.strings, 101ul);
+    ASSERT_EQ(usage.nodes, sizeof(Array) + 2 * sizeof(String));
+  }
+  {
+    // Shared nodes are counted once.
+    Json leaf{F32Array{1000}};
+    Json json{Object{}};
+    json["a"] = leaf;
+    json["b"] = leaf;
+    auto usage = GetMemoryUsage(json);
+    ASSERT_EQ(usage.n_values, 2ul);
+    ASSERT_EQ(usage.arrays, 1000 * sizeof(float));
+    ASSERT_GT(usage.map_nodes, 0ul);
+    ASSERT_EQ(usage.Total(), usage.nodes + usage.strings + usage.arrays + usage.slack +
+                                 usage.map_nodes);
+  }
+}
+
+TEST(JsonMemory, Breakdown) {
+  auto json = Json::Load(ConstStringRef{GetModelStr()});
+  json["big/key"] = F32Array{1 << 16};
+  auto total = GetMemoryUsage(json);
+
+  auto entries = GetMemoryBreakdown(json, 1);
+  ASSERT_FALSE(entries.empty());
+  // The root comes first with the same total as GetMemoryUsage.
+  ASSERT_EQ(entries[0].path, "");
+  ASSERT_EQ(entries[0].usage.Total(), total.Total());
+  ASSERT_EQ(entries[0].usage.n_values, total.n_values);
+  ASSERT_EQ(entries[1].path, "/big~1key");
+  for (size_t i = 1; i < entries.size(); ++i) {
+    ASSERT_LE(entries[i].usage.Total(), entries[i - 1].usage.Total());
+    // Only direct children of the root.
+    ASSERT_EQ(entries[i].path.find('/', 1), std::string::npos);
+  }
+  // Children of the root add up to the root minus its own overhead.
+  size_t children = 0;
+  for (size_t i = 1; i < entries.size(); ++i) {
+    children += entries[i].usage.Total();
+  }
+  ASSERT_LT(children, total.Total());
+
+  auto deep = GetMemoryBreakdown(json, 8);
+  ASSERT_GT(deep.size(), entries.size());
+  bool found = false;
+  for (auto const& entry : deep) {
+    found |= entry.path == "/gbm/trees/0";
+  }
+  ASSERT_TRUE(found);
+
+  auto filtered = GetMemoryBreakdown(json, 8, sizeof(float) << 16);
+  ASSERT_EQ(filtered.size(), 2ul);
+}
+}  // namespace nih
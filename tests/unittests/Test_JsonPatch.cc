@@ -0,0 +1,137 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <numeric>  // std::iota
+#include <string>
+#include <vector>
+
+#include "nih/Json.h"
+#include "nih/JsonPatch.h"
+
+namespace nih {
+std::string GetModelStr();
+
+namespace {
+Json MakePatchTestDoc() {
+  auto str = GetModelStr();
+  auto json = Json::Load(ConstStringRef{str});
+  F32Array weights{1000};
+  std::iota(weights.GetArray().begin(), weights.GetArray().end(), 0.0f);
+  json["weights"] = std::move(weights);
+  I64Array ids{16};
+  std::iota(ids.GetArray().begin(), ids.GetArray().end(), 0);
+  json["ids"] = std::move(ids);
+  json["a/b~c"] = Integer{1};
+  return json;
+}
+
+// Apply the patch to a fresh copy of `from`, both directly and after a text round trip.
+void CheckPatch(std::string const& from_str, Json const& patch, Json const& to) {
+  for (auto mode : {std::ios::binary, std::ios::in}) {
+    auto from = Json::Load(ConstStringRef{from_str}, std::ios::binary);
+    std::string patch_str;
+    Json::Dump(patch, &patch_str, mode);
+    Patch(&from, Json::Load(ConstStringRef{patch_str}, mode));
+    ASSERT_EQ(from, to) << Diff(from, to);
+  }
+}
+}  // anonymous namespace
+
+TEST(JsonPatch, Diff) {
+  auto from = MakePatchTestDoc();
+  std::string from_str;
+  Json::Dump(from, &from_str, std::ios::binary);
+  auto to = Json::Load(ConstStringRef{from_str}, std::ios::binary);
+
+  auto patch = Diff(from, to);
+  ASSERT_EQ(get<Array const>(patch).size(), 0ul);
+  patch = Diff(from, from);
+  ASSERT_EQ(get<Array const>(patch).size(), 0ul);
+
+  auto& nodes = get<Array>(to["gbm"]["trees"][0]["nodes"]);
+  nodes[3]["leaf"] = Number{1.0f};
+  nodes.pop_back();
+  get<Object>(to["model_parameter"]).erase("num_class");
+  to["model_parameter"]["new"] = String{"value"};
+  to["a/b~c"] = Boolean{true};
+  to["gbm"]["tree_info"] = Object{};
+
+  auto& weights = get<F32Array>(to["weights"]);
+  weights[10] = -1.0f;
+  weights[12] = -1.0f;
+  weights[500] = std::nanf("");
+  weights.push_back(1001.0f);
+  get<I64Array>(to["ids"]).pop_back();
+
+  patch = Diff(from, to);
+  size_t n_splices = 0;
+  for (auto const& op : get<Array const>(patch)) {
+    auto const& name = get<String const>(op["op"]);
+    n_splices += name == "splice";
+  }
+  // [10, 13), [500, 501), [1000, 1001) and the last element of ids.
+  ASSERT_EQ(n_splices, 4ul);
+  CheckPatch(from_str, patch, to);
+
+  // A single splice over the whole typed array when most elements change, plus the one
+  // for ids.
+  std::iota(weights.begin(), weights.end(), 1.0f);
+  patch = Diff(from, to);
+  n_splices = 0;
+  for (auto const& op : get<Array const>(patch)) {
+    n_splices += get<String const>(op["op"]) == "splice";
+  }
+  ASSERT_EQ(n_splices, 2ul);
+  CheckPatch(from_str, patch, to);
+
+  // Root replacement.
+  patch = Diff(from, Json{Integer{3}});
+  ASSERT_EQ(get<Array const>(patch).size(), 1ul);
+  CheckPatch(from_str, patch, Json{Integer{3}});
+}
+
+TEST(JsonPatch, Apply) {
+  std::string doc_str = R"({"foo": ["bar", "baz"], "m~n": 8, "a/b": {"c": [1, 2]}})";
+  auto doc = Json::Load(ConstStringRef{doc_str});
+  std::string patch_str = R"([
+    {"op": "test", "path": "/m~0n", "value": 8},
+    {"op": "add", "path": "/foo/1", "value": "qux"},
+    {"op": "add", "path": "/foo/-", "value": "end"},
+    {"op": "remove", "path": "/foo/0"},
+    {"op": "replace", "path": "/a~1b/c/0", "value": 3},
+    {"op": "copy", "from": "/a~1b/c", "path": "/d"},
+    {"op": "move", "from": "/m~0n", "path": "/e"},
+    {"op": "splice", "path": "/d", "offset": 1, "length": 1, "value": [4, 5]}
+  ])";
+  Patch(&doc, Json::Load(ConstStringRef{patch_str}));
+  std::string expected_str =
+      R"({"foo": ["qux", "baz", "end"], "a/b": {"c": [3, 2]}, "d": [3, 4, 5], "e": 8})";
+  ASSERT_EQ(doc, Json::Load(ConstStringRef{expected_str}));
+
+  auto invalid = [&](std::string const& op) {
+    auto doc = Json::Load(ConstStringRef{doc_str});
+    auto patch = Json::Load(ConstStringRef{"[" + op + "]"});
+    ASSERT_ANY_THROW(Patch(&doc, patch));
+  };
+  invalid(R"({"op": "test", "path": "/m~0n", "value": 9})");
+  invalid(R"({"op": "remove", "path": "/bar"})");
+  invalid(R"({"op": "remove", "path": "/foo/2"})");
+  invalid(R"({"op": "add", "path": "/foo/01", "value": 1})");
+  invalid(R"({"op": "add", "path": "foo", "value": 1})");
+  invalid(R"({"op": "add", "path": "/m~2n", "value": 1})");
+  invalid(R"({"op": "replace", "path": "/foo/-", "value": 1})");
+  invalid(R"({"op": "move", "from": "/a~1b", "path": "/a~1b/d"})");
+  invalid(R"({"op": "splice", "path": "/foo", "offset": 1, "length": 2, "value": []})");
+  invalid(R"({"op": "unknown", "path": "/foo"})");
+  invalid(R"({"path": "/foo"})");
+}
+
+TEST(JsonPatch, EscapePointerToken) {
+  ASSERT_EQ(EscapePointerToken("foo"), "foo");
+  ASSERT_EQ(EscapePointerToken("a/b~c"), "a~1b~0c");
+  ASSERT_EQ(EscapePointerToken("~1"), "~01");
+}
+}  // namespace nih
@@ -0,0 +1,107 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "nih/Json.h"
+#include "nih/JsonPointer.h"
+
+namespace nih {
+std::string GetModelStr();
+
+TEST(JsonPointer, Parse) {
+  JsonPointer root{""};
+  ASSERT_TRUE(root.IsRoot());
+  ASSERT_EQ(root.ToString(), "");
+
+  JsonPointer ptr{"/a~1b/0/~0/01/"};
+  ASSERT_EQ(ptr.Size(), 5ul);
+  ASSERT_EQ(ptr.Tokens()[0], "a/b");
+  ASSERT_EQ(ptr.Tokens()[2], "~");
+  ASSERT_EQ(ptr.Tokens()[4], "");
+  ASSERT_EQ(ptr.Index(0), -1);
+  ASSERT_EQ(ptr.Index(1), 0);
+  // Leading zeros are not valid indices.
+  ASSERT_EQ(ptr.Index(3), -1);
+  ASSERT_EQ(ptr.ToString(), "/a~1b/0/~0/01/");
+
+  ASSERT_EQ(JsonPointer::FromTokens({"x/y", "3"}).ToString(), "/x~1y/3");
+  ASSERT_EQ(JsonPointer::FromTokens({"x/y", "3"}).Index(1), 3);
+
+  ASSERT_THROW({ JsonPointer{"a"}; }, std::exception);
+  ASSERT_THROW({ JsonPointer{"/a~2"}; }, std::exception);
+  ASSERT_THROW({ JsonPointer{"/a~"}; }, std::exception);
+}
+
+TEST(JsonPointer, Find) {
+  auto json = Json::Load(ConstStringRef{GetModelStr()});
+  auto p_leaf = JsonPointer{"/gbm/trees/0/nodes/3/leaf"}.Find(json);
+  ASSERT_NE(p_leaf, nullptr);
+  ASSERT_EQ(get<Number const>(*p_leaf), 0.375f);
+  ASSERT_EQ(JsonPointer{""}.Find(json), &json);
+  ASSERT_EQ(JsonPointer{"/gbm/trees/100"}.Find(json), nullptr);
+  ASSERT_EQ(JsonPointer{"/gbm/trees/x"}.Find(json), nullptr);
+  ASSERT_EQ(JsonPointer{"/objective/0"}.Find(json), nullptr);
+
+  auto p_obj = JsonPointer{"/objective"}.Find(&json);
+  *p_obj = String{"binary:logistic"};
+  ASSERT_EQ(get<String const>(json["objective"]), "binary:logistic");
+}
+
+TEST(JsonPointer, Projection) {
+  auto json = Json::Load(ConstStringRef{GetModelStr()});
+  json["a/b"] = I32Array{4};
+  get<I32Array>(json["a/b"])[2] = 7;
+  json["escaped\nkey"] = Array{std::vector<Json>{Json{Null{}}, Json{Boolean{true}}}};
+
+  std::vector<std::string> paths{"/gbm/trees/0/nodes/3/leaf",
+                                 "/gbm/trees/0/nodes/3",
+                                 "/objective",
+                                 "/model_parameter",
+                                 "/model_parameter/num_class",
+                                 "/a~1b/2",
+                                 "/a~1b/9",
+                                 "/escaped\nkey/1",
+                                 "/missing/0",
+                                 "/configuration/objective"};
+  JsonProjection proj{paths};
+  ASSERT_EQ(proj.Paths().size(), paths.size());
+
+  auto expected = proj.Extract(json);
+  auto const& obj = get<Object const>(expected);
+  ASSERT_EQ(obj.size(), paths.size() - 2);
+  ASSERT_EQ(get<Number const>(expected["/gbm/trees/0/nodes/3/leaf"]), 0.375f);
+  ASSERT_EQ(get<String const>(expected["/objective"]), "reg:linear");
+  ASSERT_EQ(get<String const>(expected["/model_parameter/num_class"]), "0");
+  ASSERT_EQ(get<Integer const>(expected["/a~1b/2"]), 7);
+  ASSERT_TRUE(get<Boolean const>(expected["/escaped\nkey/1"]));
+  ASSERT_EQ(obj.find("/missing/0"), obj.cend());
+  ASSERT_EQ(obj.find("/a~1b/9"), obj.cend());
+
+  std::string text;
+  Json::Dump(json, &text);
+  auto from_text = proj.Extract(ConstStringRef{text});
+  ASSERT_EQ(from_text, expected);
+
+  std::string binary;
+  Json::Dump(json, &binary, std::ios::binary);
+  auto from_ubj = proj.Extract(ConstStringRef{binary}, std::ios::binary);
+  ASSERT_EQ(from_ubj, expected);
+
+  // Whole document.
+  JsonProjection whole{std::vector<std::string>{""}};
+  // Typed arrays are not retained in text.
+  ASSERT_EQ(whole.Extract(ConstStringRef{text})[""], Json::Load(ConstStringRef{text}));
+  ASSERT_EQ(whole.Extract(ConstStringRef{binary}, std::ios::binary)[""], json);
+
+  // Errors are reported in the scanned part.
+  std::string truncated = text.substr(0, text.size() / 2);
+  ASSERT_THROW({ proj.Extract(ConstStringRef{truncated}); }, std::exception);
+  truncated = binary.substr(0, binary.size() / 2);
+  ASSERT_THROW({ proj.Extract(ConstStringRef{truncated}, std::ios::binary); },
+               std::exception);
+}
+}  // namespace nih
@@ -0,0 +1,173 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include <gtest/gtest.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif  // defined(__linux__)
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "nih/Json.h"
+#include "nih/JsonMemory.h"
+#include "nih/JsonTape.h"
+#include "nih/Tempfile.h"
+
+namespace nih {
+std::string GetModelStr();
+namespace {
+std::string ToStr(ConstStringRef str) { return std::string{str.data(), str.size()}; }
+}  // anonymous namespace
+
+TEST(JsonTape, Load) {
+  auto str = GetModelStr();
+  auto json = Json::Load(ConstStringRef{str});
+  auto tape = JsonTape::Load(ConstStringRef{str});
+  auto root = tape.Root();
+  ASSERT_TRUE(IsA<Object>(root));
+  ASSERT_EQ(root.ToJson(), json);
+  ASSERT_EQ(JsonTape::FromJson(json).Root().ToJson(), json);
+  ASSERT_EQ(JsonTape::FromJson(Json{0.5}).Root().GetNumber(), 0.5f);
+  ASSERT_THROW(JsonTape::FromJson(Json{1.0 / 3.0}), std::exception);
+
+  ASSERT_EQ(ToStr(get<String const>(root["objective"])), "reg:linear");
+  auto trees = root["gbm"]["trees"];
+  ASSERT_EQ(trees.Size(), 1ul);
+  auto nodes = get<Array const>(trees[0]["nodes"]);
+  ASSERT_EQ(nodes.size(), get<Array const>(json["gbm"]["trees"][0]["nodes"]).size());
+  ASSERT_EQ(get<Integer const>(nodes[0]["depth"]), 0);
+  ASSERT_EQ(get<Number const>(nodes[3]["leaf"]), 0.375f);
+  std::size_t n_leaves = 0;
+  for (auto node : nodes) {
+    auto obj = get<Object const>(node);
+    n_leaves += obj.find("leaf") != obj.end();
+  }
+  ASSERT_EQ(n_leaves, 5ul);
+
+  // Members are in the order of the input.
+  auto obj = get<Object const>(root["model_parameter"]);
+  std::vector<std::string> keys;
+  for (auto kv : obj) {
+    keys.emplace_back(ToStr(kv.first));
+    ASSERT_TRUE(IsA<String>(kv.second));
+  }
+  ASSERT_EQ(keys, (std::vector<std::string>{"base_score", "num_class", "num_feature"}));
+
+  // Much smaller than the Json tree.
+  ASSERT_LT(tape.MemoryUsage(), GetMemoryUsage(json).Total() / 2);
+
+  ASSERT_THROW({ get<Number const>(root["objective"]); }, std::exception);
+  ASSERT_THROW({ root["missing"]; }, std::exception);
+  ASSERT_THROW({ trees[1]; }, std::exception);
+}
+
+TEST(JsonTape, Scalars) {
+  std::string str = R"([0, -1, 36028797018963967, -36028797018963968,
+    9223372036854775807, -9223372036854775807, 1.5, -2e3, NaN, -Infinity,
+    true, false, null, "a\"\u00e9\ud83d\ude00", "", [], {}, [[{"": [1]}]]])";
+  auto tape = JsonTape::Load(ConstStringRef{str});
+  auto arr = get<Array const>(tape.Root());
+  ASSERT_EQ(arr.size(), 18ul);
+  ASSERT_EQ(get<Integer const>(arr[2]), (int64_t{1} << 55) - 1);
+  ASSERT_EQ(get<Integer const>(arr[3]), -(int64_t{1} << 55));
+  ASSERT_EQ(get<Integer const>(arr[4]), std::numeric_limits<int64_t>::max());
+  ASSERT_EQ(get<Integer const>(arr[5]), -std::numeric_limits<int64_t>::max());
+  ASSERT_EQ(get<Number const>(arr[7]), -2000.0f);
+  ASSERT_TRUE(std::isnan(get<Number const>(arr[8])));
+  ASSERT_TRUE(get<Boolean const>(arr[10]));
+  ASSERT_TRUE(IsA<Null>(arr[12]));
+  ASSERT_EQ(ToStr(get<String const>(arr[13])), "a\"\xc3\xa9\xf0\x9f\x98\x80");
+  ASSERT_EQ(get<Integer const>(arr[17][0][0][""][0]), 1);
+  ASSERT_EQ(tape.Root().ToJson(), Json::Load(ConstStringRef{str}));
+
+  for (auto bad : {"[1,", "{\"a\" 1}", "[1 2]", "{\"a\":1]", "\"\\x\"", "[tru]", "1e"}) {
+    ASSERT_THROW({ JsonTape::Load(ConstStringRef{bad}); }, std::exception) << bad;
+  }
+  // Deep nesting doesn't use the call stack.
+  std::string deep(100000, '[');
+  deep += std::string(100000, ']');
+  auto deep_tape = JsonTape::Load(ConstStringRef{deep});
+  ASSERT_EQ(deep_tape.Root().Size(), 1ul);
+}
+
+TEST(JsonTape, Image) {
+  auto str = GetModelStr();
+  auto json = Json::Load(ConstStringRef{str});
+  auto tape = JsonTape::Load(ConstStringRef{str});
+  ASSERT_FALSE(tape.IsMapped());
+
+  std::vector<char> image;
+  tape.Save(&image);
+  auto view = JsonTape::View(ConstStringRef{image.data(), image.size()});
+  ASSERT_TRUE(view.IsMapped());
+  ASSERT_EQ(view.MemoryUsage(), tape.MemoryUsage());
+  ASSERT_EQ(view.Root().ToJson(), json);
+  // Copies read from the same image.
+  auto copy = view;
+  ASSERT_EQ(ToStr(get<String const>(copy.Root()["objective"])), "reg:linear");
+  ASSERT_EQ(copy.Root()["gbm"].Index(), view.Root()["gbm"].Index());
+
+  TemporaryDirectory tmpdir;
+  auto path = (tmpdir.path() / "model.tape").string();
+  tape.Save(path);
+  auto mapped = JsonTape::Map(path);
+  ASSERT_TRUE(mapped.IsMapped());
+  ASSERT_EQ(mapped.Root().ToJson(), json);
+  ASSERT_EQ(get<Integer const>(mapped.Root()["gbm"]["trees"][0]["nodes"][0]["depth"]), 0);
+
+#if defined(__linux__)
+  // Anonymous shared memory that can be passed to child processes.
+  auto fd = memfd_create("nih-tape", 0);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(write(fd, image.data(), image.size()), static_cast<ssize_t>(image.size()));
+  auto shared = JsonTape::Map("/proc/self/fd/" + std::to_string(fd));
+  close(fd);
+  ASSERT_EQ(shared.Root().ToJson(), json);
+#endif  // defined(__linux__)
+
+  // Scalar documents.
+  for (auto doc : {"1", "\"str\"", "[]", "null"}) {
+    std::vector<char> scalar;
+    JsonTape::Load(ConstStringRef{doc}).Save(&scalar);
+    ASSERT_EQ(JsonTape::View(ConstStringRef{scalar.data(), scalar.size()}).Root().ToJson(),
+              Json::Load(ConstStringRef{doc}));
+  }
+}
+
+TEST(JsonTape, InvalidImage) {
+  std::string str = R"({"a": [1, 36028797018963968, "b", {"c": null}], "d": 1.5})";
+  std::vector<char> image;
+  JsonTape::Load(ConstStringRef{str}).Save(&image);
+  std::size_t header = image.size() - JsonTape::Load(ConstStringRef{str}).MemoryUsage();
+  ASSERT_NO_THROW({ JsonTape::View(ConstStringRef{image.data(), image.size()}); });
+
+  ASSERT_THROW({ JsonTape::View(ConstStringRef{image.data(), header - 1}); },
+               std::exception);
+  ASSERT_THROW({ JsonTape::View(ConstStringRef{image.data(), image.size() - 1}); },
+               std::exception);
+  auto bad_magic = image;
+  bad_magic[0] = 'X';
+  ASSERT_THROW(
+      { JsonTape::View(ConstStringRef{bad_magic.data(), bad_magic.size()}); },
+      std::exception);
+
+  // Corrupted words are either rejected or read without going out of bounds.
+  for (std::size_t i = header; i < image.size(); ++i) {
+    for (char c : {'\x00', '\x07', '\x7f', '\xff'}) {
+      auto corrupted = image;
+      corrupted[i] = c;
+      try {
+        auto tape = JsonTape::View(ConstStringRef{corrupted.data(), corrupted.size()});
+        tape.Root().ToJson();
+      } catch (std::exception const&) {
+      }
+    }
+  }
+}
+}  // namespace nih
@@ -0,0 +1,212 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include <gtest/gtest.h>
+
+#include <ios>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "nih/Json.h"
+#include "nih/JsonIO.h"
+#include "nih/JsonTape.h"
+
+namespace nih {
+std::string GetModelStr();
+namespace {
+Json LoadBinary(std::vector<char> const& buf) {
+  return Json::Load(ConstStringRef{buf.data(), buf.size()}, std::ios::binary);
+}
+}  // anonymous namespace
+
+TEST(JsonTranscode, TextToUBJ) {
+  auto str = GetModelStr();
+  auto json = Json::Load(ConstStringRef{str});
+
+  std::vector<char> ubj;
+  Transcode(ConstStringRef{str}, std::ios::in, &ubj, std::ios::binary, false);
+  ASSERT_EQ(LoadBinary(ubj), json);
+
+  // UBJ to UBJ without typed arrays keeps the document.
+  std::vector<char> copy;
+  Transcode(ConstStringRef{ubj.data(), ubj.size()}, std::ios::binary, &copy,
+            std::ios::binary, false);
+  ASSERT_EQ(copy, ubj);
+
+  // Back to text.
+  std::vector<char> text;
+  Transcode(ConstStringRef{ubj.data(), ubj.size()}, std::ios::binary, &text,
+            std::ios::out);
+  ASSERT_EQ(Json::Load(ConstStringRef{text.data(), text.size()}), json);
+}
+
+TEST(JsonTranscode, TypedArray) {
+  std::string str = R"({"u8": [0, 1, 255], "i32": [-1, 256, 2147483647],
+    "i64": [1, 2147483648], "f32": [1.5, -2e3, 0.0], "mixed": [1, 2.5, "a"],
+    "ints": [1, 2, 3.5], "empty": [], "nested": [[1, 2], [3.5], [1, [2]]]})";
+  std::vector<char> ubj;
+  Transcode(ConstStringRef{str}, std::ios::in, &ubj, std::ios::binary);
+  auto json = LoadBinary(ubj);
+
+  ASSERT_TRUE(IsA<U8Array>(json["u8"]));
+  ASSERT_EQ(get<U8Array const>(json["u8"])[2], 255);
+  ASSERT_TRUE(IsA<I32Array>(json["i32"]));
+  ASSERT_EQ(get<I32Array const>(json["i32"])[2], std::numeric_limits<int32_t>::max());
+  ASSERT_TRUE(IsA<I64Array>(json["i64"]));
+  ASSERT_EQ(get<I64Array const>(json["i64"])[1], int64_t{1} << 31);
+  ASSERT_TRUE(IsA<F32Array>(json["f32"]));
+  ASSERT_EQ(get<F32Array const>(json["f32"])[1], -2000.0f);
+
+  ASSERT_TRUE(IsA<Array>(json["mixed"]));
+  ASSERT_EQ(get<Number const>(json["mixed"][1]), 2.5f);
+  ASSERT_TRUE(IsA<Array>(json["ints"]));
+  ASSERT_EQ(get<Integer const>(json["ints"][1]), 2);
+  ASSERT_EQ(get<Number const>(json["ints"][2]), 3.5f);
+  ASSERT_TRUE(IsA<Array>(json["empty"]));
+  ASSERT_TRUE(get<Array const>(json["empty"]).empty());
+
+  auto const& nested = json["nested"];
+  ASSERT_TRUE(IsA<Array>(nested));
+  ASSERT_TRUE(IsA<U8Array>(nested[0]));
+  ASSERT_TRUE(IsA<F32Array>(nested[1]));
+  ASSERT_TRUE(IsA<Array>(nested[2]));
+  ASSERT_TRUE(IsA<U8Array>(nested[2][1]));
+
+  // Typed arrays are written as plain arrays in text.
+  std::vector<char> text;
+  Transcode(ConstStringRef{ubj.data(), ubj.size()}, std::ios::binary, &text,
+            std::ios::out);
+  ASSERT_EQ(Json::Load(ConstStringRef{text.data(), text.size()}),
+            Json::Load(ConstStringRef{str}));
+}
+
+TEST(JsonTranscode, LongTypedArray) {
+  // Longer than the buffer used for parsing runs of numbers.
+  std::string ints, floats;
+  for (int i = 0; i < 1000; ++i) {
+    ints += (i == 0 ? "" : ", ") + std::to_string(i * 1000);
+    floats += (i == 0 ? "" : ",\n") + std::to_string(i) + ".5";
+  }
+  std::string str = R"({"ints": [)" + ints + R"(], "floats": [)" + floats +
+                    R"(], "tail": [)" + ints + R"(, 1.5, NaN], "nan": [NaN, 1e3]})";
+  std::vector<char> ubj;
+  Transcode(ConstStringRef{str}, std::ios::in, &ubj, std::ios::binary);
+  auto json = LoadBinary(ubj);
+
+  ASSERT_TRUE(IsA<I32Array>(json["ints"]));
+  ASSERT_EQ(get<I32Array const>(json["ints"]).size(), 1000);
+  ASSERT_EQ(get<I32Array const>(json["ints"])[999], 999000);
+  ASSERT_TRUE(IsA<F32Array>(json["floats"]));
+  ASSERT_EQ(get<F32Array const>(json["floats"]).size(), 1000);
+  ASSERT_EQ(get<F32Array const>(json["floats"])[999], 999.5f);
+  ASSERT_TRUE(IsA<Array>(json["tail"]));
+  ASSERT_EQ(get<Integer const>(json["tail"][999]), 999000);
+  ASSERT_EQ(get<Number const>(json["tail"][1000]), 1.5f);
+  ASSERT_TRUE(IsA<F32Array>(json["nan"]));
+
+  std::vector<char> text;
+  Transcode(ConstStringRef{ubj.data(), ubj.size()}, std::ios::binary, &text,
+            std::ios::out);
+  ASSERT_EQ(Json::Load(ConstStringRef{text.data(), text.size()}),
+            Json::Load(ConstStringRef{str}));
+}
+
+TEST(JsonTranscode, Errors) {
+  std::vector<char> out;
+  for (auto bad : {"[1,", "{\"a\" 1}", "[1 2]", "\"\\x\""}) {
+    out.clear();
+    ASSERT_THROW(
+        { Transcode(ConstStringRef{bad}, std::ios::in, &out, std::ios::binary); },
+        std::exception)
+        << bad;
+  }
+
+  std::vector<char> ubj;
+  Transcode(ConstStringRef{R"({"a": [1, "b", [2.5]]})"}, std::ios::in, &ubj,
+            std::ios::binary);
+  for (std::size_t n = 1; n < ubj.size(); ++n) {
+    out.clear();
+    ASSERT_THROW(
+        {
+          Transcode(ConstStringRef{ubj.data(), n}, std::ios::binary, &out, std::ios::out);
+        },
+        std::exception)
+        << n;
+  }
+  for (auto bad : {"D", "H", "x", "[$D#L"}) {
+    out.clear();
+    ASSERT_THROW(
+        { Transcode(ConstStringRef{bad}, std::ios::binary, &out, std::ios::out); },
+        std::exception)
+        << bad;
+  }
+}
+
+TEST(JsonTranscode, DuplicateKeys) {
+  std::vector<char> out;
+  for (auto bad : {R"({"k": 1, "k": 2})", R"([{"a": {"k": 1, "b": 0, "k": 2}}])"}) {
+    out.clear();
+    ASSERT_THROW(
+        { Transcode(ConstStringRef{bad}, std::ios::in, &out, std::ios::binary); },
+        std::exception)
+        << bad;
+  }
+  // UBJSON input, {"k": 1, "k": 2}.
+  std::string ubj{'{', 'L', 0, 0, 0, 0, 0, 0, 0, 1, 'k', 'i', 1,
+                  'L', 0, 0, 0, 0, 0, 0, 0, 1, 'k', 'i', 2, '}'};
+  out.clear();
+  ASSERT_THROW(
+      { Transcode(ConstStringRef{ubj}, std::ios::binary, &out, std::ios::out); },
+      std::exception);
+
+  // Same keys in different objects.
+  std::string text = R"({"k": {"k": 1}, "a": [{"k": 2}, {"k": 3}], "b": {"k": {}}})";
+  out.clear();
+  Transcode(ConstStringRef{text}, std::ios::in, &out, std::ios::binary);
+  ASSERT_EQ(LoadBinary(out), Json::Load(ConstStringRef{text}));
+}
+
+TEST(JsonTranscode, Grammar) {
+  // The text parsers must agree on what's valid.
+  auto accepted = [](ConstStringRef str) {
+    bool loaded = true;
+    try {
+      Json::Load(str);
+    } catch (std::exception const&) {
+      loaded = false;
+    }
+    std::vector<char> out;
+    bool transcoded = true;
+    try {
+      Transcode(str, std::ios::in, &out, std::ios::binary);
+    } catch (std::exception const&) {
+      transcoded = false;
+    }
+    bool taped = true;
+    try {
+      JsonTape::Load(str);
+    } catch (std::exception const&) {
+      taped = false;
+    }
+    EXPECT_EQ(loaded, transcoded) << str.data();
+    EXPECT_EQ(loaded, taped) << str.data();
+    return loaded;
+  };
+  for (auto valid : {"[-1, 2]", "-Infinity", "[NaN, Infinity]", "[1e+5, 1E-5]", "-0.5",
+                     "[-0]", "[ ]", "{ }", R"({"a": [true, false, null]})"}) {
+    ASSERT_TRUE(accepted(ConstStringRef{valid})) << valid;
+    ASSERT_TRUE(Json::Validate(ConstStringRef{valid})) << valid;
+  }
+  // Leading zeros are accepted by the parsers, only the validator is strict about them.
+  for (auto lenient : {"[01]", "[-01.5]"}) {
+    ASSERT_TRUE(accepted(ConstStringRef{lenient})) << lenient;
+    ASSERT_FALSE(Json::Validate(ConstStringRef{lenient})) << lenient;
+  }
+  for (auto invalid : {"[+1, 2]", "+1", "+Infinity", "[1e]", "[.5]", "[1.]", "[-]",
+                       "[1,]", "[1, ]", R"({"a" 1})", R"({"a": 1,})", "tru"}) {
+    ASSERT_FALSE(accepted(ConstStringRef{invalid})) << invalid;
+    ASSERT_FALSE(Json::Validate(ConstStringRef{invalid})) << invalid;
+  }
+}
+}  // namespace nih
@@ -0,0 +1,97 @@
+/*!
+ * Copyright (c) by Contributors 2023
+ */
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <string_view>
+
+#include "nih/Json.h"
+#include "nih/StaticJson.h"
+
+namespace nih {
+namespace {
+constexpr char kDoc[] = R"({
+  "name": "tree\u00e9\n",
+  "depth": 6,
+  "eta": 0.3,
+  "tiny": -1.5e-40,
+  "flags": [true, false, null],
+  "nested": {"empty": {}, "list": [], "neg": -7, "big": 9223372036854775807},
+  "inf": -Infinity,
+  "pos": 2.5E3
+})";
+
+static constexpr auto kStatic = NIH_STATIC_JSON(kDoc);
+
+// Everything below is evaluated by the compiler.
+static_assert(kStatic.Root().Type() == Value::ValueKind::kObject);
+static_assert(kStatic.Root().Size() == 8);
+static_assert(kStatic.Root()["name"].GetString() == "tree\xc3\xa9\n");
+static_assert(kStatic.Root()["depth"].GetInteger() == 6);
+static_assert(kStatic.Root()["eta"].GetNumber() == 0.3f);
+static_assert(kStatic.Root()["flags"].Size() == 3);
+static_assert(kStatic.Root()["flags"][0].GetBoolean());
+static_assert(kStatic.Root()["flags"][2].IsNull());
+static_assert(kStatic.Root()["nested"]["list"].Size() == 0);
+static_assert(kStatic.Root()["nested"]["neg"].GetInteger() == -7);
+static_assert(kStatic.Root()["pos"].GetNumber() == 2500.0f);
+static_assert(kStatic.Root()["inf"].GetNumber() ==
+              -std::numeric_limits<float>::infinity());
+static_assert(kStatic.Root().Contains("tiny") && !kStatic.Root().Contains("missing"));
+static_assert(NIH_STATIC_JSON("").Root().IsNull());
+static_assert(NIH_STATIC_JSON(" [1, [2, [3]]] ").Root()[1][1][0].GetInteger() == 3);
+
+constexpr auto kSize = detail::MeasureStaticJson(kDoc);
+// One node per value and per key.
+static_assert(kSize.n_nodes == 28);
+}  // anonymous namespace
+
+TEST(StaticJson, Parse) {
+  auto json = Json::Load(ConstStringRef{kDoc});
+  ASSERT_EQ(kStatic.ToJson(), json);
+  ASSERT_EQ(kStatic.Root()["tiny"].GetNumber(), get<Number const>(json["tiny"]));
+
+  // Floats are rounded the same way as the runtime reader.
+  for (auto str : {"1.17549435e-38", "3.40282347e+38", "1e-45", "0.1", "-0.0", "1e39",
+                   "123456.789", "7.038531e-26"}) {
+    ASSERT_EQ(detail::MeasureStaticJson(str).n_nodes, 1ul);
+    StaticNode node;
+    char chars[1];
+    detail::StaticParser{str, &node, 1, chars, 0}.Parse();
+    auto json = Json::Load(ConstStringRef{str});
+    auto expected = get<Number const>(json);
+    ASSERT_EQ(std::signbit(node.number), std::signbit(expected)) << str;
+    ASSERT_EQ(node.number, expected) << str;
+  }
+  StaticNode node;
+  char chars[1];
+  detail::StaticParser{"NaN", &node, 1, chars, 0}.Parse();
+  ASSERT_TRUE(std::isnan(node.number));
+}
+
+TEST(StaticJson, Errors) {
+  for (auto bad : {"[1,", "{\"a\" 1}", "[1 2]", "\"\\x\"", "{\"a\": 1}}", "tru", "+1",
+                   "1.0000000001", "\"\xff\"", "{1: 2}"}) {
+    ASSERT_THROW({ detail::MeasureStaticJson(bad); }, std::exception) << bad;
+  }
+  std::string deep(65, '[');
+  ASSERT_THROW({ detail::MeasureStaticJson(deep); }, std::exception);
+
+  // The buffers are too small.
+  StaticNode nodes[2];
+  char chars[2];
+  ASSERT_THROW({ detail::StaticParser("[1, 2]", nodes, 2, chars, 2).Parse(); },
+               std::exception);
+  ASSERT_THROW({ detail::StaticParser("\"abc\"", nodes, 2, chars, 2).Parse(); },
+               std::exception);
+
+  auto root = kStatic.Root();
+  ASSERT_THROW({ root["missing"]; }, std::exception);
+  ASSERT_THROW({ root["flags"][3]; }, std::exception);
+  ASSERT_THROW({ root["depth"].GetNumber(); }, std::exception);
+  ASSERT_THROW({ root["flags"].Size(); root["depth"].Size(); }, std::exception);
+}
+}  // namespace nih